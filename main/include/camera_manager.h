@@ -21,15 +21,90 @@ typedef struct {
     uint16_t sensor_id;
 } camera_manager_status_t;
 
+// Sensor standby accounting; current is estimated from time in each state
+typedef struct {
+    uint32_t standbys;
+    uint32_t wakes;
+    uint32_t wake_failures;
+    uint32_t last_wake_latency_us;      // Wake to first complete frame
+    uint32_t max_wake_latency_us;
+    uint64_t total_wake_latency_us;
+    int64_t active_us;
+    int64_t standby_us;
+    float average_current_ma;
+} camera_power_stats_t;
+
+typedef enum {
+    CAMERA_FRAME_OK = 0,
+    CAMERA_FRAME_TOO_DARK,
+    CAMERA_FRAME_OVEREXPOSED,
+    CAMERA_FRAME_BLURRY,
+    CAMERA_FRAME_CORRUPT,
+    CAMERA_FRAME_VERDICT_COUNT
+} camera_frame_verdict_t;
+
+typedef struct {
+    uint32_t frames_assessed;
+    uint32_t rejected[CAMERA_FRAME_VERDICT_COUNT];  // Indexed by verdict
+    uint32_t kept_below_gate;       // Frames returned anyway once the retries ran out
+    camera_frame_verdict_t last_verdict;            // Of the frame last returned by camera_capture_frame()
+    float last_mean_luma;
+    float last_sharpness;
+    uint32_t last_assess_us;
+} camera_quality_stats_t;
+
+// Re-encoded reduced-scale copy of a captured frame; jpeg is heap allocated
+typedef struct {
+    uint8_t *jpeg;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+} camera_thumbnail_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t decode_us;
+    uint64_t encode_us;
+    uint32_t max_us;
+} camera_thumbnail_bench_t;
+
+// Sensor window in pixels of the full 1600x1200 OV2640 array. The sensor crops to it
+// and scales it by the configured frame size's ratio, so a window covering a fifth
+// of the field of view yields a frame a fifth the size of a full one.
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} camera_roi_t;
+
 esp_err_t camera_get_status(camera_manager_status_t *status);
 // Function declarations
 esp_err_t camera_init_with_config(const camera_config_params_t *params);
 esp_err_t camera_init_default(void);
+esp_err_t camera_capture_frame(camera_fb_t **fb);
+esp_err_t camera_frame_to_base64(const camera_fb_t *fb, char **base64_output, size_t *output_len);
+esp_err_t camera_frame_to_base64_sha256(const camera_fb_t *fb, char **base64_output, size_t *output_len,
+                                        uint8_t *sha256);
 esp_err_t camera_capture_to_base64(char **base64_output, size_t *output_len);
 esp_err_t camera_capture_raw(camera_fb_t **fb);
 void camera_return_frame_buffer(camera_fb_t *fb);
 esp_err_t camera_set_flash(bool enable);
 bool camera_is_initialized(void);
 esp_err_t camera_deinit(void);
+esp_err_t camera_power_off(bool hold_in_sleep);
+esp_err_t camera_power_on(uint32_t warmup_ms);
+esp_err_t camera_standby(void);
+void camera_get_power_stats(camera_power_stats_t *stats);
+const char *camera_frame_verdict_name(camera_frame_verdict_t verdict);
+void camera_get_quality_stats(camera_quality_stats_t *stats);
+esp_err_t camera_make_thumbnail(const camera_fb_t *fb, uint16_t min_width, uint8_t quality,
+                                camera_thumbnail_t *thumbnail);
+void camera_free_thumbnail(camera_thumbnail_t *thumbnail);
+void camera_log_thumbnail_bench(void);
+esp_err_t camera_set_roi(const camera_roi_t *roi);
+bool camera_get_roi(camera_roi_t *roi, uint16_t *out_width, uint16_t *out_height);
+esp_err_t camera_parse_roi(const char *text, camera_roi_t *roi);
+void camera_get_view(camera_roi_t *view);
 
 #endif // CAMERA_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef CAPTURE_SCHEDULER_H
+#define CAPTURE_SCHEDULER_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct {
+    uint32_t min_interval_ms;
+    uint32_t max_interval_ms;
+    uint32_t initial_interval_ms;
+    float activity_threshold;       // Fraction of changed thumbnail pixels that counts as activity
+    uint8_t pixel_delta;            // Luminance change that marks a pixel as changed
+    uint32_t bytes_per_hour;        // Upload budget, 0 for unlimited
+    bool align_to_wall_clock;       // Fire on multiples of the interval once the clock is synced
+} capture_scheduler_config_t;
+
+typedef struct {
+    uint32_t cycles;
+    uint32_t active_cycles;
+    uint32_t budget_limited_cycles;
+    uint32_t overruns;              // Cycles whose processing outlasted the interval
+    uint32_t skipped_slots;         // Aligned slots dropped because of overruns
+    uint32_t aligned_cycles;        // Cycles that woke on a wall-clock boundary
+    uint32_t idle_periods;          // Times the device idled outside the capture schedule
+    uint32_t interval_ms;
+    float last_activity;
+    int32_t last_jitter_us;         // Wake time minus deadline for the latest cycle
+    int32_t max_jitter_us;
+    int64_t total_jitter_us;        // Sum of absolute jitter, divide by timed_cycles for the mean
+    uint32_t timed_cycles;
+} capture_scheduler_stats_t;
+
+// Function declarations
+esp_err_t capture_scheduler_init(const capture_scheduler_config_t *config);
+void capture_scheduler_observe_frame(const camera_fb_t *fb);
+void capture_scheduler_record_bytes(size_t bytes);
+void capture_scheduler_wait_next(void);
+time_t capture_scheduler_slot_time(void);
+void capture_scheduler_set_device_id(const char *device_id);
+void capture_scheduler_frame_key(char *key, size_t max_len);
+esp_err_t capture_scheduler_set_window(const char *expression);
+void capture_scheduler_wait_window(void);
+uint32_t capture_scheduler_get_interval_ms(void);
+void capture_scheduler_get_stats(capture_scheduler_stats_t *stats);
+
+#endif // CAPTURE_SCHEDULER_H
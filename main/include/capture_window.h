@@ -0,0 +1,31 @@
+#ifndef CAPTURE_WINDOW_H
+#define CAPTURE_WINDOW_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Cron-style capture schedule: "minute hour day-of-month month day-of-week".
+// Each field takes '*', a value, a range "a-b", a step "*/n" or "a-b/n", or a
+// comma list of those. A minute that matches every field is an active minute;
+// runs of active minutes form the capture windows. Examples:
+//   "* 8-17 * * 1-5"        business hours, Monday to Friday
+//   "* 0-5,19-23 * * *"     dusk to dawn
+typedef struct {
+    uint64_t minutes;       // Bits 0-59
+    uint32_t hours;         // Bits 0-23
+    uint32_t days;          // Bits 1-31
+    uint16_t months;        // Bits 1-12
+    uint8_t weekdays;       // Bits 0-6, Sunday is 0
+    bool any_day;           // Day-of-month field was '*'
+    bool any_weekday;       // Day-of-week field was '*'
+} capture_window_t;
+
+// Function declarations
+esp_err_t capture_window_parse(const char *expression, capture_window_t *window);
+bool capture_window_is_always(const capture_window_t *window);
+bool capture_window_contains(const capture_window_t *window, time_t when);
+esp_err_t capture_window_next_start(const capture_window_t *window, time_t from, time_t *start);
+
+#endif // CAPTURE_WINDOW_H
@@ -2,12 +2,97 @@
 #define CONFIG_H
 
 // Application configuration
-#define NUMBER_OF_SECONDS 30
+#define NUMBER_OF_SECONDS 30        // Initial capture interval
+
+// Adaptive capture scheduling
+#define CAPTURE_MIN_INTERVAL_MS 5000
+#define CAPTURE_MAX_INTERVAL_MS (10 * 60 * 1000)
+#define CAPTURE_ACTIVITY_THRESHOLD 0.02f    // Fraction of changed thumbnail pixels
+#define CAPTURE_ACTIVITY_PIXEL_DELTA 24     // Luminance change that marks a pixel as changed
+#define CAPTURE_BYTES_PER_HOUR (8 * 1024 * 1024)  // Upload budget, 0 for unlimited
+#define ACTIVITY_THUMBNAIL_MIN_WIDTH 40
+#define CAPTURE_ALIGN_TO_WALL_CLOCK true  // Fire on wall-clock multiples of the interval after SNTP sync
+#define SNTP_SERVER "pool.ntp.org"
+#define SNTP_SYNC_TIMEOUT_MS 10000
+
+// Capture schedule (cron-style, see capture_window.h); empty means always active.
+// The NVS runtime namespace overrides the default.
+#define CAPTURE_SCHEDULE_DEFAULT ""
+#define CAPTURE_SCHEDULE_MAX_LEN 96
+#define CAPTURE_WINDOW_WARMUP_S 5           // Camera power-up ahead of a window for AE/AWB to settle
+#define POWER_DEEP_SLEEP_MIN_S 600          // Shorter idle periods use modem sleep
+#define POWER_DEEP_SLEEP_BOOT_S 15          // Wake this early from deep sleep to boot and reconnect
+#define POWER_SLEEP_FLUSH_TIMEOUT_MS 10000  // Upload flush allowed before deep sleep
 
 // Camera configuration
 #define CAMERA_FRAME_SIZE FRAMESIZE_QVGA
 #define CAMERA_JPEG_QUALITY 12
 #define CAMERA_FB_COUNT 1
+#define CAMERA_ROI_DEFAULT ""               // "x,y,width,height" on the 1600x1200 array; empty reads out the full frame
+#define CAMERA_ROI_MAX_LEN 24
+#define JPEG_SANITIZE_ENABLED 1             // Drop APPn/COM segments and post-EOI padding before upload
+#define JPEG_OPTIMIZE_ENABLED 1             // Lossless re-coding with per-frame Huffman tables
+#define JPEG_OPTIMIZE_POOL_SIZE (128 * 1024)    // Output buffer; larger frames go out unoptimized
+#define JPEG_OPTIMIZE_MAX_MS 400            // Never spend longer than this per frame
+#define JPEG_OPTIMIZE_CPU_PERCENT 5         // Share of the capture interval the optimizer may use
+#define STAGE_ENABLED 1                     // Run base64, hashing and MCU scans on internal-RAM copies of PSRAM frames
+#define STAGE_SCRATCH_SIZE (16 * 1024)      // Internal RAM; tile scans stage frames up to this size
+#define STAGE_BENCHMARK_AT_BOOT 0           // Log direct vs staged kernel timings on the first frame
+#define STAGE_BENCH_ITERATIONS 10
+#define CAMERA_STANDBY_BETWEEN_CAPTURES 1   // Power the sensor down while waiting for the next capture
+#define CAMERA_WAKE_TIMEOUT_MS 2000
+#define CAMERA_ACTIVE_CURRENT_MA 100        // Nominal draw while streaming, for the current estimate
+#define CAMERA_STANDBY_CURRENT_MA 2         // Nominal draw in power-down
+
+// Frame quality gate, evaluated on a downscaled grayscale decode
+#define QUALITY_GATE_ENABLED 1
+#define QUALITY_THUMBNAIL_MIN_WIDTH 80
+#define QUALITY_DARK_LEVEL 16               // Luminance at or below counts as crushed black
+#define QUALITY_BRIGHT_LEVEL 240            // Luminance at or above counts as blown out
+#define QUALITY_MIN_MEAN_LUMA 25
+#define QUALITY_MAX_MEAN_LUMA 230
+#define QUALITY_MAX_CLIPPED_FRACTION 0.6f
+#define QUALITY_MIN_SHARPNESS 15.0f         // Laplacian variance; lower means out of focus or smeared
+
+// Privacy masking: MCUs under these polygons are blanked in the DCT domain before a frame leaves the device
+#define PRIVACY_MASK_ENABLED 1
+#define PRIVACY_MASK_DEFAULT ""             // "x,y x,y x,y; ..." on the 1600x1200 sensor array; empty masks nothing
+#define PRIVACY_MASK_MAX_LEN 256
+#define PRIVACY_MASK_FILL_LUMA 128          // Gray level of masked areas
+#define PRIVACY_MASK_POOL_SIZE (128 * 1024) // Output buffer; larger frames are dropped, never sent unmasked
+
+// Person-detection gate: an int8 TFLite classifier in the "model" partition scores each
+// frame and uploads only those at or above the threshold. Flash the model with
+//   parttool.py write_partition --partition-name model --input person_detect.tflite
+// tools/tinyml_bench.c measures latency and arena use of a model on the host.
+#define PERSON_DETECT_ENABLED 0
+#define PERSON_DETECT_PARTITION_LABEL "model"
+#define PERSON_DETECT_THRESHOLD 0.6f        // Person probability needed to upload
+#define PERSON_DETECT_CLASS_INDEX 1         // Output of the person class; 0 is "no person"
+#define PERSON_DETECT_ARENA_SIZE (100 * 1024)   // Activations and requantization tables; MobileNet-0.25 at 96x96 plans ~75 KB
+#define PERSON_DETECT_MAX_MS 1500           // Never spend longer than this per frame
+#define PERSON_DETECT_CPU_PERCENT 20        // Share of the capture interval the gate may use; over it frames pass unscored
+
+// Task topology: network and upload work runs on core 0 next to the WiFi/lwIP tasks,
+// capture, image analysis and encoding on core 1. One row per task:
+//   X(id, name, stack bytes, priority, core)
+// The camera driver and esp-mqtt tasks are placed by CONFIG_CAMERA_CORE1 and
+// CONFIG_MQTT_TASK_CORE_SELECTION in menuconfig.
+#define TASK_PLAN_TABLE(X) \
+    X(PIPELINE,    "pipeline", 8192, 5, 1)  /* Capture, gates, masking, re-coding, base64 */ \
+    X(NETWORK,     "network",  8192, 5, 0)  /* Uploads, resumable drain, original fetches */ \
+    X(FANOUT_SINK, "sink",     6144, 4, 0)  /* One per fan-out sink */
+#define TASK_LOAD_LOG_EVERY 10      // Cycles between per-core load reports (needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+
+// Firmware updates into the inactive app slot; tools/ota_delta.py makes patches and the
+// manifest. Rolling back an image that never confirms needs CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE.
+#define OTA_ENABLED 1
+#define OTA_MANIFEST_PATH "firmware"        // RTDB node holding the manifest
+#define OTA_MANIFEST_SIZE 1024
+#define OTA_CHECK_EVERY 60                  // Capture cycles between manifest checks
+#define OTA_DOWNLOAD_CHUNK 1460
+#define OTA_HEALTH_CYCLES 3                 // Completed capture cycles that confirm a new image
+#define OTA_HEALTH_TIMEOUT_MS (15 * 60 * 1000)  // Unconfirmed for this long rolls back
 
 // WiFi configuration
 #define WIFI_MAXIMUM_RETRY 10
@@ -15,6 +100,87 @@
 // HTTP configuration
 #define HTTP_RESPONSE_BUFFER_SIZE 1024
 #define HTTP_TIMEOUT_MS 10000
+#define FIREBASE_AUTH_BACKOFF_MIN_S 60      // First pause after a 401/403, doubled each time the retried upload is rejected
+#define FIREBASE_AUTH_BACKOFF_MAX_S 3600
+
+// Upload modes
+#define UPLOAD_MODE_RTDB_JSON 0     // Single PUT of base64 JSON to Realtime Database
+#define UPLOAD_MODE_RESUMABLE 1     // Chunked resumable upload of raw JPEG to Firebase Storage
+#define UPLOAD_MODE_FANOUT 2        // One capture dispatched to every enabled sink
+#define UPLOAD_MODE_THUMBNAIL 3     // Thumbnail to Realtime Database, original spooled for on-demand fetch
+#define UPLOAD_MODE_TILES 4         // Changed MCU regions as JPEG tiles between periodic keyframes
+#define UPLOAD_MODE UPLOAD_MODE_RTDB_JSON
+
+// Thumbnail mode; raise CAMERA_FRAME_SIZE so the spooled original is worth fetching
+#define THUMBNAIL_MIN_WIDTH 160             // Coarsest 1/2..1/8 decode scale that keeps this many columns
+#define THUMBNAIL_JPEG_QUALITY 60           // fmt2jpg quality, 1-100
+#define THUMBNAIL_BENCH_LOG_EVERY 20
+#define ORIGINAL_FETCH_PATH "fetch_requests"    // RTDB: fetch_requests/<device>/<key> = true
+#define ORIGINAL_FETCH_MAX_PER_CYCLE 2
+#define ORIGINAL_FETCH_RESPONSE_SIZE 1024
+
+// Changed-tile mode; tools/reconstruct_tiles.py rebuilds frames from the uploads
+#define TILE_POOL_SIZE (96 * 1024)          // Tiles of one frame; an overflow sends a keyframe instead
+#define TILE_KEYFRAME_INTERVAL 30           // Frames between full keyframes
+#define TILE_MAX_PER_FRAME 4                // Nearby regions are merged down to this many tiles
+#define TILE_MAX_AREA_PERCENT 50            // Larger changed areas send a keyframe
+#define TILE_MARGIN_MCUS 1                  // Grow changed areas so edges of moving objects are included
+#define TILE_DC_THRESHOLD 6                 // Mean luma change of an MCU that counts as changed
+#define TILE_AC_THRESHOLD 40                // Minimum AC amplitude change that counts as changed
+
+// Fan-out sinks (used when UPLOAD_MODE is UPLOAD_MODE_FANOUT)
+#define FANOUT_SINK_FIREBASE 1
+#define FANOUT_SINK_MQTT 1
+#define FANOUT_SINK_SD 1
+#define FANOUT_QUEUE_DEPTH 2        // Per sink; a full queue drops its oldest frame
+
+// Uploader backends (used when UPLOAD_MODE is UPLOAD_MODE_RTDB_JSON)
+#define UPLOADER_BACKEND_FIREBASE 0
+#define UPLOADER_BACKEND_MQTT 1
+#define UPLOADER_BACKEND UPLOADER_BACKEND_FIREBASE
+#define CONTENT_HASH_ENABLED 1              // SHA-256 of the uploaded JPEG in each frame's metadata
+#define CONTENT_HASH_KEY_CHARS 16           // Hex digits of it appended to the timestamp key, 0 for plain timestamps
+
+// MQTT configuration
+#define MQTT_BROKER_URI "mqtt://192.168.1.10:1883"
+#define MQTT_TOPIC_PREFIX "cameras"
+#define MQTT_KEEPALIVE_S 60
+#define MQTT_BUFFER_SIZE 4096
+#define MQTT_CONNECT_TIMEOUT_MS 10000
+
+// Resumable upload configuration
+#define FIREBASE_STORAGE_HOST "https://firebasestorage.googleapis.com"
+#define FIREBASE_STORAGE_BUCKET_SUFFIX ".appspot.com"
+#define RESUMABLE_CHUNK_SIZE (32 * 1024)    // Rounded up to the server's chunk granularity
+#define RESUMABLE_MAX_ATTEMPTS 5            // Per frame and cycle, each attempt resumes at the committed offset
+#define RESUMABLE_URL_MAX_LEN 512
+#if UPLOAD_MODE == UPLOAD_MODE_THUMBNAIL
+#define RESUMABLE_RECORD_PREFIX "originals"     // images/<key> already holds the thumbnail
+#else
+#define RESUMABLE_RECORD_PREFIX "images"
+#endif
+
+// Spool storage (SPIFFS partition from partitions.csv)
+#ifndef SPOOL_BASE_PATH
+#define SPOOL_BASE_PATH "/spiffs"           // Host tools build with a directory of their own
+#endif
+#define SPOOL_PARTITION_LABEL "spiffs"
+#define SPOOL_MAX_FILES 16
+#define SPOOL_KEY_MAX_LEN 48
+
+// microSD archive
+#define SD_MOUNT_POINT "/sdcard"
+#define SD_ARCHIVE_DIR SD_MOUNT_POINT "/ARCHIVE"
+#ifndef SD_ARCHIVE_SEGMENT_SIZE
+#define SD_ARCHIVE_SEGMENT_SIZE (64 * 1024 * 1024)  // Preallocated per segment file; host tools use less
+#endif
+#define SD_ARCHIVE_SECTOR_SIZE 512
+#define SD_ARCHIVE_BUFFER_SIZE (16 * 1024)          // Multiple of the sector size
+#define SD_ARCHIVE_INDEX_ENTRIES 4096
+#ifndef SD_ARCHIVE_MAX_SEGMENTS
+#define SD_ARCHIVE_MAX_SEGMENTS 64                  // Oldest segments are deleted beyond this
+#endif
+#define SD_ARCHIVE_SYNC_EVERY 4                     // Frames between index/fsync checkpoints
 
 // NVS storage keys for credentials - MUST match Python script keys
 #define NVS_NAMESPACE "credentials"
@@ -24,6 +190,14 @@
 #define NVS_FIREBASE_DB_URL_KEY "fb_db_url"
 #define NVS_FIREBASE_API_KEY_KEY "fb_api_key"
 
+// NVS runtime settings - MUST match Python script keys
+#define RUNTIME_NVS_NAMESPACE "runtime"
+#define RUNTIME_CAPTURE_SCHEDULE_KEY "cap_sched"
+#define RUNTIME_CAMERA_ROI_KEY "cam_roi"
+#define RUNTIME_PRIVACY_MASK_KEY "priv_mask"
+#define RUNTIME_DEVICE_ID_KEY "device_id"          // Fleet name; the MAC-based ID is used without it
+#define RUNTIME_BOOT_COUNT_KEY "boot_count"        // Names frames captured before the clock is synced
+
 // Maximum credential lengths
 #define MAX_SSID_LEN 32
 #define MAX_PASSWORD_LEN 64
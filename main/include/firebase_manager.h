@@ -3,6 +3,8 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // Firebase configuration structure
 typedef struct {
@@ -15,6 +17,11 @@ typedef struct {
 esp_err_t firebase_init(const firebase_config_t *config);
 esp_err_t firebase_upload_image(const char* base64_image, const char* timestamp);
 esp_err_t firebase_upload_image_with_metadata(const char* base64_image, const char* timestamp, const char* metadata);
+esp_err_t firebase_put_json(const char *path, const char *json);
+esp_err_t firebase_get_json(const char *path, const char *query, char *buf, size_t max_len);
+esp_err_t firebase_delete(const char *path);
+// True while image uploads are held back after the database rejected the credentials
+bool firebase_upload_blocked(uint32_t *retry_in_s);
 bool firebase_is_configured(void);
 
 #endif // FIREBASE_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef FRAME_FANOUT_H
+#define FRAME_FANOUT_H
+
+#include "esp_err.h"
+#include "uploader.h"
+#include <stdint.h>
+
+#define FANOUT_MAX_SINKS 4
+
+// Per-sink counters on top of the backend's own uploader_stats_t
+typedef struct {
+    const char *name;
+    uint32_t frames_queued;
+    uint32_t frames_dropped;    // Evicted because the sink's queue was full
+    uint32_t frames_failed;
+    uint32_t queue_depth;       // Frames currently waiting
+} fanout_sink_stats_t;
+
+// Function declarations
+esp_err_t fanout_init(void);
+esp_err_t fanout_add_sink(const uploader_backend_t *backend, const void *config, size_t queue_depth);
+esp_err_t fanout_dispatch(const uint8_t *jpeg, size_t jpeg_len, const char *timestamp, const char *metadata);
+esp_err_t fanout_flush(uint32_t timeout_ms);
+int fanout_get_sink_count(void);
+esp_err_t fanout_get_sink_stats(int index, fanout_sink_stats_t *stats);
+void fanout_log_stats(void);
+
+#endif // FRAME_FANOUT_H
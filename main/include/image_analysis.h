@@ -0,0 +1,37 @@
+#ifndef IMAGE_ANALYSIS_H
+#define IMAGE_ANALYSIS_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// 8-bit grayscale image, row-major without padding
+typedef struct {
+    uint8_t *pixels;
+    uint16_t width;
+    uint16_t height;
+} gray_image_t;
+
+#define IMAGE_HISTOGRAM_BINS 32
+
+// Exposure and focus metrics for a grayscale image
+typedef struct {
+    uint32_t histogram[IMAGE_HISTOGRAM_BINS];   // Luminance in bins of 256 / IMAGE_HISTOGRAM_BINS levels
+    float mean_luma;
+    float dark_fraction;        // Pixels at or below dark_level
+    float bright_fraction;      // Pixels at or above bright_level
+    float sharpness;            // Variance of the 4-neighbour Laplacian
+} image_quality_t;
+
+// Function declarations
+esp_err_t image_analysis_rgb565_from_jpeg(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                          uint16_t min_width, uint8_t **rgb565, uint16_t *out_width,
+                                          uint16_t *out_height);
+esp_err_t image_analysis_gray_from_jpeg(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                        uint16_t min_width, gray_image_t *out);
+void image_analysis_free(gray_image_t *image);
+float image_analysis_change_ratio(const gray_image_t *previous, const gray_image_t *current, uint8_t pixel_threshold);
+esp_err_t image_analysis_quality(const gray_image_t *image, uint8_t dark_level, uint8_t bright_level,
+                                 image_quality_t *quality);
+
+#endif // IMAGE_ANALYSIS_H
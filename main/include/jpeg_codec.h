@@ -0,0 +1,146 @@
+#ifndef JPEG_CODEC_H
+#define JPEG_CODEC_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Entropy layer of baseline sequential JPEG: header parsing, Huffman decoding of
+// the scan into quantized coefficient blocks and re-encoding them. Pixels are
+// never reconstructed, so anything built on it is lossless by construction.
+
+#define JPEG_MAX_COMPONENTS 4
+#define JPEG_MAX_BLOCKS_IN_MCU 10
+#define JPEG_MAX_HEADER_SEGMENTS 16
+
+typedef struct {
+    uint8_t bits[17];           // bits[l] = number of codes of length l
+    uint8_t huffval[256];
+    bool defined;
+    // Decoding (Annex F.2.2.3 with an 8-bit lookahead)
+    int32_t maxcode[18];
+    int32_t valoffset[17];
+    uint8_t look_len[256];
+    uint8_t look_sym[256];
+    // Encoding
+    uint16_t ehufco[256];
+    uint8_t ehufsi[256];
+} jpeg_huff_table_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t tq;
+    uint8_t dc_tbl;
+    uint8_t ac_tbl;
+} jpeg_component_t;
+
+typedef struct {
+    size_t offset;              // Of the 0xFF marker byte
+    size_t len;                 // Including the marker
+    uint8_t marker;
+} jpeg_segment_t;
+
+// Quantized coefficients in zigzag order; [0] is the absolute DC value
+typedef int16_t jpeg_block_t[64];
+
+typedef struct {
+    jpeg_huff_table_t dc[4];
+    jpeg_huff_table_t ac[4];
+    uint16_t quant[4][64];              // Zigzag order
+    jpeg_component_t comps[JPEG_MAX_COMPONENTS];
+    int ncomps;
+    int scan_comp[JPEG_MAX_COMPONENTS];
+    int scan_ncomps;
+    uint16_t width;
+    uint16_t height;
+    uint8_t hmax;
+    uint8_t vmax;
+    uint16_t restart_interval;
+    // MCU layout of the scan
+    uint32_t mcus_x;
+    uint32_t mcus_y;
+    uint8_t mcu_width;                  // Pixels
+    uint8_t mcu_height;
+    int blocks_in_mcu;
+    uint8_t block_comp[JPEG_MAX_BLOCKS_IN_MCU];     // Component index of each block in an MCU
+    // Header segments kept on re-encoding; DHT, APPn (except APP14) and COM are dropped
+    jpeg_segment_t segments[JPEG_MAX_HEADER_SEGMENTS];
+    int segment_count;
+    jpeg_segment_t sos;
+    size_t scan_start;
+} jpeg_frame_t;
+
+typedef struct {
+    uint32_t dc[4][257];
+    uint32_t ac[4][257];
+} jpeg_symbol_counts_t;
+
+typedef struct {
+    jpeg_huff_table_t dc[4];
+    jpeg_huff_table_t ac[4];
+    bool dc_used[4];
+    bool ac_used[4];
+} jpeg_table_set_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    uint32_t acc;               // Left-aligned bit buffer
+    int bits;
+    bool marker;                // Hit a marker; feeding zeros
+    int zero_bytes;             // Zero bytes fed past a marker, bounds corrupt input
+    int16_t dc_pred[JPEG_MAX_COMPONENTS];
+    uint32_t mcu;               // Index of the next MCU; a copy of the reader resumes from here
+    uint32_t bits_fed;          // Bits loaded into acc so far
+    // Bit state at the start of the last MCU read, for copying it without re-encoding
+    size_t mcu_pos;
+    uint32_t mcu_acc;
+    int mcu_bits;
+    bool mcu_marker;
+    uint32_t mcu_bits_fed;
+    int16_t mcu_dc_pred[JPEG_MAX_COMPONENTS];
+} jpeg_reader_t;
+
+typedef struct {
+    uint8_t *out;
+    size_t size;
+    size_t pos;
+    uint32_t acc;
+    int bits;
+    bool overflow;
+    jpeg_symbol_counts_t *counts;       // Count symbols instead of writing them
+    const jpeg_table_set_t *tables;
+    int16_t dc_pred[JPEG_MAX_COMPONENTS];
+    uint16_t restart_interval;
+    uint32_t mcu;
+} jpeg_writer_t;
+
+// Function declarations
+esp_err_t jpeg_frame_parse(const uint8_t *jpeg, size_t len, jpeg_frame_t *frame);
+
+void jpeg_reader_init(jpeg_reader_t *reader, const jpeg_frame_t *frame, const uint8_t *jpeg, size_t len);
+esp_err_t jpeg_reader_mcu(jpeg_reader_t *reader, const jpeg_frame_t *frame, jpeg_block_t *blocks);
+esp_err_t jpeg_reader_finish(jpeg_reader_t *reader, size_t *end);
+
+void jpeg_writer_init(jpeg_writer_t *writer, uint8_t *out, size_t size);
+void jpeg_writer_init_counter(jpeg_writer_t *writer, jpeg_symbol_counts_t *counts);
+void jpeg_writer_bytes(jpeg_writer_t *writer, const uint8_t *data, size_t len);
+void jpeg_writer_headers(jpeg_writer_t *writer, const uint8_t *jpeg, const jpeg_frame_t *frame,
+                         uint16_t width, uint16_t height, bool keep_restart);
+void jpeg_writer_dht(jpeg_writer_t *writer, const jpeg_table_set_t *tables);
+void jpeg_writer_begin_scan(jpeg_writer_t *writer, const uint8_t *jpeg, const jpeg_frame_t *frame,
+                            const jpeg_table_set_t *tables, uint16_t restart_interval);
+esp_err_t jpeg_writer_mcu(jpeg_writer_t *writer, const jpeg_frame_t *frame, const jpeg_block_t *blocks);
+esp_err_t jpeg_writer_copy_mcu(jpeg_writer_t *writer, const jpeg_frame_t *frame, const jpeg_reader_t *reader,
+                               const jpeg_block_t *blocks);
+void jpeg_writer_end_scan(jpeg_writer_t *writer);
+
+esp_err_t jpeg_tables_optimize(jpeg_table_set_t *tables, const jpeg_frame_t *frame,
+                               const jpeg_symbol_counts_t *counts);
+void jpeg_tables_from_frame(jpeg_table_set_t *tables, const jpeg_frame_t *frame);
+
+#endif // JPEG_CODEC_H
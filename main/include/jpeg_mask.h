@@ -0,0 +1,56 @@
+#ifndef JPEG_MASK_H
+#define JPEG_MASK_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Privacy masking in the DCT domain: every MCU touching a configured polygon is
+// replaced by flat blocks while the scan is re-entropy-coded. Everything outside
+// the masked MCUs keeps its coefficients, so no decode or re-encode loss applies.
+
+#define JPEG_MASK_MAX_POLYGONS 4
+#define JPEG_MASK_MAX_VERTICES 8
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+} jpeg_mask_point_t;
+
+typedef struct {
+    int count;
+    jpeg_mask_point_t points[JPEG_MASK_MAX_VERTICES];
+} jpeg_mask_polygon_t;
+
+// Rectangle of polygon coordinate space the frame shows, e.g. the sensor window
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} jpeg_mask_view_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t failures;              // Frames that could not be masked and must not leave the device
+    uint32_t two_pass;              // Fill needed symbols missing from the frame's tables
+    uint32_t masked_mcus;           // In the last frame
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} jpeg_mask_stats_t;
+
+// Function declarations
+esp_err_t jpeg_mask_init(size_t pool_size);
+esp_err_t jpeg_mask_parse(const char *text, jpeg_mask_polygon_t *polygons, int max_polygons, int *count);
+esp_err_t jpeg_mask_set_polygons(const jpeg_mask_polygon_t *polygons, int count, uint8_t fill_luma);
+bool jpeg_mask_active(void);
+esp_err_t jpeg_mask_apply(const uint8_t *jpeg, size_t len, const jpeg_mask_view_t *view,
+                          const uint8_t **out, size_t *out_len);
+esp_err_t jpeg_mask_apply_into(const uint8_t *jpeg, size_t len, const jpeg_mask_view_t *view,
+                               uint8_t *out, size_t out_size, size_t *out_len);
+void jpeg_mask_get_stats(jpeg_mask_stats_t *stats);
+
+#endif // JPEG_MASK_H
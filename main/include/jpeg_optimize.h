@@ -0,0 +1,28 @@
+#ifndef JPEG_OPTIMIZE_H
+#define JPEG_OPTIMIZE_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Lossless re-entropy-coding of baseline JPEGs with Huffman tables built from
+// the frame's own symbol statistics. Only the Huffman layer is touched, so the
+// decoded pixels are bit-identical to the input.
+
+typedef struct {
+    uint32_t frames_optimized;
+    uint32_t frames_skipped_budget;     // Predicted cost exceeded the cycle's budget
+    uint32_t frames_unsupported;        // Progressive, arithmetic, malformed or no gain
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint32_t last_us;
+    uint32_t ns_per_byte;               // Running cost estimate used for budgeting
+} jpeg_optimize_stats_t;
+
+// Function declarations
+esp_err_t jpeg_optimize_init(size_t pool_size);
+esp_err_t jpeg_optimize(const uint8_t *jpeg, size_t len, uint32_t budget_us, const uint8_t **out, size_t *out_len);
+esp_err_t jpeg_optimize_into(const uint8_t *jpeg, size_t len, uint8_t *out, size_t out_size, size_t *out_len);
+void jpeg_optimize_get_stats(jpeg_optimize_stats_t *stats);
+
+#endif // JPEG_OPTIMIZE_H
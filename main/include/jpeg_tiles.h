@@ -0,0 +1,51 @@
+#ifndef JPEG_TILES_H
+#define JPEG_TILES_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Changed-region uploads: MCUs whose luma DC or AC energy moved away from what
+// the receiver last got are grouped into rectangles and cut losslessly out of
+// the sensor JPEG as standalone tiles. Unchanged MCUs are never re-sent until
+// the next keyframe.
+
+#define JPEG_TILES_MAX 8
+
+typedef struct {
+    uint16_t x;                 // Position in the full frame, MCU aligned
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    const uint8_t *jpeg;        // In the tile pool, valid until the next call
+    size_t len;
+} jpeg_tile_t;
+
+typedef struct {
+    bool keyframe;              // Send the whole frame; no tiles were cut
+    int count;                  // Tiles to send; 0 with keyframe false means nothing changed
+    jpeg_tile_t tiles[JPEG_TILES_MAX];
+    uint16_t frame_width;
+    uint16_t frame_height;
+    float changed_fraction;     // Changed MCUs over all MCUs
+} jpeg_tile_set_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t keyframes;
+    uint32_t tiled_frames;
+    uint32_t unchanged_frames;
+    uint32_t fallbacks;         // Tiling failed and a keyframe went out instead
+    uint32_t tiles;
+    uint64_t bytes_in;          // Sensor JPEG bytes of tiled frames
+    uint64_t bytes_out;         // Tile bytes sent for them
+} jpeg_tiles_stats_t;
+
+// Function declarations
+esp_err_t jpeg_tiles_init(size_t pool_size);
+esp_err_t jpeg_tiles_process(const uint8_t *jpeg, size_t len, jpeg_tile_set_t *set);
+void jpeg_tiles_invalidate(void);
+void jpeg_tiles_get_stats(jpeg_tiles_stats_t *stats);
+
+#endif // JPEG_TILES_H
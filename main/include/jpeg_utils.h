@@ -0,0 +1,41 @@
+#ifndef JPEG_UTILS_H
+#define JPEG_UTILS_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JPEG_MAX_RANGES 16
+
+// A sanitized JPEG is a list of spans into the original buffer; nothing is copied.
+// Concatenating the spans gives SOI..EOI without APPn/COM segments or padding.
+typedef struct {
+    size_t offset;
+    size_t len;
+} jpeg_range_t;
+
+typedef struct {
+    jpeg_range_t ranges[JPEG_MAX_RANGES];
+    size_t count;
+    size_t total_len;           // Sum of the range lengths
+    size_t original_len;
+} jpeg_ranges_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t malformed;         // Frames passed through unchanged
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} jpeg_sanitize_stats_t;
+
+// Function declarations
+esp_err_t jpeg_sanitize(const uint8_t *jpeg, size_t len, jpeg_ranges_t *ranges);
+void jpeg_ranges_whole(size_t len, jpeg_ranges_t *ranges);
+void jpeg_ranges_copy(const uint8_t *jpeg, const jpeg_ranges_t *ranges, uint8_t *out);
+size_t jpeg_ranges_base64_len(const jpeg_ranges_t *ranges);
+esp_err_t jpeg_ranges_base64(const uint8_t *jpeg, const jpeg_ranges_t *ranges, char *out, size_t out_size,
+                             size_t *out_len);
+void jpeg_sanitize_get_stats(jpeg_sanitize_stats_t *stats);
+
+#endif // JPEG_UTILS_H
@@ -0,0 +1,14 @@
+#ifndef ORIGINAL_FETCH_H
+#define ORIGINAL_FETCH_H
+
+#include "esp_err.h"
+
+// On-demand upload of spooled full-resolution frames. A client requests one by
+// writing true to ORIGINAL_FETCH_PATH/<device>/<key> in the Realtime Database;
+// the device uploads it with the resumable uploader and deletes the request.
+
+// Function declarations
+esp_err_t original_fetch_init(const char *device_id);
+int original_fetch_poll(void);
+
+#endif // ORIGINAL_FETCH_H
@@ -0,0 +1,73 @@
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming applier for patches from tools/ota_delta.py. The patch body is fed as it
+// downloads; old image bytes are read through a callback and the new image leaves
+// through another, so the applier works against flash partitions or plain files.
+
+#define OTA_DELTA_HEADER_SIZE 80
+#define OTA_DELTA_WINDOW 4096           // LZSS window, fixed by the patch format
+#define OTA_DELTA_OUT_SIZE 4096         // New image bytes per write, one flash sector
+#define OTA_DELTA_OLD_CHUNK 512
+
+#define OTA_DELTA_COMPRESSION_NONE 0
+#define OTA_DELTA_COMPRESSION_LZSS 1
+
+typedef esp_err_t (*ota_delta_read_t)(void *ctx, size_t offset, uint8_t *buf, size_t len);
+typedef esp_err_t (*ota_delta_write_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint8_t compression;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint8_t old_sha256[32];             // Of the first old_size bytes of the running image
+    uint8_t new_sha256[32];
+} ota_delta_header_t;
+
+typedef enum {
+    OTA_DELTA_RECORD,
+    OTA_DELTA_DIFF,
+    OTA_DELTA_EXTRA,
+} ota_delta_state_t;
+
+typedef struct {
+    ota_delta_header_t header;
+    ota_delta_read_t read_old;
+    ota_delta_write_t write_new;
+    void *ctx;
+    esp_err_t error;                    // First failure; later feeds return it
+    // LZSS decoder
+    uint8_t window[OTA_DELTA_WINDOW];
+    uint32_t decoded;                   // Bytes decompressed so far
+    uint32_t emitted;                   // Of those, bytes handed to the record parser
+    uint8_t flags;
+    int flag_bits;
+    uint8_t token[3];
+    int token_len;
+    // Record parser
+    ota_delta_state_t state;
+    uint8_t record[12];
+    int record_len;
+    uint32_t diff_left;
+    uint32_t extra_left;
+    int32_t seek;
+    uint32_t old_pos;
+    uint32_t produced;                  // New image bytes, including those still in out
+    uint8_t old_chunk[OTA_DELTA_OLD_CHUNK];
+    uint8_t out[OTA_DELTA_OUT_SIZE];
+    size_t out_len;
+} ota_delta_t;
+
+// Function declarations
+esp_err_t ota_delta_parse_header(const uint8_t *data, size_t len, ota_delta_header_t *header);
+void ota_delta_begin(ota_delta_t *delta, const ota_delta_header_t *header, ota_delta_read_t read_old,
+                     ota_delta_write_t write_new, void *ctx);
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, size_t len);
+esp_err_t ota_delta_finish(ota_delta_t *delta);
+
+#endif // OTA_DELTA_H
@@ -0,0 +1,31 @@
+#ifndef OTA_MANAGER_H
+#define OTA_MANAGER_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Firmware updates into the inactive app slot. The manifest at OTA_MANIFEST_PATH in the
+// Realtime Database names the current version, its SHA-256 and download URLs; a delta
+// patch for the running version is preferred over the full image. A new image stays on
+// probation until it completed OTA_HEALTH_CYCLES capture cycles and is rolled back otherwise.
+// Cycles count whether or not their frame was uploaded: static scenes, gates and paused
+// uploads are normal operation.
+
+typedef struct {
+    uint32_t checks;
+    uint32_t updates;               // Images verified and switched to
+    uint32_t failures;
+    uint32_t last_download_bytes;
+    uint32_t last_image_bytes;
+    bool pending_verify;            // Running a new image that has not proven itself yet
+} ota_stats_t;
+
+// Function declarations
+esp_err_t ota_manager_init(void);
+esp_err_t ota_manager_check(void);
+void ota_manager_report_cycle(bool healthy);
+void ota_manager_prepare_sleep(void);
+void ota_manager_get_stats(ota_stats_t *stats);
+
+#endif // OTA_MANAGER_H
@@ -0,0 +1,33 @@
+#ifndef PERSON_DETECT_H
+#define PERSON_DETECT_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Person-detection gate: an int8 classifier (TFLite flatbuffer in its own flash
+// partition, run by tinyml.c) scores a grayscale downscale of each frame.
+
+typedef struct {
+    uint32_t runs;
+    uint32_t skipped_budget;        // Predicted cost exceeded the cycle's budget
+    uint32_t failures;              // Decode or inference errors
+    uint32_t passed;                // Score at or above the threshold
+    uint32_t rejected;
+    uint32_t last_us;               // Decode, resize and inference of the last run
+    uint32_t avg_us;                // Running estimate used for budgeting
+    uint32_t max_us;
+    size_t arena_bytes;             // Activations plus requantization tables
+    uint32_t macs;
+    float last_score;
+} person_detect_stats_t;
+
+// Function declarations
+esp_err_t person_detect_init(const char *partition_label, size_t arena_size, float threshold);
+bool person_detect_ready(void);
+esp_err_t person_detect_evaluate(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                 uint32_t budget_us, float *score, bool *person);
+void person_detect_get_stats(person_detect_stats_t *stats);
+
+#endif // PERSON_DETECT_H
@@ -23,4 +23,9 @@
 // Flash LED pin
 #define FLASH_GPIO_NUM    4
 
+// microSD slot, used in 1-bit SDMMC mode (D1-D3 share GPIO4/12/13)
+#define SD_CLK_GPIO_NUM   14
+#define SD_CMD_GPIO_NUM   15
+#define SD_D0_GPIO_NUM     2
+
 #endif // PIN_CONFIG_H
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Pushes out whatever the upload path still holds in RAM (uploader_backend_t.flush)
+typedef esp_err_t (*power_flush_fn_t)(uint32_t timeout_ms);
+
+// Function declarations
+void power_manager_set_flush(power_flush_fn_t flush);
+esp_err_t power_manager_idle_until(time_t wake_at);
+bool power_manager_woke_from_deep_sleep(void);
+
+#endif // POWER_MANAGER_H
@@ -0,0 +1,36 @@
+#ifndef PSRAM_STAGE_H
+#define PSRAM_STAGE_H
+
+#include "esp_err.h"
+#include "jpeg_utils.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Staging of PSRAM buffers through an internal-DRAM scratch area. Byte-wise kernels
+// reading PSRAM and writing PSRAM evict each other's lines from the shared 32 KB
+// cache; copying cache-sized blocks in bulk and running the kernel on DRAM keeps
+// PSRAM traffic to sequential line fills and writebacks. Buffers already in internal
+// RAM, or callers finding the scratch area busy, run the kernel directly.
+
+typedef void (*psram_stage_fn_t)(const uint8_t *block, size_t len, void *ctx);
+
+typedef struct {
+    uint32_t staged_calls;
+    uint32_t direct_calls;          // Source in internal RAM, no scratch or scratch busy
+    uint32_t busy;                  // Scratch held by another task
+    uint64_t staged_bytes;
+} psram_stage_stats_t;
+
+// Function declarations
+esp_err_t psram_stage_init(size_t scratch_size);
+esp_err_t psram_stage_base64(const uint8_t *jpeg, const jpeg_ranges_t *ranges, char *out, size_t out_size,
+                             size_t *out_len, uint8_t *sha256);
+void psram_stage_stream(const uint8_t *src, size_t len, psram_stage_fn_t fn, void *ctx);
+void psram_stage_sha256(const uint8_t *src, size_t len, uint8_t sha256[32]);
+const uint8_t *psram_stage_acquire(const uint8_t *src, size_t len);
+void psram_stage_release(const uint8_t *staged);
+esp_err_t psram_stage_benchmark(const uint8_t *jpeg, size_t len, int iterations);
+void psram_stage_get_stats(psram_stage_stats_t *stats);
+
+#endif // PSRAM_STAGE_H
@@ -0,0 +1,27 @@
+#ifndef RESUMABLE_UPLOAD_H
+#define RESUMABLE_UPLOAD_H
+
+#include "esp_err.h"
+#include "firebase_manager.h"
+#include <stdint.h>
+
+// Upload statistics; goodput is bytes_committed / bytes_sent
+typedef struct {
+    uint32_t sessions_started;
+    uint32_t sessions_resumed;
+    uint32_t chunks_failed;
+    uint32_t frames_completed;
+    uint32_t frames_quarantined; // Frames the server or spool rejected for good
+    uint64_t bytes_sent;        // Body bytes handed to the transport, including lost ones
+    uint64_t bytes_committed;   // Body bytes acknowledged by the server
+} resumable_upload_stats_t;
+
+// Function declarations
+esp_err_t resumable_upload_init(const firebase_config_t *config);
+// ESP_ERR_INVALID_RESPONSE, ESP_ERR_INVALID_SIZE and ESP_ERR_NOT_FOUND mean the frame
+// can never be uploaded; other errors are worth retrying on a later cycle
+esp_err_t resumable_upload_spooled(const char *key);
+int resumable_upload_drain(void);
+void resumable_upload_get_stats(resumable_upload_stats_t *stats);
+
+#endif // RESUMABLE_UPLOAD_H
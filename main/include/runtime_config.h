@@ -0,0 +1,18 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Runtime settings live in their own NVS namespace so they can be changed
+// without touching the credentials partition layout
+
+// Function declarations
+esp_err_t runtime_config_init(void);
+esp_err_t runtime_config_get_str(const char *key, char *value, size_t max_len);
+esp_err_t runtime_config_set_str(const char *key, const char *value);
+esp_err_t runtime_config_get_u32(const char *key, uint32_t *value);
+esp_err_t runtime_config_set_u32(const char *key, uint32_t value);
+
+#endif // RUNTIME_CONFIG_H
@@ -0,0 +1,59 @@
+#ifndef SD_ARCHIVE_H
+#define SD_ARCHIVE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Segment file layout (all fields little-endian):
+//   sector 0            sd_archive_header_t
+//   sector 1 .. index   packed records: sd_archive_record_t + JPEG payload
+//   index .. end        sd_archive_index_entry_t[index_capacity]
+// Segments are preallocated to their full size when opened.
+
+#define SD_ARCHIVE_MAGIC        0x47455343  // "CSEG"
+#define SD_ARCHIVE_RECORD_MAGIC 0x314D5246  // "FRM1"
+#define SD_ARCHIVE_VERSION      1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segment_size;
+    uint32_t sector_size;
+    uint32_t index_offset;
+    uint32_t index_capacity;
+    uint32_t frame_count;       // Valid entries in the index as of the last sync
+    uint32_t data_end;          // End of the last synced record
+} sd_archive_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t length;            // Payload bytes following this header
+    uint32_t timestamp;         // Unix time of capture
+    uint32_t sequence;
+} sd_archive_record_t;
+
+typedef struct {
+    uint32_t offset;            // File offset of the record header
+    uint32_t length;
+    uint32_t timestamp;
+    uint32_t sequence;
+} sd_archive_index_entry_t;
+
+typedef struct {
+    uint32_t frames_written;
+    uint32_t segments_opened;
+    uint32_t write_errors;
+    uint32_t open_errors;       // Segments that could not be created; retried on the next append
+    uint64_t bytes_written;     // Bytes issued to the file, including framing and index
+    uint64_t write_time_us;     // Time spent in write/fsync, for sustained throughput
+} sd_archive_stats_t;
+
+// Function declarations
+esp_err_t sd_archive_open(const char *dir_path);
+esp_err_t sd_archive_append(const uint8_t *data, size_t len, uint32_t timestamp);
+esp_err_t sd_archive_sync(void);
+esp_err_t sd_archive_close(void);
+void sd_archive_get_stats(sd_archive_stats_t *stats);
+
+#endif // SD_ARCHIVE_H
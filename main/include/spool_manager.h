@@ -0,0 +1,27 @@
+#ifndef SPOOL_MANAGER_H
+#define SPOOL_MANAGER_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Frames are spooled as <key>.jpg with an optional <key>.ses state sidecar.
+// Keys are capture timestamps, or boot count and uptime before the clock is
+// synced, so lexical order is capture order. Frames that can never be uploaded
+// are kept as <key>.bad until the space is needed.
+
+// Function declarations
+esp_err_t spool_init(void);
+bool spool_is_ready(void);
+esp_err_t spool_store_frame(const char *key, const uint8_t *data, size_t len);
+esp_err_t spool_get_frame_size(const char *key, size_t *len);
+esp_err_t spool_read_frame(const char *key, size_t offset, uint8_t *buf, size_t len, size_t *read_len);
+esp_err_t spool_save_state(const char *key, const void *state, size_t len);
+esp_err_t spool_load_state(const char *key, void *state, size_t len);
+esp_err_t spool_oldest_frame(char *key, size_t max_len);
+esp_err_t spool_remove_frame(const char *key);
+esp_err_t spool_quarantine_frame(const char *key);
+size_t spool_pending_count(void);
+
+#endif // SPOOL_MANAGER_H
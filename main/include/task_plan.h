@@ -0,0 +1,44 @@
+#ifndef TASK_PLAN_H
+#define TASK_PLAN_H
+
+#include "esp_err.h"
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdint.h>
+
+// Task topology from TASK_PLAN_TABLE in config.h: every long-lived task is created
+// from its row, and network work from other tasks is run on the core-0 network task.
+
+typedef enum {
+#define TASK_PLAN_ID(id, name, stack, priority, core) TASK_PLAN_##id,
+    TASK_PLAN_TABLE(TASK_PLAN_ID)
+#undef TASK_PLAN_ID
+    TASK_PLAN_COUNT
+} task_plan_task_t;
+
+#define TASK_PLAN_MAX_CORES 2
+
+typedef esp_err_t (*task_plan_work_t)(void *arg);
+
+typedef struct {
+    uint8_t core_load[TASK_PLAN_MAX_CORES];     // Percent busy over the last report window
+    uint8_t task_load[TASK_PLAN_COUNT];         // Percent of one core, summed over a row's tasks
+    uint32_t cycles;
+    uint32_t last_cycle_us;                     // Capture to upload completion
+    uint32_t max_cycle_us;
+    uint64_t total_cycle_us;
+    uint32_t network_calls;
+    uint64_t network_busy_us;
+} task_plan_stats_t;
+
+// Function declarations
+esp_err_t task_plan_create(task_plan_task_t task, TaskFunction_t function, void *arg, const char *name,
+                           TaskHandle_t *handle);
+esp_err_t task_plan_start_network(void);
+esp_err_t task_plan_run_network(task_plan_work_t work, void *arg);
+void task_plan_record_cycle(uint32_t cycle_us);
+void task_plan_log_load(void);
+void task_plan_get_stats(task_plan_stats_t *stats);
+
+#endif // TASK_PLAN_H
@@ -0,0 +1,14 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Function declarations
+esp_err_t time_sync_init(const char *server);
+esp_err_t time_sync_wait(uint32_t timeout_ms);
+bool time_sync_is_synced(void);
+int64_t time_sync_now_ms(void);
+
+#endif // TIME_SYNC_H
@@ -0,0 +1,92 @@
+#ifndef TINYML_H
+#define TINYML_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal int8 interpreter for TensorFlow Lite flatbuffers. Covers the operators of
+// MobileNet-style classifiers such as the TFLite Micro person_detect model, with the
+// reference kernels' quantization arithmetic. Weights are read in place from the
+// model buffer (a memory-mapped partition on the device); activations share one
+// arena laid out ahead of time from tensor lifetimes.
+
+#define TINYML_MAX_TENSORS 128
+#define TINYML_MAX_OPS 64
+#define TINYML_MAX_DIMS 4
+#define TINYML_ARENA_ALIGN 16
+
+typedef enum {
+    TINYML_OP_CONV_2D,
+    TINYML_OP_DEPTHWISE_CONV_2D,
+    TINYML_OP_AVERAGE_POOL_2D,
+    TINYML_OP_MAX_POOL_2D,
+    TINYML_OP_FULLY_CONNECTED,
+    TINYML_OP_RESHAPE,
+    TINYML_OP_SOFTMAX,
+    TINYML_OP_COUNT
+} tinyml_op_type_t;
+
+typedef struct {
+    int32_t dims[TINYML_MAX_DIMS];
+    int ndims;
+    uint8_t type;                   // TFLite TensorType; int8 and int32 are supported
+    float scale;
+    int32_t zero_point;
+    const uint8_t *channel_scales;  // Little-endian floats in the model, per output channel
+    int channel_count;
+    const void *data;               // Constant data in the model, or the tensor's arena slot
+    size_t bytes;
+    bool constant;
+    int first_op;                   // Lifetime in operator indices, for arena planning
+    int last_op;
+    size_t arena_offset;
+} tinyml_tensor_t;
+
+typedef struct {
+    tinyml_op_type_t type;
+    int inputs[3];                  // -1 for an omitted optional input
+    int output;
+    uint8_t padding;                // 0 = SAME, 1 = VALID
+    uint8_t stride_w;
+    uint8_t stride_h;
+    uint8_t filter_w;               // Pooling window
+    uint8_t filter_h;
+    uint8_t dilation_w;
+    uint8_t dilation_h;
+    uint8_t depth_multiplier;
+    float beta;
+    int32_t act_min;
+    int32_t act_max;
+    // Requantization per output channel, in the arena's persistent area
+    int32_t *multipliers;
+    int8_t *shifts;
+    int32_t *bias_folded;           // Bias plus input offset times filter sum, for unpadded 1x1 convolutions
+} tinyml_op_t;
+
+typedef struct {
+    const uint8_t *model;
+    size_t model_len;
+    tinyml_tensor_t tensors[TINYML_MAX_TENSORS];
+    int tensor_count;
+    tinyml_op_t ops[TINYML_MAX_OPS];
+    int op_count;
+    int input;
+    int output;
+    uint8_t *arena;
+    size_t arena_size;
+    size_t activation_bytes;        // Planned peak of the activation area
+    size_t persistent_bytes;        // Requantization tables at the top of the arena
+    uint64_t macs;                  // Multiply-accumulates per invocation
+} tinyml_model_t;
+
+// Function declarations
+esp_err_t tinyml_load(tinyml_model_t *model, const uint8_t *tflite, size_t len, uint8_t *arena, size_t arena_size);
+esp_err_t tinyml_invoke(tinyml_model_t *model);
+esp_err_t tinyml_invoke_op(tinyml_model_t *model, int index);
+tinyml_tensor_t *tinyml_input(tinyml_model_t *model);
+const tinyml_tensor_t *tinyml_output(const tinyml_model_t *model);
+const char *tinyml_op_name(tinyml_op_type_t type);
+
+#endif // TINYML_H
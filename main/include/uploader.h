@@ -0,0 +1,60 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Payload encoding a backend expects in uploader_frame_t
+typedef enum {
+    UPLOADER_ENCODING_RAW,      // jpeg/jpeg_len
+    UPLOADER_ENCODING_BASE64    // base64/base64_len
+} uploader_encoding_t;
+
+// One captured frame; buffers are borrowed for the duration of submit()
+typedef struct {
+    const uint8_t *jpeg;
+    size_t jpeg_len;
+    const char *base64;
+    size_t base64_len;
+    const char *timestamp;
+    const char *metadata;       // Optional, may be NULL
+} uploader_frame_t;
+
+typedef struct {
+    uint32_t frames_submitted;
+    uint32_t frames_failed;
+    uint64_t bytes_sent;
+    uint32_t last_latency_ms;
+    uint32_t max_latency_ms;
+    uint64_t total_latency_ms;  // Sum over successful frames, for averages
+} uploader_stats_t;
+
+// Backend interface; init() takes the backend's own config structure
+typedef struct {
+    const char *name;
+    uploader_encoding_t encoding;
+    esp_err_t (*init)(const void *config);
+    esp_err_t (*submit)(const uploader_frame_t *frame);
+    esp_err_t (*flush)(uint32_t timeout_ms);
+    void (*get_stats)(uploader_stats_t *stats);
+} uploader_backend_t;
+
+// MQTT backend configuration
+typedef struct {
+    char broker_uri[128];
+    char client_id[32];
+    char topic_prefix[64];
+} uploader_mqtt_config_t;
+
+// Available backends
+extern const uploader_backend_t uploader_firebase_backend;  // init() takes firebase_config_t
+extern const uploader_backend_t uploader_mqtt_backend;      // init() takes uploader_mqtt_config_t
+extern const uploader_backend_t uploader_sd_backend;        // init() takes no config (NULL)
+
+// Shared helpers for backend implementations
+void uploader_stats_record(uploader_stats_t *stats, esp_err_t result, size_t bytes, int64_t start_us);
+void uploader_log_stats(const char *name, const uploader_stats_t *stats);
+
+#endif // UPLOADER_H
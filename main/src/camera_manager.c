@@ -1,13 +1,18 @@
 #include "camera_manager.h"
+#include "image_analysis.h"
+#include "jpeg_utils.h"
+#include "psram_stage.h"
 #include "pin_config.h"
 #include "config.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
-#include "mbedtls/base64.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_heap_caps.h"
 #include "esp_psram.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -15,6 +20,27 @@ static const char *TAG = "CAMERA_MGR";
 static bool camera_initialized = false;
 static SemaphoreHandle_t camera_semaphore = NULL;
 static TickType_t last_capture_time = 0;
+static camera_config_params_t active_params;
+static bool active_params_valid = false;
+
+// Sensor standby between captures
+static bool camera_in_standby = false;
+static camera_status_t standby_status;
+static camera_power_stats_t power_stats;
+static int64_t power_state_since_us = 0;
+
+static camera_quality_stats_t quality_stats;
+
+// Thumbnail timing, indexed by the sensor frame size the source was captured at
+static camera_thumbnail_bench_t thumbnail_bench[FRAMESIZE_INVALID];
+static uint32_t thumbnails_made = 0;
+
+// Sensor window; kept across standby and re-init, applied whenever the frame size is rewritten
+static camera_roi_t active_roi;
+static bool roi_enabled = false;
+static uint16_t roi_out_width = 0;
+static uint16_t roi_out_height = 0;
+static camera_roi_t roi_view;              // Programmed window in array pixels, after alignment
 
 // Enhanced retry configuration
 #define MAX_CAPTURE_RETRIES 3
@@ -23,9 +49,95 @@ static TickType_t last_capture_time = 0;
 #define FLASH_WARMUP_MS 200
 #define FLASH_STABILIZE_MS 100
 
+// Standby: OV2640 COM2 (sensor bank) bit 4 when no PWDN pin is wired
+#define OV2640_COM2_REG 0x109
+#define OV2640_COM2_STANDBY 0x10
+#define WAKE_PWDN_SETTLE_MS 5
+
+// OV2640 window geometry: the full array, and the readout modes set_framesize picks
+#define OV2640_ARRAY_WIDTH 1600
+#define OV2640_ARRAY_HEIGHT 1200
+#define OV2640_MODE_UXGA 0
+#define OV2640_MODE_SVGA 1
+#define OV2640_MODE_CIF 2
+#define OV2640_CIF_MAX_HEIGHT 296
+
 // Memory allocation strategy
 #define PSRAM_MIN_SIZE_THRESHOLD 8192
-#define BASE64_OVERHEAD_FACTOR 1.4f  // More accurate than 4/3
+
+// Program the DSP window for the active ROI. The readout mode and scaling are the
+// ones set_framesize uses for the configured frame size, so the ROI keeps the
+// pixel density of a full-frame capture and never outgrows the frame buffers.
+static esp_err_t apply_roi(sensor_t *s) {
+    roi_out_width = 0;
+    roi_out_height = 0;
+    if (!roi_enabled || s == NULL) {
+        return ESP_OK;
+    }
+    if (s->id.PID != OV2640_PID || s->set_res_raw == NULL) {
+        ESP_LOGW(TAG, "Sensor 0x%02x has no window control, ROI ignored", s->id.PID);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint32_t frame_width = resolution[s->status.framesize].width;
+    uint32_t frame_height = resolution[s->status.framesize].height;
+    int mode = OV2640_MODE_UXGA;
+    uint32_t div = 1;
+    uint32_t array_height = OV2640_ARRAY_HEIGHT;
+    if (frame_width <= 400 && frame_height <= OV2640_CIF_MAX_HEIGHT) {
+        mode = OV2640_MODE_CIF;
+        div = 4;
+        array_height = OV2640_CIF_MAX_HEIGHT;
+    } else if (frame_width <= 800 && frame_height <= 600) {
+        mode = OV2640_MODE_SVGA;
+        div = 2;
+        array_height = OV2640_ARRAY_HEIGHT / 2;
+    }
+    uint32_t array_width = OV2640_ARRAY_WIDTH / div;
+
+    // Window in mode pixels; the size registers count in units of 4
+    uint32_t x = active_roi.x / div;
+    uint32_t y = active_roi.y / div;
+    uint32_t w = (active_roi.width / div) & ~3u;
+    uint32_t h = (active_roi.height / div) & ~3u;
+    if (y + h > array_height) {
+        h = (array_height - (y < array_height ? y : array_height)) & ~3u;
+    }
+
+    // Same output-per-window ratio as a full frame on both axes, whole JPEG MCUs only
+    uint32_t out_w = (w * frame_width / array_width) & ~15u;
+    uint32_t out_h = (h * frame_width / array_width) & ~7u;
+    if (out_h > frame_height) {
+        out_h = frame_height & ~7u;
+        h = ((out_h * array_width / frame_width) + 3) & ~3u;
+    }
+    if (out_w < 16 || out_h < 8) {
+        ESP_LOGE(TAG, "ROI %ux%u is too small for %ux%u frames", active_roi.width, active_roi.height,
+                 (unsigned)frame_width, (unsigned)frame_height);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (s->set_res_raw(s, mode, 0, 0, 0, x, y, w, h, out_w, out_h, false, false) != 0) {
+        ESP_LOGE(TAG, "Failed to program sensor window");
+        return ESP_FAIL;
+    }
+
+    roi_out_width = out_w;
+    roi_out_height = out_h;
+    roi_view = (camera_roi_t){x * div, y * div, w * div, h * div};
+    ESP_LOGI(TAG, "ROI %u,%u %ux%u: mode %d window %u,%u %ux%u -> %ux%u output",
+             active_roi.x, active_roi.y, active_roi.width, active_roi.height, mode,
+             (unsigned)x, (unsigned)y, (unsigned)w, (unsigned)h, (unsigned)out_w, (unsigned)out_h);
+    return ESP_OK;
+}
+
+// The driver stamps frames with the frame size's dimensions; a window changes them
+static void apply_roi_geometry(camera_fb_t *fb) {
+    if (fb != NULL && roi_out_width > 0) {
+        fb->width = roi_out_width;
+        fb->height = roi_out_height;
+    }
+}
 
 esp_err_t camera_init_with_config(const camera_config_params_t *params) {
     if (params == NULL) {
@@ -49,6 +161,9 @@ esp_err_t camera_init_with_config(const camera_config_params_t *params) {
         xSemaphoreGive(camera_semaphore);
     }
     
+    // PWDN may still be latched high from a deep sleep power-down
+    gpio_hold_dis(PWDN_GPIO_NUM);
+
     // Configure flash LED pin
     gpio_reset_pin(FLASH_GPIO_NUM);
     gpio_set_direction(FLASH_GPIO_NUM, GPIO_MODE_OUTPUT);
@@ -139,6 +254,9 @@ esp_err_t camera_init_with_config(const camera_config_params_t *params) {
         s->set_special_effect(s, 0); // No special effects
         s->set_hmirror(s, 0);        // No horizontal mirror
         s->set_vflip(s, 0);          // No vertical flip
+
+        // Window last; set_framesize above reset it to the full frame
+        apply_roi(s);
         
         ESP_LOGI(TAG, "Sensor configured (PID: 0x%02x)", s->id.PID);
     } else {
@@ -147,6 +265,10 @@ esp_err_t camera_init_with_config(const camera_config_params_t *params) {
 
     camera_initialized = true;
     last_capture_time = 0;  // Reset capture timing
+    active_params = *params;
+    active_params_valid = true;
+    camera_in_standby = false;
+    power_state_since_us = esp_timer_get_time();
     
     ESP_LOGI(TAG, "Camera initialized successfully");
     ESP_LOGI(TAG, "Config: Frame=%d, Quality=%d, PSRAM=%s", 
@@ -235,14 +357,244 @@ static unsigned char* allocate_base64_buffer(size_t required_size, bool *used_ps
     return buffer;
 }
 
-esp_err_t camera_capture_to_base64(char **base64_output, size_t *output_len) {
+// Move the time spent in the current power state into its counter
+static void account_power_state(void) {
+    int64_t now = esp_timer_get_time();
+    if (power_state_since_us != 0) {
+        if (camera_in_standby) {
+            power_stats.standby_us += now - power_state_since_us;
+        } else {
+            power_stats.active_us += now - power_state_since_us;
+        }
+    }
+    power_state_since_us = now;
+}
+
+static void set_sensor_standby(sensor_t *s, bool standby) {
+    if (PWDN_GPIO_NUM >= 0) {
+        gpio_set_level(PWDN_GPIO_NUM, standby ? 1 : 0);
+    } else if (s != NULL && s->set_reg != NULL) {
+        s->set_reg(s, OV2640_COM2_REG, OV2640_COM2_STANDBY, standby ? OV2640_COM2_STANDBY : 0);
+    }
+}
+
+// Rewrite the settings cached at standby; cheaper than a driver re-init and safe
+// whether or not the sensor kept its registers through power-down
+static void restore_sensor_status(sensor_t *s, const camera_status_t *st) {
+    s->set_framesize(s, st->framesize);
+    s->set_quality(s, st->quality);
+    s->set_brightness(s, st->brightness);
+    s->set_contrast(s, st->contrast);
+    s->set_saturation(s, st->saturation);
+    s->set_whitebal(s, st->awb);
+    s->set_awb_gain(s, st->awb_gain);
+    s->set_wb_mode(s, st->wb_mode);
+    s->set_exposure_ctrl(s, st->aec);
+    s->set_aec2(s, st->aec2);
+    s->set_ae_level(s, st->ae_level);
+    if (s->set_aec_value) s->set_aec_value(s, st->aec_value);
+    s->set_gain_ctrl(s, st->agc);
+    if (s->set_agc_gain) s->set_agc_gain(s, st->agc_gain);
+    s->set_dcw(s, st->dcw);
+    s->set_bpc(s, st->bpc);
+    s->set_wpc(s, st->wpc);
+    if (s->set_lenc) s->set_lenc(s, st->lenc);
+    s->set_special_effect(s, st->special_effect);
+    s->set_hmirror(s, st->hmirror);
+    s->set_vflip(s, st->vflip);
+}
+
+static bool frame_is_valid_jpeg(const camera_fb_t *fb) {
+    if (fb == NULL || fb->buf == NULL || fb->len < 4 || fb->buf[0] != 0xFF || fb->buf[1] != 0xD8) {
+        return false;
+    }
+    // The driver may pad after EOI, so look for it near the end
+    size_t start = fb->len > 32 ? fb->len - 32 : 2;
+    for (size_t i = fb->len - 2; i >= start; i--) {
+        if (fb->buf[i] == 0xFF && fb->buf[i + 1] == 0xD9) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bring the sensor out of standby and wait for the first complete frame. Caller holds the semaphore.
+static esp_err_t camera_wake(void) {
+    int64_t start = esp_timer_get_time();
+    sensor_t *s = esp_camera_sensor_get();
+
+    set_sensor_standby(s, false);
+    account_power_state();
+    camera_in_standby = false;
+    vTaskDelay(pdMS_TO_TICKS(WAKE_PWDN_SETTLE_MS));
+
+    if (s != NULL) {
+        restore_sensor_status(s, &standby_status);
+        apply_roi(s);
+    }
+
+    // Frames straddling the wake are truncated or stale; drop them until one is whole
+    bool valid = false;
+    while (!valid && esp_timer_get_time() - start < (int64_t)CAMERA_WAKE_TIMEOUT_MS * 1000) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        valid = frame_is_valid_jpeg(fb);
+        if (fb != NULL) {
+            esp_camera_fb_return(fb);
+        }
+    }
+
+    if (!valid) {
+        power_stats.wake_failures++;
+        ESP_LOGE(TAG, "No valid frame within %d ms of wake", CAMERA_WAKE_TIMEOUT_MS);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - start);
+    power_stats.wakes++;
+    power_stats.last_wake_latency_us = latency;
+    power_stats.total_wake_latency_us += latency;
+    if (latency > power_stats.max_wake_latency_us) {
+        power_stats.max_wake_latency_us = latency;
+    }
+
+    camera_power_stats_t snapshot;
+    camera_get_power_stats(&snapshot);
+    ESP_LOGI(TAG, "Wake to first valid frame: %u ms (avg %u ms, max %u ms), est. average current %.1f mA",
+             (unsigned)(latency / 1000), (unsigned)(power_stats.total_wake_latency_us / power_stats.wakes / 1000),
+             (unsigned)(power_stats.max_wake_latency_us / 1000), snapshot.average_current_ma);
+    return ESP_OK;
+}
+
+// Put the sensor into power-down until the next capture; the driver stays initialized
+esp_err_t camera_standby(void) {
+    if (!camera_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (camera_in_standby) {
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(camera_semaphore, pdMS_TO_TICKS(5000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    sensor_t *s = esp_camera_sensor_get();
+    if (s != NULL) {
+        standby_status = s->status;
+    }
+    gpio_set_level(FLASH_GPIO_NUM, 0);
+    set_sensor_standby(s, true);
+
+    account_power_state();
+    camera_in_standby = true;
+    power_stats.standbys++;
+
+    xSemaphoreGive(camera_semaphore);
+    ESP_LOGD(TAG, "Sensor in standby");
+    return ESP_OK;
+}
+
+void camera_get_power_stats(camera_power_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    *stats = power_stats;
+
+    // Include the time spent in the current state so far
+    int64_t pending = power_state_since_us ? esp_timer_get_time() - power_state_since_us : 0;
+    if (camera_in_standby) {
+        stats->standby_us += pending;
+    } else {
+        stats->active_us += pending;
+    }
+
+    int64_t total = stats->active_us + stats->standby_us;
+    stats->average_current_ma = total > 0
+        ? (float)(stats->active_us * CAMERA_ACTIVE_CURRENT_MA + stats->standby_us * CAMERA_STANDBY_CURRENT_MA) / (float)total
+        : 0.0f;
+}
+
+// Grade a captured frame from a downscaled grayscale decode
+static camera_frame_verdict_t assess_frame(const camera_fb_t *fb) {
+    if (fb->format != PIXFORMAT_JPEG) {
+        return CAMERA_FRAME_OK;
+    }
+
+    int64_t start = esp_timer_get_time();
+    gray_image_t gray = {0};
+    if (image_analysis_gray_from_jpeg(fb->buf, fb->len, fb->width, fb->height,
+                                      QUALITY_THUMBNAIL_MIN_WIDTH, &gray) != ESP_OK) {
+        return CAMERA_FRAME_CORRUPT;
+    }
+
+    image_quality_t q;
+    esp_err_t err = image_analysis_quality(&gray, QUALITY_DARK_LEVEL, QUALITY_BRIGHT_LEVEL, &q);
+    image_analysis_free(&gray);
+    if (err != ESP_OK) {
+        return CAMERA_FRAME_CORRUPT;
+    }
+
+    camera_frame_verdict_t verdict = CAMERA_FRAME_OK;
+    if (q.mean_luma < QUALITY_MIN_MEAN_LUMA || q.dark_fraction > QUALITY_MAX_CLIPPED_FRACTION) {
+        verdict = CAMERA_FRAME_TOO_DARK;
+    } else if (q.mean_luma > QUALITY_MAX_MEAN_LUMA || q.bright_fraction > QUALITY_MAX_CLIPPED_FRACTION) {
+        verdict = CAMERA_FRAME_OVEREXPOSED;
+    } else if (q.sharpness < QUALITY_MIN_SHARPNESS) {
+        verdict = CAMERA_FRAME_BLURRY;
+    }
+
+    quality_stats.frames_assessed++;
+    quality_stats.last_mean_luma = q.mean_luma;
+    quality_stats.last_sharpness = q.sharpness;
+    quality_stats.last_assess_us = (uint32_t)(esp_timer_get_time() - start);
+
+    ESP_LOGI(TAG, "Quality: luma %.0f, dark %.0f%%, bright %.0f%%, sharpness %.0f -> %s (%u us)",
+             q.mean_luma, q.dark_fraction * 100.0f, q.bright_fraction * 100.0f, q.sharpness,
+             camera_frame_verdict_name(verdict), (unsigned)quality_stats.last_assess_us);
+    return verdict;
+}
+
+// Nudge auto-exposure toward the failure before recapturing
+static void adjust_exposure(camera_frame_verdict_t verdict) {
+    sensor_t *s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return;
+    }
+
+    int level = s->status.ae_level;
+    if (verdict == CAMERA_FRAME_TOO_DARK && level < 2) {
+        s->set_ae_level(s, level + 1);
+    } else if (verdict == CAMERA_FRAME_OVEREXPOSED && level > -2) {
+        s->set_ae_level(s, level - 1);
+    }
+}
+
+const char *camera_frame_verdict_name(camera_frame_verdict_t verdict) {
+    switch (verdict) {
+        case CAMERA_FRAME_OK: return "ok";
+        case CAMERA_FRAME_TOO_DARK: return "too dark";
+        case CAMERA_FRAME_OVEREXPOSED: return "overexposed";
+        case CAMERA_FRAME_BLURRY: return "blurry";
+        case CAMERA_FRAME_CORRUPT: return "corrupt";
+        default: return "unknown";
+    }
+}
+
+void camera_get_quality_stats(camera_quality_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = quality_stats;
+    }
+}
+
+esp_err_t camera_capture_frame(camera_fb_t **fb_out) {
     if (!camera_initialized) {
         ESP_LOGE(TAG, "Camera not initialized");
         return ESP_ERR_INVALID_STATE;
     }
     
-    if (base64_output == NULL || output_len == NULL) {
-        ESP_LOGE(TAG, "Output parameters cannot be NULL");
+    if (fb_out == NULL) {
+        ESP_LOGE(TAG, "Frame buffer pointer cannot be NULL");
         return ESP_ERR_INVALID_ARG;
     }
     
@@ -265,14 +617,23 @@ esp_err_t camera_capture_to_base64(char **base64_output, size_t *output_len) {
         return ESP_ERR_TIMEOUT;
     }
     
-    esp_err_t result = ESP_OK;
     camera_fb_t *fb = NULL;
-    unsigned char *encoded = NULL;
-    bool used_psram = false;
+
+    if (camera_in_standby) {
+        esp_err_t err = camera_wake();
+        if (err != ESP_OK) {
+            xSemaphoreGive(camera_semaphore);
+            return err;
+        }
+    }
     
     ESP_LOGI(TAG, "Starting capture - Free: Heap=%d, PSRAM=%d", 
              esp_get_free_heap_size(), heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
     
+    // Exposure tweaks for recaptures are undone once this capture finishes
+    sensor_t *sensor = esp_camera_sensor_get();
+    int baseline_ae_level = sensor != NULL ? sensor->status.ae_level : 0;
+
     // Retry loop with exponential backoff
     for (int attempt = 1; attempt <= MAX_CAPTURE_RETRIES; attempt++) {
         // Pre-capture preparation
@@ -289,8 +650,30 @@ esp_err_t camera_capture_to_base64(char **base64_output, size_t *output_len) {
 
         // Capture attempt
         fb = esp_camera_fb_get();
+        apply_roi_geometry(fb);
         
         if (fb != NULL && fb->len > 0 && fb->buf != NULL) {
+#if QUALITY_GATE_ENABLED
+            camera_frame_verdict_t verdict = assess_frame(fb);
+            quality_stats.last_verdict = verdict;
+            if (verdict != CAMERA_FRAME_OK && verdict != CAMERA_FRAME_CORRUPT && attempt == MAX_CAPTURE_RETRIES) {
+                // A dark or featureless scene never passes. With a single frame buffer the
+                // earlier attempts cannot be held, so keep this one, taken with every exposure
+                // nudge applied; the caller finds its verdict in the quality stats.
+                quality_stats.kept_below_gate++;
+                ESP_LOGW(TAG, "Keeping %s frame after %d attempts", camera_frame_verdict_name(verdict), attempt);
+                break;
+            }
+            if (verdict != CAMERA_FRAME_OK) {
+                quality_stats.rejected[verdict]++;
+                ESP_LOGW(TAG, "Rejecting %s frame on attempt %d", camera_frame_verdict_name(verdict), attempt);
+                esp_camera_fb_return(fb);
+                fb = NULL;
+                gpio_set_level(FLASH_GPIO_NUM, 0);
+                adjust_exposure(verdict);
+                continue;
+            }
+#endif
             ESP_LOGI(TAG, "Capture successful on attempt %d: %d bytes, format=%d", 
                      attempt, fb->len, fb->format);
             break;
@@ -312,61 +695,177 @@ esp_err_t camera_capture_to_base64(char **base64_output, size_t *output_len) {
     
     // Turn off flash
     gpio_set_level(FLASH_GPIO_NUM, 0);
+
+    if (sensor != NULL && sensor->status.ae_level != baseline_ae_level) {
+        sensor->set_ae_level(sensor, baseline_ae_level);
+    }
     
-    if (fb == NULL || fb->len == 0 || fb->buf == NULL) {
+    if (fb == NULL) {
         ESP_LOGE(TAG, "All capture attempts failed");
-        result = ESP_FAIL;
-        goto cleanup;
+        xSemaphoreGive(camera_semaphore);
+        return ESP_FAIL;
+    }
+
+    last_capture_time = xTaskGetTickCount();
+    xSemaphoreGive(camera_semaphore);
+
+    *fb_out = fb;
+    return ESP_OK;
+}
+
+// Scaled JPEG decode plus fmt2jpg re-encode; the source frame is left untouched
+esp_err_t camera_make_thumbnail(const camera_fb_t *fb, uint16_t min_width, uint8_t quality,
+                                camera_thumbnail_t *thumbnail) {
+    if (fb == NULL || fb->buf == NULL || fb->len == 0 || thumbnail == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
+    if (fb->format != PIXFORMAT_JPEG) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(thumbnail, 0, sizeof(*thumbnail));
+
+    int64_t start = esp_timer_get_time();
+    uint8_t *rgb565 = NULL;
+    esp_err_t err = image_analysis_rgb565_from_jpeg(fb->buf, fb->len, fb->width, fb->height, min_width,
+                                                    &rgb565, &thumbnail->width, &thumbnail->height);
+    if (err != ESP_OK) {
+        return err;
+    }
+    int64_t decoded = esp_timer_get_time();
+
+    bool encoded = fmt2jpg(rgb565, (size_t)thumbnail->width * thumbnail->height * 2,
+                           thumbnail->width, thumbnail->height, PIXFORMAT_RGB565, quality,
+                           &thumbnail->jpeg, &thumbnail->len);
+    free(rgb565);
+    if (!encoded) {
+        ESP_LOGE(TAG, "Thumbnail encode failed (%ux%u)", thumbnail->width, thumbnail->height);
+        thumbnail->jpeg = NULL;
+        return ESP_FAIL;
+    }
+    int64_t done = esp_timer_get_time();
+
+    sensor_t *s = esp_camera_sensor_get();
+    framesize_t size = s != NULL ? s->status.framesize : FRAMESIZE_INVALID;
+    if (size < FRAMESIZE_INVALID) {
+        camera_thumbnail_bench_t *bench = &thumbnail_bench[size];
+        uint32_t total_us = (uint32_t)(done - start);
+        bench->count++;
+        bench->decode_us += (uint64_t)(decoded - start);
+        bench->encode_us += (uint64_t)(done - decoded);
+        if (total_us > bench->max_us) {
+            bench->max_us = total_us;
+        }
+    }
+
+    ESP_LOGI(TAG, "Thumbnail %ux%u -> %ux%u: %zu -> %zu bytes, decode %u us, encode %u us",
+             fb->width, fb->height, thumbnail->width, thumbnail->height, fb->len, thumbnail->len,
+             (unsigned)(decoded - start), (unsigned)(done - decoded));
+
+    if (++thumbnails_made % THUMBNAIL_BENCH_LOG_EVERY == 0) {
+        camera_log_thumbnail_bench();
+    }
+    return ESP_OK;
+}
 
-    // Calculate base64 buffer size more accurately
-    size_t encoded_len = (size_t)(fb->len * BASE64_OVERHEAD_FACTOR) + 64;  // Extra safety margin
+void camera_free_thumbnail(camera_thumbnail_t *thumbnail) {
+    if (thumbnail != NULL) {
+        free(thumbnail->jpeg);
+        thumbnail->jpeg = NULL;
+        thumbnail->len = 0;
+    }
+}
+
+void camera_log_thumbnail_bench(void) {
+    for (int i = 0; i < FRAMESIZE_INVALID; i++) {
+        const camera_thumbnail_bench_t *bench = &thumbnail_bench[i];
+        if (bench->count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Thumbnail bench %ux%u: %u frames, avg decode %u us, avg encode %u us, max total %u us",
+                 resolution[i].width, resolution[i].height, (unsigned)bench->count,
+                 (unsigned)(bench->decode_us / bench->count), (unsigned)(bench->encode_us / bench->count),
+                 (unsigned)bench->max_us);
+    }
+}
+
+esp_err_t camera_frame_to_base64(const camera_fb_t *fb, char **base64_output, size_t *output_len) {
+    return camera_frame_to_base64_sha256(fb, base64_output, output_len, NULL);
+}
+
+// sha256, when set, receives the digest of the JPEG bytes the base64 decodes to,
+// hashed block by block during the encode
+esp_err_t camera_frame_to_base64_sha256(const camera_fb_t *fb, char **base64_output, size_t *output_len,
+                                        uint8_t *sha256) {
+    if (fb == NULL || fb->buf == NULL || fb->len == 0) {
+        ESP_LOGE(TAG, "Frame buffer cannot be empty");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (base64_output == NULL || output_len == NULL) {
+        ESP_LOGE(TAG, "Output parameters cannot be NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    bool used_psram = false;
+
+    // Encode straight from the sanitized spans of the driver buffer, staged through internal RAM
+    jpeg_ranges_t ranges;
+#if JPEG_SANITIZE_ENABLED
+    if (fb->format == PIXFORMAT_JPEG) {
+        jpeg_sanitize(fb->buf, fb->len, &ranges);
+    } else {
+        jpeg_ranges_whole(fb->len, &ranges);
+    }
+#else
+    jpeg_ranges_whole(fb->len, &ranges);
+#endif
+
+    size_t encoded_len = jpeg_ranges_base64_len(&ranges);
     
     // Smart memory allocation
-    encoded = allocate_base64_buffer(encoded_len + 1, &used_psram);
+    unsigned char *encoded = allocate_base64_buffer(encoded_len + 1, &used_psram);
     if (!encoded) {
         ESP_LOGE(TAG, "Memory allocation failed: %zu bytes needed", encoded_len + 1);
         ESP_LOGE(TAG, "Available - Heap: %d, PSRAM: %d", 
                  esp_get_free_heap_size(), heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
-        result = ESP_ERR_NO_MEM;
-        goto cleanup;
+        return ESP_ERR_NO_MEM;
     }
 
-    // Clear buffer and encode
-    memset(encoded, 0, encoded_len + 1);
-
     size_t actual_len = 0;
-    int base64_result = mbedtls_base64_encode(encoded, encoded_len, &actual_len, fb->buf, fb->len);
-    
-    if (base64_result != 0) {
-        ESP_LOGE(TAG, "Base64 encoding failed: error=%d, input=%d bytes, buffer=%zu bytes", 
-                 base64_result, fb->len, encoded_len);
-        result = ESP_FAIL;
-        goto cleanup;
+    esp_err_t err = psram_stage_base64(fb->buf, &ranges, (char *)encoded, encoded_len + 1, &actual_len, sha256);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Base64 encoding failed: %s, input=%zu bytes, buffer=%zu bytes", 
+                 esp_err_to_name(err), ranges.total_len, encoded_len);
+        free(encoded);
+        return ESP_FAIL;
     }
     
-    encoded[actual_len] = '\0';
-    
-    ESP_LOGI(TAG, "Encoding successful: %zu chars (%.1f%% expansion, %s)", 
-             actual_len, (float)actual_len * 100.0f / (float)fb->len,
+    ESP_LOGI(TAG, "Encoding successful: %zu chars, %zu of %zu JPEG bytes kept (%zu saved, %s)", 
+             actual_len, ranges.total_len, fb->len, fb->len - ranges.total_len,
              used_psram ? "PSRAM" : "DRAM");
 
     // Success - transfer ownership
     *base64_output = (char*)encoded;
     *output_len = actual_len;
-    encoded = NULL;  // Prevent cleanup
-    last_capture_time = xTaskGetTickCount();
+    return ESP_OK;
+}
 
-cleanup:
-    if (fb != NULL) {
-        esp_camera_fb_return(fb);
-    }
-    if (encoded != NULL) {
-        free(encoded);
+esp_err_t camera_capture_to_base64(char **base64_output, size_t *output_len) {
+    if (base64_output == NULL || output_len == NULL) {
+        ESP_LOGE(TAG, "Output parameters cannot be NULL");
+        return ESP_ERR_INVALID_ARG;
     }
     
-    xSemaphoreGive(camera_semaphore);
-    return result;
+    camera_fb_t *fb = NULL;
+    esp_err_t err = camera_capture_frame(&fb);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = camera_frame_to_base64(fb, base64_output, output_len);
+    esp_camera_fb_return(fb);
+    return err;
 }
 
 esp_err_t camera_capture_raw(camera_fb_t **fb) {
@@ -409,6 +908,7 @@ esp_err_t camera_capture_raw(camera_fb_t **fb) {
     // Final preparation and capture
     vTaskDelay(pdMS_TO_TICKS(FLASH_STABILIZE_MS));
     *fb = esp_camera_fb_get();
+    apply_roi_geometry(*fb);
 
     // Turn off flash
     gpio_set_level(FLASH_GPIO_NUM, 0);
@@ -462,6 +962,13 @@ esp_err_t camera_deinit(void) {
     
     // Turn off flash
     gpio_set_level(FLASH_GPIO_NUM, 0);
+
+    // A sensor in standby produces no frames, so buffer clearing would stall
+    if (camera_in_standby) {
+        set_sensor_standby(esp_camera_sensor_get(), false);
+        account_power_state();
+        camera_in_standby = false;
+    }
     
     // Clear pending buffers
     int cleared = clear_camera_buffers(10, 10);
@@ -474,6 +981,7 @@ esp_err_t camera_deinit(void) {
     }
     
     camera_initialized = false;
+    camera_in_standby = false;
     last_capture_time = 0;
     
     // Clean up semaphore
@@ -486,6 +994,166 @@ esp_err_t camera_deinit(void) {
     return err;
 }
 
+// Release the driver and hold the sensor in power-down (PWDN high) for long idle periods
+esp_err_t camera_power_off(bool hold_in_sleep) {
+    if (camera_initialized) {
+        camera_deinit();
+    }
+
+    if (PWDN_GPIO_NUM < 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    gpio_reset_pin(PWDN_GPIO_NUM);
+    gpio_set_direction(PWDN_GPIO_NUM, GPIO_MODE_OUTPUT);
+    gpio_set_level(PWDN_GPIO_NUM, 1);
+    if (hold_in_sleep) {
+        // Keep the pin latched through deep sleep; camera_init_with_config releases it
+        gpio_hold_en(PWDN_GPIO_NUM);
+        gpio_deep_sleep_hold_en();
+    }
+
+    ESP_LOGI(TAG, "Camera powered down");
+    return ESP_OK;
+}
+
+// Re-initialize with the last configuration and discard frames while AE/AWB settle
+esp_err_t camera_power_on(uint32_t warmup_ms) {
+    esp_err_t err = active_params_valid ? camera_init_with_config(&active_params) : camera_init_default();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    int discarded = 0;
+    while (pdTICKS_TO_MS(xTaskGetTickCount() - start) < warmup_ms) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (fb != NULL) {
+            esp_camera_fb_return(fb);
+            discarded++;
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(RETRY_DELAY_MS));
+        }
+    }
+
+    ESP_LOGI(TAG, "Camera powered up, discarded %d warm-up frames", discarded);
+    return ESP_OK;
+}
+
+// Change the sensor window without re-initializing the driver. Before init or in
+// standby the ROI is only stored; it is programmed on the next init or wake.
+esp_err_t camera_set_roi(const camera_roi_t *roi) {
+    bool enable = roi != NULL && roi->width > 0 && roi->height > 0;
+    if (enable && ((uint32_t)roi->x + roi->width > OV2640_ARRAY_WIDTH ||
+                   (uint32_t)roi->y + roi->height > OV2640_ARRAY_HEIGHT)) {
+        ESP_LOGE(TAG, "ROI %u,%u %ux%u exceeds the %ux%u sensor array", roi->x, roi->y,
+                 roi->width, roi->height, OV2640_ARRAY_WIDTH, OV2640_ARRAY_HEIGHT);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!camera_initialized) {
+        if (enable) {
+            active_roi = *roi;
+        }
+        roi_enabled = enable;
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(camera_semaphore, pdMS_TO_TICKS(5000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to acquire camera semaphore for ROI change");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (enable) {
+        active_roi = *roi;
+    }
+    roi_enabled = enable;
+
+    esp_err_t err = ESP_OK;
+    sensor_t *s = esp_camera_sensor_get();
+    if (!camera_in_standby && s != NULL) {
+        err = apply_roi(s);
+        if (!enable || err != ESP_OK) {
+            // Back to the full frame
+            roi_enabled = false;
+            s->set_framesize(s, s->status.framesize);
+        }
+        // Frames already in flight have the old geometry
+        clear_camera_buffers(3, 10);
+    }
+
+    xSemaphoreGive(camera_semaphore);
+    if (!enable) {
+        ESP_LOGI(TAG, "ROI cleared, capturing the full frame");
+    }
+    return err;
+}
+
+// Returns whether an ROI is set; the output size is 0x0 until the sensor has been programmed
+bool camera_get_roi(camera_roi_t *roi, uint16_t *out_width, uint16_t *out_height) {
+    if (roi != NULL) {
+        *roi = roi_enabled ? active_roi : (camera_roi_t){0};
+    }
+    if (out_width != NULL) {
+        *out_width = roi_out_width;
+    }
+    if (out_height != NULL) {
+        *out_height = roi_out_height;
+    }
+    return roi_enabled;
+}
+
+// Sensor array rectangle the current frames show: the programmed window, or for full
+// frames the centred crop matching the frame size's aspect ratio
+void camera_get_view(camera_roi_t *view) {
+    if (view == NULL) {
+        return;
+    }
+
+    if (roi_out_width > 0) {
+        *view = roi_view;
+        return;
+    }
+
+    sensor_t *s = camera_initialized ? esp_camera_sensor_get() : NULL;
+    framesize_t size = s != NULL ? s->status.framesize : CAMERA_FRAME_SIZE;
+    uint32_t height = (uint32_t)OV2640_ARRAY_WIDTH * resolution[size].height / resolution[size].width;
+    if (height > OV2640_ARRAY_HEIGHT) {
+        height = OV2640_ARRAY_HEIGHT;
+    }
+    view->x = 0;
+    view->y = (uint16_t)((OV2640_ARRAY_HEIGHT - height) / 2);
+    view->width = OV2640_ARRAY_WIDTH;
+    view->height = (uint16_t)height;
+}
+
+// "x,y,width,height"; an empty string means no ROI
+esp_err_t camera_parse_roi(const char *text, camera_roi_t *roi) {
+    if (text == NULL || roi == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(roi, 0, sizeof(*roi));
+    if (text[0] == '\0') {
+        return ESP_OK;
+    }
+
+    unsigned x, y, w, h;
+    int consumed = 0;
+    if (sscanf(text, "%u,%u,%u,%u%n", &x, &y, &w, &h, &consumed) != 4 || text[consumed] != '\0' ||
+        w == 0 || h == 0 || x > OV2640_ARRAY_WIDTH || y > OV2640_ARRAY_HEIGHT || x + w > OV2640_ARRAY_WIDTH || y + h > OV2640_ARRAY_HEIGHT) {
+        ESP_LOGE(TAG, "Invalid ROI '%s', expected x,y,width,height within %ux%u", text,
+                 OV2640_ARRAY_WIDTH, OV2640_ARRAY_HEIGHT);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    roi->x = x;
+    roi->y = y;
+    roi->width = w;
+    roi->height = h;
+    return ESP_OK;
+}
+
 esp_err_t camera_get_status(camera_manager_status_t *status) {
     if (status == NULL) {
         return ESP_ERR_INVALID_ARG;
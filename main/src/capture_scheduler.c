@@ -0,0 +1,375 @@
+#include "capture_scheduler.h"
+#include "image_analysis.h"
+#include "time_sync.h"
+#include "capture_window.h"
+#include "power_manager.h"
+#include "runtime_config.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *TAG = "SCHEDULER";
+
+static capture_scheduler_config_t sched_config;
+static capture_scheduler_stats_t sched_stats;
+static bool scheduler_initialized = false;
+static TickType_t last_wake = 0;
+static uint32_t interval_ms = 0;
+static gray_image_t previous_thumbnail;
+
+// Wall-clock slot bookkeeping for aligned mode
+static int64_t last_slot_ms = 0;
+static uint32_t last_slot_period_ms = 0;
+static time_t slot_time = 0;
+static uint32_t boot_number = 0;           // Read lazily, only boots that name unsynced frames count
+static char device_tag[9] = "";            // Ends every frame key so cameras sharing a database differ
+
+// Capture windows; an always-on schedule skips the window checks entirely
+static capture_window_t capture_window;
+static bool window_restricted = false;
+
+// Token bucket for the upload budget, in bytes
+static int64_t budget_tokens = 0;
+static int64_t budget_refill_us = 0;
+static uint32_t average_frame_bytes = 0;
+
+static void budget_refill(void) {
+    if (sched_config.bytes_per_hour == 0) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t earned = (now - budget_refill_us) * (int64_t)sched_config.bytes_per_hour / 3600000000LL;
+    if (earned > 0) {
+        budget_tokens += earned;
+        budget_refill_us = now;
+        if (budget_tokens > (int64_t)sched_config.bytes_per_hour) {
+            budget_tokens = sched_config.bytes_per_hour;
+        }
+    }
+}
+
+// Interval needed to earn enough budget for one more average frame
+static uint32_t budget_interval_ms(void) {
+    if (sched_config.bytes_per_hour == 0 || budget_tokens >= (int64_t)average_frame_bytes) {
+        return 0;
+    }
+
+    int64_t deficit = (int64_t)average_frame_bytes - budget_tokens;
+    return (uint32_t)(deficit * 3600000LL / sched_config.bytes_per_hour);
+}
+
+esp_err_t capture_scheduler_init(const capture_scheduler_config_t *config) {
+    if (config == NULL) {
+        capture_scheduler_config_t defaults = {
+            .min_interval_ms = CAPTURE_MIN_INTERVAL_MS,
+            .max_interval_ms = CAPTURE_MAX_INTERVAL_MS,
+            .initial_interval_ms = NUMBER_OF_SECONDS * 1000,
+            .activity_threshold = CAPTURE_ACTIVITY_THRESHOLD,
+            .pixel_delta = CAPTURE_ACTIVITY_PIXEL_DELTA,
+            .bytes_per_hour = CAPTURE_BYTES_PER_HOUR,
+            .align_to_wall_clock = CAPTURE_ALIGN_TO_WALL_CLOCK,
+        };
+        sched_config = defaults;
+    } else {
+        sched_config = *config;
+    }
+
+    if (sched_config.min_interval_ms == 0 || sched_config.min_interval_ms > sched_config.max_interval_ms) {
+        ESP_LOGE(TAG, "Invalid interval bounds: %u..%u ms",
+                 (unsigned)sched_config.min_interval_ms, (unsigned)sched_config.max_interval_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    interval_ms = sched_config.initial_interval_ms;
+    if (interval_ms < sched_config.min_interval_ms) {
+        interval_ms = sched_config.min_interval_ms;
+    } else if (interval_ms > sched_config.max_interval_ms) {
+        interval_ms = sched_config.max_interval_ms;
+    }
+
+    memset(&sched_stats, 0, sizeof(sched_stats));
+    image_analysis_free(&previous_thumbnail);
+    budget_tokens = sched_config.bytes_per_hour;
+    budget_refill_us = esp_timer_get_time();
+    average_frame_bytes = 0;
+    last_wake = xTaskGetTickCount();
+    last_slot_ms = 0;
+    last_slot_period_ms = 0;
+    slot_time = 0;
+    scheduler_initialized = true;
+
+    ESP_LOGI(TAG, "Adaptive interval %u..%u ms (start %u ms), budget %u bytes/h, %s",
+             (unsigned)sched_config.min_interval_ms, (unsigned)sched_config.max_interval_ms,
+             (unsigned)interval_ms, (unsigned)sched_config.bytes_per_hour,
+             sched_config.align_to_wall_clock ? "wall-clock aligned" : "relative");
+    return ESP_OK;
+}
+
+// Activity snaps the interval to the minimum; quiet frames double it up to the maximum
+void capture_scheduler_observe_frame(const camera_fb_t *fb) {
+    if (!scheduler_initialized || fb == NULL) {
+        return;
+    }
+
+    gray_image_t thumbnail = {0};
+    if (image_analysis_gray_from_jpeg(fb->buf, fb->len, fb->width, fb->height,
+                                      ACTIVITY_THUMBNAIL_MIN_WIDTH, &thumbnail) != ESP_OK) {
+        return;
+    }
+
+    float activity = image_analysis_change_ratio(&previous_thumbnail, &thumbnail, sched_config.pixel_delta);
+    image_analysis_free(&previous_thumbnail);
+    previous_thumbnail = thumbnail;
+
+    sched_stats.last_activity = activity;
+    if (activity >= sched_config.activity_threshold) {
+        sched_stats.active_cycles++;
+        interval_ms = sched_config.min_interval_ms;
+    } else {
+        uint32_t next = interval_ms * 2;
+        interval_ms = (next > sched_config.max_interval_ms || next < interval_ms) ? sched_config.max_interval_ms : next;
+    }
+
+    ESP_LOGI(TAG, "Activity %.1f%% -> interval %u ms", activity * 100.0f, (unsigned)interval_ms);
+}
+
+void capture_scheduler_record_bytes(size_t bytes) {
+    if (!scheduler_initialized) {
+        return;
+    }
+
+    budget_refill();
+    budget_tokens -= (int64_t)bytes;
+    average_frame_bytes = average_frame_bytes ? (average_frame_bytes * 7 + (uint32_t)bytes) / 8 : (uint32_t)bytes;
+}
+
+static void record_jitter(int64_t jitter_us) {
+    if (jitter_us > INT32_MAX) {
+        jitter_us = INT32_MAX;
+    } else if (jitter_us < INT32_MIN) {
+        jitter_us = INT32_MIN;
+    }
+
+    int32_t jitter = (int32_t)jitter_us;
+    int32_t magnitude = jitter < 0 ? -jitter : jitter;
+    sched_stats.last_jitter_us = jitter;
+    if (magnitude > sched_stats.max_jitter_us) {
+        sched_stats.max_jitter_us = magnitude;
+    }
+    sched_stats.total_jitter_us += magnitude;
+    sched_stats.timed_cycles++;
+
+    ESP_LOGD(TAG, "Cycle jitter %d us (max %d us, mean %lld us)", (int)jitter, (int)sched_stats.max_jitter_us,
+             (long long)(sched_stats.total_jitter_us / sched_stats.timed_cycles));
+}
+
+// Sleep until the next absolute tick deadline so processing time does not stretch the period
+static void wait_relative(uint32_t period_ms) {
+    TickType_t period = pdMS_TO_TICKS(period_ms);
+    TickType_t elapsed = xTaskGetTickCount() - last_wake;
+    slot_time = 0;
+    if (elapsed >= period) {
+        // Overran the deadline: start the next cycle now instead of bursting to catch up
+        sched_stats.overruns++;
+        ESP_LOGW(TAG, "Cycle overran interval by %u ms", (unsigned)pdTICKS_TO_MS(elapsed - period));
+        last_wake = xTaskGetTickCount();
+        return;
+    }
+
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)pdTICKS_TO_MS(period - elapsed) * 1000;
+    ESP_LOGI(TAG, "Next capture in %u ms", (unsigned)pdTICKS_TO_MS(period - elapsed));
+    xTaskDelayUntil(&last_wake, period);
+    record_jitter(esp_timer_get_time() - deadline_us);
+}
+
+// Sleep until the next wall-clock multiple of the period, so every camera in the fleet
+// with the same interval fires on the same boundaries (:00, :30, ...). Slots that were
+// missed while the pipeline overran are dropped rather than fired back to back.
+static void wait_aligned(uint32_t period_ms) {
+    int64_t now_ms = time_sync_now_ms();
+    int64_t boundary_ms = (now_ms / period_ms + 1) * period_ms;
+
+    if (last_slot_ms != 0 && last_slot_period_ms == period_ms) {
+        int64_t missed = (boundary_ms - last_slot_ms) / period_ms - 1;
+        if (missed > 0) {
+            sched_stats.overruns++;
+            sched_stats.skipped_slots += (uint32_t)missed;
+            ESP_LOGW(TAG, "Cycle overran, skipping %lld slot(s)", (long long)missed);
+        }
+    }
+
+    ESP_LOGI(TAG, "Next capture at slot %lld (in %lld ms)", (long long)(boundary_ms / 1000),
+             (long long)(boundary_ms - now_ms));
+
+    // Tick rounding can wake us slightly early; top up a tick at a time until the boundary passes
+    vTaskDelay(pdMS_TO_TICKS((uint32_t)(boundary_ms - now_ms)));
+    while ((now_ms = time_sync_now_ms()) < boundary_ms) {
+        vTaskDelay(1);
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    record_jitter((int64_t)tv.tv_sec * 1000000 + tv.tv_usec - boundary_ms * 1000);
+
+    last_slot_ms = boundary_ms;
+    last_slot_period_ms = period_ms;
+    slot_time = (time_t)(boundary_ms / 1000);
+    sched_stats.aligned_cycles++;
+
+    // Keep the tick deadline current in case the clock is lost and we fall back
+    last_wake = xTaskGetTickCount();
+}
+
+esp_err_t capture_scheduler_set_window(const char *expression) {
+    capture_window_t window;
+    esp_err_t err = capture_window_parse(expression, &window);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    capture_window = window;
+    window_restricted = !capture_window_is_always(&window);
+    ESP_LOGI(TAG, "Capture schedule: %s", window_restricted ? expression : "always");
+    return ESP_OK;
+}
+
+// Idle in low power until the first window that opens at or after `from`
+static void idle_until_window(time_t from) {
+    time_t now = time(NULL);
+    time_t start;
+    if (capture_window_next_start(&capture_window, from, &start) != ESP_OK) {
+        ESP_LOGE(TAG, "Capture schedule never becomes active, ignoring it");
+        window_restricted = false;
+        return;
+    }
+
+    ESP_LOGI(TAG, "Outside capture window, next window opens in %lld s", (long long)(start - now));
+    sched_stats.idle_periods++;
+
+    // Gaps shorter than the warm-up are not worth powering the camera down for
+    if (start - now > CAPTURE_WINDOW_WARMUP_S) {
+        power_manager_idle_until(start - CAPTURE_WINDOW_WARMUP_S);
+    }
+
+    int64_t start_ms = (int64_t)start * 1000;
+    int64_t now_ms;
+    while ((now_ms = time_sync_now_ms()) < start_ms) {
+        vTaskDelay(pdMS_TO_TICKS((uint32_t)(start_ms - now_ms)) + 1);
+    }
+
+    // Restart the cadence at the window boundary
+    slot_time = start;
+    last_slot_ms = 0;
+    last_wake = xTaskGetTickCount();
+}
+
+// Block while the current time is outside the capture schedule
+void capture_scheduler_wait_window(void) {
+    if (window_restricted && time_sync_is_synced() && !capture_window_contains(&capture_window, time(NULL))) {
+        idle_until_window(time(NULL));
+    }
+}
+
+void capture_scheduler_wait_next(void) {
+    if (!scheduler_initialized) {
+        vTaskDelay(pdMS_TO_TICKS(NUMBER_OF_SECONDS * 1000));
+        return;
+    }
+
+    budget_refill();
+
+    // The budget is a hard limit and may push the interval past max_interval_ms
+    uint32_t effective_ms = interval_ms;
+    uint32_t budget_ms = budget_interval_ms();
+    if (budget_ms > effective_ms) {
+        effective_ms = budget_ms;
+        sched_stats.budget_limited_cycles++;
+        ESP_LOGW(TAG, "Upload budget exhausted, stretching interval to %u ms", (unsigned)effective_ms);
+    }
+
+    sched_stats.cycles++;
+    sched_stats.interval_ms = effective_ms;
+
+    // If the next capture would fall outside the schedule, sleep through to the next window
+    if (window_restricted && time_sync_is_synced()) {
+        time_t next = time(NULL) + (effective_ms + 999) / 1000;
+        if (!capture_window_contains(&capture_window, next)) {
+            idle_until_window(next);
+            return;
+        }
+    }
+
+    if (sched_config.align_to_wall_clock && time_sync_is_synced()) {
+        // Whole seconds keep budget-stretched periods on readable boundaries
+        wait_aligned((effective_ms + 999) / 1000 * 1000);
+    } else {
+        wait_relative(effective_ms);
+    }
+}
+
+// Nominal wall-clock time of the cycle that just started, so frames are named after
+// their slot instead of whenever the capture happened to run
+time_t capture_scheduler_slot_time(void) {
+    return slot_time ? slot_time : time(NULL);
+}
+
+// This boot's number from NVS, counting boots that needed one
+static uint32_t current_boot_number(void) {
+    if (boot_number == 0) {
+        uint32_t previous = 0;
+        runtime_config_get_u32(RUNTIME_BOOT_COUNT_KEY, &previous);
+        boot_number = previous + 1;
+        if (runtime_config_set_u32(RUNTIME_BOOT_COUNT_KEY, boot_number) != ESP_OK) {
+            ESP_LOGW(TAG, "Boot count not saved, frame keys may repeat after a reboot");
+        }
+    }
+    return boot_number;
+}
+
+// The tag is a hash of the device ID rather than the ID itself: fleet names can be long,
+// and key plus tag plus spool extension has to fit a 31-character SPIFFS object name
+void capture_scheduler_set_device_id(const char *device_id) {
+    uint32_t hash = 2166136261u;                // FNV-1a
+    for (const char *p = device_id; p != NULL && *p != '\0'; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    snprintf(device_tag, sizeof(device_tag), "%08x", (unsigned)hash);
+    ESP_LOGI(TAG, "Frame keys end in _%s for device %s", device_tag, device_id ? device_id : "");
+}
+
+// Key naming the frame of the cycle that just started, <time>_<device tag>. Before the
+// clock is synced, time() restarts near 1970 on every boot, so those frames are named
+// after the boot count and uptime instead and can't overwrite frames spooled by an
+// earlier boot. Every upload mode derives its keys from this one.
+void capture_scheduler_frame_key(char *key, size_t max_len) {
+    if (time_sync_is_synced()) {
+        time_t when = capture_scheduler_slot_time();
+        struct tm timeinfo;
+        localtime_r(&when, &timeinfo);
+        strftime(key, max_len, "%Y%m%d_%H%M%S", &timeinfo);
+    } else {
+        snprintf(key, max_len, "b%05u_%08u", (unsigned)(current_boot_number() % 100000),
+                 (unsigned)(esp_timer_get_time() / 1000000));
+    }
+
+    size_t len = strlen(key);
+    if (device_tag[0] != '\0' && len < max_len) {
+        snprintf(key + len, max_len - len, "_%s", device_tag);
+    }
+}
+
+uint32_t capture_scheduler_get_interval_ms(void) {
+    return interval_ms;
+}
+
+void capture_scheduler_get_stats(capture_scheduler_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = sched_stats;
+    }
+}
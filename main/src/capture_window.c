@@ -0,0 +1,197 @@
+#include "capture_window.h"
+#include "esp_log.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "CAPTURE_WINDOW";
+
+// Search no further than this for the next active minute
+#define NEXT_START_SEARCH_DAYS 400
+
+static esp_err_t parse_number(const char **cursor, int *value) {
+    const char *p = *cursor;
+    if (!isdigit((unsigned char)*p)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int result = 0;
+    while (isdigit((unsigned char)*p)) {
+        result = result * 10 + (*p - '0');
+        if (result > 1000) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        p++;
+    }
+
+    *value = result;
+    *cursor = p;
+    return ESP_OK;
+}
+
+// Parse one whitespace-delimited field into a bitmask of allowed values in [min, max]
+static esp_err_t parse_field(const char **cursor, int min, int max, uint64_t *mask, bool *any) {
+    const char *p = *cursor;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *mask = 0;
+    *any = (p[0] == '*' && (p[1] == '\0' || p[1] == ' ' || p[1] == '\t'));
+
+    while (true) {
+        int start = min;
+        int end = max;
+        int step = 1;
+        bool single = false;
+
+        if (*p == '*') {
+            p++;
+        } else {
+            if (parse_number(&p, &start) != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            end = start;
+            single = true;
+            if (*p == '-') {
+                p++;
+                single = false;
+                if (parse_number(&p, &end) != ESP_OK) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+            }
+        }
+
+        if (*p == '/') {
+            p++;
+            if (parse_number(&p, &step) != ESP_OK || step == 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (single) {
+                end = max;  // "a/n" runs from a to the end of the range
+            }
+        }
+
+        if (start < min || end > max || start > end) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (int v = start; v <= end; v += step) {
+            *mask |= 1ULL << v;
+        }
+
+        if (*p != ',') {
+            break;
+        }
+        p++;
+    }
+
+    if (*p != '\0' && *p != ' ' && *p != '\t') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *cursor = p;
+    return ESP_OK;
+}
+
+esp_err_t capture_window_parse(const char *expression, capture_window_t *window) {
+    if (window == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // An empty schedule means always active
+    if (expression == NULL || expression[0] == '\0') {
+        return capture_window_parse("* * * * *", window);
+    }
+
+    const char *p = expression;
+    uint64_t minutes, hours, days, months, weekdays;
+    bool any_minute, any_hour, any_day, any_month, any_weekday;
+
+    if (parse_field(&p, 0, 59, &minutes, &any_minute) != ESP_OK ||
+        parse_field(&p, 0, 23, &hours, &any_hour) != ESP_OK ||
+        parse_field(&p, 1, 31, &days, &any_day) != ESP_OK ||
+        parse_field(&p, 1, 12, &months, &any_month) != ESP_OK ||
+        parse_field(&p, 0, 7, &weekdays, &any_weekday) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid capture schedule '%s'", expression);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p != '\0') {
+        ESP_LOGE(TAG, "Trailing characters in capture schedule '%s'", expression);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Day-of-week 7 is an alias for Sunday
+    if (weekdays & (1ULL << 7)) {
+        weekdays = (weekdays | 1ULL) & 0x7F;
+    }
+
+    window->minutes = minutes;
+    window->hours = (uint32_t)hours;
+    window->days = (uint32_t)days;
+    window->months = (uint16_t)months;
+    window->weekdays = (uint8_t)weekdays;
+    window->any_day = any_day;
+    window->any_weekday = any_weekday;
+    return ESP_OK;
+}
+
+bool capture_window_is_always(const capture_window_t *window) {
+    return window->minutes == 0x0FFFFFFFFFFFFFFFULL && window->hours == 0x00FFFFFF &&
+           window->months == 0x1FFE && window->any_day && window->any_weekday;
+}
+
+// Standard cron rule: when both day fields are restricted, either may match
+static bool day_matches(const capture_window_t *window, const struct tm *tm) {
+    bool dom = (window->days >> tm->tm_mday) & 1;
+    bool dow = (window->weekdays >> tm->tm_wday) & 1;
+    if (!window->any_day && !window->any_weekday) {
+        return dom || dow;
+    }
+    return dom && dow;
+}
+
+bool capture_window_contains(const capture_window_t *window, time_t when) {
+    struct tm tm;
+    localtime_r(&when, &tm);
+    return ((window->months >> (tm.tm_mon + 1)) & 1) && day_matches(window, &tm) &&
+           ((window->hours >> tm.tm_hour) & 1) && ((window->minutes >> tm.tm_min) & 1);
+}
+
+// First active minute at or after `from`, skipping whole days and hours that cannot match
+esp_err_t capture_window_next_start(const capture_window_t *window, time_t from, time_t *start) {
+    if (window == NULL || start == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (capture_window_contains(window, from)) {
+        *start = from;
+        return ESP_OK;
+    }
+
+    time_t t = from - (from % 60) + 60;
+    time_t limit = from + (time_t)NEXT_START_SEARCH_DAYS * 24 * 3600;
+    while (t < limit) {
+        struct tm tm;
+        localtime_r(&t, &tm);
+
+        if (!((window->months >> (tm.tm_mon + 1)) & 1) || !day_matches(window, &tm)) {
+            t += ((23 - tm.tm_hour) * 60 + (60 - tm.tm_min)) * 60;
+        } else if (!((window->hours >> tm.tm_hour) & 1)) {
+            t += (60 - tm.tm_min) * 60;
+        } else if (!((window->minutes >> tm.tm_min) & 1)) {
+            t += 60;
+        } else {
+            *start = t;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
@@ -2,7 +2,9 @@
 #include "config.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "cJSON.h"
+#include "freertos/FreeRTOS.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -14,6 +16,13 @@ static bool firebase_configured = false;
 static char http_response_buffer[HTTP_RESPONSE_BUFFER_SIZE];
 static int http_response_len = 0;
 
+// Rejected credentials or rules: image uploads are held until the backoff runs out, then
+// the next upload is tried and its answer decides. Read by every uploading task.
+static portMUX_TYPE auth_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t auth_retry_at_us;       // 0 while uploads are allowed
+static uint32_t auth_backoff_s;
+static int auth_status;                // Status that started the backoff, for logs
+
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
     switch (evt->event_id)
@@ -79,6 +88,115 @@ esp_err_t firebase_upload_image(const char *base64_image, const char *timestamp)
     return firebase_upload_image_with_metadata(base64_image, timestamp, NULL);
 }
 
+static bool status_is_auth_failure(int status) {
+    return status == 401 || status == 403;
+}
+
+static void auth_reject(int status) {
+    portENTER_CRITICAL(&auth_lock);
+    auth_backoff_s = (auth_backoff_s == 0) ? FIREBASE_AUTH_BACKOFF_MIN_S : auth_backoff_s * 2;
+    if (auth_backoff_s > FIREBASE_AUTH_BACKOFF_MAX_S) {
+        auth_backoff_s = FIREBASE_AUTH_BACKOFF_MAX_S;
+    }
+    uint32_t backoff_s = auth_backoff_s;
+    auth_retry_at_us = esp_timer_get_time() + (int64_t)backoff_s * 1000000;
+    auth_status = status;
+    portEXIT_CRITICAL(&auth_lock);
+
+    ESP_LOGW(TAG, "Database rejected the credentials (Status = %d), uploads paused for %lu s",
+             status, (unsigned long)backoff_s);
+}
+
+static void auth_accept(void) {
+    portENTER_CRITICAL(&auth_lock);
+    bool was_blocked = auth_retry_at_us != 0;
+    auth_retry_at_us = 0;
+    auth_backoff_s = 0;
+    auth_status = 0;
+    portEXIT_CRITICAL(&auth_lock);
+
+    if (was_blocked) {
+        ESP_LOGI(TAG, "Database accepts writes again, uploads resumed");
+    }
+}
+
+// True while the backoff runs; *status gets the status that started it
+static bool auth_blocked(uint32_t *retry_in_s, int *status) {
+    portENTER_CRITICAL(&auth_lock);
+    int64_t retry_at_us = auth_retry_at_us;
+    if (status != NULL) {
+        *status = auth_status;
+    }
+    portEXIT_CRITICAL(&auth_lock);
+
+    int64_t remaining_us = retry_at_us - esp_timer_get_time();
+    if (retry_at_us == 0 || remaining_us <= 0) {
+        return false;
+    }
+    if (retry_in_s != NULL) {
+        *retry_in_s = (uint32_t)((remaining_us + 999999) / 1000000);
+    }
+    return true;
+}
+
+bool firebase_upload_blocked(uint32_t *retry_in_s) {
+    return auth_blocked(retry_in_s, NULL);
+}
+
+// PUT body to <path>.json, streaming it after the headers so a dropped connection stops the write
+static esp_err_t put_streamed(const char *path, const char *body, size_t body_len, int *status) {
+    *status = 0;
+
+    char url[384];
+    snprintf(url, sizeof(url), "%s/%s.json?auth=%s",
+             firebase_config.database_url, path, firebase_config.api_key);
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_PUT,
+        .event_handler = http_event_handler,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_http_client_set_header(client, "Content-Type", "application/json");
+    esp_err_t err = esp_http_client_open(client, (int)body_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to PUT %s: %s", path, esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    size_t written = 0;
+    while (written < body_len) {
+        int n = esp_http_client_write(client, body + written, (int)(body_len - written));
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+
+    if (written < body_len) {
+        ESP_LOGE(TAG, "PUT %s dropped after %zu/%zu bytes", path, written, body_len);
+        err = ESP_FAIL;
+    } else if (esp_http_client_fetch_headers(client) < 0) {
+        ESP_LOGE(TAG, "No response to PUT %s", path);
+        err = ESP_FAIL;
+    } else {
+        *status = esp_http_client_get_status_code(client);
+        int discarded = 0;
+        esp_http_client_flush_response(client, &discarded);
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
 esp_err_t firebase_upload_image_with_metadata(const char* base64_image, const char* timestamp, const char* metadata) {
     if (!firebase_configured) {
         ESP_LOGE(TAG, "Firebase not configured");
@@ -90,6 +208,20 @@ esp_err_t firebase_upload_image_with_metadata(const char* base64_image, const ch
         return ESP_ERR_INVALID_ARG;
     }
 
+    // A rejected key stays rejected; don't send the image again until the backoff runs out.
+    // After that this upload is the probe: only the answer to a real image write says whether
+    // the credentials and rules accept images, a smaller test write could be judged differently.
+    uint32_t retry_in_s = 0;
+    int blocked_status = 0;
+    if (auth_blocked(&retry_in_s, &blocked_status)) {
+        ESP_LOGW(TAG, "Upload of %s skipped, credentials rejected (Status = %d), retry in %lu s",
+                 timestamp, blocked_status, (unsigned long)retry_in_s);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), "images/%s", timestamp);
+
     // Create JSON payload
     cJSON *json = cJSON_CreateObject();
     if (json == NULL) {
@@ -118,18 +250,46 @@ esp_err_t firebase_upload_image_with_metadata(const char* base64_image, const ch
     }
 
     char *json_string = cJSON_Print(json);
+    cJSON_Delete(json);
     if (json_string == NULL) {
         ESP_LOGE(TAG, "Failed to print JSON");
-        cJSON_Delete(json);
         return ESP_ERR_NO_MEM;
     }
 
-    // Create URL for Firebase Realtime Database
+    int status = 0;
+    esp_err_t err = put_streamed(path, json_string, strlen(json_string), &status);
+    free(json_string);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (status >= 200 && status < 300) {
+        ESP_LOGI(TAG, "Image uploaded successfully, Status = %d", status);
+        auth_accept();
+        return ESP_OK;
+    }
+
+    if (status_is_auth_failure(status)) {
+        auth_reject(status);
+    } else {
+        ESP_LOGE(TAG, "Image upload rejected, Status = %d", status);
+    }
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+esp_err_t firebase_put_json(const char *path, const char *json) {
+    if (!firebase_configured) {
+        ESP_LOGE(TAG, "Firebase not configured");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (path == NULL || json == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
     char url[384];
-    int url_len = snprintf(url, sizeof(url), "%s/images/%s.json?auth=%s",
-                           firebase_config.database_url,
-                           timestamp,
-                           firebase_config.api_key);
+    snprintf(url, sizeof(url), "%s/%s.json?auth=%s",
+             firebase_config.database_url, path, firebase_config.api_key);
 
     esp_http_client_config_t config = {
         .url = url,
@@ -139,20 +299,128 @@ esp_err_t firebase_upload_image_with_metadata(const char* base64_image, const ch
     };
 
     esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
     esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, json_string, strlen(json_string));
+    esp_http_client_set_post_field(client, json, strlen(json));
 
     esp_err_t err = esp_http_client_perform(client);
     if (err == ESP_OK) {
-        ESP_LOGI(TAG, "Image uploaded successfully, Status = %d", esp_http_client_get_status_code(client));
+        int status = esp_http_client_get_status_code(client);
+        if (status < 200 || status >= 300) {
+            ESP_LOGE(TAG, "PUT %s rejected, Status = %d", path, status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
     } else {
-        ESP_LOGE(TAG, "Failed to upload image: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to PUT %s: %s", path, esp_err_to_name(err));
     }
 
     esp_http_client_cleanup(client);
-    cJSON_Delete(json);
-    free(json_string);
+    return err;
+}
+
+// GET <path>.json into buf as a NUL-terminated string; query is appended to the URL if set
+esp_err_t firebase_get_json(const char *path, const char *query, char *buf, size_t max_len) {
+    if (!firebase_configured) {
+        ESP_LOGE(TAG, "Firebase not configured");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (path == NULL || buf == NULL || max_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char url[384];
+    snprintf(url, sizeof(url), "%s/%s.json?auth=%s%s%s",
+             firebase_config.database_url, path, firebase_config.api_key,
+             query ? "&" : "", query ? query : "");
 
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .event_handler = http_event_handler,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to GET %s: %s", path, esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+    int total = 0;
+    while (total < (int)max_len - 1) {
+        int n = esp_http_client_read(client, buf + total, max_len - 1 - total);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    buf[total] = '\0';
+
+    if (status < 200 || status >= 300) {
+        ESP_LOGE(TAG, "GET %s rejected, Status = %d", path, status);
+        err = ESP_ERR_INVALID_RESPONSE;
+    } else if (total == (int)max_len - 1) {
+        char extra;
+        if (esp_http_client_read(client, &extra, 1) > 0) {
+            ESP_LOGW(TAG, "GET %s response truncated at %d bytes", path, total);
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+esp_err_t firebase_delete(const char *path) {
+    if (!firebase_configured) {
+        ESP_LOGE(TAG, "Firebase not configured");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char url[384];
+    snprintf(url, sizeof(url), "%s/%s.json?auth=%s",
+             firebase_config.database_url, path, firebase_config.api_key);
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_DELETE,
+        .event_handler = http_event_handler,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = esp_http_client_perform(client);
+    if (err == ESP_OK) {
+        int status = esp_http_client_get_status_code(client);
+        if (status < 200 || status >= 300) {
+            ESP_LOGE(TAG, "DELETE %s rejected, Status = %d", path, status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    } else {
+        ESP_LOGE(TAG, "Failed to DELETE %s: %s", path, esp_err_to_name(err));
+    }
+
+    esp_http_client_cleanup(client);
     return err;
 }
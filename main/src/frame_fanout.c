@@ -0,0 +1,325 @@
+#include "frame_fanout.h"
+#include "config.h"
+#include "jpeg_utils.h"
+#include "psram_stage.h"
+#include "task_plan.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "FANOUT";
+
+// One captured frame shared by all sinks; freed when the last sink releases it
+typedef struct {
+    uint8_t *jpeg;
+    size_t jpeg_len;
+    char *base64;               // Encoded on first use, then shared
+    size_t base64_len;
+    SemaphoreHandle_t encode_lock;
+    int refcount;
+    char timestamp[64];
+    char metadata[128];
+} fanout_frame_t;
+
+typedef struct {
+    const uploader_backend_t *backend;
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    fanout_sink_stats_t stats;
+    int pending;                // Queued plus in submit(), under fanout_lock
+} fanout_sink_t;
+
+static fanout_sink_t sinks[FANOUT_MAX_SINKS];
+static int sink_count = 0;
+static bool fanout_initialized = false;
+static portMUX_TYPE fanout_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void *fanout_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+static void sink_pending_add(fanout_sink_t *sink, int delta) {
+    portENTER_CRITICAL(&fanout_lock);
+    sink->pending += delta;
+    portEXIT_CRITICAL(&fanout_lock);
+}
+
+static int sink_pending(fanout_sink_t *sink) {
+    portENTER_CRITICAL(&fanout_lock);
+    int pending = sink->pending;
+    portEXIT_CRITICAL(&fanout_lock);
+    return pending;
+}
+
+static void frame_release(fanout_frame_t *frame) {
+    portENTER_CRITICAL(&fanout_lock);
+    int remaining = --frame->refcount;
+    portEXIT_CRITICAL(&fanout_lock);
+
+    if (remaining > 0) {
+        return;
+    }
+
+    vSemaphoreDelete(frame->encode_lock);
+    free(frame->base64);
+    free(frame->jpeg);
+    free(frame);
+}
+
+// The first base64 sink pays for the encoding; later ones reuse the result
+static esp_err_t frame_ensure_base64(fanout_frame_t *frame) {
+    xSemaphoreTake(frame->encode_lock, portMAX_DELAY);
+
+    esp_err_t err = ESP_OK;
+    if (frame->base64 == NULL) {
+        jpeg_ranges_t ranges;
+        jpeg_ranges_whole(frame->jpeg_len, &ranges);
+        size_t encoded_len = jpeg_ranges_base64_len(&ranges) + 1;
+        char *encoded = fanout_alloc(encoded_len);
+        size_t actual_len = 0;
+        if (encoded == NULL) {
+            err = ESP_ERR_NO_MEM;
+        } else if ((err = psram_stage_base64(frame->jpeg, &ranges, encoded, encoded_len, &actual_len, NULL)) != ESP_OK) {
+            free(encoded);
+        } else {
+            frame->base64 = encoded;
+            frame->base64_len = actual_len;
+        }
+    }
+
+    xSemaphoreGive(frame->encode_lock);
+    return err;
+}
+
+static void sink_task(void *pvParameters) {
+    fanout_sink_t *sink = (fanout_sink_t *)pvParameters;
+    fanout_frame_t *frame = NULL;
+
+    while (1) {
+        if (xQueueReceive(sink->queue, &frame, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        esp_err_t err = ESP_OK;
+        if (sink->backend->encoding == UPLOADER_ENCODING_BASE64) {
+            err = frame_ensure_base64(frame);
+        }
+
+        if (err == ESP_OK) {
+            uploader_frame_t upload = {
+                .jpeg = frame->jpeg,
+                .jpeg_len = frame->jpeg_len,
+                .base64 = frame->base64,
+                .base64_len = frame->base64_len,
+                .timestamp = frame->timestamp,
+                .metadata = frame->metadata[0] ? frame->metadata : NULL,
+            };
+            err = sink->backend->submit(&upload);
+        }
+
+        if (err != ESP_OK) {
+            // Failures stay inside this sink; the others are unaffected
+            sink->stats.frames_failed++;
+            ESP_LOGW(TAG, "[%s] frame %s failed: %s", sink->backend->name, frame->timestamp, esp_err_to_name(err));
+        }
+
+        frame_release(frame);
+        sink_pending_add(sink, -1);
+    }
+}
+
+esp_err_t fanout_init(void) {
+    if (fanout_initialized) {
+        return ESP_OK;
+    }
+
+    memset(sinks, 0, sizeof(sinks));
+    sink_count = 0;
+    fanout_initialized = true;
+    ESP_LOGI(TAG, "Fan-out initialized");
+    return ESP_OK;
+}
+
+esp_err_t fanout_add_sink(const uploader_backend_t *backend, const void *config, size_t queue_depth) {
+    if (!fanout_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (backend == NULL || queue_depth == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sink_count >= FANOUT_MAX_SINKS) {
+        ESP_LOGE(TAG, "Maximum of %d sinks reached", FANOUT_MAX_SINKS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = backend->init(config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sink %s failed to initialize: %s", backend->name, esp_err_to_name(err));
+        return err;
+    }
+
+    fanout_sink_t *sink = &sinks[sink_count];
+    sink->backend = backend;
+    sink->stats.name = backend->name;
+    sink->queue = xQueueCreate(queue_depth, sizeof(fanout_frame_t *));
+    if (sink->queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    char task_name[16];
+    snprintf(task_name, sizeof(task_name), "sink_%s", backend->name);
+    if (task_plan_create(TASK_PLAN_FANOUT_SINK, sink_task, sink, task_name, &sink->task) != ESP_OK) {
+        vQueueDelete(sink->queue);
+        sink->queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    sink_count++;
+    ESP_LOGI(TAG, "Added sink %s (%s, queue depth %zu)", backend->name,
+             backend->encoding == UPLOADER_ENCODING_BASE64 ? "base64" : "raw", queue_depth);
+    return ESP_OK;
+}
+
+esp_err_t fanout_dispatch(const uint8_t *jpeg, size_t jpeg_len, const char *timestamp, const char *metadata) {
+    if (!fanout_initialized || sink_count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (jpeg == NULL || jpeg_len == 0 || timestamp == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Copy once so the camera buffer can be returned before any sink runs;
+    // the copy gathers only the sanitized spans
+    jpeg_ranges_t ranges;
+#if JPEG_SANITIZE_ENABLED
+    jpeg_sanitize(jpeg, jpeg_len, &ranges);
+#else
+    jpeg_ranges_whole(jpeg_len, &ranges);
+#endif
+
+    fanout_frame_t *frame = calloc(1, sizeof(fanout_frame_t));
+    if (frame == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    frame->jpeg = fanout_alloc(ranges.total_len);
+    frame->encode_lock = xSemaphoreCreateMutex();
+    if (frame->jpeg == NULL || frame->encode_lock == NULL) {
+        if (frame->encode_lock != NULL) {
+            vSemaphoreDelete(frame->encode_lock);
+        }
+        free(frame->jpeg);
+        free(frame);
+        ESP_LOGE(TAG, "Failed to allocate %zu byte frame copy", ranges.total_len);
+        return ESP_ERR_NO_MEM;
+    }
+    jpeg_ranges_copy(jpeg, &ranges, frame->jpeg);
+    frame->jpeg_len = ranges.total_len;
+    strncpy(frame->timestamp, timestamp, sizeof(frame->timestamp) - 1);
+    if (metadata != NULL) {
+        strncpy(frame->metadata, metadata, sizeof(frame->metadata) - 1);
+    }
+
+    // Hold a dispatch reference so early-finishing sinks cannot free the frame mid-loop
+    frame->refcount = 1 + sink_count;
+
+    for (int i = 0; i < sink_count; i++) {
+        fanout_sink_t *sink = &sinks[i];
+
+        // Never block the capture task: a full queue evicts its oldest frame
+        if (xQueueSend(sink->queue, &frame, 0) != pdTRUE) {
+            fanout_frame_t *oldest = NULL;
+            if (xQueueReceive(sink->queue, &oldest, 0) == pdTRUE) {
+                sink->stats.frames_dropped++;
+                ESP_LOGW(TAG, "[%s] queue full, dropped frame %s", sink->backend->name, oldest->timestamp);
+                frame_release(oldest);
+                sink_pending_add(sink, -1);
+            }
+            if (xQueueSend(sink->queue, &frame, 0) != pdTRUE) {
+                sink->stats.frames_dropped++;
+                frame_release(frame);
+                continue;
+            }
+        }
+        sink->stats.frames_queued++;
+        sink_pending_add(sink, 1);
+    }
+
+    frame_release(frame);
+    return ESP_OK;
+}
+
+// Lets every sink work through its queue, then flushes each backend in the time left
+esp_err_t fanout_flush(uint32_t timeout_ms) {
+    if (!fanout_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    esp_err_t result = ESP_OK;
+
+    for (int i = 0; i < sink_count; i++) {
+        fanout_sink_t *sink = &sinks[i];
+        while (sink_pending(sink) > 0 && esp_timer_get_time() < deadline) {
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+
+        int pending = sink_pending(sink);
+        if (pending > 0) {
+            ESP_LOGW(TAG, "[%s] %d frame(s) still queued at the flush deadline", sink->backend->name, pending);
+            result = ESP_ERR_TIMEOUT;
+            continue;
+        }
+
+        int64_t remaining_ms = (deadline - esp_timer_get_time()) / 1000;
+        esp_err_t err = sink->backend->flush(remaining_ms > 0 ? (uint32_t)remaining_ms : 0);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "[%s] flush failed: %s", sink->backend->name, esp_err_to_name(err));
+            if (result == ESP_OK) {
+                result = err;
+            }
+        }
+    }
+    return result;
+}
+
+int fanout_get_sink_count(void) {
+    return sink_count;
+}
+
+esp_err_t fanout_get_sink_stats(int index, fanout_sink_stats_t *stats) {
+    if (index < 0 || index >= sink_count || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = sinks[index].stats;
+    stats->queue_depth = uxQueueMessagesWaiting(sinks[index].queue);
+    return ESP_OK;
+}
+
+void fanout_log_stats(void) {
+    for (int i = 0; i < sink_count; i++) {
+        fanout_sink_stats_t stats;
+        uploader_stats_t upload_stats;
+
+        fanout_get_sink_stats(i, &stats);
+        sinks[i].backend->get_stats(&upload_stats);
+        ESP_LOGI(TAG, "[%s] queued=%u dropped=%u failed=%u waiting=%u",
+                 stats.name, (unsigned)stats.frames_queued, (unsigned)stats.frames_dropped,
+                 (unsigned)stats.frames_failed, (unsigned)stats.queue_depth);
+        uploader_log_stats(stats.name, &upload_stats);
+    }
+}
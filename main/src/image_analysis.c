@@ -0,0 +1,165 @@
+#include "image_analysis.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "img_converters.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "IMAGE_ANALYSIS";
+
+static void *analysis_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+// Decode at the coarsest JPEG scale that still yields at least min_width columns.
+// Scaled decoding skips the IDCT work for dropped pixels, so a 1/8 decode is cheap.
+esp_err_t image_analysis_rgb565_from_jpeg(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                          uint16_t min_width, uint8_t **rgb565, uint16_t *out_width,
+                                          uint16_t *out_height) {
+    if (jpeg == NULL || len == 0 || width == 0 || height == 0 || rgb565 == NULL ||
+        out_width == NULL || out_height == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jpg_scale_t scale = JPG_SCALE_8X;
+    int divisor = 8;
+    while (divisor > 1 && width / divisor < min_width) {
+        scale = (jpg_scale_t)(scale - 1);
+        divisor /= 2;
+    }
+
+    uint16_t scaled_width = width / divisor;
+    uint16_t scaled_height = height / divisor;
+    size_t buffer_len = (size_t)scaled_width * scaled_height * 2;
+
+    uint8_t *buffer = analysis_alloc(buffer_len);
+    if (buffer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte decode buffer", buffer_len);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (!jpg2rgb565(jpeg, len, buffer, scale)) {
+        ESP_LOGW(TAG, "JPEG decode failed (%zu bytes)", len);
+        free(buffer);
+        return ESP_FAIL;
+    }
+
+    *rgb565 = buffer;
+    *out_width = scaled_width;
+    *out_height = scaled_height;
+    return ESP_OK;
+}
+
+esp_err_t image_analysis_gray_from_jpeg(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                        uint16_t min_width, gray_image_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *rgb565 = NULL;
+    uint16_t out_width = 0;
+    uint16_t out_height = 0;
+    esp_err_t err = image_analysis_rgb565_from_jpeg(jpeg, len, width, height, min_width,
+                                                    &rgb565, &out_width, &out_height);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Convert in place: the grayscale result fits in the first half of the buffer
+    size_t pixel_count = (size_t)out_width * out_height;
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint8_t hi = rgb565[2 * i];
+        uint8_t lo = rgb565[2 * i + 1];
+        uint32_t r = hi & 0xF8;
+        uint32_t g = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+        uint32_t b = (lo & 0x1F) << 3;
+        rgb565[i] = (uint8_t)((77 * r + 150 * g + 29 * b) >> 8);
+    }
+
+    out->pixels = rgb565;
+    out->width = out_width;
+    out->height = out_height;
+    return ESP_OK;
+}
+
+void image_analysis_free(gray_image_t *image) {
+    if (image != NULL) {
+        free(image->pixels);
+        image->pixels = NULL;
+        image->width = 0;
+        image->height = 0;
+    }
+}
+
+// Fraction of pixels whose luminance moved by more than pixel_threshold
+float image_analysis_change_ratio(const gray_image_t *previous, const gray_image_t *current, uint8_t pixel_threshold) {
+    if (previous == NULL || current == NULL || previous->pixels == NULL || current->pixels == NULL ||
+        previous->width != current->width || previous->height != current->height) {
+        return 1.0f;  // Nothing comparable: treat as a scene change
+    }
+
+    size_t pixel_count = (size_t)current->width * current->height;
+    size_t changed = 0;
+    for (size_t i = 0; i < pixel_count; i++) {
+        int diff = (int)current->pixels[i] - (int)previous->pixels[i];
+        if (diff > pixel_threshold || -diff > pixel_threshold) {
+            changed++;
+        }
+    }
+
+    return pixel_count ? (float)changed / (float)pixel_count : 0.0f;
+}
+
+// Single pass for the histogram, a second over the interior for the Laplacian.
+// A focused image has strong second derivatives at edges, so a low variance means blur.
+esp_err_t image_analysis_quality(const gray_image_t *image, uint8_t dark_level, uint8_t bright_level,
+                                 image_quality_t *quality) {
+    if (image == NULL || image->pixels == NULL || quality == NULL || image->width < 3 || image->height < 3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(quality, 0, sizeof(*quality));
+
+    const uint8_t *px = image->pixels;
+    size_t pixel_count = (size_t)image->width * image->height;
+    uint64_t luma_sum = 0;
+    size_t dark = 0;
+    size_t bright = 0;
+
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint8_t v = px[i];
+        quality->histogram[v * IMAGE_HISTOGRAM_BINS / 256]++;
+        luma_sum += v;
+        dark += v <= dark_level;
+        bright += v >= bright_level;
+    }
+
+    int64_t lap_sum = 0;
+    int64_t lap_sq_sum = 0;
+    size_t w = image->width;
+    for (size_t y = 1; y + 1 < image->height; y++) {
+        const uint8_t *row = px + y * w;
+        for (size_t x = 1; x + 1 < w; x++) {
+            int lap = 4 * row[x] - row[x - 1] - row[x + 1] - row[x - w] - row[x + w];
+            lap_sum += lap;
+            lap_sq_sum += (int64_t)lap * lap;
+        }
+    }
+
+    size_t interior = (image->width - 2) * (size_t)(image->height - 2);
+    float lap_mean = (float)lap_sum / (float)interior;
+
+    quality->mean_luma = (float)luma_sum / (float)pixel_count;
+    quality->dark_fraction = (float)dark / (float)pixel_count;
+    quality->bright_fraction = (float)bright / (float)pixel_count;
+    quality->sharpness = (float)lap_sq_sum / (float)interior - lap_mean * lap_mean;
+    return ESP_OK;
+}
@@ -0,0 +1,885 @@
+#include "jpeg_codec.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Marker codes
+#define M_SOF0 0xC0
+#define M_SOF1 0xC1
+#define M_DHT 0xC4
+#define M_SOI 0xD8
+#define M_EOI 0xD9
+#define M_SOS 0xDA
+#define M_DQT 0xDB
+#define M_DRI 0xDD
+#define M_APP0 0xE0
+#define M_APP14 0xEE
+#define M_APP15 0xEF
+#define M_COM 0xFE
+
+#define LOOKAHEAD_BITS 8
+
+// ---- Huffman tables ----
+
+static esp_err_t derive_table(jpeg_huff_table_t *t) {
+    uint8_t huffsize[257];
+    uint16_t huffcode[257];
+    int p = 0;
+
+    for (int l = 1; l <= 16; l++) {
+        for (int i = 0; i < t->bits[l]; i++) {
+            if (p >= 256) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            huffsize[p++] = (uint8_t)l;
+        }
+    }
+    huffsize[p] = 0;
+    int count = p;
+
+    uint32_t code = 0;
+    int si = huffsize[0];
+    p = 0;
+    while (huffsize[p]) {
+        while (huffsize[p] == si) {
+            huffcode[p++] = (uint16_t)code++;
+        }
+        if (code > (1U << si)) {
+            return ESP_ERR_INVALID_ARG;  // Over-subscribed code space
+        }
+        code <<= 1;
+        si++;
+    }
+
+    p = 0;
+    for (int l = 1; l <= 16; l++) {
+        if (t->bits[l]) {
+            t->valoffset[l] = p - huffcode[p];
+            p += t->bits[l];
+            t->maxcode[l] = huffcode[p - 1];
+        } else {
+            t->maxcode[l] = -1;
+        }
+    }
+    t->maxcode[17] = 0x7FFFFFFF;
+
+    memset(t->look_len, 0, sizeof(t->look_len));
+    memset(t->ehufsi, 0, sizeof(t->ehufsi));
+    for (p = 0; p < count; p++) {
+        int l = huffsize[p];
+        uint8_t sym = t->huffval[p];
+        t->ehufco[sym] = huffcode[p];
+        t->ehufsi[sym] = (uint8_t)l;
+        if (l <= LOOKAHEAD_BITS) {
+            int base = huffcode[p] << (LOOKAHEAD_BITS - l);
+            for (int i = 0; i < (1 << (LOOKAHEAD_BITS - l)); i++) {
+                t->look_len[base + i] = (uint8_t)l;
+                t->look_sym[base + i] = sym;
+            }
+        }
+    }
+
+    t->defined = true;
+    return ESP_OK;
+}
+
+// Annex K.2 code lengths limited to 16 bits, as in libjpeg's jpeg_gen_optimal_table
+static void build_optimal_table(const uint32_t freq_in[257], jpeg_huff_table_t *t) {
+    uint32_t freq[257];
+    uint8_t codesize[257];
+    int16_t others[257];
+    uint8_t bits[33];
+
+    memcpy(freq, freq_in, sizeof(freq));
+    freq[256] = 1;  // Reserved point so no real code is all ones
+    memset(codesize, 0, sizeof(codesize));
+    for (int i = 0; i < 257; i++) {
+        others[i] = -1;
+    }
+
+    while (true) {
+        int c1 = -1;
+        int c2 = -1;
+        uint32_t v = UINT32_MAX;
+        for (int i = 0; i <= 256; i++) {
+            if (freq[i] && freq[i] <= v) {
+                v = freq[i];
+                c1 = i;
+            }
+        }
+        v = UINT32_MAX;
+        for (int i = 0; i <= 256; i++) {
+            if (freq[i] && freq[i] <= v && i != c1) {
+                v = freq[i];
+                c2 = i;
+            }
+        }
+        if (c2 < 0) {
+            break;
+        }
+
+        freq[c1] += freq[c2];
+        freq[c2] = 0;
+
+        codesize[c1]++;
+        while (others[c1] >= 0) {
+            c1 = others[c1];
+            codesize[c1]++;
+        }
+        others[c1] = (int16_t)c2;
+
+        codesize[c2]++;
+        while (others[c2] >= 0) {
+            c2 = others[c2];
+            codesize[c2]++;
+        }
+    }
+
+    memset(bits, 0, sizeof(bits));
+    for (int i = 0; i <= 256; i++) {
+        if (codesize[i]) {
+            bits[codesize[i] > 32 ? 32 : codesize[i]]++;
+        }
+    }
+
+    for (int i = 32; i > 16; i--) {
+        while (bits[i] > 0) {
+            int j = i - 2;
+            while (bits[j] == 0) {
+                j--;
+            }
+            bits[i] -= 2;
+            bits[i - 1]++;
+            bits[j + 1] += 2;
+            bits[j]--;
+        }
+    }
+
+    int i = 16;
+    while (bits[i] == 0) {
+        i--;
+    }
+    bits[i]--;  // Drop the reserved symbol
+
+    memset(t, 0, sizeof(*t));
+    memcpy(t->bits, bits, 17);
+    int p = 0;
+    for (int size = 1; size <= 32; size++) {
+        for (int sym = 0; sym < 256; sym++) {
+            if (codesize[sym] == size) {
+                t->huffval[p++] = (uint8_t)sym;
+            }
+        }
+    }
+}
+
+esp_err_t jpeg_tables_optimize(jpeg_table_set_t *tables, const jpeg_frame_t *frame,
+                               const jpeg_symbol_counts_t *counts) {
+    memset(tables->dc_used, 0, sizeof(tables->dc_used));
+    memset(tables->ac_used, 0, sizeof(tables->ac_used));
+    for (int i = 0; i < frame->scan_ncomps; i++) {
+        tables->dc_used[frame->comps[frame->scan_comp[i]].dc_tbl] = true;
+        tables->ac_used[frame->comps[frame->scan_comp[i]].ac_tbl] = true;
+    }
+
+    for (int id = 0; id < 4; id++) {
+        esp_err_t err;
+        if (tables->dc_used[id]) {
+            build_optimal_table(counts->dc[id], &tables->dc[id]);
+            if ((err = derive_table(&tables->dc[id])) != ESP_OK) {
+                return err;
+            }
+        }
+        if (tables->ac_used[id]) {
+            build_optimal_table(counts->ac[id], &tables->ac[id]);
+            if ((err = derive_table(&tables->ac[id])) != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+// The frame's own tables, for re-encoding without a counting pass
+void jpeg_tables_from_frame(jpeg_table_set_t *tables, const jpeg_frame_t *frame) {
+    memset(tables->dc_used, 0, sizeof(tables->dc_used));
+    memset(tables->ac_used, 0, sizeof(tables->ac_used));
+    for (int i = 0; i < frame->scan_ncomps; i++) {
+        uint8_t dc = frame->comps[frame->scan_comp[i]].dc_tbl;
+        uint8_t ac = frame->comps[frame->scan_comp[i]].ac_tbl;
+        if (!tables->dc_used[dc]) {
+            tables->dc[dc] = frame->dc[dc];
+            tables->dc_used[dc] = true;
+        }
+        if (!tables->ac_used[ac]) {
+            tables->ac[ac] = frame->ac[ac];
+            tables->ac_used[ac] = true;
+        }
+    }
+}
+
+// ---- Headers ----
+
+static esp_err_t parse_dht(jpeg_frame_t *frame, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        if (len < 17) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        uint8_t tc = p[0] >> 4;
+        uint8_t th = p[0] & 0x0F;
+        if (tc > 1 || th > 3) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        jpeg_huff_table_t *t = tc ? &frame->ac[th] : &frame->dc[th];
+        memset(t, 0, sizeof(*t));
+        size_t count = 0;
+        for (int l = 1; l <= 16; l++) {
+            t->bits[l] = p[l];
+            count += p[l];
+        }
+        if (count > 256 || len < 17 + count) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(t->huffval, p + 17, count);
+
+        esp_err_t err = derive_table(t);
+        if (err != ESP_OK) {
+            return err;
+        }
+        p += 17 + count;
+        len -= 17 + count;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_dqt(jpeg_frame_t *frame, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        uint8_t pq = p[0] >> 4;
+        uint8_t tq = p[0] & 0x0F;
+        size_t size = 1 + (pq ? 128 : 64);
+        if (pq > 1 || tq > 3 || len < size) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (int k = 0; k < 64; k++) {
+            frame->quant[tq][k] = pq ? (uint16_t)((p[1 + 2 * k] << 8) | p[2 + 2 * k]) : p[1 + k];
+        }
+        p += size;
+        len -= size;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sof(jpeg_frame_t *frame, const uint8_t *p, size_t len) {
+    if (len < 6) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frame->height = (uint16_t)((p[1] << 8) | p[2]);
+    frame->width = (uint16_t)((p[3] << 8) | p[4]);
+    frame->ncomps = p[5];
+    if (frame->ncomps < 1 || frame->ncomps > JPEG_MAX_COMPONENTS || len < 6 + 3 * (size_t)frame->ncomps ||
+        frame->width == 0 || frame->height == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    frame->hmax = 1;
+    frame->vmax = 1;
+    for (int i = 0; i < frame->ncomps; i++) {
+        jpeg_component_t *c = &frame->comps[i];
+        c->id = p[6 + 3 * i];
+        c->h = p[7 + 3 * i] >> 4;
+        c->v = p[7 + 3 * i] & 0x0F;
+        c->tq = p[8 + 3 * i] & 0x03;
+        if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        frame->hmax = c->h > frame->hmax ? c->h : frame->hmax;
+        frame->vmax = c->v > frame->vmax ? c->v : frame->vmax;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sos(jpeg_frame_t *frame, const uint8_t *p, size_t len) {
+    if (len < 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frame->scan_ncomps = p[0];
+    if (frame->scan_ncomps < 1 || frame->scan_ncomps > frame->ncomps ||
+        len != 4 + 2 * (size_t)frame->scan_ncomps) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (frame->scan_ncomps != frame->ncomps) {
+        return ESP_ERR_NOT_SUPPORTED;  // Non-interleaved multi-scan file
+    }
+
+    for (int i = 0; i < frame->scan_ncomps; i++) {
+        uint8_t id = p[1 + 2 * i];
+        int index = -1;
+        for (int c = 0; c < frame->ncomps; c++) {
+            if (frame->comps[c].id == id) {
+                index = c;
+            }
+        }
+        if (index < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        jpeg_component_t *c = &frame->comps[index];
+        frame->scan_comp[i] = index;
+        c->dc_tbl = p[2 + 2 * i] >> 4;
+        c->ac_tbl = p[2 + 2 * i] & 0x0F;
+        if (c->dc_tbl > 3 || c->ac_tbl > 3 || !frame->dc[c->dc_tbl].defined || !frame->ac[c->ac_tbl].defined) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    const uint8_t *tail = p + 1 + 2 * frame->scan_ncomps;
+    if (tail[0] != 0 || tail[1] != 63 || tail[2] != 0) {
+        return ESP_ERR_NOT_SUPPORTED;  // Not a baseline sequential scan
+    }
+
+    if (frame->scan_ncomps > 1) {
+        frame->mcu_width = (uint8_t)(8 * frame->hmax);
+        frame->mcu_height = (uint8_t)(8 * frame->vmax);
+        frame->mcus_x = (frame->width + frame->mcu_width - 1) / frame->mcu_width;
+        frame->mcus_y = (frame->height + frame->mcu_height - 1) / frame->mcu_height;
+        frame->blocks_in_mcu = 0;
+        for (int i = 0; i < frame->scan_ncomps; i++) {
+            const jpeg_component_t *c = &frame->comps[frame->scan_comp[i]];
+            for (int b = 0; b < c->h * c->v; b++) {
+                if (frame->blocks_in_mcu >= JPEG_MAX_BLOCKS_IN_MCU) {
+                    return ESP_ERR_NOT_SUPPORTED;
+                }
+                frame->block_comp[frame->blocks_in_mcu++] = (uint8_t)frame->scan_comp[i];
+            }
+        }
+    } else {
+        // Single component: one block per MCU over the component's own dimensions
+        const jpeg_component_t *c = &frame->comps[frame->scan_comp[0]];
+        uint32_t comp_w = (frame->width * c->h + frame->hmax - 1) / frame->hmax;
+        uint32_t comp_h = (frame->height * c->v + frame->vmax - 1) / frame->vmax;
+        frame->mcu_width = (uint8_t)(8 * frame->hmax / c->h);
+        frame->mcu_height = (uint8_t)(8 * frame->vmax / c->v);
+        frame->mcus_x = (comp_w + 7) / 8;
+        frame->mcus_y = (comp_h + 7) / 8;
+        frame->blocks_in_mcu = 1;
+        frame->block_comp[0] = (uint8_t)frame->scan_comp[0];
+    }
+    return ESP_OK;
+}
+
+// Parse the tables up to the start of scan data and record the segments worth keeping
+esp_err_t jpeg_frame_parse(const uint8_t *jpeg, size_t len, jpeg_frame_t *frame) {
+    if (jpeg == NULL || frame == NULL || len < 4 || jpeg[0] != 0xFF || jpeg[1] != M_SOI) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(frame, 0, sizeof(*frame));
+
+    bool have_sof = false;
+    size_t pos = 2;
+    while (true) {
+        while (pos + 1 < len && jpeg[pos] == 0xFF && jpeg[pos + 1] == 0xFF) {
+            pos++;
+        }
+        if (pos + 4 > len || jpeg[pos] != 0xFF) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        uint8_t marker = jpeg[pos + 1];
+        size_t seg_len = ((size_t)jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (seg_len < 2 || pos + 2 + seg_len > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        const uint8_t *body = jpeg + pos + 4;
+        size_t body_len = seg_len - 2;
+        esp_err_t err = ESP_OK;
+        bool keep = true;
+
+        if (marker == M_SOF0 || marker == M_SOF1) {
+            err = parse_sof(frame, body, body_len);
+            have_sof = true;
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != M_DHT) {
+            return ESP_ERR_NOT_SUPPORTED;  // Progressive, lossless, hierarchical or arithmetic
+        } else if (marker == M_DHT) {
+            err = parse_dht(frame, body, body_len);
+            keep = false;
+        } else if (marker == M_DQT) {
+            err = parse_dqt(frame, body, body_len);
+        } else if (marker == M_DRI) {
+            if (body_len < 2) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            frame->restart_interval = (uint16_t)((body[0] << 8) | body[1]);
+        } else if (marker == M_SOS) {
+            if (!have_sof) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            frame->sos.offset = pos;
+            frame->sos.len = seg_len + 2;
+            frame->sos.marker = marker;
+            frame->scan_start = pos + 2 + seg_len;
+            return parse_sos(frame, body, body_len);
+        } else if ((marker >= M_APP0 && marker <= M_APP15 && marker != M_APP14) || marker == M_COM) {
+            keep = false;
+        }
+
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (keep) {
+            if (frame->segment_count >= JPEG_MAX_HEADER_SEGMENTS) {
+                return ESP_ERR_NO_MEM;
+            }
+            frame->segments[frame->segment_count].offset = pos;
+            frame->segments[frame->segment_count].len = seg_len + 2;
+            frame->segments[frame->segment_count].marker = marker;
+            frame->segment_count++;
+        }
+        pos += 2 + seg_len;
+    }
+}
+
+// ---- Scan reading ----
+
+static inline void reader_fill(jpeg_reader_t *r) {
+    while (r->bits <= 24) {
+        uint8_t b = 0;
+        if (!r->marker && r->pos < r->len) {
+            b = r->buf[r->pos];
+            if (b == 0xFF) {
+                uint8_t next = (r->pos + 1 < r->len) ? r->buf[r->pos + 1] : M_EOI;
+                if (next == 0x00) {
+                    r->pos += 2;
+                } else {
+                    r->marker = true;
+                    b = 0;
+                }
+            } else {
+                r->pos++;
+            }
+        } else {
+            r->zero_bytes++;
+        }
+        r->acc |= (uint32_t)b << (24 - r->bits);
+        r->bits += 8;
+        r->bits_fed += 8;
+    }
+}
+
+static inline int32_t reader_value(jpeg_reader_t *r, int n) {
+    reader_fill(r);
+    int32_t v = (int32_t)(r->acc >> (32 - n));
+    r->acc <<= n;
+    r->bits -= n;
+    // Sign extension of the magnitude category (F.2.2.1)
+    return v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+}
+
+static inline int reader_symbol(jpeg_reader_t *r, const jpeg_huff_table_t *t) {
+    reader_fill(r);
+    unsigned look = r->acc >> (32 - LOOKAHEAD_BITS);
+    int l = t->look_len[look];
+    if (l) {
+        r->acc <<= l;
+        r->bits -= l;
+        return t->look_sym[look];
+    }
+
+    l = LOOKAHEAD_BITS + 1;
+    int32_t code = (int32_t)(r->acc >> (32 - l));
+    while (l <= 16 && code > t->maxcode[l]) {
+        l++;
+        code = (int32_t)(r->acc >> (32 - l));
+    }
+    if (l > 16) {
+        return -1;
+    }
+    r->acc <<= l;
+    r->bits -= l;
+    return t->huffval[code + t->valoffset[l]];
+}
+
+// Drop the padding bits and step over the RSTn marker that must follow
+static esp_err_t reader_restart(jpeg_reader_t *r) {
+    r->acc = 0;
+    r->bits = 0;
+    r->marker = false;
+    r->zero_bytes = 0;
+    while (r->pos + 1 < r->len &&
+           !(r->buf[r->pos] == 0xFF && r->buf[r->pos + 1] != 0x00 && r->buf[r->pos + 1] != 0xFF)) {
+        r->pos++;
+    }
+    if (r->pos + 1 >= r->len || r->buf[r->pos + 1] < 0xD0 || r->buf[r->pos + 1] > 0xD7) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    r->pos += 2;
+    memset(r->dc_pred, 0, sizeof(r->dc_pred));
+    return ESP_OK;
+}
+
+static esp_err_t read_block(jpeg_reader_t *r, const jpeg_frame_t *frame, int comp, int16_t *coef) {
+    const jpeg_component_t *c = &frame->comps[comp];
+    memset(coef, 0, sizeof(jpeg_block_t));
+
+    int s = reader_symbol(r, &frame->dc[c->dc_tbl]);
+    if (s < 0 || s > 15) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (s) {
+        r->dc_pred[comp] = (int16_t)(r->dc_pred[comp] + reader_value(r, s));
+    }
+    coef[0] = r->dc_pred[comp];
+
+    const jpeg_huff_table_t *ac = &frame->ac[c->ac_tbl];
+    for (int k = 1; k < 64; k++) {
+        int rs = reader_symbol(r, ac);
+        if (rs < 0) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        int run = rs >> 4;
+        int size = rs & 0x0F;
+        if (size == 0) {
+            if (run != 15) {
+                break;  // EOB
+            }
+            k += 15;
+            continue;
+        }
+        k += run;
+        if (k > 63) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        coef[k] = (int16_t)reader_value(r, size);
+    }
+
+    if (r->zero_bytes > 4) {
+        return ESP_ERR_INVALID_SIZE;  // Ran past the end of the scan
+    }
+    return ESP_OK;
+}
+
+void jpeg_reader_init(jpeg_reader_t *reader, const jpeg_frame_t *frame, const uint8_t *jpeg, size_t len) {
+    memset(reader, 0, sizeof(*reader));
+    reader->buf = jpeg;
+    reader->len = len;
+    reader->pos = frame->scan_start;
+}
+
+// Decode the next MCU into blocks[frame->blocks_in_mcu]
+esp_err_t jpeg_reader_mcu(jpeg_reader_t *reader, const jpeg_frame_t *frame, jpeg_block_t *blocks) {
+    if (reader->mcu >= frame->mcus_x * frame->mcus_y) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (frame->restart_interval && reader->mcu > 0 && reader->mcu % frame->restart_interval == 0) {
+        esp_err_t err = reader_restart(reader);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    reader->mcu_pos = reader->pos;
+    reader->mcu_acc = reader->acc;
+    reader->mcu_bits = reader->bits;
+    reader->mcu_marker = reader->marker;
+    reader->mcu_bits_fed = reader->bits_fed;
+    memcpy(reader->mcu_dc_pred, reader->dc_pred, sizeof(reader->dc_pred));
+
+    for (int b = 0; b < frame->blocks_in_mcu; b++) {
+        esp_err_t err = read_block(reader, frame, frame->block_comp[b], blocks[b]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    reader->mcu++;
+    return ESP_OK;
+}
+
+// After the last MCU: locate the end of the file, which must be EOI (a second scan is not supported)
+esp_err_t jpeg_reader_finish(jpeg_reader_t *reader, size_t *end) {
+    size_t pos = reader->pos;
+    const uint8_t *buf = reader->buf;
+    while (pos + 1 < reader->len && !(buf[pos] == 0xFF && buf[pos + 1] != 0x00 && buf[pos + 1] != 0xFF)) {
+        pos++;
+    }
+    if (pos + 1 >= reader->len || buf[pos + 1] != M_EOI) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (end != NULL) {
+        *end = pos + 2;
+    }
+    return ESP_OK;
+}
+
+// ---- Writing ----
+
+static inline void writer_byte(jpeg_writer_t *w, uint8_t b) {
+    if (w->pos < w->size) {
+        w->out[w->pos++] = b;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static inline void writer_put(jpeg_writer_t *w, uint32_t code, int size) {
+    w->acc = (w->acc << size) | (code & ((1U << size) - 1));
+    w->bits += size;
+    while (w->bits >= 8) {
+        uint8_t b = (uint8_t)(w->acc >> (w->bits - 8));
+        writer_byte(w, b);
+        if (b == 0xFF) {
+            writer_byte(w, 0x00);
+        }
+        w->bits -= 8;
+    }
+    w->acc &= (1U << w->bits) - 1;
+}
+
+// Pad the final partial byte with ones
+static void writer_flush(jpeg_writer_t *w) {
+    if (w->bits > 0) {
+        writer_put(w, 0x7F, 7);
+    }
+    w->acc = 0;
+    w->bits = 0;
+}
+
+void jpeg_writer_init(jpeg_writer_t *writer, uint8_t *out, size_t size) {
+    memset(writer, 0, sizeof(*writer));
+    writer->out = out;
+    writer->size = size;
+}
+
+void jpeg_writer_init_counter(jpeg_writer_t *writer, jpeg_symbol_counts_t *counts) {
+    memset(writer, 0, sizeof(*writer));
+    memset(counts, 0, sizeof(*counts));
+    writer->counts = counts;
+}
+
+void jpeg_writer_bytes(jpeg_writer_t *writer, const uint8_t *data, size_t len) {
+    if (writer->counts != NULL) {
+        return;
+    }
+    if (writer->pos + len > writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->out + writer->pos, data, len);
+    writer->pos += len;
+}
+
+// SOI and the kept header segments, with the frame size rewritten for crops
+void jpeg_writer_headers(jpeg_writer_t *writer, const uint8_t *jpeg, const jpeg_frame_t *frame,
+                         uint16_t width, uint16_t height, bool keep_restart) {
+    static const uint8_t soi[2] = {0xFF, M_SOI};
+    jpeg_writer_bytes(writer, soi, sizeof(soi));
+
+    for (int i = 0; i < frame->segment_count; i++) {
+        const jpeg_segment_t *seg = &frame->segments[i];
+        const uint8_t *data = jpeg + seg->offset;
+
+        if (seg->marker == M_DRI && !keep_restart) {
+            continue;
+        }
+        if ((seg->marker == M_SOF0 || seg->marker == M_SOF1) &&
+            (width != frame->width || height != frame->height)) {
+            uint8_t size[4] = {(uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width};
+            jpeg_writer_bytes(writer, data, 5);
+            jpeg_writer_bytes(writer, size, sizeof(size));
+            jpeg_writer_bytes(writer, data + 9, seg->len - 9);
+            continue;
+        }
+        jpeg_writer_bytes(writer, data, seg->len);
+    }
+}
+
+static size_t table_symbols(const jpeg_huff_table_t *t) {
+    size_t count = 0;
+    for (int l = 1; l <= 16; l++) {
+        count += t->bits[l];
+    }
+    return count;
+}
+
+void jpeg_writer_dht(jpeg_writer_t *writer, const jpeg_table_set_t *tables) {
+    size_t seg_len = 2;
+    for (int id = 0; id < 4; id++) {
+        seg_len += tables->dc_used[id] ? 17 + table_symbols(&tables->dc[id]) : 0;
+        seg_len += tables->ac_used[id] ? 17 + table_symbols(&tables->ac[id]) : 0;
+    }
+
+    uint8_t header[4] = {0xFF, M_DHT, (uint8_t)(seg_len >> 8), (uint8_t)seg_len};
+    jpeg_writer_bytes(writer, header, sizeof(header));
+    for (int tc = 0; tc < 2; tc++) {
+        for (int id = 0; id < 4; id++) {
+            const bool *used = tc ? tables->ac_used : tables->dc_used;
+            if (!used[id]) {
+                continue;
+            }
+            const jpeg_huff_table_t *t = tc ? &tables->ac[id] : &tables->dc[id];
+            uint8_t class_id = (uint8_t)((tc << 4) | id);
+            jpeg_writer_bytes(writer, &class_id, 1);
+            jpeg_writer_bytes(writer, &t->bits[1], 16);
+            jpeg_writer_bytes(writer, t->huffval, table_symbols(t));
+        }
+    }
+}
+
+// Copy the SOS header and start entropy coding with the given tables (unused when counting)
+void jpeg_writer_begin_scan(jpeg_writer_t *writer, const uint8_t *jpeg, const jpeg_frame_t *frame,
+                            const jpeg_table_set_t *tables, uint16_t restart_interval) {
+    jpeg_writer_bytes(writer, jpeg + frame->sos.offset, frame->sos.len);
+    writer->tables = tables;
+    writer->restart_interval = restart_interval;
+    writer->mcu = 0;
+    writer->acc = 0;
+    writer->bits = 0;
+    memset(writer->dc_pred, 0, sizeof(writer->dc_pred));
+}
+
+static inline int magnitude_bits(int32_t v) {
+    uint32_t a = (uint32_t)(v < 0 ? -v : v);
+    return a ? 32 - __builtin_clz(a) : 0;
+}
+
+static inline esp_err_t writer_symbol(jpeg_writer_t *w, const jpeg_huff_table_t *t, int sym) {
+    if (t->ehufsi[sym] == 0) {
+        return ESP_ERR_INVALID_STATE;  // Symbol missing from the output table
+    }
+    writer_put(w, t->ehufco[sym], t->ehufsi[sym]);
+    return ESP_OK;
+}
+
+static esp_err_t write_block(jpeg_writer_t *w, const jpeg_frame_t *frame, int comp, const int16_t *coef) {
+    const jpeg_component_t *c = &frame->comps[comp];
+    int32_t diff = coef[0] - w->dc_pred[comp];
+    w->dc_pred[comp] = coef[0];
+    int s = magnitude_bits(diff);
+    if (s > 15) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (w->counts != NULL) {
+        w->counts->dc[c->dc_tbl][s]++;
+        int run = 0;
+        for (int k = 1; k < 64; k++) {
+            if (coef[k] == 0) {
+                run++;
+                continue;
+            }
+            for (; run > 15; run -= 16) {
+                w->counts->ac[c->ac_tbl][0xF0]++;
+            }
+            w->counts->ac[c->ac_tbl][(run << 4) | magnitude_bits(coef[k])]++;
+            run = 0;
+        }
+        if (run > 0) {
+            w->counts->ac[c->ac_tbl][0x00]++;
+        }
+        return ESP_OK;
+    }
+
+    const jpeg_huff_table_t *dc = &w->tables->dc[c->dc_tbl];
+    const jpeg_huff_table_t *ac = &w->tables->ac[c->ac_tbl];
+    if (writer_symbol(w, dc, s) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s) {
+        writer_put(w, (uint32_t)(diff < 0 ? diff - 1 : diff), s);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int32_t v = coef[k];
+        if (v == 0) {
+            run++;
+            continue;
+        }
+        for (; run > 15; run -= 16) {
+            if (writer_symbol(w, ac, 0xF0) != ESP_OK) {
+                return ESP_ERR_INVALID_STATE;
+            }
+        }
+        int size = magnitude_bits(v);
+        if (writer_symbol(w, ac, (run << 4) | size) != ESP_OK) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        writer_put(w, (uint32_t)(v < 0 ? v - 1 : v), size);
+        run = 0;
+    }
+    if (run > 0) {
+        return writer_symbol(w, ac, 0x00);
+    }
+    return ESP_OK;
+}
+
+static void writer_restart(jpeg_writer_t *writer) {
+    if (writer->restart_interval && writer->mcu > 0 && writer->mcu % writer->restart_interval == 0) {
+        if (writer->counts == NULL) {
+            uint32_t index = writer->mcu / writer->restart_interval - 1;
+            writer_flush(writer);
+            writer_byte(writer, 0xFF);
+            writer_byte(writer, (uint8_t)(0xD0 + (index & 7)));
+        }
+        memset(writer->dc_pred, 0, sizeof(writer->dc_pred));
+    }
+}
+
+esp_err_t jpeg_writer_mcu(jpeg_writer_t *writer, const jpeg_frame_t *frame, const jpeg_block_t *blocks) {
+    writer_restart(writer);
+
+    for (int b = 0; b < frame->blocks_in_mcu; b++) {
+        esp_err_t err = write_block(writer, frame, frame->block_comp[b], blocks[b]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    writer->mcu++;
+    return writer->overflow ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+// Append the MCU the reader last decoded by copying its entropy-coded bits, which is
+// only valid while the writer uses the source's own tables. Re-encodes from blocks
+// when counting or when the DC predictors have diverged from the source's.
+esp_err_t jpeg_writer_copy_mcu(jpeg_writer_t *writer, const jpeg_frame_t *frame, const jpeg_reader_t *reader,
+                               const jpeg_block_t *blocks) {
+    writer_restart(writer);
+    if (writer->counts != NULL || memcmp(writer->dc_pred, reader->mcu_dc_pred, sizeof(writer->dc_pred)) != 0) {
+        for (int b = 0; b < frame->blocks_in_mcu; b++) {
+            esp_err_t err = write_block(writer, frame, frame->block_comp[b], blocks[b]);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    } else {
+        // Replay the reader from the start of the MCU, 16 bits at a time
+        jpeg_reader_t cursor = {
+            .buf = reader->buf,
+            .len = reader->len,
+            .pos = reader->mcu_pos,
+            .acc = reader->mcu_acc,
+            .bits = reader->mcu_bits,
+            .marker = reader->mcu_marker,
+        };
+        uint32_t n = (reader->bits_fed - (uint32_t)reader->bits) - (reader->mcu_bits_fed - (uint32_t)reader->mcu_bits);
+        while (n > 0) {
+            int take = n > 16 ? 16 : (int)n;
+            reader_fill(&cursor);
+            writer_put(writer, cursor.acc >> (32 - take), take);
+            cursor.acc <<= take;
+            cursor.bits -= take;
+            n -= take;
+        }
+        for (int b = 0; b < frame->blocks_in_mcu; b++) {
+            writer->dc_pred[frame->block_comp[b]] = blocks[b][0];
+        }
+    }
+    writer->mcu++;
+    return writer->overflow ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+void jpeg_writer_end_scan(jpeg_writer_t *writer) {
+    static const uint8_t eoi[2] = {0xFF, M_EOI};
+    if (writer->counts != NULL) {
+        return;
+    }
+    writer_flush(writer);
+    jpeg_writer_bytes(writer, eoi, sizeof(eoi));
+}
@@ -0,0 +1,445 @@
+#include "jpeg_mask.h"
+#include "jpeg_codec.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "JPEG_MASK";
+
+typedef struct {
+    jpeg_frame_t frame;
+    jpeg_table_set_t tables;
+    jpeg_symbol_counts_t counts;
+    jpeg_block_t blocks[JPEG_MAX_BLOCKS_IN_MCU];
+    int16_t fill_dc[JPEG_MAX_COMPONENTS];
+    // One byte per MCU, nonzero when it is masked; rebuilt when the geometry changes
+    uint8_t *map;
+    size_t map_size;
+    uint32_t masked_mcus;
+    bool map_valid;
+    uint32_t map_generation;
+    uint16_t map_width;
+    uint16_t map_height;
+    uint8_t map_mcu_width;
+    uint8_t map_mcu_height;
+    jpeg_mask_view_t map_view;
+} jpeg_mask_ctx_t;
+
+static jpeg_mask_polygon_t mask_polygons[JPEG_MASK_MAX_POLYGONS];
+static int mask_polygon_count = 0;
+static uint8_t mask_fill_luma = 128;
+static uint32_t mask_generation = 0;
+
+static jpeg_mask_ctx_t *pool_ctx = NULL;
+static uint8_t *pool_buffer = NULL;
+static size_t pool_size = 0;
+static jpeg_mask_stats_t mask_stats;
+
+// ---- Geometry ----
+
+// Liang-Barsky clip of a segment against a closed rectangle {x0, y0, x1, y1}
+static bool segment_hits_rect(float x0, float y0, float x1, float y1, const float rect[4]) {
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {x0 - rect[0], rect[2] - x0, y0 - rect[1], rect[3] - y0};
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0.0f) {
+            if (q[i] < 0.0f) {
+                return false;
+            }
+            continue;
+        }
+        float t = q[i] / p[i];
+        if (p[i] < 0.0f) {
+            if (t > t1) {
+                return false;
+            }
+            if (t > t0) {
+                t0 = t;
+            }
+        } else {
+            if (t < t0) {
+                return false;
+            }
+            if (t < t1) {
+                t1 = t;
+            }
+        }
+    }
+    return true;
+}
+
+static bool point_in_polygon(const float *xs, const float *ys, int n, float x, float y) {
+    bool inside = false;
+    for (int i = 0, j = n - 1; i < n; j = i++) {
+        if ((ys[i] > y) != (ys[j] > y) && x < (xs[j] - xs[i]) * (y - ys[i]) / (ys[j] - ys[i]) + xs[i]) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// An MCU is masked when any part of it overlaps a polygon: either an edge crosses
+// it or, with no edge crossing, it lies wholly inside
+static bool rect_hits_polygon(const float *xs, const float *ys, int n, const float rect[4]) {
+    for (int i = 0, j = n - 1; i < n; j = i++) {
+        if (segment_hits_rect(xs[j], ys[j], xs[i], ys[i], rect)) {
+            return true;
+        }
+    }
+    return point_in_polygon(xs, ys, n, (rect[0] + rect[2]) * 0.5f, (rect[1] + rect[3]) * 0.5f);
+}
+
+static esp_err_t build_map(jpeg_mask_ctx_t *ctx, const jpeg_mask_view_t *view) {
+    const jpeg_frame_t *f = &ctx->frame;
+    size_t mcus = (size_t)f->mcus_x * f->mcus_y;
+    if (mcus > ctx->map_size) {
+        uint8_t *map = realloc(ctx->map, mcus);
+        if (map == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        ctx->map = map;
+        ctx->map_size = mcus;
+    }
+    memset(ctx->map, 0, mcus);
+    ctx->masked_mcus = 0;
+
+    float sx = (float)f->width / (float)view->width;
+    float sy = (float)f->height / (float)view->height;
+    for (int p = 0; p < mask_polygon_count; p++) {
+        const jpeg_mask_polygon_t *poly = &mask_polygons[p];
+        float xs[JPEG_MASK_MAX_VERTICES];
+        float ys[JPEG_MASK_MAX_VERTICES];
+        float min_x = 1e9f, min_y = 1e9f, max_x = -1e9f, max_y = -1e9f;
+        for (int i = 0; i < poly->count; i++) {
+            xs[i] = ((float)poly->points[i].x - (float)view->x) * sx;
+            ys[i] = ((float)poly->points[i].y - (float)view->y) * sy;
+            min_x = xs[i] < min_x ? xs[i] : min_x;
+            min_y = ys[i] < min_y ? ys[i] : min_y;
+            max_x = xs[i] > max_x ? xs[i] : max_x;
+            max_y = ys[i] > max_y ? ys[i] : max_y;
+        }
+
+        // Only MCUs under the bounding box need the exact test
+        int mx0 = min_x > 0.0f ? (int)(min_x / f->mcu_width) : 0;
+        int my0 = min_y > 0.0f ? (int)(min_y / f->mcu_height) : 0;
+        int mx1 = max_x < 0.0f ? -1 : (int)(max_x / f->mcu_width);
+        int my1 = max_y < 0.0f ? -1 : (int)(max_y / f->mcu_height);
+        mx1 = mx1 < (int)f->mcus_x ? mx1 : (int)f->mcus_x - 1;
+        my1 = my1 < (int)f->mcus_y ? my1 : (int)f->mcus_y - 1;
+
+        for (int my = my0; my <= my1; my++) {
+            for (int mx = mx0; mx <= mx1; mx++) {
+                uint8_t *cell = &ctx->map[(size_t)my * f->mcus_x + mx];
+                if (*cell) {
+                    continue;
+                }
+                float rect[4] = {(float)(mx * f->mcu_width), (float)(my * f->mcu_height),
+                                 (float)((mx + 1) * f->mcu_width), (float)((my + 1) * f->mcu_height)};
+                if (rect_hits_polygon(xs, ys, poly->count, rect)) {
+                    *cell = 1;
+                    ctx->masked_mcus++;
+                }
+            }
+        }
+    }
+
+    ctx->map_valid = true;
+    ctx->map_generation = mask_generation;
+    ctx->map_width = f->width;
+    ctx->map_height = f->height;
+    ctx->map_mcu_width = f->mcu_width;
+    ctx->map_mcu_height = f->mcu_height;
+    ctx->map_view = *view;
+    return ESP_OK;
+}
+
+static bool map_matches(const jpeg_mask_ctx_t *ctx, const jpeg_mask_view_t *view) {
+    const jpeg_frame_t *f = &ctx->frame;
+    return ctx->map_valid && ctx->map_generation == mask_generation &&
+           ctx->map_width == f->width && ctx->map_height == f->height &&
+           ctx->map_mcu_width == f->mcu_width && ctx->map_mcu_height == f->mcu_height &&
+           memcmp(&ctx->map_view, view, sizeof(*view)) == 0;
+}
+
+// ---- Scan ----
+
+// Quantized DC of a flat block: the level-shifted sample times 8, over the quantizer
+static void compute_fill(jpeg_mask_ctx_t *ctx) {
+    const jpeg_frame_t *f = &ctx->frame;
+    for (int c = 0; c < f->ncomps; c++) {
+        int level = c == 0 ? (int)mask_fill_luma - 128 : 0;
+        int q = f->quant[f->comps[c].tq][0] ? f->quant[f->comps[c].tq][0] : 1;
+        int dc = level * 8;
+        ctx->fill_dc[c] = (int16_t)(dc >= 0 ? (dc + q / 2) / q : -((-dc + q / 2) / q));
+    }
+}
+
+// One pass: decode each MCU and either flatten and encode it or, with the source's
+// tables, copy its bits through untouched
+static esp_err_t mask_scan(jpeg_mask_ctx_t *ctx, const uint8_t *jpeg, size_t len, jpeg_writer_t *writer,
+                           bool copy, bool *missing_symbol) {
+    const jpeg_frame_t *f = &ctx->frame;
+    jpeg_reader_t reader;
+    jpeg_reader_init(&reader, f, jpeg, len);
+
+    uint32_t mcus = f->mcus_x * f->mcus_y;
+    for (uint32_t m = 0; m < mcus; m++) {
+        esp_err_t err = jpeg_reader_mcu(&reader, f, ctx->blocks);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (ctx->map[m]) {
+            for (int b = 0; b < f->blocks_in_mcu; b++) {
+                memset(ctx->blocks[b], 0, sizeof(jpeg_block_t));
+                ctx->blocks[b][0] = ctx->fill_dc[f->block_comp[b]];
+            }
+            err = jpeg_writer_mcu(writer, f, ctx->blocks);
+        } else if (copy) {
+            err = jpeg_writer_copy_mcu(writer, f, &reader, ctx->blocks);
+        } else {
+            err = jpeg_writer_mcu(writer, f, ctx->blocks);
+        }
+        if (err != ESP_OK) {
+            *missing_symbol = (err == ESP_ERR_INVALID_STATE);
+            return err;
+        }
+    }
+    return jpeg_reader_finish(&reader, NULL);
+}
+
+static esp_err_t write_masked(jpeg_mask_ctx_t *ctx, const uint8_t *jpeg, size_t len, uint8_t *out, size_t out_size,
+                              size_t *out_len, bool copy, bool *missing_symbol) {
+    jpeg_writer_t writer;
+    jpeg_writer_init(&writer, out, out_size);
+    jpeg_writer_headers(&writer, jpeg, &ctx->frame, ctx->frame.width, ctx->frame.height, true);
+    jpeg_writer_dht(&writer, &ctx->tables);
+    jpeg_writer_begin_scan(&writer, jpeg, &ctx->frame, &ctx->tables, ctx->frame.restart_interval);
+    esp_err_t err = mask_scan(ctx, jpeg, len, &writer, copy, missing_symbol);
+    if (err != ESP_OK) {
+        return err;
+    }
+    jpeg_writer_end_scan(&writer);
+
+    if (writer.overflow) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *out_len = writer.pos;
+    return ESP_OK;
+}
+
+static esp_err_t mask(jpeg_mask_ctx_t *ctx, const uint8_t *jpeg, size_t len, const jpeg_mask_view_t *view,
+                      uint8_t *out, size_t out_size, size_t *out_len) {
+    esp_err_t err = jpeg_frame_parse(jpeg, len, &ctx->frame);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (!map_matches(ctx, view)) {
+        err = build_map(ctx, view);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    compute_fill(ctx);
+
+    // The frame's own tables almost always cover the fill symbols (sensor JPEGs use
+    // the Annex K tables), so unmasked MCUs are copied bit for bit and only masked
+    // ones and their right-hand neighbours are encoded
+    bool missing_symbol = false;
+    jpeg_tables_from_frame(&ctx->tables, &ctx->frame);
+    err = write_masked(ctx, jpeg, len, out, out_size, out_len, true, &missing_symbol);
+    if (err == ESP_OK || !missing_symbol) {
+        return err;
+    }
+
+    // Tables were trimmed upstream; count the masked symbols and build ones that fit
+    mask_stats.two_pass++;
+    jpeg_writer_t counter;
+    jpeg_writer_init_counter(&counter, &ctx->counts);
+    jpeg_writer_begin_scan(&counter, jpeg, &ctx->frame, NULL, ctx->frame.restart_interval);
+    err = mask_scan(ctx, jpeg, len, &counter, false, &missing_symbol);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = jpeg_tables_optimize(&ctx->tables, &ctx->frame, &ctx->counts);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return write_masked(ctx, jpeg, len, out, out_size, out_len, false, &missing_symbol);
+}
+
+// ---- API ----
+
+static void *mask_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+esp_err_t jpeg_mask_init(size_t size) {
+    if (pool_buffer != NULL) {
+        return ESP_OK;
+    }
+
+    pool_ctx = mask_alloc(sizeof(jpeg_mask_ctx_t));
+    pool_buffer = mask_alloc(size);
+    if (pool_ctx == NULL || pool_buffer == NULL) {
+        free(pool_ctx);
+        free(pool_buffer);
+        pool_ctx = NULL;
+        pool_buffer = NULL;
+        ESP_LOGE(TAG, "Failed to allocate %zu byte output pool", size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(pool_ctx, 0, sizeof(*pool_ctx));
+    pool_size = size;
+    memset(&mask_stats, 0, sizeof(mask_stats));
+    ESP_LOGI(TAG, "Privacy masking ready, %zu byte pool", size);
+    return ESP_OK;
+}
+
+// "x,y x,y x,y; x,y x,y x,y x,y": polygons separated by ';', at least 3 vertices each
+esp_err_t jpeg_mask_parse(const char *text, jpeg_mask_polygon_t *polygons, int max_polygons, int *count) {
+    if (text == NULL || polygons == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *count = 0;
+    const char *p = text;
+    while (*p != '\0') {
+        jpeg_mask_polygon_t poly = {0};
+        while (*p != '\0' && *p != ';') {
+            if (*p == ' ') {
+                p++;
+                continue;
+            }
+            char *end;
+            unsigned long x = strtoul(p, &end, 10);
+            if (end == p || *end != ',') {
+                return ESP_ERR_INVALID_ARG;
+            }
+            p = end + 1;
+            unsigned long y = strtoul(p, &end, 10);
+            if (end == p || x > UINT16_MAX || y > UINT16_MAX || poly.count >= JPEG_MASK_MAX_VERTICES) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            p = end;
+            poly.points[poly.count].x = (uint16_t)x;
+            poly.points[poly.count].y = (uint16_t)y;
+            poly.count++;
+        }
+        if (*p == ';') {
+            p++;
+        }
+        if (poly.count == 0) {
+            continue;  // Empty polygon between separators
+        }
+        if (poly.count < 3 || *count >= max_polygons) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        polygons[(*count)++] = poly;
+    }
+    return ESP_OK;
+}
+
+// Call from the capturing task, or before it starts
+esp_err_t jpeg_mask_set_polygons(const jpeg_mask_polygon_t *polygons, int count, uint8_t fill_luma) {
+    if (count < 0 || count > JPEG_MASK_MAX_POLYGONS || (count > 0 && polygons == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < count; i++) {
+        if (polygons[i].count < 3 || polygons[i].count > JPEG_MASK_MAX_VERTICES) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (count > 0) {
+        memcpy(mask_polygons, polygons, count * sizeof(jpeg_mask_polygon_t));
+    }
+    mask_polygon_count = count;
+    mask_fill_luma = fill_luma;
+    mask_generation++;
+    ESP_LOGI(TAG, "%d privacy polygon(s) configured", count);
+    return ESP_OK;
+}
+
+bool jpeg_mask_active(void) {
+    return mask_polygon_count > 0;
+}
+
+// Unpooled variant: the caller owns the output buffer
+esp_err_t jpeg_mask_apply_into(const uint8_t *jpeg, size_t len, const jpeg_mask_view_t *view,
+                               uint8_t *out, size_t out_size, size_t *out_len) {
+    if (jpeg == NULL || len == 0 || view == NULL || view->width == 0 || view->height == 0 ||
+        out == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jpeg_mask_ctx_t *ctx = calloc(1, sizeof(jpeg_mask_ctx_t));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = mask(ctx, jpeg, len, view, out, out_size, out_len);
+    free(ctx->map);
+    free(ctx);
+    return err;
+}
+
+// Mask into the shared pool, valid until the next call. On failure the frame must
+// not be sent: there is no unmasked fallback.
+esp_err_t jpeg_mask_apply(const uint8_t *jpeg, size_t len, const jpeg_mask_view_t *view,
+                          const uint8_t **out, size_t *out_len) {
+    if (pool_buffer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (jpeg == NULL || len == 0 || view == NULL || view->width == 0 || view->height == 0 ||
+        out == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    size_t result_len = 0;
+    esp_err_t err = mask(pool_ctx, jpeg, len, view, pool_buffer, pool_size, &result_len);
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    if (err != ESP_OK) {
+        mask_stats.failures++;
+        ESP_LOGE(TAG, "Masking failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    mask_stats.frames++;
+    mask_stats.masked_mcus = pool_ctx->masked_mcus;
+    mask_stats.last_us = elapsed;
+    if (elapsed > mask_stats.max_us) {
+        mask_stats.max_us = elapsed;
+    }
+    mask_stats.bytes_in += len;
+    mask_stats.bytes_out += result_len;
+    ESP_LOGI(TAG, "Masked %u of %u MCUs: %zu -> %zu bytes in %u us", (unsigned)pool_ctx->masked_mcus,
+             (unsigned)(pool_ctx->frame.mcus_x * pool_ctx->frame.mcus_y), len, result_len, (unsigned)elapsed);
+
+    *out = pool_buffer;
+    *out_len = result_len;
+    return ESP_OK;
+}
+
+void jpeg_mask_get_stats(jpeg_mask_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = mask_stats;
+    }
+}
@@ -0,0 +1,182 @@
+#include "jpeg_optimize.h"
+#include "jpeg_codec.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "JPEG_OPT";
+
+typedef struct {
+    jpeg_frame_t frame;
+    jpeg_table_set_t tables;
+    jpeg_symbol_counts_t counts;
+    jpeg_block_t blocks[JPEG_MAX_BLOCKS_IN_MCU];
+} jpeg_opt_ctx_t;
+
+static jpeg_opt_ctx_t *pool_ctx = NULL;
+static uint8_t *pool_buffer = NULL;
+static size_t pool_size = 0;
+static jpeg_optimize_stats_t opt_stats;
+
+// One pass over the scan, feeding every MCU to the writer
+static esp_err_t transcode_scan(jpeg_opt_ctx_t *ctx, const uint8_t *jpeg, size_t len, jpeg_writer_t *writer) {
+    jpeg_reader_t reader;
+    jpeg_reader_init(&reader, &ctx->frame, jpeg, len);
+
+    uint32_t mcus = ctx->frame.mcus_x * ctx->frame.mcus_y;
+    for (uint32_t m = 0; m < mcus; m++) {
+        esp_err_t err = jpeg_reader_mcu(&reader, &ctx->frame, ctx->blocks);
+        if (err == ESP_OK) {
+            err = jpeg_writer_mcu(writer, &ctx->frame, ctx->blocks);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return jpeg_reader_finish(&reader, NULL);
+}
+
+static esp_err_t optimize(jpeg_opt_ctx_t *ctx, const uint8_t *jpeg, size_t len, uint8_t *out, size_t out_size,
+                          size_t *out_len) {
+    esp_err_t err = jpeg_frame_parse(jpeg, len, &ctx->frame);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Pass 1: symbol statistics
+    jpeg_writer_t writer;
+    jpeg_writer_init_counter(&writer, &ctx->counts);
+    jpeg_writer_begin_scan(&writer, jpeg, &ctx->frame, NULL, ctx->frame.restart_interval);
+    err = transcode_scan(ctx, jpeg, len, &writer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = jpeg_tables_optimize(&ctx->tables, &ctx->frame, &ctx->counts);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Pass 2: same headers and coefficients, new tables
+    jpeg_writer_init(&writer, out, out_size);
+    jpeg_writer_headers(&writer, jpeg, &ctx->frame, ctx->frame.width, ctx->frame.height, true);
+    jpeg_writer_dht(&writer, &ctx->tables);
+    jpeg_writer_begin_scan(&writer, jpeg, &ctx->frame, &ctx->tables, ctx->frame.restart_interval);
+    err = transcode_scan(ctx, jpeg, len, &writer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    jpeg_writer_end_scan(&writer);
+
+    if (writer.overflow) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *out_len = writer.pos;
+    return ESP_OK;
+}
+
+// Unpooled variant: the caller owns the output buffer
+esp_err_t jpeg_optimize_into(const uint8_t *jpeg, size_t len, uint8_t *out, size_t out_size, size_t *out_len) {
+    if (jpeg == NULL || len == 0 || out == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jpeg_opt_ctx_t *ctx = malloc(sizeof(jpeg_opt_ctx_t));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = optimize(ctx, jpeg, len, out, out_size, out_len);
+    free(ctx);
+    return err;
+}
+
+static void *opt_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+esp_err_t jpeg_optimize_init(size_t size) {
+    if (pool_buffer != NULL) {
+        return ESP_OK;
+    }
+
+    pool_ctx = opt_alloc(sizeof(jpeg_opt_ctx_t));
+    pool_buffer = opt_alloc(size);
+    if (pool_ctx == NULL || pool_buffer == NULL) {
+        free(pool_ctx);
+        free(pool_buffer);
+        pool_ctx = NULL;
+        pool_buffer = NULL;
+        ESP_LOGE(TAG, "Failed to allocate %zu byte output pool", size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pool_size = size;
+    memset(&opt_stats, 0, sizeof(opt_stats));
+    ESP_LOGI(TAG, "Huffman optimizer ready, %zu byte pool", size);
+    return ESP_OK;
+}
+
+// Re-encode into the shared pool, valid until the next call. Skipped when the running
+// cost estimate says the frame would not finish within budget_us (0 means no limit).
+esp_err_t jpeg_optimize(const uint8_t *jpeg, size_t len, uint32_t budget_us, const uint8_t **out, size_t *out_len) {
+    if (pool_buffer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (jpeg == NULL || len == 0 || out == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (budget_us && opt_stats.ns_per_byte &&
+        (uint64_t)len * opt_stats.ns_per_byte / 1000 > budget_us) {
+        opt_stats.frames_skipped_budget++;
+        ESP_LOGD(TAG, "Skipping: predicted %u us exceeds budget %u us",
+                 (unsigned)((uint64_t)len * opt_stats.ns_per_byte / 1000), (unsigned)budget_us);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int64_t start = esp_timer_get_time();
+    size_t result_len = 0;
+    esp_err_t err = optimize(pool_ctx, jpeg, len, pool_buffer, pool_size, &result_len);
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    // Cost is paid whether or not the result is used, so it always feeds the estimate
+    uint32_t ns_per_byte = (uint32_t)((uint64_t)elapsed * 1000 / len);
+    opt_stats.ns_per_byte = opt_stats.ns_per_byte ? (opt_stats.ns_per_byte * 3 + ns_per_byte) / 4 : ns_per_byte;
+    opt_stats.last_us = elapsed;
+
+    if (err == ESP_OK && result_len >= len) {
+        err = ESP_ERR_INVALID_SIZE;  // Nothing gained
+    }
+    if (err != ESP_OK) {
+        opt_stats.frames_unsupported++;
+        ESP_LOGD(TAG, "Not optimized: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    opt_stats.frames_optimized++;
+    opt_stats.bytes_in += len;
+    opt_stats.bytes_out += result_len;
+    ESP_LOGI(TAG, "Huffman optimized %zu -> %zu bytes (%.1f%% saved) in %u us",
+             len, result_len, 100.0f * (float)(len - result_len) / (float)len, (unsigned)elapsed);
+
+    *out = pool_buffer;
+    *out_len = result_len;
+    return ESP_OK;
+}
+
+void jpeg_optimize_get_stats(jpeg_optimize_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = opt_stats;
+    }
+}
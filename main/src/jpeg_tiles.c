@@ -0,0 +1,493 @@
+#include "jpeg_tiles.h"
+#include "jpeg_codec.h"
+#include "psram_stage.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "JPEG_TILES";
+
+#define MAX_REGIONS 64
+
+#if TILE_MAX_PER_FRAME > JPEG_TILES_MAX
+#error "TILE_MAX_PER_FRAME exceeds JPEG_TILES_MAX"
+#endif
+
+// Per-MCU luma summary taken straight from the quantized coefficients
+typedef struct {
+    int16_t dc;                 // Mean luma offset from 128
+    uint16_t ac;                // Mean absolute AC amplitude per block
+} mcu_signature_t;
+
+typedef struct {
+    uint16_t x0;                // MCU columns [x0, x1) and rows [y0, y1)
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+} mcu_rect_t;
+
+typedef struct {
+    jpeg_frame_t frame;
+    jpeg_table_set_t tables;
+    jpeg_symbol_counts_t counts;
+    jpeg_block_t blocks[JPEG_MAX_BLOCKS_IN_MCU];
+} tiles_ctx_t;
+
+static tiles_ctx_t *ctx = NULL;
+static uint8_t *pool_buffer = NULL;
+static size_t pool_size = 0;
+
+// Grid state, reallocated when the frame size changes
+static uint32_t grid_mcus = 0;
+static mcu_signature_t *reference = NULL;   // What the receiver currently has
+static mcu_signature_t *current = NULL;
+static uint8_t *changed = NULL;
+static uint32_t *fill_queue = NULL;
+static jpeg_reader_t *row_start = NULL;     // Reader state at the first MCU of every row
+static uint16_t grid_width = 0;
+static uint16_t grid_height = 0;
+
+static bool have_reference = false;
+static uint32_t frames_since_keyframe = 0;
+static jpeg_tiles_stats_t tiles_stats;
+
+static void *tiles_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+static void free_grid(void) {
+    free(reference);
+    free(current);
+    free(changed);
+    free(fill_queue);
+    free(row_start);
+    reference = NULL;
+    current = NULL;
+    changed = NULL;
+    fill_queue = NULL;
+    row_start = NULL;
+    grid_mcus = 0;
+}
+
+static esp_err_t ensure_grid(const jpeg_frame_t *frame) {
+    uint32_t mcus = frame->mcus_x * frame->mcus_y;
+    if (mcus == grid_mcus && frame->width == grid_width && frame->height == grid_height) {
+        return ESP_OK;
+    }
+
+    free_grid();
+    have_reference = false;
+    reference = tiles_alloc(mcus * sizeof(mcu_signature_t));
+    current = tiles_alloc(mcus * sizeof(mcu_signature_t));
+    changed = tiles_alloc(mcus);
+    fill_queue = tiles_alloc(mcus * sizeof(uint32_t));
+    row_start = tiles_alloc(frame->mcus_y * sizeof(jpeg_reader_t));
+    if (!reference || !current || !changed || !fill_queue || !row_start) {
+        free_grid();
+        return ESP_ERR_NO_MEM;
+    }
+
+    grid_mcus = mcus;
+    grid_width = frame->width;
+    grid_height = frame->height;
+    ESP_LOGI(TAG, "Tracking %ux%u MCUs of %ux%u px", (unsigned)frame->mcus_x, (unsigned)frame->mcus_y,
+             frame->mcu_width, frame->mcu_height);
+    return ESP_OK;
+}
+
+static mcu_signature_t summarize_mcu(const jpeg_frame_t *frame, const jpeg_block_t *blocks) {
+    int32_t dc = 0;
+    uint32_t ac = 0;
+    int luma_blocks = 0;
+
+    for (int b = 0; b < frame->blocks_in_mcu; b++) {
+        if (frame->block_comp[b] != 0) {
+            continue;
+        }
+        const uint16_t *q = frame->quant[frame->comps[0].tq];
+        dc += blocks[b][0] * q[0];
+        for (int k = 1; k < 64; k++) {
+            int32_t v = blocks[b][k];
+            ac += (uint32_t)(v < 0 ? -v : v) * q[k];
+        }
+        luma_blocks++;
+    }
+
+    // The DC term is eight times the block mean; scale AC the same way
+    mcu_signature_t sig;
+    sig.dc = (int16_t)(dc / (8 * luma_blocks));
+    ac /= 8 * (uint32_t)luma_blocks;
+    sig.ac = (uint16_t)(ac > UINT16_MAX ? UINT16_MAX : ac);
+    return sig;
+}
+
+static bool signature_changed(const mcu_signature_t *ref, const mcu_signature_t *cur) {
+    int dc_delta = abs(cur->dc - ref->dc);
+    int ac_delta = abs((int)cur->ac - (int)ref->ac);
+    int ac_limit = (cur->ac + ref->ac) / 4;  // Texture changes count relative to the texture present
+    if (ac_limit < TILE_AC_THRESHOLD) {
+        ac_limit = TILE_AC_THRESHOLD;
+    }
+    return dc_delta > TILE_DC_THRESHOLD || ac_delta > ac_limit;
+}
+
+// Decode every MCU once for its signature, remembering where each row starts
+static esp_err_t scan_signatures(const uint8_t *jpeg, size_t len) {
+    const jpeg_frame_t *frame = &ctx->frame;
+    jpeg_reader_t reader;
+    jpeg_reader_init(&reader, frame, jpeg, len);
+
+    for (uint32_t y = 0; y < frame->mcus_y; y++) {
+        row_start[y] = reader;
+        for (uint32_t x = 0; x < frame->mcus_x; x++) {
+            esp_err_t err = jpeg_reader_mcu(&reader, frame, ctx->blocks);
+            if (err != ESP_OK) {
+                return err;
+            }
+            current[y * frame->mcus_x + x] = summarize_mcu(frame, ctx->blocks);
+        }
+    }
+    return jpeg_reader_finish(&reader, NULL);
+}
+
+static uint32_t rect_area(const mcu_rect_t *r) {
+    return (uint32_t)(r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static mcu_rect_t rect_union(const mcu_rect_t *a, const mcu_rect_t *b) {
+    mcu_rect_t u = {
+        .x0 = a->x0 < b->x0 ? a->x0 : b->x0,
+        .y0 = a->y0 < b->y0 ? a->y0 : b->y0,
+        .x1 = a->x1 > b->x1 ? a->x1 : b->x1,
+        .y1 = a->y1 > b->y1 ? a->y1 : b->y1,
+    };
+    return u;
+}
+
+static bool rects_overlap(const mcu_rect_t *a, const mcu_rect_t *b) {
+    return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+// Mark changed MCUs grown by TILE_MARGIN_MCUS; returns the number of changed MCUs before growing
+static uint32_t mark_changes(void) {
+    const jpeg_frame_t *frame = &ctx->frame;
+    uint32_t count = 0;
+
+    memset(changed, 0, grid_mcus);
+    for (uint32_t y = 0; y < frame->mcus_y; y++) {
+        for (uint32_t x = 0; x < frame->mcus_x; x++) {
+            uint32_t m = y * frame->mcus_x + x;
+            if (!signature_changed(&reference[m], &current[m])) {
+                continue;
+            }
+            count++;
+            uint32_t ya = y >= TILE_MARGIN_MCUS ? y - TILE_MARGIN_MCUS : 0;
+            uint32_t xa = x >= TILE_MARGIN_MCUS ? x - TILE_MARGIN_MCUS : 0;
+            for (uint32_t yy = ya; yy <= y + TILE_MARGIN_MCUS && yy < frame->mcus_y; yy++) {
+                for (uint32_t xx = xa; xx <= x + TILE_MARGIN_MCUS && xx < frame->mcus_x; xx++) {
+                    changed[yy * frame->mcus_x + xx] = 1;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Overlapping boxes would send the same MCUs twice
+static int merge_overlapping(mcu_rect_t *rects, int count) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < count && !merged; i++) {
+            for (int j = i + 1; j < count && !merged; j++) {
+                if (rects_overlap(&rects[i], &rects[j])) {
+                    rects[i] = rect_union(&rects[i], &rects[j]);
+                    rects[j] = rects[--count];
+                    merged = true;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Bounding boxes of the connected changed areas, merged down to TILE_MAX_PER_FRAME
+static int find_regions(mcu_rect_t *rects) {
+    const jpeg_frame_t *frame = &ctx->frame;
+    int count = 0;
+
+    for (uint32_t start = 0; start < grid_mcus; start++) {
+        if (changed[start] != 1) {
+            continue;
+        }
+        if (count >= MAX_REGIONS) {
+            return -1;
+        }
+
+        mcu_rect_t r = {UINT16_MAX, UINT16_MAX, 0, 0};
+        uint32_t head = 0;
+        uint32_t tail = 0;
+        fill_queue[tail++] = start;
+        changed[start] = 2;
+        while (head < tail) {
+            uint32_t m = fill_queue[head++];
+            uint16_t x = (uint16_t)(m % frame->mcus_x);
+            uint16_t y = (uint16_t)(m / frame->mcus_x);
+            r.x0 = x < r.x0 ? x : r.x0;
+            r.y0 = y < r.y0 ? y : r.y0;
+            r.x1 = x + 1 > r.x1 ? x + 1 : r.x1;
+            r.y1 = y + 1 > r.y1 ? y + 1 : r.y1;
+
+            uint32_t neighbours[4] = {
+                x > 0 ? m - 1 : UINT32_MAX,
+                x + 1 < frame->mcus_x ? m + 1 : UINT32_MAX,
+                y > 0 ? m - frame->mcus_x : UINT32_MAX,
+                y + 1 < frame->mcus_y ? m + frame->mcus_x : UINT32_MAX,
+            };
+            for (int i = 0; i < 4; i++) {
+                if (neighbours[i] != UINT32_MAX && changed[neighbours[i]] == 1) {
+                    changed[neighbours[i]] = 2;
+                    fill_queue[tail++] = neighbours[i];
+                }
+            }
+        }
+        rects[count++] = r;
+    }
+
+    count = merge_overlapping(rects, count);
+    while (count > TILE_MAX_PER_FRAME) {
+        int best_i = 0;
+        int best_j = 1;
+        uint32_t best_cost = UINT32_MAX;
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                mcu_rect_t u = rect_union(&rects[i], &rects[j]);
+                uint32_t cost = rect_area(&u) - rect_area(&rects[i]) - rect_area(&rects[j]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        rects[best_i] = rect_union(&rects[best_i], &rects[best_j]);
+        rects[best_j] = rects[--count];
+        count = merge_overlapping(rects, count);  // A union can reach a third box
+    }
+    return count;
+}
+
+// Feed the MCUs of one rectangle to the writer, resuming from the saved row states
+static esp_err_t transcode_rect(const mcu_rect_t *r, jpeg_writer_t *writer) {
+    const jpeg_frame_t *frame = &ctx->frame;
+
+    for (uint32_t y = r->y0; y < r->y1; y++) {
+        jpeg_reader_t reader = row_start[y];
+        for (uint32_t x = 0; x < r->x1; x++) {
+            esp_err_t err = jpeg_reader_mcu(&reader, frame, ctx->blocks);
+            if (err == ESP_OK && x >= r->x0) {
+                err = jpeg_writer_mcu(writer, frame, ctx->blocks);
+            }
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+// Standalone JPEG of one rectangle with tables fitted to its own symbols
+static esp_err_t cut_tile(const uint8_t *jpeg, const mcu_rect_t *r, size_t offset, jpeg_tile_t *tile) {
+    const jpeg_frame_t *frame = &ctx->frame;
+    jpeg_writer_t writer;
+
+    jpeg_writer_init_counter(&writer, &ctx->counts);
+    jpeg_writer_begin_scan(&writer, jpeg, frame, NULL, 0);
+    esp_err_t err = transcode_rect(r, &writer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = jpeg_tables_optimize(&ctx->tables, frame, &ctx->counts);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    tile->x = (uint16_t)(r->x0 * frame->mcu_width);
+    tile->y = (uint16_t)(r->y0 * frame->mcu_height);
+    tile->width = (uint16_t)((r->x1 == frame->mcus_x ? frame->width : r->x1 * frame->mcu_width) - tile->x);
+    tile->height = (uint16_t)((r->y1 == frame->mcus_y ? frame->height : r->y1 * frame->mcu_height) - tile->y);
+
+    jpeg_writer_init(&writer, pool_buffer + offset, pool_size - offset);
+    jpeg_writer_headers(&writer, jpeg, frame, tile->width, tile->height, false);
+    jpeg_writer_dht(&writer, &ctx->tables);
+    jpeg_writer_begin_scan(&writer, jpeg, frame, &ctx->tables, 0);
+    err = transcode_rect(r, &writer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    jpeg_writer_end_scan(&writer);
+    if (writer.overflow) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    tile->jpeg = pool_buffer + offset;
+    tile->len = writer.pos;
+    return ESP_OK;
+}
+
+static void commit_keyframe(jpeg_tile_set_t *set) {
+    memcpy(reference, current, grid_mcus * sizeof(mcu_signature_t));
+    have_reference = true;
+    frames_since_keyframe = 0;
+    set->keyframe = true;
+    set->count = 0;
+    tiles_stats.keyframes++;
+}
+
+esp_err_t jpeg_tiles_init(size_t size) {
+    if (pool_buffer != NULL) {
+        return ESP_OK;
+    }
+
+    ctx = tiles_alloc(sizeof(tiles_ctx_t));
+    pool_buffer = tiles_alloc(size);
+    if (ctx == NULL || pool_buffer == NULL) {
+        free(ctx);
+        free(pool_buffer);
+        ctx = NULL;
+        pool_buffer = NULL;
+        ESP_LOGE(TAG, "Failed to allocate %zu byte tile pool", size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pool_size = size;
+    memset(&tiles_stats, 0, sizeof(tiles_stats));
+    ESP_LOGI(TAG, "Tiling ready, %zu byte pool, keyframe every %d frames", size, TILE_KEYFRAME_INTERVAL);
+    return ESP_OK;
+}
+
+static esp_err_t process_frame(const uint8_t *jpeg, size_t len, jpeg_tile_set_t *set) {
+    memset(set, 0, sizeof(*set));
+    tiles_stats.frames++;
+
+    esp_err_t err = jpeg_frame_parse(jpeg, len, &ctx->frame);
+    if (err == ESP_OK) {
+        err = ensure_grid(&ctx->frame);
+    }
+    if (err == ESP_OK) {
+        err = scan_signatures(jpeg, len);
+    }
+    if (err != ESP_OK) {
+        // Cannot track this frame; the whole frame goes out and the next one starts over
+        ESP_LOGW(TAG, "Frame not tileable: %s", esp_err_to_name(err));
+        have_reference = false;
+        set->keyframe = true;
+        tiles_stats.keyframes++;
+        return ESP_OK;
+    }
+
+    set->frame_width = ctx->frame.width;
+    set->frame_height = ctx->frame.height;
+
+    if (!have_reference || ++frames_since_keyframe >= TILE_KEYFRAME_INTERVAL) {
+        set->changed_fraction = 1.0f;
+        commit_keyframe(set);
+        return ESP_OK;
+    }
+
+    uint32_t changed_mcus = mark_changes();
+    set->changed_fraction = (float)changed_mcus / (float)grid_mcus;
+    if (changed_mcus == 0) {
+        tiles_stats.unchanged_frames++;
+        return ESP_OK;
+    }
+
+    mcu_rect_t rects[MAX_REGIONS];
+    int count = find_regions(rects);
+    uint32_t area = 0;
+    for (int i = 0; i < count; i++) {
+        area += rect_area(&rects[i]);
+    }
+    if (count < 0 || area > grid_mcus * TILE_MAX_AREA_PERCENT / 100) {
+        ESP_LOGI(TAG, "%.0f%% of MCUs changed, sending a keyframe", set->changed_fraction * 100.0f);
+        commit_keyframe(set);
+        return ESP_OK;
+    }
+
+    size_t offset = 0;
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        err = cut_tile(jpeg, &rects[i], offset, &set->tiles[i]);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Tile cut failed (%s), sending a keyframe", esp_err_to_name(err));
+            tiles_stats.fallbacks++;
+            commit_keyframe(set);
+            return ESP_OK;
+        }
+        offset += set->tiles[i].len;
+        total += set->tiles[i].len;
+    }
+
+    // Tiles that add up to more than the frame are not worth it
+    if (total >= len) {
+        commit_keyframe(set);
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < count; i++) {
+        for (uint32_t y = rects[i].y0; y < rects[i].y1; y++) {
+            uint32_t row = y * ctx->frame.mcus_x;
+            memcpy(&reference[row + rects[i].x0], &current[row + rects[i].x0],
+                   (rects[i].x1 - rects[i].x0) * sizeof(mcu_signature_t));
+        }
+    }
+
+    set->count = count;
+    tiles_stats.tiled_frames++;
+    tiles_stats.tiles += count;
+    tiles_stats.bytes_in += len;
+    tiles_stats.bytes_out += total;
+    ESP_LOGI(TAG, "%d tile(s), %zu of %zu bytes, %.1f%% of MCUs changed",
+             count, total, len, set->changed_fraction * 100.0f);
+    return ESP_OK;
+}
+
+// Decide between a keyframe, tiles or nothing for this frame. The reference is
+// updated as if the result reaches the receiver; call jpeg_tiles_invalidate()
+// when it does not.
+esp_err_t jpeg_tiles_process(const uint8_t *jpeg, size_t len, jpeg_tile_set_t *set) {
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (jpeg == NULL || set == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The signature scan and tile cuts decode the frame twice with random row access;
+    // on a DRAM copy those reads stay off the PSRAM cache. Tiles point into the pool.
+    const uint8_t *staged = psram_stage_acquire(jpeg, len);
+    esp_err_t err = process_frame(staged, len, set);
+    psram_stage_release(staged);
+    return err;
+}
+
+// Force a keyframe next, e.g. after an upload failed and the receiver fell behind
+void jpeg_tiles_invalidate(void) {
+    have_reference = false;
+}
+
+void jpeg_tiles_get_stats(jpeg_tiles_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = tiles_stats;
+    }
+}
@@ -0,0 +1,236 @@
+#include "jpeg_utils.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "JPEG_UTILS";
+static jpeg_sanitize_stats_t sanitize_stats;
+
+// Marker codes
+#define M_SOI 0xD8
+#define M_EOI 0xD9
+#define M_SOS 0xDA
+#define M_APP0 0xE0
+#define M_APP14 0xEE
+#define M_APP15 0xEF
+#define M_COM 0xFE
+
+static bool marker_is_droppable(uint8_t marker) {
+    // APP14 (Adobe) can change the colour transform, so it stays
+    return (marker >= M_APP0 && marker <= M_APP15 && marker != M_APP14) || marker == M_COM;
+}
+
+static esp_err_t add_range(jpeg_ranges_t *ranges, size_t offset, size_t len) {
+    if (len == 0) {
+        return ESP_OK;
+    }
+
+    // Extend the previous span when contiguous so the list stays short
+    if (ranges->count > 0) {
+        jpeg_range_t *last = &ranges->ranges[ranges->count - 1];
+        if (last->offset + last->len == offset) {
+            last->len += len;
+            ranges->total_len += len;
+            return ESP_OK;
+        }
+    }
+
+    if (ranges->count >= JPEG_MAX_RANGES) {
+        return ESP_ERR_NO_MEM;
+    }
+    ranges->ranges[ranges->count].offset = offset;
+    ranges->ranges[ranges->count].len = len;
+    ranges->count++;
+    ranges->total_len += len;
+    return ESP_OK;
+}
+
+void jpeg_ranges_whole(size_t len, jpeg_ranges_t *ranges) {
+    memset(ranges, 0, sizeof(*ranges));
+    ranges->original_len = len;
+    add_range(ranges, 0, len);
+}
+
+// Walk the marker segments up to SOS, then scan entropy-coded data for EOI.
+// On anything unexpected the whole buffer is passed through untouched.
+static esp_err_t sanitize(const uint8_t *jpeg, size_t len, jpeg_ranges_t *ranges) {
+    size_t pos = 0;
+
+    // The driver can leave junk before SOI
+    while (pos + 1 < len && !(jpeg[pos] == 0xFF && jpeg[pos + 1] == M_SOI)) {
+        pos++;
+    }
+    if (pos + 1 >= len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = add_range(ranges, pos, 2);
+    pos += 2;
+
+    // Header segments
+    while (err == ESP_OK) {
+        if (pos + 4 > len || jpeg[pos] != 0xFF) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        // Skip fill bytes between segments
+        size_t marker_pos = pos;
+        while (marker_pos + 1 < len && jpeg[marker_pos + 1] == 0xFF) {
+            marker_pos++;
+        }
+        if (marker_pos + 4 > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        uint8_t marker = jpeg[marker_pos + 1];
+        if (marker == M_EOI || marker == M_SOI || (marker >= 0xD0 && marker <= 0xD7)) {
+            return ESP_ERR_INVALID_STATE;  // No image data before these
+        }
+
+        size_t seg_len = ((size_t)jpeg[marker_pos + 2] << 8) | jpeg[marker_pos + 3];
+        if (seg_len < 2 || marker_pos + 2 + seg_len > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        size_t seg_end = marker_pos + 2 + seg_len;
+        if (!marker_is_droppable(marker)) {
+            err = add_range(ranges, marker_pos, seg_end - marker_pos);
+        }
+        pos = seg_end;
+
+        if (marker == M_SOS) {
+            break;
+        }
+    }
+
+    // Entropy-coded data: FF00 is a stuffed byte and FFD0-FFD7 are restart markers
+    size_t scan_start = pos;
+    while (pos + 1 < len) {
+        if (jpeg[pos] != 0xFF) {
+            pos++;
+            continue;
+        }
+        uint8_t next = jpeg[pos + 1];
+        if (next == 0x00 || (next >= 0xD0 && next <= 0xD7) || next == 0xFF) {
+            pos += (next == 0xFF) ? 1 : 2;
+            continue;
+        }
+        if (next == M_EOI) {
+            if (err == ESP_OK) {
+                err = add_range(ranges, scan_start, pos + 2 - scan_start);
+            }
+            return err;
+        }
+        // Progressive or multi-scan files: keep the rest verbatim up to EOI
+        pos += 2;
+    }
+
+    return ESP_ERR_NOT_FOUND;  // No EOI
+}
+
+esp_err_t jpeg_sanitize(const uint8_t *jpeg, size_t len, jpeg_ranges_t *ranges) {
+    if (jpeg == NULL || len == 0 || ranges == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(ranges, 0, sizeof(*ranges));
+    ranges->original_len = len;
+
+    esp_err_t err = sanitize(jpeg, len, ranges);
+    sanitize_stats.frames++;
+    sanitize_stats.bytes_in += len;
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Not sanitizing %zu byte JPEG: %s", len, esp_err_to_name(err));
+        sanitize_stats.malformed++;
+        jpeg_ranges_whole(len, ranges);
+    }
+    sanitize_stats.bytes_out += ranges->total_len;
+
+    ESP_LOGD(TAG, "Sanitized %zu -> %zu bytes in %zu range(s)", len, ranges->total_len, ranges->count);
+    return err;
+}
+
+void jpeg_ranges_copy(const uint8_t *jpeg, const jpeg_ranges_t *ranges, uint8_t *out) {
+    for (size_t i = 0; i < ranges->count; i++) {
+        memcpy(out, jpeg + ranges->ranges[i].offset, ranges->ranges[i].len);
+        out += ranges->ranges[i].len;
+    }
+}
+
+size_t jpeg_ranges_base64_len(const jpeg_ranges_t *ranges) {
+    return 4 * ((ranges->total_len + 2) / 3);
+}
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static inline void encode_group(const uint8_t in[3], char *out) {
+    out[0] = base64_alphabet[in[0] >> 2];
+    out[1] = base64_alphabet[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+    out[2] = base64_alphabet[((in[1] & 0x0F) << 2) | (in[2] >> 6)];
+    out[3] = base64_alphabet[in[2] & 0x3F];
+}
+
+// Base64 across range boundaries, carrying up to two bytes from one span into the next
+esp_err_t jpeg_ranges_base64(const uint8_t *jpeg, const jpeg_ranges_t *ranges, char *out, size_t out_size,
+                             size_t *out_len) {
+    if (jpeg == NULL || ranges == NULL || out == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t needed = jpeg_ranges_base64_len(ranges);
+    if (out_size < needed + 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t carry[3];
+    size_t carried = 0;
+    char *dst = out;
+
+    for (size_t r = 0; r < ranges->count; r++) {
+        const uint8_t *src = jpeg + ranges->ranges[r].offset;
+        size_t remaining = ranges->ranges[r].len;
+
+        while (carried > 0 && carried < 3 && remaining > 0) {
+            carry[carried++] = *src++;
+            remaining--;
+        }
+        if (carried == 3) {
+            encode_group(carry, dst);
+            dst += 4;
+            carried = 0;
+        }
+
+        while (remaining >= 3) {
+            encode_group(src, dst);
+            dst += 4;
+            src += 3;
+            remaining -= 3;
+        }
+
+        while (remaining > 0) {
+            carry[carried++] = *src++;
+            remaining--;
+        }
+    }
+
+    if (carried > 0) {
+        if (carried == 1) {
+            carry[1] = 0;
+        }
+        carry[2] = 0;
+        encode_group(carry, dst);
+        dst[3] = '=';
+        if (carried == 1) {
+            dst[2] = '=';
+        }
+        dst += 4;
+    }
+
+    *dst = '\0';
+    *out_len = (size_t)(dst - out);
+    return ESP_OK;
+}
+
+void jpeg_sanitize_get_stats(jpeg_sanitize_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = sanitize_stats;
+    }
+}
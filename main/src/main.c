@@ -11,8 +11,27 @@
 #include "wifi_manager.h"
 #include "firebase_manager.h"
 #include "camera_manager.h"
+#include "spool_manager.h"
+#include "resumable_upload.h"
+#include "uploader.h"
+#include "frame_fanout.h"
+#include "capture_scheduler.h"
+#include "time_sync.h"
+#include "runtime_config.h"
+#include "power_manager.h"
+#include "original_fetch.h"
+#include "jpeg_optimize.h"
+#include "jpeg_tiles.h"
+#include "jpeg_mask.h"
+#include "person_detect.h"
+#include "task_plan.h"
+#include "psram_stage.h"
+#include "ota_manager.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
 
 static const char *TAG = "MAIN";
+static const uploader_backend_t *active_uploader = NULL;
 
 // Add this to your main.c before credentials_init()
 
@@ -62,16 +81,19 @@ void debug_nvs_partition(void)
 // Call this in app_main() before credentials_init():
 // debug_nvs_partition();
 // Function to generate timestamp
-void generate_timestamp(char *buffer, size_t buffer_size)
+void format_timestamp(time_t when, char *buffer, size_t buffer_size)
 {
-    time_t now;
     struct tm timeinfo;
 
-    time(&now);
-    localtime_r(&now, &timeinfo);
+    localtime_r(&when, &timeinfo);
     strftime(buffer, buffer_size, "%Y%m%d_%H%M%S", &timeinfo);
 }
 
+void generate_timestamp(char *buffer, size_t buffer_size)
+{
+    format_timestamp(time(NULL), buffer, buffer_size);
+}
+
 // Function to setup default credentials (for first-time setup)
 esp_err_t setup_default_credentials(void)
 {
@@ -102,48 +124,560 @@ esp_err_t setup_default_credentials(void)
     return ESP_OK;
 }
 
-// Main camera and upload task
+#if UPLOAD_MODE != UPLOAD_MODE_RESUMABLE && UPLOAD_MODE != UPLOAD_MODE_FANOUT
+static esp_err_t submit_work(void *arg)
+{
+    return active_uploader->submit((const uploader_frame_t *)arg);
+}
+
+// Submit on the core-0 network task; the frame's buffers stay valid until it returns
+static esp_err_t upload_submit(const uploader_frame_t *frame)
+{
+    return task_plan_run_network(submit_work, (void *)frame);
+}
+#endif
+
+#if UPLOAD_MODE == UPLOAD_MODE_RESUMABLE
+static esp_err_t drain_work(void *arg)
+{
+    *(int *)arg = resumable_upload_drain();
+    return ESP_OK;
+}
+#endif
+
+#if UPLOAD_MODE == UPLOAD_MODE_THUMBNAIL
+static esp_err_t fetch_work(void *arg)
+{
+    *(int *)arg = original_fetch_poll();
+    return ESP_OK;
+}
+#endif
+
+#if UPLOAD_MODE == UPLOAD_MODE_TILES
+static char keyframe_timestamp[64] = "";
+
+// Base64-encode a standalone JPEG and submit it under key; returns bytes sent
+static size_t submit_jpeg(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                          const char *key, const char *metadata)
+{
+    camera_fb_t jpeg_fb = {
+        .buf = (uint8_t *)jpeg,
+        .len = len,
+        .width = width,
+        .height = height,
+        .format = PIXFORMAT_JPEG,
+    };
+    char *base64_image = NULL;
+    size_t base64_len = 0;
+    esp_err_t err = camera_frame_to_base64(&jpeg_fb, &base64_image, &base64_len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to encode %s: %s", key, esp_err_to_name(err));
+        return 0;
+    }
+
+    uploader_frame_t frame = {
+        .base64 = base64_image,
+        .base64_len = base64_len,
+        .timestamp = key,
+        .metadata = metadata,
+    };
+    err = upload_submit(&frame);
+    free(base64_image);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to upload %s: %s", key, esp_err_to_name(err));
+        return 0;
+    }
+    return base64_len;
+}
+#endif
+
+#if UPLOAD_MODE != UPLOAD_MODE_RESUMABLE && UPLOAD_MODE != UPLOAD_MODE_THUMBNAIL && UPLOAD_MODE != UPLOAD_MODE_TILES
+// Wrap annotation members such as "person":0.91 into a JSON object; NULL when there are none
+static const char *annotation_json(const char *annotation, char *buffer, size_t size)
+{
+    if (annotation[0] == '\0')
+    {
+        return NULL;
+    }
+    snprintf(buffer, size, "{%s}", annotation);
+    return buffer;
+}
+#endif
+
+#if CONTENT_HASH_ENABLED && UPLOAD_MODE == UPLOAD_MODE_RTDB_JSON
+static void content_hash_hex(const uint8_t digest[32], char hex[65])
+{
+    for (int i = 0; i < 32; i++)
+    {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+}
+#endif
+
+// Hand one captured frame to the configured upload path; returns bytes sent upstream.
+// annotation holds extra JSON metadata members for the frame, or is empty.
+static size_t deliver_frame(const camera_fb_t *fb, const char *timestamp, const char *annotation)
+{
+#if UPLOAD_MODE == UPLOAD_MODE_RESUMABLE
+    // Spool the raw JPEG first so an interrupted upload can resume after a reboot
+    esp_err_t err = spool_store_frame(timestamp, fb->buf, fb->len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to spool image: %s", esp_err_to_name(err));
+    }
+
+    int uploaded = 0;
+    task_plan_run_network(drain_work, &uploaded);
+    ESP_LOGI(TAG, "Uploaded %d spooled frame(s), %zu pending", uploaded, spool_pending_count());
+    return (err == ESP_OK) ? fb->len : 0;
+#elif UPLOAD_MODE == UPLOAD_MODE_THUMBNAIL
+    // Keep the original locally; only the thumbnail goes out every cycle
+    esp_err_t err = spool_store_frame(timestamp, fb->buf, fb->len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to spool original: %s", esp_err_to_name(err));
+    }
+
+    camera_thumbnail_t thumbnail;
+    err = camera_make_thumbnail(fb, THUMBNAIL_MIN_WIDTH, THUMBNAIL_JPEG_QUALITY, &thumbnail);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to make thumbnail: %s", esp_err_to_name(err));
+        return 0;
+    }
+
+    camera_fb_t thumbnail_fb = {
+        .buf = thumbnail.jpeg,
+        .len = thumbnail.len,
+        .width = thumbnail.width,
+        .height = thumbnail.height,
+        .format = PIXFORMAT_JPEG,
+    };
+    char *base64_image = NULL;
+    size_t base64_len = 0;
+    err = camera_frame_to_base64(&thumbnail_fb, &base64_image, &base64_len);
+    camera_free_thumbnail(&thumbnail);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to encode thumbnail: %s", esp_err_to_name(err));
+        return 0;
+    }
+
+    char metadata[192];
+    snprintf(metadata, sizeof(metadata),
+             "{\"thumbnail\":true,\"width\":%u,\"height\":%u,\"original_width\":%u,\"original_height\":%u,\"original_size\":%zu%s%s}",
+             thumbnail_fb.width, thumbnail_fb.height, fb->width, fb->height, fb->len,
+             annotation[0] ? "," : "", annotation);
+    uploader_frame_t frame = {
+        .jpeg = NULL,
+        .base64 = base64_image,
+        .base64_len = base64_len,
+        .timestamp = timestamp,
+        .metadata = metadata,
+    };
+    err = upload_submit(&frame);
+    free(base64_image);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to upload thumbnail: %s", esp_err_to_name(err));
+        return 0;
+    }
+
+    // Serve any originals a client asked for since the last cycle
+    int fetched = 0;
+    task_plan_run_network(fetch_work, &fetched);
+    if (fetched > 0)
+    {
+        ESP_LOGI(TAG, "Uploaded %d requested original(s)", fetched);
+    }
+    return base64_len;
+#elif UPLOAD_MODE == UPLOAD_MODE_TILES
+    jpeg_tile_set_t set;
+    esp_err_t err = jpeg_tiles_process(fb->buf, fb->len, &set);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to tile image: %s", esp_err_to_name(err));
+        return 0;
+    }
+
+    char metadata[224];
+    if (set.keyframe)
+    {
+        snprintf(metadata, sizeof(metadata), "{\"keyframe\":true,\"width\":%u,\"height\":%u%s%s}",
+                 fb->width, fb->height, annotation[0] ? "," : "", annotation);
+        size_t sent = submit_jpeg(fb->buf, fb->len, fb->width, fb->height, timestamp, metadata);
+        if (sent == 0)
+        {
+            jpeg_tiles_invalidate();
+            keyframe_timestamp[0] = '\0';
+            return 0;
+        }
+        snprintf(keyframe_timestamp, sizeof(keyframe_timestamp), "%s", timestamp);
+        return sent;
+    }
+
+    // Tiles are applied in capture order on top of the keyframe they name
+    size_t bytes_sent = 0;
+    for (int i = 0; i < set.count; i++)
+    {
+        const jpeg_tile_t *tile = &set.tiles[i];
+        char key[80];
+        snprintf(key, sizeof(key), "%s_t%d", timestamp, i);
+        snprintf(metadata, sizeof(metadata),
+                 "{\"tile\":true,\"keyframe\":\"%s\",\"frame\":\"%s\",\"index\":%d,\"count\":%d,"
+                 "\"x\":%u,\"y\":%u,\"width\":%u,\"height\":%u%s%s}",
+                 keyframe_timestamp, timestamp, i, set.count, tile->x, tile->y, tile->width, tile->height,
+                 annotation[0] ? "," : "", annotation);
+
+        size_t sent = submit_jpeg(tile->jpeg, tile->len, tile->width, tile->height, key, metadata);
+        if (sent == 0)
+        {
+            // The receiver is now behind; the next frame goes out whole
+            jpeg_tiles_invalidate();
+            break;
+        }
+        bytes_sent += sent;
+    }
+    if (set.count == 0)
+    {
+        ESP_LOGI(TAG, "Scene unchanged, nothing uploaded");
+    }
+    return bytes_sent;
+#elif UPLOAD_MODE == UPLOAD_MODE_FANOUT
+    // One capture feeds every sink; dispatch copies the frame and never blocks
+    char metadata[80];
+    esp_err_t err = fanout_dispatch(fb->buf, fb->len, timestamp,
+                                    annotation_json(annotation, metadata, sizeof(metadata)));
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to dispatch image: %s", esp_err_to_name(err));
+    }
+
+    fanout_log_stats();
+    return (err == ESP_OK) ? fb->len : 0;
+#else
+#if UPLOADER_BACKEND == UPLOADER_BACKEND_FIREBASE
+    // Skip the encode too while the database is refusing our credentials
+    uint32_t retry_in_s = 0;
+    if (firebase_upload_blocked(&retry_in_s))
+    {
+        ESP_LOGW(TAG, "Uploads paused after an auth failure, retry in %lu s", (unsigned long)retry_in_s);
+        return 0;
+    }
+#endif
+
+    // Encode only if the active backend expects base64
+    char metadata[160];
+    uploader_frame_t frame = {
+        .jpeg = fb->buf,
+        .jpeg_len = fb->len,
+        .timestamp = timestamp,
+        .metadata = annotation_json(annotation, metadata, sizeof(metadata)),
+    };
+    char *base64_image = NULL;
+    size_t base64_len = 0;
+    uint8_t digest[32];
+
+    if (active_uploader->encoding == UPLOADER_ENCODING_BASE64)
+    {
+        esp_err_t err = camera_frame_to_base64_sha256(fb, &base64_image, &base64_len,
+                                                      CONTENT_HASH_ENABLED ? digest : NULL);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to encode image: %s", esp_err_to_name(err));
+            return 0;
+        }
+        frame.base64 = base64_image;
+        frame.base64_len = base64_len;
+    }
+#if CONTENT_HASH_ENABLED
+    else
+    {
+        psram_stage_sha256(fb->buf, fb->len, digest);
+    }
+
+    // The same frame always gets the same key, so a repeated upload overwrites itself
+    char key[96];
+    char digest_hex[65];
+    content_hash_hex(digest, digest_hex);
+    if (CONTENT_HASH_KEY_CHARS > 0)
+    {
+        snprintf(key, sizeof(key), "%s_%.*s", timestamp, CONTENT_HASH_KEY_CHARS, digest_hex);
+        frame.timestamp = key;
+    }
+    snprintf(metadata, sizeof(metadata), "{\"sha256\":\"%s\"%s%s}", digest_hex, annotation[0] ? "," : "",
+             annotation);
+    frame.metadata = metadata;
+#endif
+
+    ESP_LOGI(TAG, "Uploading image via %s...", active_uploader->name);
+    esp_err_t err = upload_submit(&frame);
+
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Image uploaded successfully!");
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Failed to upload image via %s: %s", active_uploader->name, esp_err_to_name(err));
+    }
+
+    size_t bytes_sent = (err != ESP_OK) ? 0 : (base64_image != NULL ? base64_len : fb->len);
+
+    // Cleanup
+    free(base64_image);
+
+    uploader_stats_t upload_stats;
+    active_uploader->get_stats(&upload_stats);
+    uploader_log_stats(active_uploader->name, &upload_stats);
+
+    return bytes_sent;
+#endif
+}
+
+#if JPEG_OPTIMIZE_ENABLED
+// Point a copy of the frame at the re-coded JPEG when the cycle's CPU budget allows it
+static const camera_fb_t *optimize_frame(const camera_fb_t *fb, camera_fb_t *optimized)
+{
+    uint32_t budget_ms = capture_scheduler_get_interval_ms() / 100 * JPEG_OPTIMIZE_CPU_PERCENT;
+    if (budget_ms > JPEG_OPTIMIZE_MAX_MS)
+    {
+        budget_ms = JPEG_OPTIMIZE_MAX_MS;
+    }
+
+    const uint8_t *jpeg = NULL;
+    size_t len = 0;
+    if (jpeg_optimize(fb->buf, fb->len, budget_ms * 1000, &jpeg, &len) != ESP_OK)
+    {
+        return fb;
+    }
+
+    *optimized = *fb;
+    optimized->buf = (uint8_t *)jpeg;
+    optimized->len = len;
+    return optimized;
+}
+#endif
+
+#if PERSON_DETECT_ENABLED
+// Score the frame and add the score to its annotation; false when no person is in view.
+// Frames the gate cannot evaluate within the cycle's budget are uploaded unscored.
+static bool person_gate(const camera_fb_t *fb, char *annotation, size_t size)
+{
+    uint32_t budget_ms = capture_scheduler_get_interval_ms() / 100 * PERSON_DETECT_CPU_PERCENT;
+    if (budget_ms > PERSON_DETECT_MAX_MS)
+    {
+        budget_ms = PERSON_DETECT_MAX_MS;
+    }
+
+    float score = 0.0f;
+    bool person = true;
+    if (!person_detect_ready() ||
+        person_detect_evaluate(fb->buf, fb->len, fb->width, fb->height, budget_ms * 1000, &score, &person) != ESP_OK)
+    {
+        return true;
+    }
+
+    snprintf(annotation, size, "\"person\":%.3f", score);
+    return person;
+}
+#endif
+
+#if PRIVACY_MASK_ENABLED
+// Point a copy of the frame at the masked JPEG; NULL when the frame must be dropped
+static const camera_fb_t *mask_frame(const camera_fb_t *fb, camera_fb_t *masked)
+{
+    if (!jpeg_mask_active())
+    {
+        return fb;
+    }
+
+    camera_roi_t view;
+    camera_get_view(&view);
+    jpeg_mask_view_t mask_view = {
+        .x = view.x,
+        .y = view.y,
+        .width = view.width,
+        .height = view.height,
+    };
+
+    const uint8_t *jpeg = NULL;
+    size_t len = 0;
+    if (jpeg_mask_apply(fb->buf, fb->len, &mask_view, &jpeg, &len) != ESP_OK)
+    {
+        return NULL;
+    }
+
+    *masked = *fb;
+    masked->buf = (uint8_t *)jpeg;
+    masked->len = len;
+    return masked;
+}
+
+// Load the site's polygons; a mask that cannot be parsed blanks the whole frame
+static void privacy_mask_init(void)
+{
+    char text[PRIVACY_MASK_MAX_LEN];
+    if (runtime_config_get_str(RUNTIME_PRIVACY_MASK_KEY, text, sizeof(text)) != ESP_OK)
+    {
+        snprintf(text, sizeof(text), "%s", PRIVACY_MASK_DEFAULT);
+    }
+
+    jpeg_mask_polygon_t polygons[JPEG_MASK_MAX_POLYGONS];
+    int count = 0;
+    if (jpeg_mask_parse(text, polygons, JPEG_MASK_MAX_POLYGONS, &count) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Invalid privacy mask '%s', masking the whole frame", text);
+        polygons[0] = (jpeg_mask_polygon_t){
+            .count = 4,
+            .points = {{0, 0}, {1600, 0}, {1600, 1200}, {0, 1200}},
+        };
+        count = 1;
+    }
+
+    jpeg_mask_set_polygons(polygons, count, PRIVACY_MASK_FILL_LUMA);
+    if (count > 0 && jpeg_mask_init(PRIVACY_MASK_POOL_SIZE) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Privacy mask has no buffer, frames will be dropped");
+    }
+}
+#endif
+
+// Per-core load next to cycle time and wake-up jitter, every TASK_LOAD_LOG_EVERY cycles
+static void log_cycle_load(void)
+{
+    task_plan_stats_t plan_stats;
+    task_plan_get_stats(&plan_stats);
+    if (plan_stats.cycles % TASK_LOAD_LOG_EVERY != 0)
+    {
+        return;
+    }
+
+    task_plan_log_load();
+    capture_scheduler_stats_t sched_stats;
+    capture_scheduler_get_stats(&sched_stats);
+    if (sched_stats.timed_cycles > 0)
+    {
+        ESP_LOGI(TAG, "Jitter: mean %lld us, max %d us over %u cycles",
+                 (long long)(sched_stats.total_jitter_us / sched_stats.timed_cycles),
+                 (int)sched_stats.max_jitter_us, (unsigned)sched_stats.timed_cycles);
+    }
+}
+
+#if OTA_ENABLED
+static esp_err_t ota_work(void *arg)
+{
+    return ota_manager_check();
+}
+
+// Completed capture cycles confirm a freshly installed image, uploaded or not; updates are
+// looked for every OTA_CHECK_EVERY cycles, starting with the first, even while capture
+// fails. A successful update restarts.
+static void ota_cycle(bool healthy)
+{
+    static uint32_t cycles = 0;
+    ota_manager_report_cycle(healthy);
+    if (cycles++ % OTA_CHECK_EVERY == 0)
+    {
+        task_plan_run_network(ota_work, NULL);
+    }
+}
+#endif
+
+// Capture and processing task; network work is handed to the network task
 void camera_upload_task(void *pvParameters)
 {
     char timestamp[64];
 
+    // A boot outside the capture schedule idles until the next window opens
+    capture_scheduler_wait_window();
+
     while (1)
     {
         ESP_LOGI(TAG, "Taking picture...");
+        int64_t cycle_start = esp_timer_get_time();
 
-        // Generate timestamp
-        generate_timestamp(timestamp, sizeof(timestamp));
-
-        // Capture image as base64
-        char *base64_image = NULL;
-        size_t base64_len = 0;
+        // Name the frame after its scheduled slot so aligned cameras share the time part of keys
+        capture_scheduler_frame_key(timestamp, sizeof(timestamp));
 
-        esp_err_t err = camera_capture_to_base64(&base64_image, &base64_len);
+        camera_fb_t *fb = NULL;
+        esp_err_t err = camera_capture_frame(&fb);
         if (err != ESP_OK)
         {
             ESP_LOGE(TAG, "Failed to capture image: %s", esp_err_to_name(err));
-            vTaskDelay(pdMS_TO_TICKS(NUMBER_OF_SECONDS * 1000));
+#if OTA_ENABLED
+            ota_cycle(false);
+#endif
+            capture_scheduler_wait_next();
             continue;
         }
 
-        // Upload to Firebase
-        ESP_LOGI(TAG, "Uploading image to Firebase...");
-        err = firebase_upload_image(base64_image, timestamp);
+        // Scene activity decides how soon the next capture happens
+        capture_scheduler_observe_frame(fb);
 
-        if (err == ESP_OK)
+#if STAGE_ENABLED && STAGE_BENCHMARK_AT_BOOT
+        static bool staging_benchmarked = false;
+        if (!staging_benchmarked)
         {
-            ESP_LOGI(TAG, "Image uploaded successfully!");
+            staging_benchmarked = true;
+            psram_stage_benchmark(fb->buf, fb->len, STAGE_BENCH_ITERATIONS);
         }
-        else
+#endif
+
+        const camera_fb_t *frame = fb;
+        char annotation[64] = "";
+#if PERSON_DETECT_ENABLED
+        if (!person_gate(fb, annotation, sizeof(annotation)))
         {
-            ESP_LOGE(TAG, "Failed to upload image to Firebase: %s", esp_err_to_name(err));
+            ESP_LOGI(TAG, "No person in view, frame not uploaded");
+            frame = NULL;
         }
-
-        // Cleanup
-        free(base64_image);
-
-        ESP_LOGI(TAG, "Waiting %d seconds before next capture...", NUMBER_OF_SECONDS);
-        vTaskDelay(pdMS_TO_TICKS(NUMBER_OF_SECONDS * 1000));
+#endif
+#if QUALITY_GATE_ENABLED
+        // A frame the quality gate still rejected after all retries goes out flagged
+        camera_quality_stats_t quality;
+        camera_get_quality_stats(&quality);
+        if (quality.last_verdict != CAMERA_FRAME_OK)
+        {
+            size_t used = strlen(annotation);
+            snprintf(annotation + used, sizeof(annotation) - used, "%s\"quality\":\"%s\"", used ? "," : "",
+                     camera_frame_verdict_name(quality.last_verdict));
+        }
+#endif
+#if PRIVACY_MASK_ENABLED
+        camera_fb_t masked;
+        if (frame != NULL)
+        {
+            frame = mask_frame(frame, &masked);
+            if (frame == NULL)
+            {
+                ESP_LOGE(TAG, "Privacy mask could not be applied, frame dropped");
+            }
+        }
+#endif
+#if JPEG_OPTIMIZE_ENABLED
+        camera_fb_t optimized;
+        if (frame != NULL)
+        {
+            frame = optimize_frame(frame, &optimized);
+        }
+#endif
+        size_t bytes_sent = (frame != NULL) ? deliver_frame(frame, timestamp, annotation) : 0;
+        camera_return_frame_buffer(fb);
+        capture_scheduler_record_bytes(bytes_sent);
+        task_plan_record_cycle((uint32_t)(esp_timer_get_time() - cycle_start));
+        log_cycle_load();
+#if OTA_ENABLED
+        ota_cycle(true);
+#endif
+
+#if CAMERA_STANDBY_BETWEEN_CAPTURES
+        camera_standby();
+#endif
+
+        capture_scheduler_wait_next();
     }
 }
 
@@ -231,6 +765,23 @@ void app_main(void)
     // Initialize credentials manager
     ESP_ERROR_CHECK(credentials_init());
 
+#if OTA_ENABLED
+    // Starts the rollback timer when this is a new image on its first boots
+    if (ota_manager_init() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Firmware updates disabled");
+    }
+#endif
+
+    if (runtime_config_init() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Runtime config unavailable, using compiled defaults");
+    }
+    if (power_manager_woke_from_deep_sleep())
+    {
+        ESP_LOGI(TAG, "Woke from deep sleep for the next capture window");
+    }
+
     // Load credentials
     credentials_t creds;
     ret = credentials_load(&creds);
@@ -263,12 +814,122 @@ void app_main(void)
     strncpy(firebase_config.database_url, creds.firebase_db_url, sizeof(firebase_config.database_url) - 1);
     strncpy(firebase_config.api_key, creds.firebase_api_key, sizeof(firebase_config.api_key) - 1);
 
-    ESP_ERROR_CHECK(firebase_init(&firebase_config));
+    // MQTT client settings, used by the MQTT backend and fan-out sink
+    uploader_mqtt_config_t mqtt_config = {0};
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    strncpy(mqtt_config.broker_uri, MQTT_BROKER_URI, sizeof(mqtt_config.broker_uri) - 1);
+    strncpy(mqtt_config.topic_prefix, MQTT_TOPIC_PREFIX, sizeof(mqtt_config.topic_prefix) - 1);
+    if (runtime_config_get_str(RUNTIME_DEVICE_ID_KEY, mqtt_config.client_id, sizeof(mqtt_config.client_id)) != ESP_OK ||
+        mqtt_config.client_id[0] == '\0')
+    {
+        snprintf(mqtt_config.client_id, sizeof(mqtt_config.client_id), "esp32cam-%02x%02x%02x", mac[3], mac[4], mac[5]);
+    }
+
+#if UPLOAD_MODE == UPLOAD_MODE_FANOUT
+    ESP_ERROR_CHECK(fanout_init());
+#if FANOUT_SINK_FIREBASE
+    ESP_ERROR_CHECK(fanout_add_sink(&uploader_firebase_backend, &firebase_config, FANOUT_QUEUE_DEPTH));
+#endif
+#if FANOUT_SINK_MQTT
+    ESP_ERROR_CHECK(fanout_add_sink(&uploader_mqtt_backend, &mqtt_config, FANOUT_QUEUE_DEPTH));
+#endif
+#if FANOUT_SINK_SD
+    // A missing card should not keep the network sinks from running
+    ret = fanout_add_sink(&uploader_sd_backend, NULL, FANOUT_QUEUE_DEPTH);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "SD archive unavailable: %s", esp_err_to_name(ret));
+    }
+#endif
+#elif UPLOADER_BACKEND == UPLOADER_BACKEND_MQTT
+    active_uploader = &uploader_mqtt_backend;
+    ESP_ERROR_CHECK(active_uploader->init(&mqtt_config));
+#else
+    active_uploader = &uploader_firebase_backend;
+    ESP_ERROR_CHECK(active_uploader->init(&firebase_config));
+#endif
+
+    // Deep sleep drops RAM, so whatever the upload path still holds goes out first
+#if UPLOAD_MODE == UPLOAD_MODE_FANOUT
+    power_manager_set_flush(fanout_flush);
+#else
+    power_manager_set_flush(active_uploader->flush);
+#endif
+
+#if UPLOAD_MODE == UPLOAD_MODE_RESUMABLE
+    // Frames spooled before a reboot are resumed by the upload task
+    if (!firebase_is_configured())
+    {
+        ESP_ERROR_CHECK(firebase_init(&firebase_config));
+    }
+    ESP_ERROR_CHECK(spool_init());
+    ESP_ERROR_CHECK(resumable_upload_init(&firebase_config));
+#endif
+#if UPLOAD_MODE == UPLOAD_MODE_THUMBNAIL
+    // Originals wait in the spool until a client requests them
+    ESP_ERROR_CHECK(spool_init());
+    ESP_ERROR_CHECK(resumable_upload_init(&firebase_config));
+    ESP_ERROR_CHECK(original_fetch_init(mqtt_config.client_id));
+#endif
+#if UPLOAD_MODE == UPLOAD_MODE_TILES
+    ESP_ERROR_CHECK(jpeg_tiles_init(TILE_POOL_SIZE));
+#endif
 
     // Initialize time (for better timestamps)
     setenv("TZ", "UTC", 1);
     tzset();
 
+    // Aligned capture slots need wall-clock time; without it the scheduler runs on ticks
+    if (time_sync_init(SNTP_SERVER) == ESP_OK)
+    {
+        time_sync_wait(SNTP_SYNC_TIMEOUT_MS);
+    }
+
+#if STAGE_ENABLED
+    // Kernels read PSRAM directly if the scratch cannot be allocated
+    if (psram_stage_init(STAGE_SCRATCH_SIZE) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "PSRAM staging disabled");
+    }
+#endif
+
+#if JPEG_OPTIMIZE_ENABLED
+    // Frames are sent as captured if the pool cannot be allocated
+    if (jpeg_optimize_init(JPEG_OPTIMIZE_POOL_SIZE) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Huffman optimization disabled");
+    }
+#endif
+
+#if PRIVACY_MASK_ENABLED
+    privacy_mask_init();
+#endif
+
+#if PERSON_DETECT_ENABLED
+    // Without a usable model every frame is uploaded
+    if (person_detect_init(PERSON_DETECT_PARTITION_LABEL, PERSON_DETECT_ARENA_SIZE, PERSON_DETECT_THRESHOLD) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Person detection disabled");
+    }
+#endif
+
+    // Sensor window, programmed by camera init
+    char roi_text[CAMERA_ROI_MAX_LEN];
+    camera_roi_t roi;
+    if (runtime_config_get_str(RUNTIME_CAMERA_ROI_KEY, roi_text, sizeof(roi_text)) != ESP_OK)
+    {
+        snprintf(roi_text, sizeof(roi_text), "%s", CAMERA_ROI_DEFAULT);
+    }
+    if (camera_parse_roi(roi_text, &roi) == ESP_OK)
+    {
+        camera_set_roi(&roi);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Ignoring invalid camera ROI, capturing the full frame");
+    }
+
     // Initialize camera
     ESP_LOGI(TAG, "Initializing camera...");
     ESP_ERROR_CHECK(camera_init_default());
@@ -284,8 +945,25 @@ void app_main(void)
         ESP_LOGI(TAG, "IP Address: %s", ip_str);
     }
 
-    // Start camera upload task
-    xTaskCreate(camera_upload_task, "camera_upload", 8192, NULL, 5, NULL);
+    ESP_ERROR_CHECK(capture_scheduler_init(NULL));
+    capture_scheduler_set_device_id(mqtt_config.client_id);
+
+    char schedule[CAPTURE_SCHEDULE_MAX_LEN];
+    if (runtime_config_get_str(RUNTIME_CAPTURE_SCHEDULE_KEY, schedule, sizeof(schedule)) != ESP_OK)
+    {
+        snprintf(schedule, sizeof(schedule), "%s", CAPTURE_SCHEDULE_DEFAULT);
+    }
+    if (capture_scheduler_set_window(schedule) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Ignoring invalid capture schedule, capturing around the clock");
+        capture_scheduler_set_window(CAPTURE_SCHEDULE_DEFAULT);
+    }
+
+    // Network work on core 0 next to WiFi/lwIP, capture and processing on core 1
+#if UPLOAD_MODE != UPLOAD_MODE_FANOUT
+    ESP_ERROR_CHECK(task_plan_start_network());
+#endif
+    ESP_ERROR_CHECK(task_plan_create(TASK_PLAN_PIPELINE, camera_upload_task, NULL, NULL, NULL));
 
     ESP_LOGI(TAG, "Application started successfully");
 }
\ No newline at end of file
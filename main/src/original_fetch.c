@@ -0,0 +1,97 @@
+#include "original_fetch.h"
+#include "config.h"
+#include "firebase_manager.h"
+#include "resumable_upload.h"
+#include "spool_manager.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ORIGINAL_FETCH";
+static char request_path[sizeof(ORIGINAL_FETCH_PATH) + 40];
+static bool fetch_initialized = false;
+
+esp_err_t original_fetch_init(const char *device_id) {
+    if (device_id == NULL || strlen(device_id) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    snprintf(request_path, sizeof(request_path), "%s/%s", ORIGINAL_FETCH_PATH, device_id);
+    fetch_initialized = true;
+    ESP_LOGI(TAG, "Watching %s for original requests", request_path);
+    return ESP_OK;
+}
+
+static esp_err_t serve_request(const char *key) {
+    char path[sizeof(request_path) + SPOOL_KEY_MAX_LEN + 1];
+    snprintf(path, sizeof(path), "%s/%s", request_path, key);
+
+    size_t len = 0;
+    esp_err_t err;
+    if (strlen(key) >= SPOOL_KEY_MAX_LEN || spool_get_frame_size(key, &len) != ESP_OK) {
+        // Evicted or never captured: tell the requester instead of retrying forever
+        ESP_LOGW(TAG, "Requested original %s is not in the spool", key);
+        char record[sizeof(RESUMABLE_RECORD_PREFIX) + SPOOL_KEY_MAX_LEN + 1];
+        snprintf(record, sizeof(record), RESUMABLE_RECORD_PREFIX "/%s", key);
+        firebase_put_json(record, "{\"status\":\"unavailable\"}");
+        return firebase_delete(path);
+    }
+
+    ESP_LOGI(TAG, "Uploading requested original %s (%zu bytes)", key, len);
+    err = resumable_upload_spooled(key);
+    if (err != ESP_OK) {
+        // The session is persisted, so the next poll resumes where this one stopped
+        ESP_LOGW(TAG, "Original %s not finished: %s", key, esp_err_to_name(err));
+        return err;
+    }
+
+    return firebase_delete(path);
+}
+
+// Serve up to ORIGINAL_FETCH_MAX_PER_CYCLE pending requests; returns how many completed
+int original_fetch_poll(void) {
+    if (!fetch_initialized) {
+        return 0;
+    }
+
+    char *response = malloc(ORIGINAL_FETCH_RESPONSE_SIZE);
+    if (response == NULL) {
+        return 0;
+    }
+
+    // Shallow keeps the response to the request keys only
+    esp_err_t err = firebase_get_json(request_path, "shallow=true", response, ORIGINAL_FETCH_RESPONSE_SIZE);
+    if (err != ESP_OK) {
+        free(response);
+        return 0;
+    }
+
+    cJSON *root = cJSON_Parse(response);
+    free(response);
+    if (root == NULL || !cJSON_IsObject(root)) {
+        cJSON_Delete(root);
+        return 0;
+    }
+
+    int served = 0;
+    int attempted = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, root) {
+        if (attempted >= ORIGINAL_FETCH_MAX_PER_CYCLE) {
+            break;
+        }
+        if (item->string == NULL) {
+            continue;
+        }
+        attempted++;
+        if (serve_request(item->string) == ESP_OK) {
+            served++;
+        }
+    }
+
+    cJSON_Delete(root);
+    return served;
+}
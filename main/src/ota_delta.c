@@ -0,0 +1,234 @@
+#include "ota_delta.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "OTA_DELTA";
+
+#define PATCH_VERSION 1
+#define WINDOW_MASK (OTA_DELTA_WINDOW - 1)
+#define EMIT_THRESHOLD 1024         // Decoded bytes held back before parsing; far below the window
+
+static uint32_t read_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ESP_ERR_NOT_FOUND when data does not start with a patch, e.g. for a full image
+esp_err_t ota_delta_parse_header(const uint8_t *data, size_t len, ota_delta_header_t *header) {
+    if (data == NULL || header == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len < OTA_DELTA_HEADER_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (memcmp(data, "SGDP", 4) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (data[4] != PATCH_VERSION || data[5] > OTA_DELTA_COMPRESSION_LZSS) {
+        ESP_LOGE(TAG, "Unsupported patch version %u, compression %u", data[4], data[5]);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    header->compression = data[5];
+    header->old_size = read_u32(data + 8);
+    header->new_size = read_u32(data + 12);
+    memcpy(header->old_sha256, data + 16, 32);
+    memcpy(header->new_sha256, data + 48, 32);
+    return ESP_OK;
+}
+
+void ota_delta_begin(ota_delta_t *delta, const ota_delta_header_t *header, ota_delta_read_t read_old,
+                     ota_delta_write_t write_new, void *ctx) {
+    memset(delta, 0, sizeof(*delta));
+    delta->header = *header;
+    delta->read_old = read_old;
+    delta->write_new = write_new;
+    delta->ctx = ctx;
+    delta->state = OTA_DELTA_RECORD;
+}
+
+static esp_err_t flush_out(ota_delta_t *delta) {
+    if (delta->out_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = delta->write_new(delta->ctx, delta->out, delta->out_len);
+    delta->out_len = 0;
+    return err;
+}
+
+// Step past records and sections that are complete, including empty ones
+static esp_err_t advance(ota_delta_t *delta) {
+    if (delta->state == OTA_DELTA_DIFF && delta->diff_left == 0) {
+        delta->state = OTA_DELTA_EXTRA;
+    }
+    if (delta->state == OTA_DELTA_EXTRA && delta->extra_left == 0) {
+        int64_t pos = (int64_t)delta->old_pos + delta->seek;
+        if (pos < 0 || pos > (int64_t)delta->header.old_size) {
+            ESP_LOGE(TAG, "Seek to %lld outside the %u byte old image", (long long)pos,
+                     (unsigned)delta->header.old_size);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        delta->old_pos = (uint32_t)pos;
+        delta->state = OTA_DELTA_RECORD;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_record(ota_delta_t *delta) {
+    delta->diff_left = read_u32(delta->record);
+    delta->extra_left = read_u32(delta->record + 4);
+    delta->seek = (int32_t)read_u32(delta->record + 8);
+    delta->record_len = 0;
+
+    uint64_t remaining = delta->header.new_size - delta->produced;
+    if ((uint64_t)delta->old_pos + delta->diff_left > delta->header.old_size ||
+        (uint64_t)delta->diff_left + delta->extra_left > remaining) {
+        ESP_LOGE(TAG, "Record of %u+%u bytes at old offset %u does not fit the images",
+                 (unsigned)delta->diff_left, (unsigned)delta->extra_left, (unsigned)delta->old_pos);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    delta->state = OTA_DELTA_DIFF;
+    return ESP_OK;
+}
+
+// Run decoded patch bytes through the record parser
+static esp_err_t consume(ota_delta_t *delta, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        esp_err_t err = advance(delta);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        size_t n = 0;
+        if (delta->state == OTA_DELTA_RECORD) {
+            if (delta->produced == delta->header.new_size) {
+                ESP_LOGE(TAG, "Patch continues past the end of the new image");
+                return ESP_ERR_INVALID_SIZE;
+            }
+            n = sizeof(delta->record) - delta->record_len;
+            n = n < len ? n : len;
+            memcpy(delta->record + delta->record_len, data, n);
+            delta->record_len += n;
+            if (delta->record_len == sizeof(delta->record)) {
+                err = parse_record(delta);
+            }
+        } else {
+            size_t space = sizeof(delta->out) - delta->out_len;
+            size_t left = delta->state == OTA_DELTA_DIFF ? delta->diff_left : delta->extra_left;
+            n = len < left ? len : left;
+            n = n < space ? n : space;
+            uint8_t *out = delta->out + delta->out_len;
+            if (delta->state == OTA_DELTA_DIFF) {
+                n = n < sizeof(delta->old_chunk) ? n : sizeof(delta->old_chunk);
+                err = delta->read_old(delta->ctx, delta->old_pos, delta->old_chunk, n);
+                for (size_t i = 0; i < n; i++) {
+                    out[i] = (uint8_t)(delta->old_chunk[i] + data[i]);
+                }
+                delta->old_pos += n;
+                delta->diff_left -= n;
+            } else {
+                memcpy(out, data, n);
+                delta->extra_left -= n;
+            }
+            delta->out_len += n;
+            delta->produced += n;
+            if (err == ESP_OK && delta->out_len == sizeof(delta->out)) {
+                err = flush_out(delta);
+            }
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+// Parse what the decoder produced since the last call, at most two spans of the ring
+static esp_err_t emit(ota_delta_t *delta) {
+    while (delta->emitted != delta->decoded) {
+        uint32_t start = delta->emitted & WINDOW_MASK;
+        uint32_t n = delta->decoded - delta->emitted;
+        if (n > OTA_DELTA_WINDOW - start) {
+            n = OTA_DELTA_WINDOW - start;
+        }
+        esp_err_t err = consume(delta, delta->window + start, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        delta->emitted += n;
+    }
+    return ESP_OK;
+}
+
+// LZSS: a flag byte (bit set = literal, LSB first) ahead of each group of 8 tokens. A match
+// is a 12-bit distance minus one and a 4-bit length minus three; 15 adds a length byte.
+static esp_err_t inflate(ota_delta_t *delta, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = data[i];
+        if (delta->flag_bits == 0) {
+            delta->flags = b;
+            delta->flag_bits = 8;
+            continue;
+        }
+
+        if (delta->flags & 1) {
+            delta->window[delta->decoded++ & WINDOW_MASK] = b;
+        } else {
+            delta->token[delta->token_len++] = b;
+            int nibble = delta->token[1] & 0x0F;
+            if (delta->token_len < 2 || (delta->token_len == 2 && nibble == 15)) {
+                continue;
+            }
+            uint32_t distance = (((uint32_t)delta->token[0] << 4) | (delta->token[1] >> 4)) + 1;
+            uint32_t length = nibble == 15 ? 18u + delta->token[2] : (uint32_t)nibble + 3;
+            delta->token_len = 0;
+            if (distance > delta->decoded) {
+                ESP_LOGE(TAG, "Match %u bytes back at offset %u", (unsigned)distance, (unsigned)delta->decoded);
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            for (uint32_t k = 0; k < length; k++) {
+                delta->window[delta->decoded & WINDOW_MASK] = delta->window[(delta->decoded - distance) & WINDOW_MASK];
+                delta->decoded++;
+            }
+        }
+        delta->flags >>= 1;
+        delta->flag_bits--;
+
+        if (delta->decoded - delta->emitted >= EMIT_THRESHOLD) {
+            esp_err_t err = emit(delta);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return emit(delta);
+}
+
+// Feed the patch body, i.e. everything after the header, in pieces of any size
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, size_t len) {
+    if (delta->error == ESP_OK) {
+        delta->error = delta->header.compression == OTA_DELTA_COMPRESSION_LZSS ? inflate(delta, data, len)
+                                                                               : consume(delta, data, len);
+    }
+    return delta->error;
+}
+
+// Write out the tail of the new image; fails unless the patch ended exactly at its end
+esp_err_t ota_delta_finish(ota_delta_t *delta) {
+    if (delta->error != ESP_OK) {
+        return delta->error;
+    }
+    esp_err_t err = advance(delta);
+    if (err == ESP_OK && (delta->state != OTA_DELTA_RECORD || delta->record_len != 0 || delta->token_len != 0 ||
+                          delta->produced != delta->header.new_size)) {
+        ESP_LOGE(TAG, "Patch ended after %u of %u bytes", (unsigned)delta->produced,
+                 (unsigned)delta->header.new_size);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK) {
+        err = flush_out(delta);
+    }
+    delta->error = err;
+    return err;
+}
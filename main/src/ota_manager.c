@@ -0,0 +1,382 @@
+#include "ota_manager.h"
+#include "ota_delta.h"
+#include "firebase_manager.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "OTA";
+
+// Where the new image goes while it downloads
+typedef struct {
+    esp_ota_handle_t handle;
+    const esp_partition_t *running;
+    mbedtls_sha256_context sha;
+    size_t written;
+} install_ctx_t;
+
+static const esp_partition_t *running_partition = NULL;
+static esp_timer_handle_t health_timer = NULL;
+static uint32_t healthy_cycles = 0;
+static ota_stats_t ota_stats;
+
+static void *ota_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+// A new image that never completed its health cycles goes back to the previous slot
+static void health_timeout(void *arg) {
+    ESP_LOGE(TAG, "New image not confirmed within %d s, rolling back", OTA_HEALTH_TIMEOUT_MS / 1000);
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+esp_err_t ota_manager_init(void) {
+    running_partition = esp_ota_get_running_partition();
+    if (running_partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memset(&ota_stats, 0, sizeof(ota_stats));
+    ESP_LOGI(TAG, "Running %s from %s", esp_app_get_description()->version, running_partition->label);
+
+#if !CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    ESP_LOGW(TAG, "Bootloader rollback disabled (see sdkconfig.defaults); updates will not be installed");
+#endif
+
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running_partition, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = health_timeout,
+            .name = "ota_health",
+        };
+        esp_err_t err = esp_timer_create(&timer_args, &health_timer);
+        if (err == ESP_OK) {
+            err = esp_timer_start_once(health_timer, (uint64_t)OTA_HEALTH_TIMEOUT_MS * 1000);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        ota_stats.pending_verify = true;
+        ESP_LOGW(TAG, "New image on probation: %d capture cycles within %d s confirm it", OTA_HEALTH_CYCLES,
+                 OTA_HEALTH_TIMEOUT_MS / 1000);
+    }
+    return ESP_OK;
+}
+
+static void confirm_image(const char *reason) {
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+        esp_timer_stop(health_timer);
+        ota_stats.pending_verify = false;
+        ESP_LOGI(TAG, "New image confirmed%s after %u capture cycles", reason, (unsigned)healthy_cycles);
+    }
+}
+
+// Called once per capture cycle; healthy means the camera delivered a frame and the cycle ran
+// to its end, whatever became of the upload. Enough healthy cycles confirm a new image.
+void ota_manager_report_cycle(bool healthy) {
+    if (!ota_stats.pending_verify || !healthy || ++healthy_cycles < OTA_HEALTH_CYCLES) {
+        return;
+    }
+    confirm_image("");
+}
+
+// Called before deep sleep. The bootloader rolls back any image still pending at the next
+// boot, so an image that booted, synced its clock and got as far as the scheduler's sleep
+// is confirmed here rather than lost to the wake-up reset.
+void ota_manager_prepare_sleep(void) {
+    if (ota_stats.pending_verify) {
+        confirm_image(" before deep sleep");
+    }
+}
+
+static esp_err_t hex_to_bytes(const char *hex, uint8_t *out, size_t len) {
+    if (hex == NULL || strlen(hex) != len * 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        out[i] = (uint8_t)byte;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t read_running(void *ctx, size_t offset, uint8_t *buf, size_t len) {
+    install_ctx_t *install = ctx;
+    return esp_partition_read(install->running, offset, buf, len);
+}
+
+static esp_err_t write_update(void *ctx, const uint8_t *data, size_t len) {
+    install_ctx_t *install = ctx;
+    mbedtls_sha256_update(&install->sha, data, len);
+    install->written += len;
+    return esp_ota_write(install->handle, data, len);
+}
+
+// A patch only applies to the exact image it was made from
+static esp_err_t check_running_image(const ota_delta_header_t *header, uint8_t *buf, size_t buf_size) {
+    if (header->old_size > running_partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    esp_err_t err = ESP_OK;
+    for (size_t pos = 0; pos < header->old_size && err == ESP_OK; pos += buf_size) {
+        size_t n = header->old_size - pos < buf_size ? header->old_size - pos : buf_size;
+        err = esp_partition_read(running_partition, pos, buf, n);
+        mbedtls_sha256_update(&sha, buf, n);
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    if (err == ESP_OK && memcmp(digest, header->old_sha256, sizeof(digest)) != 0) {
+        ESP_LOGW(TAG, "Patch was made for a different build than the running one");
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    return err;
+}
+
+// Read until len bytes or the end of the body; returns the count or -1
+static int read_full(esp_http_client_handle_t client, uint8_t *buf, int len) {
+    int total = 0;
+    while (total < len) {
+        int n = esp_http_client_read(client, (char *)buf + total, len - total);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+// Stream url into the next app slot, applying it as a patch when it is one. The result
+// must hash to sha256 before the slot is finalized.
+static esp_err_t install(const char *url, const uint8_t sha256[32], size_t image_size) {
+    const esp_partition_t *update = esp_ota_get_next_update_partition(NULL);
+    if (update == NULL || image_size > update->size) {
+        ESP_LOGE(TAG, "No app slot for a %zu byte image", image_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    install_ctx_t *install = ota_alloc(sizeof(install_ctx_t));
+    ota_delta_t *delta = ota_alloc(sizeof(ota_delta_t));
+    uint8_t *buf = ota_alloc(OTA_DOWNLOAD_CHUNK);
+    if (client == NULL || install == NULL || delta == NULL || buf == NULL) {
+        if (client != NULL) {
+            esp_http_client_cleanup(client);
+        }
+        free(install);
+        free(delta);
+        free(buf);
+        return ESP_ERR_NO_MEM;
+    }
+    memset(install, 0, sizeof(*install));
+    install->running = running_partition;
+    mbedtls_sha256_init(&install->sha);
+    mbedtls_sha256_starts(&install->sha, 0);
+
+    bool began = false;
+    bool patch = false;
+    int downloaded = 0;
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        esp_http_client_fetch_headers(client);
+        int status = esp_http_client_get_status_code(client);
+        if (status < 200 || status >= 300) {
+            ESP_LOGE(TAG, "GET %s rejected, Status = %d", url, status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    // The first bytes tell a patch from a full image
+    ota_delta_header_t header;
+    int n = 0;
+    if (err == ESP_OK) {
+        n = read_full(client, buf, OTA_DELTA_HEADER_SIZE);
+        err = n < 0 ? ESP_FAIL : ota_delta_parse_header(buf, (size_t)n, &header);
+        patch = err == ESP_OK;
+        if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_SIZE) {
+            err = n > 0 ? ESP_OK : ESP_ERR_INVALID_SIZE;
+        }
+        downloaded = n > 0 ? n : 0;
+    }
+    if (err == ESP_OK && patch) {
+        if (header.new_size != image_size || memcmp(header.new_sha256, sha256, 32) != 0) {
+            ESP_LOGE(TAG, "Patch does not produce the image in the manifest");
+            err = ESP_ERR_INVALID_VERSION;
+        } else {
+            err = check_running_image(&header, buf, OTA_DOWNLOAD_CHUNK);
+        }
+    }
+    if (err == ESP_OK) {
+        err = esp_ota_begin(update, image_size, &install->handle);
+        began = err == ESP_OK;
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Writing %zu byte image to %s from a %s", image_size, update->label,
+                 patch ? "delta patch" : "full image");
+        if (patch) {
+            ota_delta_begin(delta, &header, read_running, write_update, install);
+        } else {
+            err = write_update(install, buf, (size_t)n);
+        }
+    }
+    while (err == ESP_OK) {
+        n = esp_http_client_read(client, (char *)buf, OTA_DOWNLOAD_CHUNK);
+        if (n <= 0) {
+            err = n < 0 ? ESP_FAIL : ESP_OK;
+            break;
+        }
+        downloaded += n;
+        err = patch ? ota_delta_feed(delta, buf, (size_t)n) : write_update(install, buf, (size_t)n);
+    }
+    if (err == ESP_OK && patch) {
+        err = ota_delta_finish(delta);
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&install->sha, digest);
+    mbedtls_sha256_free(&install->sha);
+    if (err == ESP_OK && (install->written != image_size || memcmp(digest, sha256, sizeof(digest)) != 0)) {
+        ESP_LOGE(TAG, "Downloaded image does not match the manifest SHA-256 (%zu of %zu bytes)",
+                 install->written, image_size);
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (began && err == ESP_OK) {
+        // Also checks the image format and its appended hash
+        err = esp_ota_end(install->handle);
+    } else if (began) {
+        esp_ota_abort(install->handle);
+    }
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(update);
+    }
+    if (err == ESP_OK) {
+        ota_stats.last_download_bytes = (uint32_t)downloaded;
+        ota_stats.last_image_bytes = (uint32_t)image_size;
+        ESP_LOGI(TAG, "Image verified: %d bytes downloaded for %zu (%d%%), booting %s", downloaded, image_size,
+                 (int)((uint64_t)downloaded * 100 / image_size), update->label);
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    free(buf);
+    free(delta);
+    free(install);
+    return err;
+}
+
+// Compare the manifest with the running version and install an update if there is one;
+// restarts into the new image on success. Runs on the network task.
+esp_err_t ota_manager_check(void) {
+    if (running_partition == NULL || !firebase_is_configured()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ota_stats.pending_verify) {
+        // No update on top of an image that may still be rolled back
+        return ESP_OK;
+    }
+#if !CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    // Without rollback a new image is never pending-verify, so a bad one could not be undone
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+    ota_stats.checks++;
+
+    char *response = malloc(OTA_MANIFEST_SIZE);
+    if (response == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = firebase_get_json(OTA_MANIFEST_PATH, NULL, response, OTA_MANIFEST_SIZE);
+    cJSON *root = err == ESP_OK ? cJSON_Parse(response) : NULL;
+    free(response);
+    if (err != ESP_OK || !cJSON_IsObject(root)) {
+        // No manifest published yet reads back as null
+        cJSON_Delete(root);
+        return err;
+    }
+
+    const char *running_version = esp_app_get_description()->version;
+    const cJSON *version = cJSON_GetObjectItem(root, "version");
+    const cJSON *size = cJSON_GetObjectItem(root, "size");
+    const cJSON *url = cJSON_GetObjectItem(root, "url");
+    uint8_t sha256[32];
+    if (!cJSON_IsString(version) || !cJSON_IsNumber(size) || size->valuedouble <= 0 || !cJSON_IsString(url) ||
+        hex_to_bytes(cJSON_GetStringValue(cJSON_GetObjectItem(root, "sha256")), sha256, sizeof(sha256)) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring malformed manifest");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (strcmp(version->valuestring, running_version) == 0) {
+        cJSON_Delete(root);
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Update available: %s -> %s", running_version, version->valuestring);
+    const char *patch_url = NULL;
+    const cJSON *patch = NULL;
+    cJSON_ArrayForEach(patch, cJSON_GetObjectItem(root, "patches")) {
+        const char *from = cJSON_GetStringValue(cJSON_GetObjectItem(patch, "from"));
+        if (from != NULL && strcmp(from, running_version) == 0) {
+            patch_url = cJSON_GetStringValue(cJSON_GetObjectItem(patch, "url"));
+        }
+    }
+
+    size_t image_size = (size_t)size->valuedouble;
+    err = ESP_ERR_NOT_FOUND;
+    if (patch_url != NULL) {
+        err = install(patch_url, sha256, image_size);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Patch failed (%s), falling back to the full image", esp_err_to_name(err));
+        }
+    }
+    if (err != ESP_OK) {
+        err = install(url->valuestring, sha256, image_size);
+    }
+    cJSON_Delete(root);
+
+    if (err != ESP_OK) {
+        ota_stats.failures++;
+        ESP_LOGE(TAG, "Update failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    ota_stats.updates++;
+    esp_restart();
+    return ESP_OK;
+}
+
+void ota_manager_get_stats(ota_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = ota_stats;
+    }
+}
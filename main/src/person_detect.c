@@ -0,0 +1,186 @@
+#include "person_detect.h"
+#include "config.h"
+#include "image_analysis.h"
+#include "tinyml.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_psram.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "PERSON_DETECT";
+
+static tinyml_model_t *model = NULL;
+static uint8_t *arena = NULL;
+static esp_partition_mmap_handle_t model_map;
+static float score_threshold = 0.5f;
+static person_detect_stats_t detect_stats = {0};
+
+static void *detect_alloc(size_t size) {
+    void *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+// Map the model partition and plan the interpreter; the gate stays off on failure
+esp_err_t person_detect_init(const char *partition_label, size_t arena_size, float threshold) {
+    if (model != NULL) {
+        return ESP_OK;
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No '%s' partition", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const void *mapped = NULL;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &model_map);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map '%s': %s", partition_label, esp_err_to_name(err));
+        return err;
+    }
+
+    model = detect_alloc(sizeof(tinyml_model_t));
+    arena = detect_alloc(arena_size);
+    if (model == NULL || arena == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte arena", arena_size);
+        err = ESP_ERR_NO_MEM;
+    } else {
+        err = tinyml_load(model, mapped, partition->size, arena, arena_size);
+    }
+    if (err == ESP_OK) {
+        const tinyml_tensor_t *input = tinyml_input(model);
+        if (input->ndims != 4 || input->dims[0] != 1 || input->dims[3] != 1 || input->scale <= 0.0f ||
+            tinyml_output(model)->bytes <= PERSON_DETECT_CLASS_INDEX) {
+            ESP_LOGE(TAG, "Model is not a single-channel classifier");
+            err = ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+    if (err != ESP_OK) {
+        free(model);
+        free(arena);
+        model = NULL;
+        arena = NULL;
+        esp_partition_munmap(model_map);
+        return err;
+    }
+
+    score_threshold = threshold;
+    memset(&detect_stats, 0, sizeof(detect_stats));
+    detect_stats.arena_bytes = model->activation_bytes + model->persistent_bytes;
+    detect_stats.macs = (uint32_t)model->macs;
+    ESP_LOGI(TAG, "Person detection ready: %dx%d input, threshold %.2f", (int)tinyml_input(model)->dims[2],
+             (int)tinyml_input(model)->dims[1], threshold);
+    return ESP_OK;
+}
+
+bool person_detect_ready(void) {
+    return model != NULL;
+}
+
+// Box-filter the decode down to the model's input and quantize [0, 1] intensities.
+// The frame is squashed rather than cropped so a person at the edge is still seen.
+static void fill_input(const gray_image_t *gray, tinyml_tensor_t *input) {
+    const int out_h = input->dims[1], out_w = input->dims[2];
+    int8_t *dst = (int8_t *)input->data;
+    const float step = 1.0f / (255.0f * input->scale);
+
+    for (int y = 0; y < out_h; y++) {
+        int y0 = y * gray->height / out_h;
+        int y1 = (y + 1) * gray->height / out_h;
+        y1 = y1 > y0 ? y1 : y0 + 1;
+        for (int x = 0; x < out_w; x++) {
+            int x0 = x * gray->width / out_w;
+            int x1 = (x + 1) * gray->width / out_w;
+            x1 = x1 > x0 ? x1 : x0 + 1;
+            uint32_t sum = 0;
+            for (int sy = y0; sy < y1; sy++) {
+                const uint8_t *row = gray->pixels + (size_t)sy * gray->width;
+                for (int sx = x0; sx < x1; sx++) {
+                    sum += row[sx];
+                }
+            }
+            uint32_t count = (uint32_t)((y1 - y0) * (x1 - x0));
+            int32_t q = (int32_t)lroundf((float)((sum + count / 2) / count) * step) + input->zero_point;
+            *dst++ = (int8_t)(q < -128 ? -128 : (q > 127 ? 127 : q));
+        }
+    }
+}
+
+// Score one frame. ESP_ERR_TIMEOUT means the running cost estimate does not fit
+// budget_us (0 means no limit) and the frame was not evaluated.
+esp_err_t person_detect_evaluate(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                 uint32_t budget_us, float *score, bool *person) {
+    if (model == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (jpeg == NULL || len == 0 || width == 0 || height == 0 || score == NULL || person == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (budget_us && detect_stats.avg_us > budget_us) {
+        detect_stats.skipped_budget++;
+        ESP_LOGD(TAG, "Skipping: predicted %u us exceeds budget %u us", (unsigned)detect_stats.avg_us,
+                 (unsigned)budget_us);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int64_t start = esp_timer_get_time();
+    tinyml_tensor_t *input = tinyml_input(model);
+
+    // Both axes of the decode must cover the input so the box filter only shrinks
+    uint32_t min_width = (uint32_t)input->dims[2];
+    uint32_t cover_height = (uint32_t)input->dims[1] * width / height;
+    min_width = cover_height > min_width ? cover_height : min_width;
+
+    gray_image_t gray = {0};
+    esp_err_t err = image_analysis_gray_from_jpeg(jpeg, len, width, height,
+                                                  (uint16_t)(min_width < width ? min_width : width), &gray);
+    if (err == ESP_OK) {
+        fill_input(&gray, input);
+        image_analysis_free(&gray);
+        err = tinyml_invoke(model);
+    }
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    detect_stats.runs++;
+    detect_stats.last_us = elapsed;
+    detect_stats.avg_us = detect_stats.avg_us ? (detect_stats.avg_us * 3 + elapsed) / 4 : elapsed;
+    detect_stats.max_us = elapsed > detect_stats.max_us ? elapsed : detect_stats.max_us;
+    if (err != ESP_OK) {
+        detect_stats.failures++;
+        ESP_LOGW(TAG, "Evaluation failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const tinyml_tensor_t *output = tinyml_output(model);
+    int8_t q = ((const int8_t *)output->data)[PERSON_DETECT_CLASS_INDEX];
+    *score = (float)(q - output->zero_point) * output->scale;
+    *person = *score >= score_threshold;
+    detect_stats.last_score = *score;
+    if (*person) {
+        detect_stats.passed++;
+    } else {
+        detect_stats.rejected++;
+    }
+
+    ESP_LOGI(TAG, "Person score %.2f in %u us (avg %u us)", *score, (unsigned)elapsed,
+             (unsigned)detect_stats.avg_us);
+    return ESP_OK;
+}
+
+void person_detect_get_stats(person_detect_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = detect_stats;
+    }
+}
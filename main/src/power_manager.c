@@ -0,0 +1,76 @@
+#include "power_manager.h"
+#include "camera_manager.h"
+#include "ota_manager.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "POWER_MGR";
+static power_flush_fn_t sleep_flush = NULL;
+
+void power_manager_set_flush(power_flush_fn_t flush) {
+    sleep_flush = flush;
+}
+
+// Idle outside capture windows. Short gaps keep Wi-Fi associated in max modem sleep;
+// gaps longer than POWER_DEEP_SLEEP_MIN_S deep sleep and reboot into app_main.
+// Either way the camera is held in power-down until the caller's wake time.
+esp_err_t power_manager_idle_until(time_t wake_at) {
+    time_t now = time(NULL);
+    if (wake_at <= now) {
+        return ESP_OK;
+    }
+
+    uint32_t idle_s = (uint32_t)(wake_at - now);
+    bool deep = idle_s >= POWER_DEEP_SLEEP_MIN_S;
+    ESP_LOGI(TAG, "Idling %u s in %s", (unsigned)idle_s, deep ? "deep sleep" : "modem sleep");
+
+    camera_power_off(deep);
+
+    if (deep) {
+        // RAM does not survive deep sleep: unacknowledged MQTT publishes and archive
+        // records not yet synced to the card would be lost
+        if (sleep_flush != NULL) {
+            esp_err_t err = sleep_flush(POWER_SLEEP_FLUSH_TIMEOUT_MS);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Upload flush before deep sleep failed: %s", esp_err_to_name(err));
+            }
+            now = time(NULL);
+            idle_s = wake_at > now ? (uint32_t)(wake_at - now) : 0;
+        }
+
+        // Boot, Wi-Fi and SNTP take a while, so come back early; the scheduler idles the rest
+        if (idle_s < POWER_DEEP_SLEEP_BOOT_S + 1) {
+            idle_s = POWER_DEEP_SLEEP_BOOT_S + 1;
+        }
+        esp_sleep_enable_timer_wakeup((uint64_t)(idle_s - POWER_DEEP_SLEEP_BOOT_S) * 1000000ULL);
+#if OTA_ENABLED
+        ota_manager_prepare_sleep();
+#endif
+        esp_deep_sleep_start();
+    }
+
+    esp_err_t err = esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to enter modem sleep: %s", esp_err_to_name(err));
+    }
+
+    while ((now = time(NULL)) < wake_at) {
+        vTaskDelay(pdMS_TO_TICKS((uint32_t)(wake_at - now) * 1000));
+    }
+
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+
+    err = camera_power_on(CAPTURE_WINDOW_WARMUP_S * 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Camera failed to power up: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool power_manager_woke_from_deep_sleep(void) {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
@@ -0,0 +1,372 @@
+#include "psram_stage.h"
+#include "jpeg_codec.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "PSRAM_STAGE";
+
+// Base64 input blocks are whole 3-byte groups and a multiple of the 16-byte cache line
+#define BASE64_BLOCK_ALIGN 48
+
+static uint8_t *scratch = NULL;
+static size_t scratch_size = 0;
+static size_t base64_block = 0;             // Input bytes per base64 block; output follows in the scratch
+static SemaphoreHandle_t scratch_lock = NULL;
+static psram_stage_stats_t stage_stats;
+
+// Kept in DRAM: a flash-resident table would compete with PSRAM for the same cache
+static DRAM_ATTR const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+esp_err_t psram_stage_init(size_t size) {
+    if (scratch != NULL) {
+        return ESP_OK;
+    }
+
+    scratch_lock = xSemaphoreCreateMutex();
+    scratch = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (scratch_lock == NULL || scratch == NULL) {
+        if (scratch_lock != NULL) {
+            vSemaphoreDelete(scratch_lock);
+        }
+        free(scratch);
+        scratch = NULL;
+        scratch_lock = NULL;
+        ESP_LOGE(TAG, "Failed to allocate %zu byte scratch", size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    scratch_size = size;
+    // 3 input bytes become 4 output characters; both halves share the scratch
+    base64_block = size * 3 / 7 / BASE64_BLOCK_ALIGN * BASE64_BLOCK_ALIGN;
+    memset(&stage_stats, 0, sizeof(stage_stats));
+    ESP_LOGI(TAG, "Staging through %zu bytes of internal RAM", size);
+    return ESP_OK;
+}
+
+static bool take_scratch(void) {
+    if (scratch == NULL) {
+        return false;
+    }
+    if (xSemaphoreTake(scratch_lock, 0) != pdTRUE) {
+        stage_stats.busy++;
+        return false;
+    }
+    return true;
+}
+
+static void give_scratch(size_t bytes) {
+    stage_stats.staged_calls++;
+    stage_stats.staged_bytes += bytes;
+    xSemaphoreGive(scratch_lock);
+}
+
+// Encode whole groups and pad a short final group; len is a multiple of 3 except at the end
+static IRAM_ATTR size_t encode_block(const uint8_t *in, size_t len, char *out) {
+    char *dst = out;
+    while (len >= 3) {
+        uint32_t v = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+        dst[0] = base64_alphabet[v >> 18];
+        dst[1] = base64_alphabet[(v >> 12) & 0x3F];
+        dst[2] = base64_alphabet[(v >> 6) & 0x3F];
+        dst[3] = base64_alphabet[v & 0x3F];
+        dst += 4;
+        in += 3;
+        len -= 3;
+    }
+    if (len > 0) {
+        uint32_t v = ((uint32_t)in[0] << 16) | (len > 1 ? (uint32_t)in[1] << 8 : 0);
+        dst[0] = base64_alphabet[v >> 18];
+        dst[1] = base64_alphabet[(v >> 12) & 0x3F];
+        dst[2] = len > 1 ? base64_alphabet[(v >> 6) & 0x3F] : '=';
+        dst[3] = '=';
+        dst += 4;
+    }
+    return (size_t)(dst - out);
+}
+
+static void sha256_block(const uint8_t *block, size_t len, void *ctx) {
+    mbedtls_sha256_update((mbedtls_sha256_context *)ctx, block, len);
+}
+
+static esp_err_t base64_direct(const uint8_t *jpeg, const jpeg_ranges_t *ranges, char *out, size_t out_size,
+                               size_t *out_len, uint8_t *sha256) {
+    stage_stats.direct_calls++;
+    esp_err_t err = jpeg_ranges_base64(jpeg, ranges, out, out_size, out_len);
+    if (err == ESP_OK && sha256 != NULL) {
+        mbedtls_sha256_context sha;
+        mbedtls_sha256_init(&sha);
+        mbedtls_sha256_starts(&sha, 0);
+        for (size_t r = 0; r < ranges->count; r++) {
+            mbedtls_sha256_update(&sha, jpeg + ranges->ranges[r].offset, ranges->ranges[r].len);
+        }
+        mbedtls_sha256_finish(&sha, sha256);
+        mbedtls_sha256_free(&sha);
+    }
+    return err;
+}
+
+// Same output as jpeg_ranges_base64(). The spans are gathered into DRAM one block at a
+// time, so block boundaries never split a group and no carry between spans is needed.
+// With sha256 set, each staged block is also hashed, giving the digest of the bytes the
+// base64 decodes to without a second pass over PSRAM.
+esp_err_t psram_stage_base64(const uint8_t *jpeg, const jpeg_ranges_t *ranges, char *out, size_t out_size,
+                             size_t *out_len, uint8_t *sha256) {
+    if (jpeg == NULL || ranges == NULL || out == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!esp_ptr_external_ram(jpeg) && !esp_ptr_external_ram(out)) {
+        return base64_direct(jpeg, ranges, out, out_size, out_len, sha256);
+    }
+    if (out_size < jpeg_ranges_base64_len(ranges) + 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (base64_block == 0 || !take_scratch()) {
+        return base64_direct(jpeg, ranges, out, out_size, out_len, sha256);
+    }
+
+    mbedtls_sha256_context sha;
+    if (sha256 != NULL) {
+        mbedtls_sha256_init(&sha);
+        mbedtls_sha256_starts(&sha, 0);
+    }
+
+    uint8_t *block = scratch;
+    char *encoded = (char *)scratch + base64_block;
+    bool stage_out = esp_ptr_external_ram(out);
+    char *dst = out;
+    size_t r = 0;
+    size_t offset = 0;
+
+    while (r < ranges->count) {
+        size_t filled = 0;
+        while (filled < base64_block && r < ranges->count) {
+            size_t n = ranges->ranges[r].len - offset;
+            if (n > base64_block - filled) {
+                n = base64_block - filled;
+            }
+            memcpy(block + filled, jpeg + ranges->ranges[r].offset + offset, n);
+            filled += n;
+            offset += n;
+            if (offset == ranges->ranges[r].len) {
+                r++;
+                offset = 0;
+            }
+        }
+        if (sha256 != NULL) {
+            mbedtls_sha256_update(&sha, block, filled);
+        }
+        if (stage_out) {
+            size_t n = encode_block(block, filled, encoded);
+            memcpy(dst, encoded, n);
+            dst += n;
+        } else {
+            dst += encode_block(block, filled, dst);
+        }
+    }
+
+    *dst = '\0';
+    *out_len = (size_t)(dst - out);
+    if (sha256 != NULL) {
+        mbedtls_sha256_finish(&sha, sha256);
+        mbedtls_sha256_free(&sha);
+    }
+    give_scratch(ranges->total_len);
+    return ESP_OK;
+}
+
+// Hand a buffer to fn in DRAM blocks of the scratch size, e.g. for hash updates
+void psram_stage_stream(const uint8_t *src, size_t len, psram_stage_fn_t fn, void *ctx) {
+    if (src == NULL || fn == NULL) {
+        return;
+    }
+    if (!esp_ptr_external_ram(src) || !take_scratch()) {
+        stage_stats.direct_calls++;
+        fn(src, len, ctx);
+        return;
+    }
+
+    for (size_t done = 0; done < len;) {
+        size_t n = len - done < scratch_size ? len - done : scratch_size;
+        memcpy(scratch, src + done, n);
+        fn(scratch, n, ctx);
+        done += n;
+    }
+    give_scratch(len);
+}
+
+// SHA-256 of a whole buffer, e.g. a raw frame for a backend that sends it unencoded
+void psram_stage_sha256(const uint8_t *src, size_t len, uint8_t sha256[32]) {
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    psram_stage_stream(src, len, sha256_block, &sha);
+    mbedtls_sha256_finish(&sha, sha256);
+    mbedtls_sha256_free(&sha);
+}
+
+// DRAM copy of a whole buffer for kernels that need random access, such as an MCU scan
+// that resumes from saved row states. Returns src itself when it is not staged; either
+// way the result goes back through psram_stage_release().
+const uint8_t *psram_stage_acquire(const uint8_t *src, size_t len) {
+    if (src == NULL || len > scratch_size || !esp_ptr_external_ram(src) || !take_scratch()) {
+        stage_stats.direct_calls++;
+        return src;
+    }
+    memcpy(scratch, src, len);
+    stage_stats.staged_bytes += len;
+    return scratch;
+}
+
+void psram_stage_release(const uint8_t *staged) {
+    if (staged != NULL && staged == scratch) {
+        give_scratch(0);
+    }
+}
+
+typedef struct {
+    int64_t direct_us;
+    int64_t staged_us;
+} bench_time_t;
+
+static void log_result(const char *kernel, size_t len, int iterations, const bench_time_t *t, bool match) {
+    double direct_us = (double)t->direct_us / iterations;
+    double staged_us = (double)t->staged_us / iterations;
+    ESP_LOGI(TAG, "%-8s direct %7.0f us (%5.2f MB/s), staged %7.0f us (%5.2f MB/s), %+.0f%%%s", kernel,
+             direct_us, len / direct_us, staged_us, len / staged_us,
+             direct_us > 0 ? (direct_us - staged_us) * 100.0 / direct_us : 0.0,
+             match ? "" : ", OUTPUT MISMATCH");
+}
+
+// Sum of the first block's DC over all MCUs, standing in for the tile signature scan
+static int64_t scan_dc(const uint8_t *jpeg, size_t len, const jpeg_frame_t *frame, jpeg_block_t *blocks) {
+    jpeg_reader_t reader;
+    jpeg_reader_init(&reader, frame, jpeg, len);
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < frame->mcus_x * frame->mcus_y; i++) {
+        if (jpeg_reader_mcu(&reader, frame, blocks) != ESP_OK) {
+            return INT64_MIN;
+        }
+        sum += blocks[0][0];
+    }
+    return sum;
+}
+
+// Time base64, SHA-256 and the DC scan over a PSRAM copy of a frame, read directly and
+// through the scratch, and the cost of hashing during the encode. Results are compared
+// so a staging bug shows up here first.
+esp_err_t psram_stage_benchmark(const uint8_t *jpeg, size_t len, int iterations) {
+    if (jpeg == NULL || len == 0 || iterations < 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (scratch == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    jpeg_ranges_t ranges;
+    jpeg_ranges_whole(len, &ranges);
+    size_t encoded_size = jpeg_ranges_base64_len(&ranges) + 1;
+    uint8_t *frame_copy = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    char *direct_out = heap_caps_malloc(encoded_size, MALLOC_CAP_SPIRAM);
+    char *staged_out = heap_caps_malloc(encoded_size, MALLOC_CAP_SPIRAM);
+    jpeg_frame_t *frame = malloc(sizeof(jpeg_frame_t));
+    jpeg_block_t *blocks = malloc(JPEG_MAX_BLOCKS_IN_MCU * sizeof(jpeg_block_t));
+    esp_err_t err = ESP_OK;
+    if (frame_copy == NULL || direct_out == NULL || staged_out == NULL || frame == NULL || blocks == NULL) {
+        ESP_LOGW(TAG, "Benchmark needs %zu bytes of PSRAM", len + 2 * encoded_size);
+        err = ESP_ERR_NO_MEM;
+        goto done;
+    }
+    memcpy(frame_copy, jpeg, len);
+    ESP_LOGI(TAG, "Benchmark: %zu byte frame in PSRAM, %zu byte scratch, %d iterations", len, scratch_size,
+             iterations);
+
+    bench_time_t t = {0};
+    size_t direct_len = 0, staged_len = 0;
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = esp_timer_get_time();
+        jpeg_ranges_base64(frame_copy, &ranges, direct_out, encoded_size, &direct_len);
+        t.direct_us += esp_timer_get_time() - start;
+        start = esp_timer_get_time();
+        psram_stage_base64(frame_copy, &ranges, staged_out, encoded_size, &staged_len, NULL);
+        t.staged_us += esp_timer_get_time() - start;
+    }
+    log_result("base64", len, iterations, &t,
+               direct_len == staged_len && memcmp(direct_out, staged_out, direct_len) == 0);
+
+    uint8_t direct_digest[32], staged_digest[32];
+    memset(&t, 0, sizeof(t));
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = esp_timer_get_time();
+        mbedtls_sha256(frame_copy, len, direct_digest, 0);
+        t.direct_us += esp_timer_get_time() - start;
+        start = esp_timer_get_time();
+        mbedtls_sha256_context sha;
+        mbedtls_sha256_init(&sha);
+        mbedtls_sha256_starts(&sha, 0);
+        psram_stage_stream(frame_copy, len, sha256_block, &sha);
+        mbedtls_sha256_finish(&sha, staged_digest);
+        mbedtls_sha256_free(&sha);
+        t.staged_us += esp_timer_get_time() - start;
+    }
+    log_result("sha256", len, iterations, &t, memcmp(direct_digest, staged_digest, 32) == 0);
+
+    // What content hashing adds to an upload: the staged base64 pass with and without
+    // hashing its blocks, against the frame read twice (encode, then hash separately)
+    int64_t encode_us = 0, fused_us = 0;
+    uint8_t fused_digest[32];
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = esp_timer_get_time();
+        psram_stage_base64(frame_copy, &ranges, staged_out, encoded_size, &staged_len, NULL);
+        encode_us += esp_timer_get_time() - start;
+        start = esp_timer_get_time();
+        psram_stage_base64(frame_copy, &ranges, staged_out, encoded_size, &staged_len, fused_digest);
+        fused_us += esp_timer_get_time() - start;
+    }
+    double encode_avg = (double)encode_us / iterations;
+    double fused_avg = (double)fused_us / iterations;
+    double separate_avg = encode_avg + (double)t.staged_us / iterations;
+    ESP_LOGI(TAG, "hashing  base64 %7.0f us, with sha256 %7.0f us (%+.0f%%), separate passes %7.0f us%s",
+             encode_avg, fused_avg, encode_avg > 0 ? (fused_avg - encode_avg) * 100.0 / encode_avg : 0.0,
+             separate_avg, memcmp(fused_digest, direct_digest, 32) == 0 ? "" : ", DIGEST MISMATCH");
+
+    if (len > scratch_size) {
+        ESP_LOGI(TAG, "dc scan  skipped, frame larger than the scratch");
+    } else if (jpeg_frame_parse(frame_copy, len, frame) == ESP_OK) {
+        int64_t direct_sum = 0, staged_sum = 0;
+        memset(&t, 0, sizeof(t));
+        for (int i = 0; i < iterations; i++) {
+            int64_t start = esp_timer_get_time();
+            direct_sum = scan_dc(frame_copy, len, frame, blocks);
+            t.direct_us += esp_timer_get_time() - start;
+            start = esp_timer_get_time();
+            const uint8_t *staged = psram_stage_acquire(frame_copy, len);
+            staged_sum = scan_dc(staged, len, frame, blocks);
+            psram_stage_release(staged);
+            t.staged_us += esp_timer_get_time() - start;
+        }
+        log_result("dc scan", len, iterations, &t, direct_sum == staged_sum && direct_sum != INT64_MIN);
+    }
+
+done:
+    free(blocks);
+    free(frame);
+    free(staged_out);
+    free(direct_out);
+    free(frame_copy);
+    return err;
+}
+
+void psram_stage_get_stats(psram_stage_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = stage_stats;
+    }
+}
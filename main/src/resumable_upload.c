@@ -0,0 +1,396 @@
+#include "resumable_upload.h"
+#include "spool_manager.h"
+#include "config.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+static const char *TAG = "RESUMABLE";
+static bool resumable_configured = false;
+static char storage_bucket[MAX_PROJECT_ID_LEN + sizeof(FIREBASE_STORAGE_BUCKET_SUFFIX)];
+static resumable_upload_stats_t upload_stats;
+
+#define SESSION_MAGIC 0x52534D31  // "RSM1"
+#define RETRY_BASE_DELAY_MS 500
+
+// Persisted next to the spooled frame so a session survives a reboot
+typedef struct {
+    uint32_t magic;
+    uint32_t total_len;
+    uint32_t committed;
+    uint32_t granularity;
+    char upload_url[RESUMABLE_URL_MAX_LEN];
+} resumable_session_t;
+
+// Response headers of interest, filled in by the HTTP event handler
+typedef struct {
+    char upload_url[RESUMABLE_URL_MAX_LEN];
+    char upload_status[16];
+    long size_received;
+    long granularity;
+} upload_response_t;
+
+static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
+    upload_response_t *resp = (upload_response_t *)evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_HEADER || resp == NULL) {
+        return ESP_OK;
+    }
+
+    if (strcasecmp(evt->header_key, "X-Goog-Upload-URL") == 0) {
+        strncpy(resp->upload_url, evt->header_value, sizeof(resp->upload_url) - 1);
+    } else if (strcasecmp(evt->header_key, "X-Goog-Upload-Status") == 0) {
+        strncpy(resp->upload_status, evt->header_value, sizeof(resp->upload_status) - 1);
+    } else if (strcasecmp(evt->header_key, "X-Goog-Upload-Size-Received") == 0) {
+        resp->size_received = strtol(evt->header_value, NULL, 10);
+    } else if (strcasecmp(evt->header_key, "X-Goog-Upload-Chunk-Granularity") == 0) {
+        resp->granularity = strtol(evt->header_value, NULL, 10);
+    }
+    return ESP_OK;
+}
+
+// One protocol request. Returns the HTTP status through *status; body bytes are
+// counted as sent even if the connection drops halfway.
+static esp_err_t send_request(const char *url, const char *command, long offset,
+                              const char *content_type, const uint8_t *body, size_t body_len,
+                              const char *const *extra_headers, upload_response_t *resp, int *status) {
+    memset(resp, 0, sizeof(*resp));
+    resp->size_received = -1;
+    *status = 0;
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_POST,
+        .event_handler = http_event_handler,
+        .user_data = resp,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    char offset_str[16];
+    esp_http_client_set_header(client, "X-Goog-Upload-Command", command);
+    if (offset >= 0) {
+        snprintf(offset_str, sizeof(offset_str), "%ld", offset);
+        esp_http_client_set_header(client, "X-Goog-Upload-Offset", offset_str);
+    }
+    if (content_type != NULL) {
+        esp_http_client_set_header(client, "Content-Type", content_type);
+    }
+    for (int i = 0; extra_headers != NULL && extra_headers[i] != NULL; i += 2) {
+        esp_http_client_set_header(client, extra_headers[i], extra_headers[i + 1]);
+    }
+
+    esp_err_t err = esp_http_client_open(client, (int)body_len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Connection failed (%s): %s", command, esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    size_t written = 0;
+    while (written < body_len) {
+        int n = esp_http_client_write(client, (const char *)body + written, (int)(body_len - written));
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+    upload_stats.bytes_sent += written;
+
+    if (written < body_len) {
+        ESP_LOGW(TAG, "Connection dropped after %zu/%zu bytes (%s)", written, body_len, command);
+        err = ESP_FAIL;
+    } else if (esp_http_client_fetch_headers(client) < 0) {
+        ESP_LOGW(TAG, "No response to %s", command);
+        err = ESP_FAIL;
+    } else {
+        *status = esp_http_client_get_status_code(client);
+        int discarded = 0;
+        esp_http_client_flush_response(client, &discarded);
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+// 4xx answers mean this frame will never be accepted, except timeouts, throttling and
+// auth failures, which say nothing about the frame and fail every other one too
+static bool status_is_permanent(int status) {
+    return status >= 400 && status < 500 && status != 401 && status != 403 && status != 408 && status != 429;
+}
+
+static esp_err_t start_session(const char *key, size_t total_len, resumable_session_t *session) {
+    char url[384];
+    snprintf(url, sizeof(url), "%s/v0/b/%s/o?name=images%%2F%s.jpg",
+             FIREBASE_STORAGE_HOST, storage_bucket, key);
+
+    char length_str[16];
+    snprintf(length_str, sizeof(length_str), "%zu", total_len);
+    const char *headers[] = {
+        "X-Goog-Upload-Protocol", "resumable",
+        "X-Goog-Upload-Header-Content-Length", length_str,
+        "X-Goog-Upload-Header-Content-Type", "image/jpeg",
+        NULL
+    };
+
+    char metadata[128];
+    int metadata_len = snprintf(metadata, sizeof(metadata),
+                                "{\"name\":\"images/%s.jpg\",\"contentType\":\"image/jpeg\"}", key);
+
+    upload_response_t resp;
+    int status = 0;
+    esp_err_t err = send_request(url, "start", -1, "application/json",
+                                 (const uint8_t *)metadata, (size_t)metadata_len, headers, &resp, &status);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (status != 200 || resp.upload_url[0] == '\0') {
+        ESP_LOGE(TAG, "Session start for %s rejected, Status = %d", key, status);
+        return status_is_permanent(status) ? ESP_ERR_INVALID_RESPONSE : ESP_FAIL;
+    }
+
+    memset(session, 0, sizeof(*session));
+    session->magic = SESSION_MAGIC;
+    session->total_len = (uint32_t)total_len;
+    session->committed = 0;
+    session->granularity = resp.granularity > 0 ? (uint32_t)resp.granularity : 1;
+    strncpy(session->upload_url, resp.upload_url, sizeof(session->upload_url) - 1);
+
+    upload_stats.sessions_started++;
+    ESP_LOGI(TAG, "Started session for %s (%zu bytes, granularity %u)",
+             key, total_len, (unsigned)session->granularity);
+    return ESP_OK;
+}
+
+// Ask the server how much it has; the server is authoritative over our local offset
+static esp_err_t query_session(resumable_session_t *session, bool *finalized) {
+    upload_response_t resp;
+    int status = 0;
+    *finalized = false;
+
+    esp_err_t err = send_request(session->upload_url, "query", -1, NULL, NULL, 0, NULL, &resp, &status);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (status == 404 || status == 410 || strcasecmp(resp.upload_status, "cancelled") == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (status != 200 || resp.size_received < 0) {
+        return ESP_FAIL;
+    }
+
+    session->committed = (uint32_t)resp.size_received;
+    *finalized = (strcasecmp(resp.upload_status, "final") == 0);
+    return ESP_OK;
+}
+
+static uint8_t *allocate_chunk_buffer(size_t size) {
+    uint8_t *buffer = NULL;
+    if (esp_psram_is_initialized()) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+static esp_err_t record_frame(const char *key, size_t total_len) {
+    char path[SPOOL_KEY_MAX_LEN + sizeof(RESUMABLE_RECORD_PREFIX) + 1];
+    char json[192];
+    snprintf(path, sizeof(path), RESUMABLE_RECORD_PREFIX "/%s", key);
+    snprintf(json, sizeof(json),
+             "{\"storage_path\":\"images/%s.jpg\",\"timestamp\":\"%s\",\"size\":%zu}",
+             key, key, total_len);
+    return firebase_put_json(path, json);
+}
+
+esp_err_t resumable_upload_init(const firebase_config_t *config) {
+    if (config == NULL || strlen(config->project_id) == 0) {
+        ESP_LOGE(TAG, "Firebase project ID is required for resumable uploads");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    snprintf(storage_bucket, sizeof(storage_bucket), "%s%s",
+             config->project_id, FIREBASE_STORAGE_BUCKET_SUFFIX);
+    memset(&upload_stats, 0, sizeof(upload_stats));
+    resumable_configured = true;
+
+    ESP_LOGI(TAG, "Resumable uploads to bucket %s", storage_bucket);
+    return ESP_OK;
+}
+
+esp_err_t resumable_upload_spooled(const char *key) {
+    if (!resumable_configured || !spool_is_ready()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t total_len = 0;
+    esp_err_t err = spool_get_frame_size(key, &total_len);
+    if (err != ESP_OK || total_len == 0) {
+        ESP_LOGE(TAG, "Spooled frame %s missing or empty", key);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    resumable_session_t session;
+    bool finalized = false;
+    bool have_session = spool_load_state(key, &session, sizeof(session)) == ESP_OK &&
+                        session.magic == SESSION_MAGIC && session.total_len == total_len;
+
+    if (have_session) {
+        err = query_session(&session, &finalized);
+        if (err == ESP_OK) {
+            upload_stats.sessions_resumed++;
+            ESP_LOGI(TAG, "Resuming %s at %u/%zu bytes", key, (unsigned)session.committed, total_len);
+        } else if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Session for %s expired, restarting", key);
+            have_session = false;
+        } else {
+            return err;  // Link is down; keep the session for the next cycle
+        }
+    }
+
+    if (!have_session) {
+        err = start_session(key, total_len, &session);
+        if (err != ESP_OK) {
+            return err;
+        }
+        spool_save_state(key, &session, sizeof(session));
+    }
+
+    size_t chunk_size = RESUMABLE_CHUNK_SIZE;
+    if (chunk_size % session.granularity != 0) {
+        chunk_size = (chunk_size / session.granularity + 1) * session.granularity;
+    }
+
+    uint8_t *chunk = NULL;
+    if (!finalized) {
+        chunk = allocate_chunk_buffer(chunk_size);
+        if (chunk == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate %zu byte chunk buffer", chunk_size);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    int attempts = 0;
+    int rejected = 0;
+    while (!finalized && attempts < RESUMABLE_MAX_ATTEMPTS) {
+        size_t offset = session.committed;
+        size_t read_len = 0;
+        err = spool_read_frame(key, offset, chunk, chunk_size, &read_len);
+        if (err != ESP_OK || (read_len == 0 && offset < total_len)) {
+            ESP_LOGE(TAG, "Failed to read %s at offset %zu", key, offset);
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        bool last = (offset + read_len >= total_len);
+        upload_response_t resp;
+        int status = 0;
+        err = send_request(session.upload_url, last ? "upload, finalize" : "upload", (long)offset,
+                           "application/octet-stream", chunk, read_len, NULL, &resp, &status);
+
+        if (err == ESP_OK && status == 200) {
+            session.committed = (uint32_t)(offset + read_len);
+            upload_stats.bytes_committed += read_len;
+            finalized = last;
+            if (!finalized) {
+                spool_save_state(key, &session, sizeof(session));
+            }
+            continue;
+        }
+
+        upload_stats.chunks_failed++;
+        attempts++;
+        if (err == ESP_OK && status_is_permanent(status)) {
+            rejected++;
+        }
+        ESP_LOGW(TAG, "Chunk at %zu failed (Status = %d, %s), attempt %d/%d",
+                 offset, status, esp_err_to_name(err), attempts, RESUMABLE_MAX_ATTEMPTS);
+        vTaskDelay(pdMS_TO_TICKS(RETRY_BASE_DELAY_MS * (1 << (attempts - 1))));
+
+        // Re-sync with whatever part of the chunk the server kept
+        uint32_t before = session.committed;
+        esp_err_t query_err = query_session(&session, &finalized);
+        if (query_err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Session for %s lost mid-upload", key);
+            err = ESP_FAIL;
+            memset(&session, 0, sizeof(session));
+            spool_save_state(key, &session, sizeof(session));
+            break;
+        }
+        if (query_err == ESP_OK && session.committed > before) {
+            upload_stats.bytes_committed += session.committed - before;
+        }
+        spool_save_state(key, &session, sizeof(session));
+    }
+
+    free(chunk);
+
+    if (!finalized) {
+        ESP_LOGW(TAG, "Upload of %s paused at %u/%zu bytes", key, (unsigned)session.committed, total_len);
+        if (rejected == RESUMABLE_MAX_ATTEMPTS) {
+            return ESP_ERR_INVALID_RESPONSE;  // Every attempt was refused, not lost
+        }
+        return (err != ESP_OK) ? err : ESP_ERR_TIMEOUT;
+    }
+
+    err = record_frame(key, total_len);
+    if (err != ESP_OK) {
+        // Object is stored; keep the session so the next pass only re-records it
+        spool_save_state(key, &session, sizeof(session));
+        return err;
+    }
+
+    spool_remove_frame(key);
+    upload_stats.frames_completed++;
+    ESP_LOGI(TAG, "Upload of %s complete (%zu bytes, goodput %.1f%%)", key, total_len,
+             upload_stats.bytes_sent ? 100.0 * (double)upload_stats.bytes_committed / (double)upload_stats.bytes_sent : 100.0);
+    return ESP_OK;
+}
+
+// Failures that will recur for this frame however often it is retried: the server
+// refused it, or its spool entry is missing or unreadable
+static bool error_is_permanent(esp_err_t err) {
+    return err == ESP_ERR_INVALID_RESPONSE || err == ESP_ERR_INVALID_SIZE || err == ESP_ERR_NOT_FOUND;
+}
+
+int resumable_upload_drain(void) {
+    int uploaded = 0;
+    char key[SPOOL_KEY_MAX_LEN];
+
+    // Oldest first. Any other failure stops the pass since the link is likely down,
+    // but a frame that can never go out is set aside so it can't hold up the rest.
+    while (spool_oldest_frame(key, sizeof(key)) == ESP_OK) {
+        esp_err_t err = resumable_upload_spooled(key);
+        if (err == ESP_OK) {
+            uploaded++;
+            continue;
+        }
+        if (!error_is_permanent(err) || spool_quarantine_frame(key) != ESP_OK) {
+            break;
+        }
+        upload_stats.frames_quarantined++;
+        ESP_LOGW(TAG, "Frame %s quarantined: %s", key, esp_err_to_name(err));
+    }
+    return uploaded;
+}
+
+void resumable_upload_get_stats(resumable_upload_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = upload_stats;
+    }
+}
@@ -0,0 +1,91 @@
+#include "runtime_config.h"
+#include "config.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include <stdbool.h>
+
+static const char *TAG = "RUNTIME_CFG";
+static nvs_handle_t runtime_handle;
+static bool runtime_initialized = false;
+
+esp_err_t runtime_config_init(void) {
+    if (runtime_initialized) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = nvs_open(RUNTIME_NVS_NAMESPACE, NVS_READWRITE, &runtime_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS namespace '%s': %s", RUNTIME_NVS_NAMESPACE, esp_err_to_name(err));
+        return err;
+    }
+
+    runtime_initialized = true;
+    ESP_LOGI(TAG, "Runtime config initialized");
+    return ESP_OK;
+}
+
+esp_err_t runtime_config_get_str(const char *key, char *value, size_t max_len) {
+    if (!runtime_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key == NULL || value == NULL || max_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t required_size = max_len;
+    esp_err_t err = nvs_get_str(runtime_handle, key, value, &required_size);
+    if (err != ESP_OK) {
+        value[0] = '\0';
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Failed to read '%s': %s", key, esp_err_to_name(err));
+        }
+    }
+    return err;
+}
+
+esp_err_t runtime_config_set_str(const char *key, const char *value) {
+    if (!runtime_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = nvs_set_str(runtime_handle, key, value);
+    if (err == ESP_OK) {
+        err = nvs_commit(runtime_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store '%s': %s", key, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t runtime_config_get_u32(const char *key, uint32_t *value) {
+    if (!runtime_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return nvs_get_u32(runtime_handle, key, value);
+}
+
+esp_err_t runtime_config_set_u32(const char *key, uint32_t value) {
+    if (!runtime_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = nvs_set_u32(runtime_handle, key, value);
+    if (err == ESP_OK) {
+        err = nvs_commit(runtime_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store '%s': %s", key, esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,432 @@
+#include "sd_archive.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef ESP_PLATFORM
+#include "esp_idf_version.h"
+#include "esp_vfs_fat.h"
+#endif
+
+// Apart from the contiguous preallocation on FATFS, only POSIX file calls are used
+// below so the writer runs unchanged against a file-backed directory on a host.
+
+static const char *TAG = "SD_ARCHIVE";
+
+#define SEGMENT_NAME_FMT "%s/SEG%05u.BIN"
+#define SEGMENT_PATH_MAX 96
+#define SEGMENT_PATH_LEN (SEGMENT_PATH_MAX + sizeof("/SEG4294967295.BIN"))  // Directory plus the widest name
+#define ALIGN_UP(x, a) ((((x) + (a) - 1) / (a)) * (a))
+
+typedef struct {
+    char dir[SEGMENT_PATH_MAX];
+    int fd;
+    unsigned segment_number;
+    uint32_t sequence;
+
+    // Sector-aligned staging buffer; buffer[0] maps to file offset buffer_offset
+    uint8_t *buffer;
+    size_t buffer_fill;
+    uint32_t buffer_offset;
+
+    sd_archive_header_t header;
+    sd_archive_index_entry_t *index;
+    uint32_t frames_since_sync;
+} sd_archive_t;
+
+static sd_archive_t archive = {.fd = -1};
+static sd_archive_stats_t archive_stats;
+
+static esp_err_t write_at(uint32_t offset, const void *data, size_t len) {
+    int64_t start = esp_timer_get_time();
+
+    if (lseek(archive.fd, (off_t)offset, SEEK_SET) != (off_t)offset) {
+        archive_stats.write_errors++;
+        return ESP_FAIL;
+    }
+
+    const uint8_t *p = data;
+    size_t remaining = len;
+    while (remaining > 0) {
+        ssize_t n = write(archive.fd, p, remaining);
+        if (n <= 0) {
+            archive_stats.write_errors++;
+            ESP_LOGE(TAG, "Write of %zu bytes at %u failed", len, (unsigned)offset);
+            return ESP_FAIL;
+        }
+        p += n;
+        remaining -= (size_t)n;
+    }
+
+    archive_stats.bytes_written += len;
+    archive_stats.write_time_us += (uint64_t)(esp_timer_get_time() - start);
+    return ESP_OK;
+}
+
+// Write every complete sector in the staging buffer and keep the partial tail
+static esp_err_t flush_full_sectors(void) {
+    size_t full = (archive.buffer_fill / SD_ARCHIVE_SECTOR_SIZE) * SD_ARCHIVE_SECTOR_SIZE;
+    if (full == 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = write_at(archive.buffer_offset, archive.buffer, full);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t tail = archive.buffer_fill - full;
+    memmove(archive.buffer, archive.buffer + full, tail);
+    archive.buffer_offset += (uint32_t)full;
+    archive.buffer_fill = tail;
+    return ESP_OK;
+}
+
+static esp_err_t buffer_append(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t space = SD_ARCHIVE_BUFFER_SIZE - archive.buffer_fill;
+        size_t n = len < space ? len : space;
+        memcpy(archive.buffer + archive.buffer_fill, data, n);
+        archive.buffer_fill += n;
+        data += n;
+        len -= n;
+
+        if (archive.buffer_fill == SD_ARCHIVE_BUFFER_SIZE) {
+            esp_err_t err = flush_full_sectors();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static uint32_t data_end(void) {
+    return archive.buffer_offset + (uint32_t)archive.buffer_fill;
+}
+
+static void segment_path(char *path, size_t max_len, unsigned number) {
+    snprintf(path, max_len, SEGMENT_NAME_FMT, archive.dir, number);
+}
+
+// Highest and lowest existing segment numbers; returns the number of segments
+static int scan_segments(unsigned *lowest, unsigned *highest) {
+    DIR *dir = opendir(archive.dir);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned number;
+        if (sscanf(entry->d_name, "SEG%5u.BIN", &number) != 1) {
+            continue;
+        }
+        if (count == 0 || number < *lowest) {
+            *lowest = number;
+        }
+        if (count == 0 || number > *highest) {
+            *highest = number;
+        }
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static void enforce_retention(void) {
+    unsigned lowest = 0, highest = 0;
+    int count = scan_segments(&lowest, &highest);
+
+    while (count > SD_ARCHIVE_MAX_SEGMENTS && lowest < archive.segment_number) {
+        char path[SEGMENT_PATH_LEN];
+        segment_path(path, sizeof(path), lowest);
+        if (unlink(path) == 0) {
+            ESP_LOGI(TAG, "Retention: removed segment %u", lowest);
+            count--;
+        }
+        lowest++;
+    }
+}
+
+static esp_err_t write_metadata(void) {
+    archive.header.data_end = data_end();
+
+    size_t index_bytes = ALIGN_UP(archive.header.frame_count * sizeof(sd_archive_index_entry_t), SD_ARCHIVE_SECTOR_SIZE);
+    if (index_bytes > 0) {
+        esp_err_t err = write_at(archive.header.index_offset, archive.index, index_bytes);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    // The header fills a whole sector so the write stays sector-aligned
+    uint8_t sector[SD_ARCHIVE_SECTOR_SIZE] __attribute__((aligned(4)));
+    memset(sector, 0, sizeof(sector));
+    memcpy(sector, &archive.header, sizeof(archive.header));
+    return write_at(0, sector, sizeof(sector));
+}
+
+// Writes zeros over the whole segment. Not counted in the stats, which track frame
+// throughput rather than the one-off cost of allocating the file.
+static esp_err_t zero_fill(int fd) {
+    memset(archive.buffer, 0, SD_ARCHIVE_BUFFER_SIZE);
+
+    uint32_t offset = 0;
+    while (offset < SD_ARCHIVE_SEGMENT_SIZE) {
+        size_t chunk = SD_ARCHIVE_SEGMENT_SIZE - offset;
+        if (chunk > SD_ARCHIVE_BUFFER_SIZE) {
+            chunk = SD_ARCHIVE_BUFFER_SIZE;
+        }
+        ssize_t n = write(fd, archive.buffer, chunk);
+        if (n <= 0) {
+            return ESP_ERR_NO_MEM;
+        }
+        offset += (uint32_t)n;
+    }
+    return ESP_OK;
+}
+
+// Creates the segment with all of its clusters allocated so appends never extend the
+// cluster chain. vfs_fat refuses to grow a file with ftruncate(), so the space comes
+// from f_expand() as one contiguous run where IDF offers it, and from writing zeros
+// otherwise (a fragmented card, older IDF, or a host directory).
+static int segment_create(const char *path) {
+#ifdef ESP_PLATFORM
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+    if (esp_vfs_fat_create_contiguous_file(SD_MOUNT_POINT, path, SD_ARCHIVE_SEGMENT_SIZE, true) == ESP_OK) {
+        int fd = open(path, O_RDWR);
+        if (fd >= 0) {
+            return fd;
+        }
+    }
+    ESP_LOGW(TAG, "No contiguous space for %s, zero-filling instead", path);
+#endif
+#endif
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (zero_fill(fd) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to preallocate %s (%u bytes)", path, (unsigned)SD_ARCHIVE_SEGMENT_SIZE);
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+static esp_err_t segment_open_next(void) {
+    unsigned lowest = 0, highest = 0;
+    archive.segment_number = scan_segments(&lowest, &highest) > 0 ? highest + 1 : 0;
+
+    char path[SEGMENT_PATH_LEN];
+    segment_path(path, sizeof(path), archive.segment_number);
+
+    int64_t start = esp_timer_get_time();
+    archive.fd = segment_create(path);
+    if (archive.fd < 0) {
+        archive_stats.open_errors++;
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        return ESP_FAIL;
+    }
+
+    memset(&archive.header, 0, sizeof(archive.header));
+    archive.header.magic = SD_ARCHIVE_MAGIC;
+    archive.header.version = SD_ARCHIVE_VERSION;
+    archive.header.segment_size = SD_ARCHIVE_SEGMENT_SIZE;
+    archive.header.sector_size = SD_ARCHIVE_SECTOR_SIZE;
+    archive.header.index_capacity = SD_ARCHIVE_INDEX_ENTRIES;
+    archive.header.index_offset = SD_ARCHIVE_SEGMENT_SIZE -
+        ALIGN_UP(SD_ARCHIVE_INDEX_ENTRIES * sizeof(sd_archive_index_entry_t), SD_ARCHIVE_SECTOR_SIZE);
+
+    archive.buffer_offset = SD_ARCHIVE_SECTOR_SIZE;
+    archive.buffer_fill = 0;
+    archive.frames_since_sync = 0;
+    memset(archive.index, 0, ALIGN_UP(SD_ARCHIVE_INDEX_ENTRIES * sizeof(sd_archive_index_entry_t), SD_ARCHIVE_SECTOR_SIZE));
+
+    // A segment without a valid header is abandoned; the next append starts another
+    esp_err_t err = write_metadata();
+    if (err != ESP_OK) {
+        archive_stats.open_errors++;
+        close(archive.fd);
+        archive.fd = -1;
+        return err;
+    }
+
+    archive_stats.segments_opened++;
+    ESP_LOGI(TAG, "Opened segment %s (%u bytes preallocated in %lld ms)", path,
+             (unsigned)SD_ARCHIVE_SEGMENT_SIZE, (long long)((esp_timer_get_time() - start) / 1000));
+
+    enforce_retention();
+    return ESP_OK;
+}
+
+static esp_err_t segment_close(void) {
+    if (archive.fd < 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = sd_archive_sync();
+    close(archive.fd);
+    archive.fd = -1;
+
+    ESP_LOGI(TAG, "Closed segment %u with %u frame(s), sustained %llu KB/s", archive.segment_number,
+             (unsigned)archive.header.frame_count,
+             archive_stats.write_time_us ? (unsigned long long)(archive_stats.bytes_written * 1000000ULL / archive_stats.write_time_us / 1024) : 0ULL);
+    return err;
+}
+
+esp_err_t sd_archive_open(const char *dir_path) {
+    if (dir_path == NULL || strlen(dir_path) >= sizeof(archive.dir)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (archive.buffer != NULL) {
+        ESP_LOGW(TAG, "Archive already open");
+        return ESP_OK;
+    }
+
+    strncpy(archive.dir, dir_path, sizeof(archive.dir) - 1);
+    mkdir(archive.dir, 0755);
+
+    // DMA-capable, word-aligned buffers let the SD driver write straight from them
+    archive.buffer = heap_caps_aligned_alloc(4, SD_ARCHIVE_BUFFER_SIZE, MALLOC_CAP_DMA);
+    archive.index = heap_caps_aligned_alloc(4, ALIGN_UP(SD_ARCHIVE_INDEX_ENTRIES * sizeof(sd_archive_index_entry_t),
+                                                        SD_ARCHIVE_SECTOR_SIZE), MALLOC_CAP_8BIT);
+    if (archive.buffer == NULL || archive.index == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate archive buffers");
+        heap_caps_free(archive.buffer);
+        heap_caps_free(archive.index);
+        archive.buffer = NULL;
+        archive.index = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&archive_stats, 0, sizeof(archive_stats));
+    archive.sequence = 0;
+
+    // Always start a fresh segment; earlier ones keep the index from their last sync
+    return segment_open_next();
+}
+
+esp_err_t sd_archive_append(const uint8_t *data, size_t len, uint32_t timestamp) {
+    if (archive.buffer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (data == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // An earlier rollover failed (transient card error, card full); try a new segment
+    if (archive.fd < 0) {
+        esp_err_t err = segment_open_next();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    size_t record_len = sizeof(sd_archive_record_t) + len;
+    if (SD_ARCHIVE_SECTOR_SIZE + record_len > archive.header.index_offset) {
+        ESP_LOGE(TAG, "Frame of %zu bytes exceeds segment capacity", len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (data_end() + record_len > archive.header.index_offset ||
+        archive.header.frame_count >= archive.header.index_capacity) {
+        // The old segment is closed even if its final sync fails; the frames it synced earlier stay readable
+        esp_err_t err = segment_close();
+        if (err == ESP_OK) {
+            err = segment_open_next();
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    sd_archive_record_t record = {
+        .magic = SD_ARCHIVE_RECORD_MAGIC,
+        .length = (uint32_t)len,
+        .timestamp = timestamp,
+        .sequence = archive.sequence,
+    };
+
+    sd_archive_index_entry_t *entry = &archive.index[archive.header.frame_count];
+    entry->offset = data_end();
+    entry->length = (uint32_t)len;
+    entry->timestamp = timestamp;
+    entry->sequence = archive.sequence;
+
+    esp_err_t err = buffer_append((const uint8_t *)&record, sizeof(record));
+    if (err == ESP_OK) {
+        err = buffer_append(data, len);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    archive.header.frame_count++;
+    archive.sequence++;
+    archive_stats.frames_written++;
+
+    if (++archive.frames_since_sync >= SD_ARCHIVE_SYNC_EVERY) {
+        return sd_archive_sync();
+    }
+    return ESP_OK;
+}
+
+// Persist buffered data (padding the partial sector), the index and the header
+esp_err_t sd_archive_sync(void) {
+    if (archive.fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = flush_full_sectors();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // The partial sector stays buffered and is rewritten in full on the next flush
+    if (archive.buffer_fill > 0) {
+        memset(archive.buffer + archive.buffer_fill, 0, SD_ARCHIVE_SECTOR_SIZE - archive.buffer_fill);
+        err = write_at(archive.buffer_offset, archive.buffer, SD_ARCHIVE_SECTOR_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    err = write_metadata();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int64_t start = esp_timer_get_time();
+    fsync(archive.fd);
+    archive_stats.write_time_us += (uint64_t)(esp_timer_get_time() - start);
+    archive.frames_since_sync = 0;
+    return ESP_OK;
+}
+
+esp_err_t sd_archive_close(void) {
+    esp_err_t err = segment_close();
+    heap_caps_free(archive.buffer);
+    heap_caps_free(archive.index);
+    archive.buffer = NULL;
+    archive.index = NULL;
+    return err;
+}
+
+void sd_archive_get_stats(sd_archive_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = archive_stats;
+    }
+}
@@ -0,0 +1,394 @@
+#include "spool_manager.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char *TAG = "SPOOL";
+static bool spool_ready = false;
+static SemaphoreHandle_t spool_mutex = NULL;
+
+#define SPOOL_FRAME_EXT ".jpg"
+#define SPOOL_STATE_EXT ".ses"
+#define SPOOL_TEMP_EXT  ".tmp"
+#define SPOOL_QUARANTINE_EXT ".bad"
+#define SPOOL_PATH_MAX  (sizeof(SPOOL_BASE_PATH) + SPOOL_KEY_MAX_LEN + 8)
+
+static void spool_path(char *path, size_t max_len, const char *key, const char *ext) {
+    snprintf(path, max_len, "%s/%s%s", SPOOL_BASE_PATH, key, ext);
+}
+
+static bool key_is_valid(const char *key) {
+    return key != NULL && key[0] != '\0' && strlen(key) < SPOOL_KEY_MAX_LEN && strchr(key, '/') == NULL;
+}
+
+// Length of the key part of a directory entry with the given extension, 0 if it has another one
+static size_t entry_key_len(const char *name, const char *ext) {
+    size_t name_len = strlen(name);
+    size_t ext_len = strlen(ext);
+    if (name_len <= ext_len || strcmp(name + name_len - ext_len, ext) != 0) {
+        return 0;
+    }
+    return name_len - ext_len;
+}
+
+// Write to a temp file and rename so a reboot mid-write never leaves a truncated entry
+static esp_err_t write_file_atomic(const char *key, const char *ext, const void *data, size_t len) {
+    char tmp_path[SPOOL_PATH_MAX];
+    char final_path[SPOOL_PATH_MAX];
+    spool_path(tmp_path, sizeof(tmp_path), key, SPOOL_TEMP_EXT);
+    spool_path(final_path, sizeof(final_path), key, ext);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s for writing", tmp_path);
+        return ESP_FAIL;
+    }
+
+    size_t written = fwrite(data, 1, len, f);
+    fclose(f);
+    if (written != len) {
+        ESP_LOGE(TAG, "Short write to %s: %zu/%zu bytes", tmp_path, written, len);
+        unlink(tmp_path);
+        return ESP_ERR_NO_MEM;
+    }
+
+    unlink(final_path);
+    if (rename(tmp_path, final_path) != 0) {
+        ESP_LOGE(TAG, "Failed to rename %s to %s", tmp_path, final_path);
+        unlink(tmp_path);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+// Oldest key with the given extension. Caller must hold spool_mutex
+static esp_err_t find_oldest_locked(const char *ext, char *key, size_t max_len) {
+    DIR *dir = opendir(SPOOL_BASE_PATH);
+    if (dir == NULL) {
+        return ESP_FAIL;
+    }
+
+    char oldest[SPOOL_KEY_MAX_LEN] = {0};
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t key_len = entry_key_len(entry->d_name, ext);
+        if (key_len == 0 || key_len >= sizeof(oldest)) {
+            continue;
+        }
+        if (oldest[0] == '\0' || strncmp(entry->d_name, oldest, key_len) < 0) {
+            memcpy(oldest, entry->d_name, key_len);
+            oldest[key_len] = '\0';
+        }
+    }
+    closedir(dir);
+
+    if (oldest[0] == '\0') {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (strlen(oldest) >= max_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    strcpy(key, oldest);
+    return ESP_OK;
+}
+
+static void remove_frame_locked(const char *key) {
+    char path[SPOOL_PATH_MAX];
+    spool_path(path, sizeof(path), key, SPOOL_FRAME_EXT);
+    unlink(path);
+    spool_path(path, sizeof(path), key, SPOOL_STATE_EXT);
+    unlink(path);
+}
+
+// Drop what a reboot mid-write leaves behind: temp files, and sessions whose frame is gone
+static void remove_orphans(void) {
+    DIR *dir = opendir(SPOOL_BASE_PATH);
+    if (dir == NULL) {
+        return;
+    }
+
+    int removed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        bool temp = true;
+        size_t key_len = entry_key_len(entry->d_name, SPOOL_TEMP_EXT);
+        if (key_len == 0) {
+            temp = false;
+            key_len = entry_key_len(entry->d_name, SPOOL_STATE_EXT);
+        }
+        char key[SPOOL_KEY_MAX_LEN];
+        if (key_len == 0 || key_len >= sizeof(key)) {
+            continue;
+        }
+        memcpy(key, entry->d_name, key_len);
+        key[key_len] = '\0';
+
+        char path[SPOOL_PATH_MAX];
+        struct stat st;
+        spool_path(path, sizeof(path), key, SPOOL_FRAME_EXT);
+        if (temp || stat(path, &st) != 0) {
+            spool_path(path, sizeof(path), key, temp ? SPOOL_TEMP_EXT : SPOOL_STATE_EXT);
+            unlink(path);
+            removed++;
+        }
+    }
+    closedir(dir);
+
+    if (removed > 0) {
+        ESP_LOGW(TAG, "Removed %d orphaned spool file(s)", removed);
+    }
+}
+
+esp_err_t spool_init(void) {
+    if (spool_ready) {
+        return ESP_OK;
+    }
+
+    if (spool_mutex == NULL) {
+        spool_mutex = xSemaphoreCreateMutex();
+        if (spool_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create spool mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = SPOOL_BASE_PATH,
+        .partition_label = SPOOL_PARTITION_LABEL,
+        .max_files = SPOOL_MAX_FILES,
+        .format_if_mount_failed = true
+    };
+
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount spool partition: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    size_t total = 0, used = 0;
+    if (esp_spiffs_info(SPOOL_PARTITION_LABEL, &total, &used) == ESP_OK) {
+        ESP_LOGI(TAG, "Spool mounted: %zu/%zu bytes used", used, total);
+    }
+
+    remove_orphans();
+    spool_ready = true;
+    ESP_LOGI(TAG, "Spool initialized with %zu pending frame(s)", spool_pending_count());
+    return ESP_OK;
+}
+
+bool spool_is_ready(void) {
+    return spool_ready;
+}
+
+esp_err_t spool_store_frame(const char *key, const uint8_t *data, size_t len) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!key_is_valid(key) || data == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+
+    // Evict quarantined frames, then the oldest pending ones, until the new one fits
+    size_t total = 0, used = 0;
+    while (esp_spiffs_info(SPOOL_PARTITION_LABEL, &total, &used) == ESP_OK && used + len > total * 9 / 10) {
+        char oldest[SPOOL_KEY_MAX_LEN];
+        char path[SPOOL_PATH_MAX];
+        if (find_oldest_locked(SPOOL_QUARANTINE_EXT, oldest, sizeof(oldest)) == ESP_OK) {
+            ESP_LOGW(TAG, "Spool full, dropping quarantined frame %s", oldest);
+            spool_path(path, sizeof(path), oldest, SPOOL_QUARANTINE_EXT);
+            unlink(path);
+            continue;
+        }
+        if (find_oldest_locked(SPOOL_FRAME_EXT, oldest, sizeof(oldest)) != ESP_OK) {
+            break;
+        }
+        ESP_LOGW(TAG, "Spool full, dropping oldest frame %s", oldest);
+        remove_frame_locked(oldest);
+    }
+
+    esp_err_t err = write_file_atomic(key, SPOOL_FRAME_EXT, data, len);
+    xSemaphoreGive(spool_mutex);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Spooled frame %s (%zu bytes)", key, len);
+    }
+    return err;
+}
+
+esp_err_t spool_get_frame_size(const char *key, size_t *len) {
+    if (!key_is_valid(key) || len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char path[SPOOL_PATH_MAX];
+    spool_path(path, sizeof(path), key, SPOOL_FRAME_EXT);
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *len = (size_t)st.st_size;
+    return ESP_OK;
+}
+
+esp_err_t spool_read_frame(const char *key, size_t offset, uint8_t *buf, size_t len, size_t *read_len) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!key_is_valid(key) || buf == NULL || read_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char path[SPOOL_PATH_MAX];
+    spool_path(path, sizeof(path), key, SPOOL_FRAME_EXT);
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        xSemaphoreGive(spool_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (fseek(f, (long)offset, SEEK_SET) != 0) {
+        err = ESP_ERR_INVALID_SIZE;
+    } else {
+        *read_len = fread(buf, 1, len, f);
+    }
+    fclose(f);
+    xSemaphoreGive(spool_mutex);
+
+    return err;
+}
+
+esp_err_t spool_save_state(const char *key, const void *state, size_t len) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!key_is_valid(key) || state == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    esp_err_t err = write_file_atomic(key, SPOOL_STATE_EXT, state, len);
+    xSemaphoreGive(spool_mutex);
+    return err;
+}
+
+esp_err_t spool_load_state(const char *key, void *state, size_t len) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!key_is_valid(key) || state == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char path[SPOOL_PATH_MAX];
+    spool_path(path, sizeof(path), key, SPOOL_STATE_EXT);
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        xSemaphoreGive(spool_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t read_len = fread(state, 1, len, f);
+    fclose(f);
+    xSemaphoreGive(spool_mutex);
+
+    // A state blob of a different size belongs to an older firmware layout
+    return (read_len == len) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t spool_oldest_frame(char *key, size_t max_len) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key == NULL || max_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    esp_err_t err = find_oldest_locked(SPOOL_FRAME_EXT, key, max_len);
+    xSemaphoreGive(spool_mutex);
+    return err;
+}
+
+esp_err_t spool_remove_frame(const char *key) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!key_is_valid(key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    remove_frame_locked(key);
+    xSemaphoreGive(spool_mutex);
+
+    ESP_LOGD(TAG, "Removed spooled frame %s", key);
+    return ESP_OK;
+}
+
+// Move a frame out of the queue, keeping its bytes for inspection until space runs out
+esp_err_t spool_quarantine_frame(const char *key) {
+    if (!spool_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!key_is_valid(key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char frame_path[SPOOL_PATH_MAX];
+    char bad_path[SPOOL_PATH_MAX];
+    spool_path(frame_path, sizeof(frame_path), key, SPOOL_FRAME_EXT);
+    spool_path(bad_path, sizeof(bad_path), key, SPOOL_QUARANTINE_EXT);
+
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    unlink(bad_path);
+    esp_err_t err = ESP_OK;
+    if (rename(frame_path, bad_path) != 0) {
+        // Unreadable entries may not rename either; dropping them still unblocks the queue
+        ESP_LOGW(TAG, "Failed to quarantine %s, removing it", key);
+        if (unlink(frame_path) != 0) {
+            err = ESP_FAIL;
+        }
+    }
+    spool_path(frame_path, sizeof(frame_path), key, SPOOL_STATE_EXT);
+    unlink(frame_path);
+    xSemaphoreGive(spool_mutex);
+    return err;
+}
+
+size_t spool_pending_count(void) {
+    if (!spool_ready) {
+        return 0;
+    }
+
+    size_t count = 0;
+    xSemaphoreTake(spool_mutex, portMAX_DELAY);
+    DIR *dir = opendir(SPOOL_BASE_PATH);
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry_key_len(entry->d_name, SPOOL_FRAME_EXT) > 0) {
+                count++;
+            }
+        }
+        closedir(dir);
+    }
+    xSemaphoreGive(spool_mutex);
+    return count;
+}
@@ -0,0 +1,202 @@
+#include "task_plan.h"
+#include "esp_log.h"
+#include "esp_idf_version.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "TASK_PLAN";
+
+typedef struct {
+    const char *name;
+    uint32_t stack;
+    UBaseType_t priority;
+    BaseType_t core;
+} task_plan_row_t;
+
+static const task_plan_row_t plan[TASK_PLAN_COUNT] = {
+#define TASK_PLAN_ROW(id, name, stack, priority, core) {name, stack, priority, core},
+    TASK_PLAN_TABLE(TASK_PLAN_ROW)
+#undef TASK_PLAN_ROW
+};
+
+#define TASK_PLAN_MAX_TASKS 8
+
+// Tasks created from the plan, for per-row load accounting
+typedef struct {
+    TaskHandle_t handle;
+    task_plan_task_t row;
+    uint32_t last_runtime;
+} planned_task_t;
+
+static planned_task_t planned[TASK_PLAN_MAX_TASKS];
+static int planned_count = 0;
+
+// A call handed to the network task; the caller blocks until it has run
+typedef struct {
+    task_plan_work_t work;
+    void *arg;
+    esp_err_t result;
+    TaskHandle_t caller;
+} network_call_t;
+
+static QueueHandle_t network_queue = NULL;
+static TaskHandle_t network_task = NULL;
+static task_plan_stats_t plan_stats = {0};
+static uint32_t last_idle_runtime[TASK_PLAN_MAX_CORES];
+static uint32_t last_total_runtime = 0;
+
+// Create a task from its row in the plan; name overrides the row's name when given
+esp_err_t task_plan_create(task_plan_task_t task, TaskFunction_t function, void *arg, const char *name,
+                           TaskHandle_t *handle) {
+    if (task >= TASK_PLAN_COUNT || function == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const task_plan_row_t *row = &plan[task];
+    BaseType_t core = row->core < portNUM_PROCESSORS ? row->core : tskNO_AFFINITY;
+    TaskHandle_t created = NULL;
+    if (xTaskCreatePinnedToCore(function, name ? name : row->name, row->stack, arg, row->priority, &created,
+                                core) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create %s", name ? name : row->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (planned_count < TASK_PLAN_MAX_TASKS) {
+        planned[planned_count++] = (planned_task_t){.handle = created, .row = task};
+    }
+    if (handle != NULL) {
+        *handle = created;
+    }
+    ESP_LOGI(TAG, "Started %s: core %d, priority %u, %u byte stack", name ? name : row->name, (int)row->core,
+             (unsigned)row->priority, (unsigned)row->stack);
+    return ESP_OK;
+}
+
+static void network_task_main(void *pvParameters) {
+    network_call_t *call = NULL;
+    while (1) {
+        if (xQueueReceive(network_queue, &call, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        call->result = call->work(call->arg);
+        plan_stats.network_busy_us += (uint64_t)(esp_timer_get_time() - start);
+        plan_stats.network_calls++;
+        xTaskNotifyGive(call->caller);
+    }
+}
+
+esp_err_t task_plan_start_network(void) {
+    if (network_task != NULL) {
+        return ESP_OK;
+    }
+
+    network_queue = xQueueCreate(1, sizeof(network_call_t *));
+    if (network_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = task_plan_create(TASK_PLAN_NETWORK, network_task_main, NULL, NULL, &network_task);
+    if (err != ESP_OK) {
+        vQueueDelete(network_queue);
+        network_queue = NULL;
+    }
+    return err;
+}
+
+// Run work on the network task and wait for its result. Buffers passed in arg only
+// need to live for the call. Runs inline when the network task is not started.
+esp_err_t task_plan_run_network(task_plan_work_t work, void *arg) {
+    if (network_task == NULL || xTaskGetCurrentTaskHandle() == network_task) {
+        return work(arg);
+    }
+
+    network_call_t call = {
+        .work = work,
+        .arg = arg,
+        .result = ESP_FAIL,
+        .caller = xTaskGetCurrentTaskHandle(),
+    };
+    network_call_t *pending = &call;
+    xQueueSend(network_queue, &pending, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return call.result;
+}
+
+void task_plan_record_cycle(uint32_t cycle_us) {
+    plan_stats.cycles++;
+    plan_stats.last_cycle_us = cycle_us;
+    plan_stats.total_cycle_us += cycle_us;
+    if (cycle_us > plan_stats.max_cycle_us) {
+        plan_stats.max_cycle_us = cycle_us;
+    }
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static TaskHandle_t idle_task(int core) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    return xTaskGetIdleTaskHandleForCore(core);
+#else
+    return xTaskGetIdleTaskHandleForCPU(core);
+#endif
+}
+
+// Busy share of each core and of each plan row since the previous sample
+static void sample_load(void) {
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(capacity * sizeof(TaskStatus_t));
+    if (tasks == NULL) {
+        return;
+    }
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, capacity, &total);
+    uint32_t window = total - last_total_runtime;
+    uint32_t row_runtime[TASK_PLAN_COUNT] = {0};
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        for (int core = 0; core < portNUM_PROCESSORS && core < TASK_PLAN_MAX_CORES; core++) {
+            if (tasks[i].xHandle == idle_task(core)) {
+                uint32_t idle = tasks[i].ulRunTimeCounter - last_idle_runtime[core];
+                last_idle_runtime[core] = tasks[i].ulRunTimeCounter;
+                plan_stats.core_load[core] = window && idle < window ? (uint8_t)(100 - (uint64_t)idle * 100 / window) : 0;
+            }
+        }
+        for (int p = 0; p < planned_count; p++) {
+            if (tasks[i].xHandle == planned[p].handle) {
+                row_runtime[planned[p].row] += tasks[i].ulRunTimeCounter - planned[p].last_runtime;
+                planned[p].last_runtime = tasks[i].ulRunTimeCounter;
+            }
+        }
+    }
+    for (int row = 0; row < TASK_PLAN_COUNT; row++) {
+        uint64_t share = window ? (uint64_t)row_runtime[row] * 100 / window : 0;
+        plan_stats.task_load[row] = share > 100 ? 100 : (uint8_t)share;
+    }
+    last_total_runtime = total;
+    free(tasks);
+}
+#endif
+
+// Log per-core load with cycle times, for comparing task placements
+void task_plan_log_load(void) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    sample_load();
+    ESP_LOGI(TAG, "Load: core0 %u%%, core1 %u%%; pipeline %u%%, network %u%%, sinks %u%%",
+             plan_stats.core_load[0], plan_stats.core_load[1], plan_stats.task_load[TASK_PLAN_PIPELINE],
+             plan_stats.task_load[TASK_PLAN_NETWORK], plan_stats.task_load[TASK_PLAN_FANOUT_SINK]);
+#endif
+    if (plan_stats.cycles > 0) {
+        ESP_LOGI(TAG, "Cycle: last %u ms, mean %u ms, max %u ms; network busy %u ms over %u calls",
+                 (unsigned)(plan_stats.last_cycle_us / 1000),
+                 (unsigned)(plan_stats.total_cycle_us / plan_stats.cycles / 1000),
+                 (unsigned)(plan_stats.max_cycle_us / 1000), (unsigned)(plan_stats.network_busy_us / 1000),
+                 (unsigned)plan_stats.network_calls);
+    }
+}
+
+void task_plan_get_stats(task_plan_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = plan_stats;
+    }
+}
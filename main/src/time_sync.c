@@ -0,0 +1,58 @@
+#include "time_sync.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "freertos/FreeRTOS.h"
+#include <sys/time.h>
+#include <time.h>
+
+static const char *TAG = "TIME_SYNC";
+static bool sntp_started = false;
+
+// Any clock before 2024-01-01 means SNTP has not set it yet
+#define MIN_VALID_EPOCH 1704067200
+
+esp_err_t time_sync_init(const char *server) {
+    if (server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sntp_started) {
+        return ESP_OK;
+    }
+
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(server);
+    config.wait_for_sync = true;
+
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start SNTP: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    sntp_started = true;
+    ESP_LOGI(TAG, "SNTP started with server %s", server);
+    return ESP_OK;
+}
+
+esp_err_t time_sync_wait(uint32_t timeout_ms) {
+    if (!sntp_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = esp_netif_sntp_sync_wait(pdMS_TO_TICKS(timeout_ms));
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Clock synchronized");
+    } else {
+        ESP_LOGW(TAG, "Clock not synchronized after %u ms", (unsigned)timeout_ms);
+    }
+    return err;
+}
+
+bool time_sync_is_synced(void) {
+    return time(NULL) >= MIN_VALID_EPOCH;
+}
+
+int64_t time_sync_now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
@@ -0,0 +1,921 @@
+#include "tinyml.h"
+#include "esp_log.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "TINYML";
+
+// TFLite schema values used below
+#define TFL_TYPE_INT32 2
+#define TFL_TYPE_INT8 9
+
+#define TFL_OP_AVERAGE_POOL_2D 1
+#define TFL_OP_CONV_2D 3
+#define TFL_OP_DEPTHWISE_CONV_2D 4
+#define TFL_OP_FULLY_CONNECTED 9
+#define TFL_OP_MAX_POOL_2D 17
+#define TFL_OP_RESHAPE 22
+#define TFL_OP_SOFTMAX 25
+
+#define TFL_ACT_NONE 0
+#define TFL_ACT_RELU 1
+#define TFL_ACT_RELU_N1_TO_1 2
+#define TFL_ACT_RELU6 3
+
+#define TFL_PADDING_SAME 0
+
+// ---- Flatbuffer access ----
+// Every read is bounds checked; a malformed model sets bad instead of reading past the end
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    bool bad;
+} fb_t;
+
+static uint32_t fb_u32(fb_t *fb, size_t pos) {
+    uint32_t v = 0;
+    if (pos + 4 > fb->len) {
+        fb->bad = true;
+        return 0;
+    }
+    memcpy(&v, fb->buf + pos, 4);
+    return v;
+}
+
+static uint16_t fb_u16(fb_t *fb, size_t pos) {
+    uint16_t v = 0;
+    if (pos + 2 > fb->len) {
+        fb->bad = true;
+        return 0;
+    }
+    memcpy(&v, fb->buf + pos, 2);
+    return v;
+}
+
+// Absolute position of a table field, 0 when the field is absent
+static size_t fb_field(fb_t *fb, size_t table, int index) {
+    if (table == 0) {
+        return 0;
+    }
+    int64_t vtable = (int64_t)table - (int32_t)fb_u32(fb, table);
+    if (vtable < 0 || (size_t)vtable >= fb->len) {
+        fb->bad = true;
+        return 0;
+    }
+    size_t slot = 4 + 2 * (size_t)index;
+    if (slot + 2 > fb_u16(fb, (size_t)vtable)) {
+        return 0;
+    }
+    uint16_t offset = fb_u16(fb, (size_t)vtable + slot);
+    return offset ? table + offset : 0;
+}
+
+// Follow an offset field to the table, vector or string it points at
+static size_t fb_ref(fb_t *fb, size_t table, int index) {
+    size_t pos = fb_field(fb, table, index);
+    return pos ? pos + fb_u32(fb, pos) : 0;
+}
+
+static uint32_t fb_vector(fb_t *fb, size_t table, int index, size_t elem_size, size_t *data) {
+    size_t vec = fb_ref(fb, table, index);
+    *data = 0;
+    if (vec == 0) {
+        return 0;
+    }
+    uint32_t count = fb_u32(fb, vec);
+    if (vec + 4 + (uint64_t)count * elem_size > fb->len) {
+        fb->bad = true;
+        return 0;
+    }
+    *data = vec + 4;
+    return count;
+}
+
+static int32_t fb_int(fb_t *fb, size_t table, int index, size_t size, int32_t def) {
+    size_t pos = fb_field(fb, table, index);
+    if (pos == 0) {
+        return def;
+    }
+    if (pos + size > fb->len) {
+        fb->bad = true;
+        return def;
+    }
+    switch (size) {
+        case 1: return (int8_t)fb->buf[pos];
+        case 2: return (int16_t)fb_u16(fb, pos);
+        default: return (int32_t)fb_u32(fb, pos);
+    }
+}
+
+static float fb_float(fb_t *fb, size_t table, int index, float def) {
+    size_t pos = fb_field(fb, table, index);
+    if (pos == 0) {
+        return def;
+    }
+    uint32_t bits = fb_u32(fb, pos);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static float read_float(const uint8_t *p) {
+    float v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// ---- Quantization arithmetic (TFLite reference kernels) ----
+
+static void quantize_multiplier(double real, int32_t *multiplier, int8_t *shift) {
+    if (real == 0.0) {
+        *multiplier = 0;
+        *shift = 0;
+        return;
+    }
+    int exponent;
+    double q = frexp(real, &exponent);
+    int64_t q_fixed = (int64_t)llround(q * (double)(1LL << 31));
+    if (q_fixed == (1LL << 31)) {
+        q_fixed /= 2;
+        exponent++;
+    }
+    if (exponent < -31) {
+        exponent = 0;
+        q_fixed = 0;
+    }
+    if (exponent > 30) {
+        exponent = 30;
+        q_fixed = (1LL << 31) - 1;
+    }
+    *multiplier = (int32_t)q_fixed;
+    *shift = (int8_t)exponent;
+}
+
+static inline int32_t rounding_doubling_high_mul(int32_t a, int32_t b) {
+    if (a == b && a == INT32_MIN) {
+        return INT32_MAX;
+    }
+    int64_t ab = (int64_t)a * b;
+    int32_t nudge = ab >= 0 ? (1 << 30) : (1 - (1 << 30));
+    return (int32_t)((ab + nudge) / (1LL << 31));
+}
+
+static inline int32_t rounding_divide_by_pot(int32_t x, int exponent) {
+    int32_t mask = (int32_t)((1LL << exponent) - 1);
+    int32_t remainder = x & mask;
+    int32_t threshold = (mask >> 1) + (x < 0 ? 1 : 0);
+    return (x >> exponent) + (remainder > threshold ? 1 : 0);
+}
+
+static inline int32_t requantize(int32_t acc, int32_t multiplier, int shift) {
+    int left = shift > 0 ? shift : 0;
+    int right = shift > 0 ? 0 : -shift;
+    return rounding_divide_by_pot(rounding_doubling_high_mul((int32_t)((int64_t)acc * (1LL << left)), multiplier),
+                                  right);
+}
+
+static inline int8_t clamp_output(int32_t v, const tinyml_op_t *op) {
+    v = v < op->act_min ? op->act_min : v;
+    v = v > op->act_max ? op->act_max : v;
+    return (int8_t)v;
+}
+
+static void activation_range(int activation, const tinyml_tensor_t *out, int32_t *min, int32_t *max) {
+    int32_t lo = -128, hi = 127;
+    int32_t zp = out->zero_point;
+    float s = out->scale > 0.0f ? out->scale : 1.0f;
+    if (activation == TFL_ACT_RELU) {
+        lo = zp;
+    } else if (activation == TFL_ACT_RELU6) {
+        lo = zp;
+        hi = zp + (int32_t)lroundf(6.0f / s);
+    } else if (activation == TFL_ACT_RELU_N1_TO_1) {
+        lo = zp + (int32_t)lroundf(-1.0f / s);
+        hi = zp + (int32_t)lroundf(1.0f / s);
+    }
+    *min = lo > -128 ? lo : -128;
+    *max = hi < 127 ? hi : 127;
+}
+
+// ---- Kernels ----
+
+static inline int8_t *act(const tinyml_tensor_t *t) {
+    return (int8_t *)t->data;
+}
+
+static void conv_2d(tinyml_model_t *m, const tinyml_op_t *op) {
+    const tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    const tinyml_tensor_t *filter = &m->tensors[op->inputs[1]];
+    const int32_t *bias = op->inputs[2] >= 0 ? (const int32_t *)m->tensors[op->inputs[2]].data : NULL;
+    const tinyml_tensor_t *out = &m->tensors[op->output];
+
+    const int in_h = in->dims[1], in_w = in->dims[2], in_c = in->dims[3];
+    const int out_h = out->dims[1], out_w = out->dims[2], out_c = out->dims[3];
+    const int f_h = filter->dims[1], f_w = filter->dims[2];
+    const int32_t in_offset = -in->zero_point;
+    const int32_t out_offset = out->zero_point;
+    const int8_t *input = act(in);
+    const int8_t *weights = (const int8_t *)filter->data;
+    int8_t *output = act(out);
+
+    if (op->bias_folded != NULL) {
+        // Pointwise: every tap is in bounds, so the input offset is folded into the bias
+        for (int p = 0; p < out_h * out_w; p++) {
+            const int8_t *px = input + (size_t)p * in_c;
+            for (int oc = 0; oc < out_c; oc++) {
+                const int8_t *w = weights + (size_t)oc * in_c;
+                int32_t acc = 0;
+                for (int ic = 0; ic < in_c; ic++) {
+                    acc += (int32_t)px[ic] * w[ic];
+                }
+                acc = requantize(acc + op->bias_folded[oc], op->multipliers[oc], op->shifts[oc]) + out_offset;
+                *output++ = clamp_output(acc, op);
+            }
+        }
+        return;
+    }
+
+    const int pad_h = op->padding == TFL_PADDING_SAME
+        ? ((out_h - 1) * op->stride_h + (f_h - 1) * op->dilation_h + 1 - in_h) / 2 : 0;
+    const int pad_w = op->padding == TFL_PADDING_SAME
+        ? ((out_w - 1) * op->stride_w + (f_w - 1) * op->dilation_w + 1 - in_w) / 2 : 0;
+
+    for (int oy = 0; oy < out_h; oy++) {
+        for (int ox = 0; ox < out_w; ox++) {
+            const int y0 = oy * op->stride_h - (pad_h > 0 ? pad_h : 0);
+            const int x0 = ox * op->stride_w - (pad_w > 0 ? pad_w : 0);
+            for (int oc = 0; oc < out_c; oc++) {
+                int32_t acc = bias ? bias[oc] : 0;
+                for (int fy = 0; fy < f_h; fy++) {
+                    const int iy = y0 + fy * op->dilation_h;
+                    if (iy < 0 || iy >= in_h) {
+                        continue;
+                    }
+                    for (int fx = 0; fx < f_w; fx++) {
+                        const int ix = x0 + fx * op->dilation_w;
+                        if (ix < 0 || ix >= in_w) {
+                            continue;
+                        }
+                        const int8_t *px = input + ((size_t)iy * in_w + ix) * in_c;
+                        const int8_t *w = weights + (((size_t)oc * f_h + fy) * f_w + fx) * in_c;
+                        for (int ic = 0; ic < in_c; ic++) {
+                            acc += ((int32_t)px[ic] + in_offset) * w[ic];
+                        }
+                    }
+                }
+                acc = requantize(acc, op->multipliers[oc], op->shifts[oc]) + out_offset;
+                *output++ = clamp_output(acc, op);
+            }
+        }
+    }
+}
+
+static void depthwise_conv_2d(tinyml_model_t *m, const tinyml_op_t *op) {
+    const tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    const tinyml_tensor_t *filter = &m->tensors[op->inputs[1]];
+    const int32_t *bias = op->inputs[2] >= 0 ? (const int32_t *)m->tensors[op->inputs[2]].data : NULL;
+    const tinyml_tensor_t *out = &m->tensors[op->output];
+
+    const int in_h = in->dims[1], in_w = in->dims[2], in_c = in->dims[3];
+    const int out_h = out->dims[1], out_w = out->dims[2], out_c = out->dims[3];
+    const int f_h = filter->dims[1], f_w = filter->dims[2];
+    const int mult = op->depth_multiplier;
+    const int32_t in_offset = -in->zero_point;
+    const int32_t out_offset = out->zero_point;
+    const int8_t *input = act(in);
+    const int8_t *weights = (const int8_t *)filter->data;
+    int8_t *output = act(out);
+
+    const int pad_h = op->padding == TFL_PADDING_SAME
+        ? ((out_h - 1) * op->stride_h + (f_h - 1) * op->dilation_h + 1 - in_h) / 2 : 0;
+    const int pad_w = op->padding == TFL_PADDING_SAME
+        ? ((out_w - 1) * op->stride_w + (f_w - 1) * op->dilation_w + 1 - in_w) / 2 : 0;
+
+    for (int oy = 0; oy < out_h; oy++) {
+        for (int ox = 0; ox < out_w; ox++) {
+            const int y0 = oy * op->stride_h - (pad_h > 0 ? pad_h : 0);
+            const int x0 = ox * op->stride_w - (pad_w > 0 ? pad_w : 0);
+            for (int ic = 0; ic < in_c; ic++) {
+                for (int k = 0; k < mult; k++) {
+                    const int oc = ic * mult + k;
+                    int32_t acc = bias ? bias[oc] : 0;
+                    for (int fy = 0; fy < f_h; fy++) {
+                        const int iy = y0 + fy * op->dilation_h;
+                        if (iy < 0 || iy >= in_h) {
+                            continue;
+                        }
+                        for (int fx = 0; fx < f_w; fx++) {
+                            const int ix = x0 + fx * op->dilation_w;
+                            if (ix < 0 || ix >= in_w) {
+                                continue;
+                            }
+                            acc += ((int32_t)input[((size_t)iy * in_w + ix) * in_c + ic] + in_offset) *
+                                   weights[((size_t)fy * f_w + fx) * out_c + oc];
+                        }
+                    }
+                    acc = requantize(acc, op->multipliers[oc], op->shifts[oc]) + out_offset;
+                    output[((size_t)oy * out_w + ox) * out_c + oc] = clamp_output(acc, op);
+                }
+            }
+        }
+    }
+}
+
+static void pool_2d(tinyml_model_t *m, const tinyml_op_t *op) {
+    const tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    const tinyml_tensor_t *out = &m->tensors[op->output];
+    const int in_h = in->dims[1], in_w = in->dims[2], channels = in->dims[3];
+    const int out_h = out->dims[1], out_w = out->dims[2];
+    const int8_t *input = act(in);
+    int8_t *output = act(out);
+
+    const int pad_h = op->padding == TFL_PADDING_SAME
+        ? ((out_h - 1) * op->stride_h + op->filter_h - in_h) / 2 : 0;
+    const int pad_w = op->padding == TFL_PADDING_SAME
+        ? ((out_w - 1) * op->stride_w + op->filter_w - in_w) / 2 : 0;
+
+    for (int oy = 0; oy < out_h; oy++) {
+        for (int ox = 0; ox < out_w; ox++) {
+            const int y0 = oy * op->stride_h - (pad_h > 0 ? pad_h : 0);
+            const int x0 = ox * op->stride_w - (pad_w > 0 ? pad_w : 0);
+            const int fy0 = y0 < 0 ? -y0 : 0;
+            const int fx0 = x0 < 0 ? -x0 : 0;
+            const int fy1 = in_h - y0 < op->filter_h ? in_h - y0 : op->filter_h;
+            const int fx1 = in_w - x0 < op->filter_w ? in_w - x0 : op->filter_w;
+            for (int c = 0; c < channels; c++) {
+                int32_t sum = 0, max = -128, count = 0;
+                for (int fy = fy0; fy < fy1; fy++) {
+                    for (int fx = fx0; fx < fx1; fx++) {
+                        int32_t v = input[((size_t)(y0 + fy) * in_w + x0 + fx) * channels + c];
+                        sum += v;
+                        max = v > max ? v : max;
+                        count++;
+                    }
+                }
+                int32_t v = max;
+                if (op->type == TINYML_OP_AVERAGE_POOL_2D) {
+                    v = count ? (sum > 0 ? sum + count / 2 : sum - count / 2) / count : 0;
+                }
+                output[((size_t)oy * out_w + ox) * channels + c] = clamp_output(v, op);
+            }
+        }
+    }
+}
+
+static void fully_connected(tinyml_model_t *m, const tinyml_op_t *op) {
+    const tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    const tinyml_tensor_t *filter = &m->tensors[op->inputs[1]];
+    const int32_t *bias = op->inputs[2] >= 0 ? (const int32_t *)m->tensors[op->inputs[2]].data : NULL;
+    const tinyml_tensor_t *out = &m->tensors[op->output];
+
+    const int depth = filter->dims[filter->ndims - 1];
+    const int units = filter->dims[0];
+    const int batches = (int)(in->bytes / (size_t)depth);
+    const int32_t in_offset = -in->zero_point;
+    const int32_t w_offset = -filter->zero_point;
+    const int8_t *input = act(in);
+    const int8_t *weights = (const int8_t *)filter->data;
+    int8_t *output = act(out);
+
+    for (int b = 0; b < batches; b++) {
+        for (int u = 0; u < units; u++) {
+            int32_t acc = bias ? bias[u] : 0;
+            for (int d = 0; d < depth; d++) {
+                acc += ((int32_t)input[(size_t)b * depth + d] + in_offset) *
+                       ((int32_t)weights[(size_t)u * depth + d] + w_offset);
+            }
+            acc = requantize(acc, op->multipliers[u], op->shifts[u]) + out->zero_point;
+            output[(size_t)b * units + u] = clamp_output(acc, op);
+        }
+    }
+}
+
+// Float softmax over the last axis, requantized to the output scale; within one
+// step of TFLite's fixed-point implementation
+static void softmax(tinyml_model_t *m, const tinyml_op_t *op) {
+    const tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    const tinyml_tensor_t *out = &m->tensors[op->output];
+    const int depth = in->dims[in->ndims - 1];
+    const int rows = (int)(in->bytes / (size_t)depth);
+    const int8_t *input = act(in);
+    int8_t *output = act(out);
+
+    for (int r = 0; r < rows; r++) {
+        const int8_t *x = input + (size_t)r * depth;
+        int32_t max = -128;
+        for (int i = 0; i < depth; i++) {
+            max = x[i] > max ? x[i] : max;
+        }
+        float sum = 0.0f;
+        for (int i = 0; i < depth; i++) {
+            sum += expf(op->beta * in->scale * (float)(x[i] - max));
+        }
+        for (int i = 0; i < depth; i++) {
+            float p = expf(op->beta * in->scale * (float)(x[i] - max)) / sum;
+            int32_t q = (int32_t)lroundf(p / out->scale) + out->zero_point;
+            output[(size_t)r * depth + i] = clamp_output(q, op);
+        }
+    }
+}
+
+// ---- Loading ----
+
+static esp_err_t parse_tensor(fb_t *fb, size_t table, size_t buffers, uint32_t buffer_count, tinyml_tensor_t *t) {
+    memset(t, 0, sizeof(*t));
+    size_t shape;
+    uint32_t ndims = fb_vector(fb, table, 0, 4, &shape);
+    if (ndims > TINYML_MAX_DIMS) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    t->ndims = (int)ndims;
+    size_t elements = 1;
+    for (uint32_t i = 0; i < ndims; i++) {
+        t->dims[i] = (int32_t)fb_u32(fb, shape + 4 * i);
+        if (t->dims[i] <= 0 || t->dims[i] > 65536) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        elements *= (size_t)t->dims[i];
+    }
+    t->type = (uint8_t)fb_int(fb, table, 1, 1, 0);
+    if (t->type != TFL_TYPE_INT8 && t->type != TFL_TYPE_INT32) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    t->bytes = elements * (t->type == TFL_TYPE_INT32 ? 4 : 1);
+
+    size_t quant = fb_ref(fb, table, 4);
+    if (quant) {
+        size_t scales, zero_points;
+        uint32_t nscales = fb_vector(fb, quant, 2, 4, &scales);
+        uint32_t nzero = fb_vector(fb, quant, 3, 8, &zero_points);
+        if (nscales > 0) {
+            t->scale = read_float(fb->buf + scales);
+            t->channel_scales = fb->buf + scales;
+            t->channel_count = (int)nscales;
+        }
+        if (nzero > 0) {
+            t->zero_point = (int32_t)fb_u32(fb, zero_points);   // Low word of the int64
+        }
+        for (uint32_t i = 0; i < nscales; i++) {
+            float scale = read_float(t->channel_scales + 4 * i);
+            if (!(scale >= 0.0f && scale < 1e6f)) {
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+        if (t->zero_point < -128 || t->zero_point > 127) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    uint32_t buffer = (uint32_t)fb_int(fb, table, 2, 4, 0);
+    if (buffer > 0 && buffer < buffer_count) {
+        size_t buf_table = buffers + 4 * buffer;
+        buf_table += fb_u32(fb, buf_table);
+        size_t data;
+        uint32_t len = fb_vector(fb, buf_table, 0, 1, &data);
+        if (len > 0) {
+            if (len < t->bytes) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            t->data = fb->buf + data;
+            t->constant = true;
+        }
+    }
+    t->first_op = -1;
+    t->last_op = -1;
+    return fb->bad ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+static esp_err_t map_builtin(int32_t code, tinyml_op_type_t *type) {
+    switch (code) {
+        case TFL_OP_CONV_2D: *type = TINYML_OP_CONV_2D; return ESP_OK;
+        case TFL_OP_DEPTHWISE_CONV_2D: *type = TINYML_OP_DEPTHWISE_CONV_2D; return ESP_OK;
+        case TFL_OP_AVERAGE_POOL_2D: *type = TINYML_OP_AVERAGE_POOL_2D; return ESP_OK;
+        case TFL_OP_MAX_POOL_2D: *type = TINYML_OP_MAX_POOL_2D; return ESP_OK;
+        case TFL_OP_FULLY_CONNECTED: *type = TINYML_OP_FULLY_CONNECTED; return ESP_OK;
+        case TFL_OP_RESHAPE: *type = TINYML_OP_RESHAPE; return ESP_OK;
+        case TFL_OP_SOFTMAX: *type = TINYML_OP_SOFTMAX; return ESP_OK;
+        default: return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+static esp_err_t parse_operator(fb_t *fb, size_t table, const int32_t *codes, uint32_t code_count,
+                                tinyml_model_t *m, tinyml_op_t *op) {
+    memset(op, 0, sizeof(*op));
+    uint32_t opcode = (uint32_t)fb_int(fb, table, 0, 4, 0);
+    if (opcode >= code_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (map_builtin(codes[opcode], &op->type) != ESP_OK) {
+        ESP_LOGE(TAG, "Unsupported operator %d", (int)codes[opcode]);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    size_t inputs, outputs;
+    uint32_t ninputs = fb_vector(fb, table, 1, 4, &inputs);
+    uint32_t noutputs = fb_vector(fb, table, 2, 4, &outputs);
+    if (ninputs < 1 || ninputs > 3 || noutputs != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < 3; i++) {
+        op->inputs[i] = i < (int)ninputs ? (int32_t)fb_u32(fb, inputs + 4 * i) : -1;
+        if (op->inputs[i] >= m->tensor_count) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    op->output = (int32_t)fb_u32(fb, outputs);
+    if (op->output < 0 || op->output >= m->tensor_count || op->inputs[0] < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t opts = fb_ref(fb, table, 4);
+    int activation = TFL_ACT_NONE;
+    op->stride_w = op->stride_h = op->dilation_w = op->dilation_h = op->depth_multiplier = 1;
+    op->beta = 1.0f;
+    switch (op->type) {
+        case TINYML_OP_CONV_2D:
+            op->padding = (uint8_t)fb_int(fb, opts, 0, 1, 0);
+            op->stride_w = (uint8_t)fb_int(fb, opts, 1, 4, 1);
+            op->stride_h = (uint8_t)fb_int(fb, opts, 2, 4, 1);
+            activation = fb_int(fb, opts, 3, 1, 0);
+            op->dilation_w = (uint8_t)fb_int(fb, opts, 4, 4, 1);
+            op->dilation_h = (uint8_t)fb_int(fb, opts, 5, 4, 1);
+            break;
+        case TINYML_OP_DEPTHWISE_CONV_2D:
+            op->padding = (uint8_t)fb_int(fb, opts, 0, 1, 0);
+            op->stride_w = (uint8_t)fb_int(fb, opts, 1, 4, 1);
+            op->stride_h = (uint8_t)fb_int(fb, opts, 2, 4, 1);
+            op->depth_multiplier = (uint8_t)fb_int(fb, opts, 3, 4, 1);
+            activation = fb_int(fb, opts, 4, 1, 0);
+            op->dilation_w = (uint8_t)fb_int(fb, opts, 5, 4, 1);
+            op->dilation_h = (uint8_t)fb_int(fb, opts, 6, 4, 1);
+            break;
+        case TINYML_OP_AVERAGE_POOL_2D:
+        case TINYML_OP_MAX_POOL_2D:
+            op->padding = (uint8_t)fb_int(fb, opts, 0, 1, 0);
+            op->stride_w = (uint8_t)fb_int(fb, opts, 1, 4, 1);
+            op->stride_h = (uint8_t)fb_int(fb, opts, 2, 4, 1);
+            op->filter_w = (uint8_t)fb_int(fb, opts, 3, 4, 1);
+            op->filter_h = (uint8_t)fb_int(fb, opts, 4, 4, 1);
+            activation = fb_int(fb, opts, 5, 1, 0);
+            break;
+        case TINYML_OP_FULLY_CONNECTED:
+            activation = fb_int(fb, opts, 0, 1, 0);
+            break;
+        case TINYML_OP_SOFTMAX:
+            op->beta = fb_float(fb, opts, 0, 1.0f);
+            break;
+        default:
+            break;
+    }
+    if (op->stride_w == 0 || op->stride_h == 0 || op->dilation_w == 0 || op->dilation_h == 0 ||
+        op->depth_multiplier == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    activation_range(activation, &m->tensors[op->output], &op->act_min, &op->act_max);
+    return fb->bad ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+static int conv_out_size(int in, int filter, int stride, int dilation, int padding) {
+    int effective = (filter - 1) * dilation + 1;
+    return padding == TFL_PADDING_SAME ? (in + stride - 1) / stride : (in - effective + stride) / stride;
+}
+
+static void *persistent_alloc(tinyml_model_t *m, size_t size) {
+    size = (size + 3) & ~(size_t)3;
+    if (m->persistent_bytes + size > m->arena_size) {
+        return NULL;
+    }
+    m->persistent_bytes += size;
+    return m->arena + m->arena_size - m->persistent_bytes;
+}
+
+// Check shapes against the operator and build the per-channel requantization tables
+static esp_err_t prepare_operator(tinyml_model_t *m, tinyml_op_t *op) {
+    tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    tinyml_tensor_t *out = &m->tensors[op->output];
+    if (in->type != TFL_TYPE_INT8 || out->type != TFL_TYPE_INT8 || in->constant || out->constant) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (op->type == TINYML_OP_RESHAPE) {
+        return in->bytes == out->bytes ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+    if (op->type == TINYML_OP_SOFTMAX) {
+        return in->bytes == out->bytes && in->ndims > 0 && out->scale > 0.0f ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+
+    if (op->type == TINYML_OP_AVERAGE_POOL_2D || op->type == TINYML_OP_MAX_POOL_2D) {
+        if (in->ndims != 4 || out->ndims != 4 || in->dims[3] != out->dims[3] || op->filter_w == 0 ||
+            op->filter_h == 0 ||
+            out->dims[1] != conv_out_size(in->dims[1], op->filter_h, op->stride_h, 1, op->padding) ||
+            out->dims[2] != conv_out_size(in->dims[2], op->filter_w, op->stride_w, 1, op->padding)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        m->macs += (uint64_t)out->bytes * op->filter_w * op->filter_h;
+        return ESP_OK;
+    }
+
+    tinyml_tensor_t *filter = op->inputs[1] >= 0 ? &m->tensors[op->inputs[1]] : NULL;
+    tinyml_tensor_t *bias = op->inputs[2] >= 0 ? &m->tensors[op->inputs[2]] : NULL;
+    if (filter == NULL || !filter->constant || filter->type != TFL_TYPE_INT8 ||
+        (bias != NULL && (!bias->constant || bias->type != TFL_TYPE_INT32))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    int channels;
+    if (op->type == TINYML_OP_FULLY_CONNECTED) {
+        channels = filter->dims[0];
+        int depth = filter->dims[filter->ndims - 1];
+        if (filter->ndims != 2 || in->bytes % (size_t)depth != 0 ||
+            out->bytes != in->bytes / (size_t)depth * (size_t)channels) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        m->macs += (uint64_t)in->bytes * channels;
+    } else {
+        bool depthwise = op->type == TINYML_OP_DEPTHWISE_CONV_2D;
+        channels = out->ndims == 4 ? out->dims[3] : 0;
+        if (in->ndims != 4 || out->ndims != 4 || filter->ndims != 4 ||
+            (depthwise ? filter->dims[3] != channels || channels != in->dims[3] * op->depth_multiplier
+                       : filter->dims[0] != channels || filter->dims[3] != in->dims[3]) ||
+            out->dims[1] != conv_out_size(in->dims[1], filter->dims[1], op->stride_h, op->dilation_h, op->padding) ||
+            out->dims[2] != conv_out_size(in->dims[2], filter->dims[2], op->stride_w, op->dilation_w, op->padding)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        m->macs += (uint64_t)out->dims[1] * out->dims[2] * channels * filter->dims[1] * filter->dims[2] *
+                   (depthwise ? 1 : in->dims[3]);
+    }
+    if (bias != NULL && (bias->bytes < (size_t)channels * 4 || ((uintptr_t)bias->data & 3) != 0)) {
+        return ESP_ERR_INVALID_SIZE;     // Converters align buffers to 16 bytes; bias is read as int32
+    }
+    if (filter->channel_count > 1 && filter->channel_count < channels) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    op->multipliers = persistent_alloc(m, (size_t)channels * sizeof(int32_t));
+    op->shifts = persistent_alloc(m, (size_t)channels);
+    if (op->multipliers == NULL || op->shifts == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int c = 0; c < channels; c++) {
+        float filter_scale = filter->channel_count > 1 ? read_float(filter->channel_scales + 4 * c) : filter->scale;
+        double real = (double)in->scale * filter_scale / (out->scale > 0.0f ? out->scale : 1.0f);
+        quantize_multiplier(real, &op->multipliers[c], &op->shifts[c]);
+    }
+
+    // Unpadded pointwise convolutions dominate MobileNets; fold the input offset into the bias
+    if (op->type == TINYML_OP_CONV_2D && filter->dims[1] == 1 && filter->dims[2] == 1 && op->stride_w == 1 &&
+        op->stride_h == 1 && in->dims[1] == out->dims[1] && in->dims[2] == out->dims[2]) {
+        op->bias_folded = persistent_alloc(m, (size_t)channels * sizeof(int32_t));
+        if (op->bias_folded == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        const int8_t *w = (const int8_t *)filter->data;
+        int depth = in->dims[3];
+        for (int c = 0; c < channels; c++) {
+            int32_t sum = 0;
+            for (int d = 0; d < depth; d++) {
+                sum += w[(size_t)c * depth + d];
+            }
+            op->bias_folded[c] = (bias ? ((const int32_t *)bias->data)[c] : 0) - in->zero_point * sum;
+        }
+    }
+    return ESP_OK;
+}
+
+// Greedy offset assignment, largest tensors first, sharing space between tensors
+// whose lifetimes do not overlap
+static esp_err_t plan_arena(tinyml_model_t *m) {
+    int order[TINYML_MAX_TENSORS];
+    int count = 0;
+    for (int i = 0; i < m->tensor_count; i++) {
+        if (!m->tensors[i].constant && m->tensors[i].first_op >= 0) {
+            order[count++] = i;
+        }
+    }
+    for (int i = 1; i < count; i++) {
+        int t = order[i], j = i;
+        for (; j > 0 && m->tensors[order[j - 1]].bytes < m->tensors[t].bytes; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = t;
+    }
+
+    size_t peak = 0;
+    for (int i = 0; i < count; i++) {
+        tinyml_tensor_t *t = &m->tensors[order[i]];
+        size_t size = (t->bytes + TINYML_ARENA_ALIGN - 1) & ~(size_t)(TINYML_ARENA_ALIGN - 1);
+        size_t offset = 0;
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (int j = 0; j < i; j++) {
+                const tinyml_tensor_t *o = &m->tensors[order[j]];
+                size_t o_size = (o->bytes + TINYML_ARENA_ALIGN - 1) & ~(size_t)(TINYML_ARENA_ALIGN - 1);
+                bool live_together = t->first_op <= o->last_op && o->first_op <= t->last_op;
+                if (live_together && offset < o->arena_offset + o_size && o->arena_offset < offset + size) {
+                    offset = o->arena_offset + o_size;
+                    moved = true;
+                }
+            }
+        }
+        t->arena_offset = offset;
+        peak = offset + size > peak ? offset + size : peak;
+    }
+
+    if (peak + m->persistent_bytes > m->arena_size) {
+        ESP_LOGE(TAG, "Arena too small: %zu activation + %zu persistent bytes, have %zu", peak,
+                 m->persistent_bytes, m->arena_size);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < count; i++) {
+        m->tensors[order[i]].data = m->arena + m->tensors[order[i]].arena_offset;
+    }
+    m->activation_bytes = peak;
+    return ESP_OK;
+}
+
+static esp_err_t load(tinyml_model_t *m, fb_t *fb) {
+    if (fb->len < 8 || memcmp(fb->buf + 4, "TFL3", 4) != 0) {
+        ESP_LOGE(TAG, "Not a TFLite flatbuffer");
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t root = fb_u32(fb, 0);
+
+    size_t codes_vec;
+    uint32_t code_count = fb_vector(fb, root, 1, 4, &codes_vec);
+    int32_t codes[TINYML_OP_COUNT * 4];
+    if (code_count == 0 || code_count > sizeof(codes) / sizeof(codes[0])) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    for (uint32_t i = 0; i < code_count; i++) {
+        size_t code = codes_vec + 4 * i + fb_u32(fb, codes_vec + 4 * i);
+        int32_t deprecated = fb_int(fb, code, 0, 1, 0);
+        int32_t builtin = fb_int(fb, code, 3, 4, 0);
+        codes[i] = builtin > deprecated ? builtin : deprecated;
+    }
+
+    size_t subgraphs;
+    if (fb_vector(fb, root, 2, 4, &subgraphs) != 1) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    size_t graph = subgraphs + fb_u32(fb, subgraphs);
+    size_t buffers;
+    uint32_t buffer_count = fb_vector(fb, root, 4, 4, &buffers);
+
+    size_t tensors;
+    uint32_t tensor_count = fb_vector(fb, graph, 0, 4, &tensors);
+    if (tensor_count == 0 || tensor_count > TINYML_MAX_TENSORS) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    m->tensor_count = (int)tensor_count;
+    for (uint32_t i = 0; i < tensor_count; i++) {
+        size_t table = tensors + 4 * i + fb_u32(fb, tensors + 4 * i);
+        esp_err_t err = parse_tensor(fb, table, buffers, buffer_count, &m->tensors[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Tensor %u: %s", (unsigned)i, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    size_t io;
+    if (fb_vector(fb, graph, 1, 4, &io) != 1) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    m->input = (int32_t)fb_u32(fb, io);
+    if (fb_vector(fb, graph, 2, 4, &io) != 1) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    m->output = (int32_t)fb_u32(fb, io);
+    if (m->input < 0 || m->input >= m->tensor_count || m->output < 0 || m->output >= m->tensor_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t ops;
+    uint32_t op_count = fb_vector(fb, graph, 3, 4, &ops);
+    if (op_count == 0 || op_count > TINYML_MAX_OPS) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    m->op_count = (int)op_count;
+    for (uint32_t i = 0; i < op_count; i++) {
+        size_t table = ops + 4 * i + fb_u32(fb, ops + 4 * i);
+        esp_err_t err = parse_operator(fb, table, codes, code_count, m, &m->ops[i]);
+        if (err == ESP_OK) {
+            err = prepare_operator(m, &m->ops[i]);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Operator %u (%s): %s", (unsigned)i, tinyml_op_name(m->ops[i].type), esp_err_to_name(err));
+            return err;
+        }
+
+        // Lifetimes of the activations it touches
+        const tinyml_op_t *op = &m->ops[i];
+        for (int k = 0; k < 3; k++) {
+            tinyml_tensor_t *t = op->inputs[k] >= 0 ? &m->tensors[op->inputs[k]] : NULL;
+            if (t != NULL && !t->constant) {
+                t->first_op = t->first_op < 0 ? (int)i : t->first_op;
+                t->last_op = (int)i;
+            }
+        }
+        tinyml_tensor_t *out = &m->tensors[op->output];
+        out->first_op = out->first_op < 0 ? (int)i : out->first_op;
+        out->last_op = (int)i;
+    }
+
+    tinyml_tensor_t *input = &m->tensors[m->input];
+    tinyml_tensor_t *output = &m->tensors[m->output];
+    if (input->first_op != 0 || input->type != TFL_TYPE_INT8 || output->type != TFL_TYPE_INT8) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    input->first_op = 0;
+    output->last_op = m->op_count;
+    return fb->bad ? ESP_ERR_INVALID_SIZE : plan_arena(m);
+}
+
+// Parse and plan a model; tflite and arena must outlive it
+esp_err_t tinyml_load(tinyml_model_t *model, const uint8_t *tflite, size_t len, uint8_t *arena, size_t arena_size) {
+    if (model == NULL || tflite == NULL || arena == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(model, 0, sizeof(*model));
+    model->model = tflite;
+    model->model_len = len;
+    model->arena = (uint8_t *)(((uintptr_t)arena + TINYML_ARENA_ALIGN - 1) & ~(uintptr_t)(TINYML_ARENA_ALIGN - 1));
+    model->arena_size = arena_size - (size_t)(model->arena - arena);
+
+    fb_t fb = {.buf = tflite, .len = len};
+    esp_err_t err = load(model, &fb);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Model: %d ops, %d tensors, %u kMAC, arena %zu + %zu bytes", model->op_count,
+             model->tensor_count, (unsigned)(model->macs / 1000), model->activation_bytes, model->persistent_bytes);
+    return ESP_OK;
+}
+
+// Run a single operator; tinyml_invoke() runs them all in order
+esp_err_t tinyml_invoke_op(tinyml_model_t *model, int index) {
+    if (index < 0 || index >= model->op_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const tinyml_op_t *op = &model->ops[index];
+    switch (op->type) {
+        case TINYML_OP_CONV_2D:
+            conv_2d(model, op);
+            break;
+        case TINYML_OP_DEPTHWISE_CONV_2D:
+            depthwise_conv_2d(model, op);
+            break;
+        case TINYML_OP_AVERAGE_POOL_2D:
+        case TINYML_OP_MAX_POOL_2D:
+            pool_2d(model, op);
+            break;
+        case TINYML_OP_FULLY_CONNECTED:
+            fully_connected(model, op);
+            break;
+        case TINYML_OP_RESHAPE:
+            memmove(act(&model->tensors[op->output]), model->tensors[op->inputs[0]].data,
+                    model->tensors[op->output].bytes);
+            break;
+        case TINYML_OP_SOFTMAX:
+            softmax(model, op);
+            break;
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+esp_err_t tinyml_invoke(tinyml_model_t *model) {
+    for (int i = 0; i < model->op_count; i++) {
+        esp_err_t err = tinyml_invoke_op(model, i);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+tinyml_tensor_t *tinyml_input(tinyml_model_t *model) {
+    return &model->tensors[model->input];
+}
+
+const tinyml_tensor_t *tinyml_output(const tinyml_model_t *model) {
+    return &model->tensors[model->output];
+}
+
+const char *tinyml_op_name(tinyml_op_type_t type) {
+    switch (type) {
+        case TINYML_OP_CONV_2D: return "conv_2d";
+        case TINYML_OP_DEPTHWISE_CONV_2D: return "depthwise_conv_2d";
+        case TINYML_OP_AVERAGE_POOL_2D: return "average_pool_2d";
+        case TINYML_OP_MAX_POOL_2D: return "max_pool_2d";
+        case TINYML_OP_FULLY_CONNECTED: return "fully_connected";
+        case TINYML_OP_RESHAPE: return "reshape";
+        case TINYML_OP_SOFTMAX: return "softmax";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,38 @@
+#include "uploader.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "UPLOADER";
+
+void uploader_stats_record(uploader_stats_t *stats, esp_err_t result, size_t bytes, int64_t start_us) {
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->frames_submitted++;
+    if (result != ESP_OK) {
+        stats->frames_failed++;
+        return;
+    }
+
+    uint32_t latency_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    stats->bytes_sent += bytes;
+    stats->last_latency_ms = latency_ms;
+    stats->total_latency_ms += latency_ms;
+    if (latency_ms > stats->max_latency_ms) {
+        stats->max_latency_ms = latency_ms;
+    }
+}
+
+void uploader_log_stats(const char *name, const uploader_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    uint32_t succeeded = stats->frames_submitted - stats->frames_failed;
+    ESP_LOGI(TAG, "[%s] frames=%u failed=%u bytes=%llu latency avg=%u ms max=%u ms",
+             name, (unsigned)stats->frames_submitted, (unsigned)stats->frames_failed,
+             (unsigned long long)stats->bytes_sent,
+             succeeded ? (unsigned)(stats->total_latency_ms / succeeded) : 0,
+             (unsigned)stats->max_latency_ms);
+}
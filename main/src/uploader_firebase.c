@@ -0,0 +1,50 @@
+#include "uploader.h"
+#include "firebase_manager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char *TAG = "UPLOADER_FB";
+static uploader_stats_t firebase_stats;
+
+static esp_err_t firebase_backend_init(const void *config) {
+    if (config == NULL) {
+        ESP_LOGE(TAG, "Firebase backend requires a firebase_config_t");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(&firebase_stats, 0, sizeof(firebase_stats));
+    return firebase_init((const firebase_config_t *)config);
+}
+
+static esp_err_t firebase_backend_submit(const uploader_frame_t *frame) {
+    if (frame == NULL || frame->base64 == NULL || frame->timestamp == NULL) {
+        ESP_LOGE(TAG, "Firebase backend requires a base64 payload and timestamp");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = firebase_upload_image_with_metadata(frame->base64, frame->timestamp, frame->metadata);
+    uploader_stats_record(&firebase_stats, err, frame->base64_len, start);
+    return err;
+}
+
+// Uploads are synchronous, nothing is ever pending
+static esp_err_t firebase_backend_flush(uint32_t timeout_ms) {
+    return ESP_OK;
+}
+
+static void firebase_backend_get_stats(uploader_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = firebase_stats;
+    }
+}
+
+const uploader_backend_t uploader_firebase_backend = {
+    .name = "firebase",
+    .encoding = UPLOADER_ENCODING_BASE64,
+    .init = firebase_backend_init,
+    .submit = firebase_backend_submit,
+    .flush = firebase_backend_flush,
+    .get_stats = firebase_backend_get_stats,
+};
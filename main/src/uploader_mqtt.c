@@ -0,0 +1,219 @@
+#include "uploader.h"
+#include "config.h"
+#include "mqtt_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "UPLOADER_MQTT";
+static esp_mqtt_client_handle_t mqtt_client = NULL;
+static EventGroupHandle_t mqtt_event_group = NULL;
+static uploader_mqtt_config_t mqtt_config;
+static uploader_stats_t mqtt_stats;
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static int pending_acks = 0;
+
+#define MQTT_CONNECTED_BIT BIT0
+#define MQTT_ACKED_BIT     BIT1
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        // With a persistent session the broker keeps our unacknowledged QoS 1 messages
+        ESP_LOGI(TAG, "Connected to broker (session present: %d)", event->session_present);
+        xEventGroupSetBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected from broker");
+        xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        portENTER_CRITICAL(&pending_lock);
+        if (pending_acks > 0) {
+            pending_acks--;
+        }
+        portEXIT_CRITICAL(&pending_lock);
+        xEventGroupSetBits(mqtt_event_group, MQTT_ACKED_BIT);
+        ESP_LOGD(TAG, "PUBACK for msg_id=%d", event->msg_id);
+        break;
+    case MQTT_EVENT_ERROR:
+        ESP_LOGE(TAG, "MQTT error event");
+        break;
+    default:
+        break;
+    }
+}
+
+static esp_err_t publish_qos1(const char *topic, const char *data, int len) {
+    // Count the message before it can be acknowledged: the MQTT task may handle the
+    // PUBACK before publish() returns to us
+    portENTER_CRITICAL(&pending_lock);
+    pending_acks++;
+    portEXIT_CRITICAL(&pending_lock);
+
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, len, 1, 0);
+    if (msg_id < 0) {
+        portENTER_CRITICAL(&pending_lock);
+        pending_acks--;
+        portEXIT_CRITICAL(&pending_lock);
+        ESP_LOGE(TAG, "Publish to %s failed", topic);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Append value to out as the body of a JSON string; returns the new length, or max_len if it didn't fit
+static size_t append_json_escaped(char *out, size_t len, size_t max_len, const char *value) {
+    for (const unsigned char *p = (const unsigned char *)value; *p != '\0' && len < max_len; p++) {
+        if (*p == '"' || *p == '\\') {
+            len += snprintf(out + len, max_len - len, "\\%c", *p);
+        } else if (*p < 0x20) {
+            len += snprintf(out + len, max_len - len, "\\u%04x", *p);
+        } else {
+            out[len++] = (char)*p;
+        }
+    }
+    return len < max_len ? len : max_len;
+}
+
+static esp_err_t mqtt_backend_init(const void *config) {
+    if (config == NULL) {
+        ESP_LOGE(TAG, "MQTT backend requires an uploader_mqtt_config_t");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mqtt_client != NULL) {
+        ESP_LOGW(TAG, "MQTT backend already initialized");
+        return ESP_OK;
+    }
+
+    memcpy(&mqtt_config, config, sizeof(mqtt_config));
+    memset(&mqtt_stats, 0, sizeof(mqtt_stats));
+
+    mqtt_event_group = xEventGroupCreate();
+    if (mqtt_event_group == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_mqtt_client_config_t client_config = {
+        .broker.address.uri = mqtt_config.broker_uri,
+        .credentials.client_id = mqtt_config.client_id,
+        .session.disable_clean_session = true,
+        .session.keepalive = MQTT_KEEPALIVE_S,
+        .buffer.size = MQTT_BUFFER_SIZE,
+        .buffer.out_size = MQTT_BUFFER_SIZE,
+    };
+
+    mqtt_client = esp_mqtt_client_init(&client_config);
+    if (mqtt_client == NULL) {
+        ESP_LOGE(TAG, "Failed to create MQTT client");
+        return ESP_FAIL;
+    }
+
+    esp_mqtt_client_register_event(mqtt_client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+    esp_err_t err = esp_mqtt_client_start(mqtt_client);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT client: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(mqtt_event_group, MQTT_CONNECTED_BIT, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(MQTT_CONNECT_TIMEOUT_MS));
+    if (!(bits & MQTT_CONNECTED_BIT)) {
+        // Not fatal: the client keeps reconnecting and QoS 1 messages wait in the outbox
+        ESP_LOGW(TAG, "Broker %s not reachable yet", mqtt_config.broker_uri);
+    }
+
+    ESP_LOGI(TAG, "MQTT backend initialized: %s as %s", mqtt_config.broker_uri, mqtt_config.client_id);
+    return ESP_OK;
+}
+
+static esp_err_t mqtt_backend_submit(const uploader_frame_t *frame) {
+    if (mqtt_client == NULL) {
+        ESP_LOGE(TAG, "MQTT backend not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (frame == NULL || frame->jpeg == NULL || frame->jpeg_len == 0 || frame->timestamp == NULL) {
+        ESP_LOGE(TAG, "MQTT backend requires a raw JPEG payload and timestamp");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    char topic[160];
+    char meta[384];
+
+    // Metadata goes first so subscribers can prepare for the binary payload. Like the
+    // Firebase record, it carries the frame's metadata as a string.
+    size_t meta_len = (size_t)snprintf(meta, sizeof(meta), "{\"timestamp\":\"");
+    meta_len = append_json_escaped(meta, meta_len, sizeof(meta), frame->timestamp);
+    if (meta_len < sizeof(meta)) {
+        meta_len += snprintf(meta + meta_len, sizeof(meta) - meta_len, "\",\"size\":%zu,\"metadata\":\"", frame->jpeg_len);
+    }
+    if (meta_len < sizeof(meta)) {
+        meta_len = append_json_escaped(meta, meta_len, sizeof(meta), frame->metadata ? frame->metadata : "");
+    }
+    if (meta_len < sizeof(meta)) {
+        meta_len += snprintf(meta + meta_len, sizeof(meta) - meta_len, "\"}");
+    }
+    if (meta_len >= sizeof(meta)) {
+        ESP_LOGE(TAG, "Metadata for %s does not fit in %zu bytes", frame->timestamp, sizeof(meta));
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    snprintf(topic, sizeof(topic), "%s/%s/%s/meta", mqtt_config.topic_prefix, mqtt_config.client_id, frame->timestamp);
+    esp_err_t err = publish_qos1(topic, meta, (int)meta_len);
+
+    if (err == ESP_OK) {
+        snprintf(topic, sizeof(topic), "%s/%s/%s/jpeg", mqtt_config.topic_prefix, mqtt_config.client_id, frame->timestamp);
+        err = publish_qos1(topic, (const char *)frame->jpeg, (int)frame->jpeg_len);
+    }
+
+    uploader_stats_record(&mqtt_stats, err, frame->jpeg_len + meta_len, start);
+    return err;
+}
+
+// Wait until the broker has acknowledged everything published so far
+static esp_err_t mqtt_backend_flush(uint32_t timeout_ms) {
+    if (mqtt_client == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (1) {
+        portENTER_CRITICAL(&pending_lock);
+        int pending = pending_acks;
+        portEXIT_CRITICAL(&pending_lock);
+
+        if (pending == 0) {
+            return ESP_OK;
+        }
+
+        int64_t remaining_us = deadline - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            ESP_LOGW(TAG, "Flush timed out with %d unacknowledged message(s)", pending);
+            return ESP_ERR_TIMEOUT;
+        }
+
+        xEventGroupWaitBits(mqtt_event_group, MQTT_ACKED_BIT, pdTRUE, pdFALSE,
+                            pdMS_TO_TICKS(remaining_us / 1000) + 1);
+    }
+}
+
+static void mqtt_backend_get_stats(uploader_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = mqtt_stats;
+    }
+}
+
+const uploader_backend_t uploader_mqtt_backend = {
+    .name = "mqtt",
+    .encoding = UPLOADER_ENCODING_RAW,
+    .init = mqtt_backend_init,
+    .submit = mqtt_backend_submit,
+    .flush = mqtt_backend_flush,
+    .get_stats = mqtt_backend_get_stats,
+};
@@ -0,0 +1,91 @@
+#include "uploader.h"
+#include "sd_archive.h"
+#include "config.h"
+#include "pin_config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
+#include "driver/sdmmc_host.h"
+#include <time.h>
+#include <string.h>
+
+static const char *TAG = "UPLOADER_SD";
+static sdmmc_card_t *sd_card = NULL;
+static uploader_stats_t sd_stats;
+
+static esp_err_t sd_mount(void) {
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
+        .format_if_mount_failed = false,
+        .max_files = 4,
+        // Large clusters keep preallocated segments contiguous
+        .allocation_unit_size = 32 * 1024,
+    };
+
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+
+    // 1-bit mode leaves GPIO4 (flash LED, D1 in 4-bit mode) alone
+    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+    slot_config.width = 1;
+    // The ESP32 routes slot 1 through IOMUX with these pins fixed; only targets
+    // with a GPIO matrix for SDMMC take them from the slot config
+#ifdef SOC_SDMMC_USE_GPIO_MATRIX
+    slot_config.clk = SD_CLK_GPIO_NUM;
+    slot_config.cmd = SD_CMD_GPIO_NUM;
+    slot_config.d0 = SD_D0_GPIO_NUM;
+#endif
+    slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+
+    esp_err_t err = esp_vfs_fat_sdmmc_mount(SD_MOUNT_POINT, &host, &slot_config, &mount_config, &sd_card);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount SD card: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    sdmmc_card_print_info(stdout, sd_card);
+    return ESP_OK;
+}
+
+// config is unused; the archive lives at SD_ARCHIVE_DIR
+static esp_err_t sd_backend_init(const void *config) {
+    memset(&sd_stats, 0, sizeof(sd_stats));
+
+    esp_err_t err = sd_mount();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    return sd_archive_open(SD_ARCHIVE_DIR);
+}
+
+static esp_err_t sd_backend_submit(const uploader_frame_t *frame) {
+    if (frame == NULL || frame->jpeg == NULL || frame->jpeg_len == 0) {
+        ESP_LOGE(TAG, "SD backend requires a raw JPEG payload");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = sd_archive_append(frame->jpeg, frame->jpeg_len, (uint32_t)time(NULL));
+    uploader_stats_record(&sd_stats, err, frame->jpeg_len, start);
+    return err;
+}
+
+static esp_err_t sd_backend_flush(uint32_t timeout_ms) {
+    return sd_archive_sync();
+}
+
+static void sd_backend_get_stats(uploader_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = sd_stats;
+    }
+}
+
+const uploader_backend_t uploader_sd_backend = {
+    .name = "sdcard",
+    .encoding = UPLOADER_ENCODING_RAW,
+    .init = sd_backend_init,
+    .submit = sd_backend_submit,
+    .flush = sd_backend_flush,
+    .get_stats = sd_backend_get_stats,
+};
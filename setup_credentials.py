@@ -5,15 +5,21 @@ This script helps you securely configure your ESP32-CAM credentials and flash th
 """
 
 import argparse
+import csv
+import re
 import sys
 import os
 import json
 import subprocess
 import shutil
+from concurrent.futures import ProcessPoolExecutor
 from pathlib import Path
 from datetime import datetime
 import getpass
 
+sys.path.insert(0, str(Path(__file__).resolve().parent / "tools"))
+from nvs_image import NvsImage, read_image
+
 def create_config_header(wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key):
     """Create a temporary config header file with credentials (fallback method)."""
     
@@ -80,7 +86,7 @@ def create_credentials_json(wifi_ssid, wifi_password, firebase_project_id, fireb
     print("✓ Created credentials.json")
     return credentials
 
-def generate_nvs_csv(credentials, csv_path="credentials.csv", namespace="credentials"):
+def generate_nvs_csv(credentials, csv_path="credentials.csv", namespace="credentials", capture_schedule=None, camera_roi=None, privacy_mask=None):
     """Generate NVS CSV file from credentials with configurable namespace."""
     
     with open(csv_path, "w") as f:
@@ -93,6 +99,15 @@ def generate_nvs_csv(credentials, csv_path="credentials.csv", namespace="credent
         f.write(f"fb_project,data,string,{credentials['firebase']['project_id']}\n")
         f.write(f"fb_db_url,data,string,{credentials['firebase']['database_url']}\n")
         f.write(f"fb_api_key,data,string,{credentials['firebase']['api_key']}\n")
+        # Runtime settings go in their own namespace (RUNTIME_NVS_NAMESPACE)
+        if capture_schedule or camera_roi or privacy_mask:
+            f.write("runtime,namespace,,\n")
+        if capture_schedule:
+            f.write(f"cap_sched,data,string,{capture_schedule}\n")
+        if camera_roi:
+            f.write(f"cam_roi,data,string,\"{camera_roi}\"\n")
+        if privacy_mask:
+            f.write(f"priv_mask,data,string,\"{privacy_mask}\"\n")
     
     print(f"✓ Created {csv_path} with namespace '{namespace}'")
     print("📝 NVS key mappings (matching your config.h):")
@@ -102,6 +117,12 @@ def generate_nvs_csv(credentials, csv_path="credentials.csv", namespace="credent
     print("  - fb_db_url → Firebase Database URL (NVS_FIREBASE_DB_URL_KEY)")
     print("  - fb_api_key → Firebase API Key (NVS_FIREBASE_API_KEY_KEY)")
     print(f"  - namespace: '{namespace}' (NVS_NAMESPACE)")
+    if capture_schedule:
+        print(f"  - cap_sched → Capture schedule '{capture_schedule}' in namespace 'runtime'")
+    if camera_roi:
+        print(f"  - cam_roi → Sensor window '{camera_roi}' in namespace 'runtime'")
+    if privacy_mask:
+        print(f"  - priv_mask → Privacy polygons '{privacy_mask}' in namespace 'runtime'")
     return csv_path
 
 def generate_nvs_bin(csv_path, bin_path="credentials.bin", partition_size=0x5000):
@@ -205,6 +226,7 @@ def create_gitignore():
         "credentials.json",
         "credentials.csv",
         "credentials.bin",
+        "fleet_nvs/",
         "temp_config.h",
         "main/temp_config.h",
         "include/temp_config.h",
@@ -300,6 +322,34 @@ def validate_inputs(wifi_ssid, wifi_password, firebase_project_id, firebase_db_u
     
     return errors, warnings
 
+def validate_runtime_settings(capture_schedule=None, camera_roi=None, privacy_mask=None):
+    """Validate the optional settings stored in the runtime namespace."""
+    
+    errors = []
+    
+    if capture_schedule and len(capture_schedule.split()) != 5:
+        errors.append("Capture schedule needs 5 fields: minute hour day month weekday")
+    
+    if camera_roi:
+        parts = camera_roi.split(",")
+        if len(parts) != 4 or not all(p.strip().isdigit() for p in parts):
+            errors.append("ROI needs 4 integers: x,y,width,height")
+        else:
+            x, y, w, h = (int(p) for p in parts)
+            if w <= 0 or h <= 0 or x + w > 1600 or y + h > 1200:
+                errors.append("ROI must lie within the 1600x1200 sensor array")
+    
+    if privacy_mask:
+        for polygon in filter(str.strip, privacy_mask.split(";")):
+            points = polygon.split()
+            if not 3 <= len(points) <= 8 or not all(re.fullmatch(r"\d+,\d+", p) for p in points):
+                errors.append("Each privacy polygon needs 3 to 8 x,y points separated by spaces")
+                break
+        if len(privacy_mask) >= 256:
+            errors.append("Privacy mask must be shorter than 256 characters")
+    
+    return errors
+
 def interactive_setup(namespace="credentials"):
     """Interactive credential setup."""
     
@@ -361,7 +411,7 @@ def interactive_setup(namespace="credentials"):
     
     return process_credentials(wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key, port, namespace)
 
-def process_credentials(wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key, port=None, namespace="credentials"):
+def process_credentials(wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key, port=None, namespace="credentials", capture_schedule=None, camera_roi=None, privacy_mask=None):
     """Process and save credentials."""
     
     try:
@@ -372,7 +422,7 @@ def process_credentials(wifi_ssid, wifi_password, firebase_project_id, firebase_
         
         # Generate NVS files with specified namespace
         print("\n🔄 Generating NVS partition...")
-        csv_path = generate_nvs_csv(credentials, namespace=namespace)
+        csv_path = generate_nvs_csv(credentials, namespace=namespace, capture_schedule=capture_schedule, camera_roi=camera_roi, privacy_mask=privacy_mask)
         bin_path = generate_nvs_bin(csv_path)
         
         # Flash to ESP32 if requested
@@ -432,6 +482,178 @@ def load_credentials_from_json(json_file):
         print(f"❌ Error loading credentials from {json_file}: {e}")
         return None, None, None, None, None
 
+# Manifest columns / JSON fields and the NVS entries they become. Credentials go in
+# the credentials namespace (NVS_* in config.h), the rest in the runtime namespace.
+FLEET_FIELDS = [
+    ("wifi_ssid", "credentials", "wifi_ssid"),
+    ("wifi_password", "credentials", "wifi_pass"),
+    ("firebase_project_id", "credentials", "fb_project"),
+    ("firebase_db_url", "credentials", "fb_db_url"),
+    ("firebase_api_key", "credentials", "fb_api_key"),
+    ("device_id", "runtime", "device_id"),
+    ("capture_schedule", "runtime", "cap_sched"),
+    ("camera_roi", "runtime", "cam_roi"),
+    ("privacy_mask", "runtime", "priv_mask"),
+]
+
+def load_fleet_manifest(manifest_path, defaults):
+    """Read per-device settings from a CSV or JSON fleet manifest.
+    
+    CSV: a header row naming FLEET_FIELDS columns, one device per row.
+    JSON: a list of devices, or {"defaults": {...}, "devices": [...]}.
+    Empty fields fall back to the JSON defaults, then to the command line.
+    """
+    
+    with open(manifest_path, newline="") as f:
+        if manifest_path.lower().endswith(".json"):
+            data = json.load(f)
+            if isinstance(data, dict):
+                defaults = {**defaults, **{k: v for k, v in data.get("defaults", {}).items() if v}}
+                data = data.get("devices", [])
+            rows = data
+        else:
+            rows = list(csv.DictReader(f))
+    
+    known = {field for field, _, _ in FLEET_FIELDS}
+    devices = []
+    for number, row in enumerate(rows, 1):
+        unknown = set(row) - known
+        if unknown:
+            raise ValueError(f"Device {number}: unknown fields {', '.join(sorted(unknown))}")
+        device = dict(defaults)
+        device.update({k: str(v).strip() for k, v in row.items() if v is not None and str(v).strip()})
+        devices.append(device)
+    return devices
+
+def validate_fleet(devices):
+    """Return a list of errors, each naming the device it belongs to."""
+    
+    errors = []
+    seen = set()
+    for number, device in enumerate(devices, 1):
+        device_id = device.get("device_id", "")
+        name = device_id or f"#{number}"
+        if not re.fullmatch(r"[A-Za-z0-9_.-]{1,31}", device_id):
+            errors.append(f"{name}: device ID needs 1 to 31 letters, digits, '.', '_' or '-'")
+        elif device_id in seen:
+            errors.append(f"{name}: duplicate device ID")
+        seen.add(device_id)
+        
+        device_errors, _ = validate_inputs(
+            device.get("wifi_ssid", ""), device.get("wifi_password", ""),
+            device.get("firebase_project_id", ""), device.get("firebase_db_url", ""),
+            device.get("firebase_api_key", ""))
+        device_errors += validate_runtime_settings(
+            device.get("capture_schedule"), device.get("camera_roi"), device.get("privacy_mask"))
+        errors += [f"{name}: {e}" for e in device_errors]
+    return errors
+
+def build_device_nvs(device, namespace="credentials", partition_size=0x5000):
+    """Lay out one device's NVS partition image natively, without nvs_partition_gen.py."""
+    
+    image = NvsImage(partition_size)
+    for field, group, key in FLEET_FIELDS:
+        if device.get(field):
+            image.set_str(namespace if group == "credentials" else group, key, device[field])
+    return image.to_bytes()
+
+def expected_nvs(device, namespace="credentials"):
+    """The {namespace: {key: value}} a device image should read back as."""
+    
+    expected = {}
+    for field, group, key in FLEET_FIELDS:
+        if device.get(field):
+            expected.setdefault(namespace if group == "credentials" else group, {})[key] = device[field]
+    return expected
+
+def provision_device(job):
+    """Worker: write one image and check it with an independent parse. Returns (path, error)."""
+    
+    device, out_dir, namespace, partition_size = job
+    bin_path = os.path.join(out_dir, f"credentials-{device['device_id']}.bin")
+    try:
+        image = build_device_nvs(device, namespace, partition_size)
+        if read_image(image) != expected_nvs(device, namespace):
+            return bin_path, "image does not read back as written"
+        with open(bin_path, "wb") as f:
+            f.write(image)
+        return bin_path, None
+    except (OSError, ValueError) as e:
+        return bin_path, str(e)
+
+def readback_fleet(readback_tool, devices, paths, namespace="credentials"):
+    """Read every image through the host NVS shim (tools/nvs_readback.c) and compare."""
+    
+    if namespace != "credentials":
+        return [f"readback only knows the 'credentials' namespace of config.h, not '{namespace}'"]
+    
+    results = {}
+    for start in range(0, len(paths), 256):
+        batch = paths[start:start + 256]
+        run = subprocess.run([readback_tool] + batch, capture_output=True, text=True)
+        for line in run.stdout.splitlines():
+            entry = json.loads(line)
+            results[entry.pop("image")] = entry
+    
+    errors = []
+    for device, path in zip(devices, paths):
+        found = results.get(path)
+        if found is None or "error" in found:
+            errors.append(f"{device['device_id']}: {found.get('error') if found else 'no readback output'}")
+            continue
+        want = {k: v for values in expected_nvs(device, namespace).values() for k, v in values.items()}
+        if found != want:
+            differing = sorted(k for k in set(want) | set(found) if want.get(k) != found.get(k))
+            errors.append(f"{device['device_id']}: readback differs in {', '.join(differing)}")
+    return errors
+
+def provision_fleet(manifest_path, defaults, out_dir="fleet_nvs", namespace="credentials",
+                    partition_size=0x5000, jobs=None, readback_tool=None):
+    """Generate and verify NVS partition images for every device in a fleet manifest."""
+    
+    try:
+        devices = load_fleet_manifest(manifest_path, defaults)
+    except (OSError, ValueError, KeyError, json.JSONDecodeError, csv.Error) as e:
+        print(f"❌ Error reading fleet manifest {manifest_path}: {e}")
+        return False
+    if not devices:
+        print(f"❌ No devices in {manifest_path}")
+        return False
+    
+    errors = validate_fleet(devices)
+    if errors:
+        print("❌ Validation errors:")
+        for error in errors:
+            print(f"  - {error}")
+        return False
+    
+    os.makedirs(out_dir, exist_ok=True)
+    started = datetime.now()
+    jobs_list = [(device, out_dir, namespace, partition_size) for device in devices]
+    with ProcessPoolExecutor(max_workers=jobs) as pool:
+        results = list(pool.map(provision_device, jobs_list, chunksize=max(1, len(devices) // 64)))
+    elapsed = (datetime.now() - started).total_seconds()
+    
+    errors = [f"{os.path.basename(path)}: {error}" for path, error in results if error]
+    paths = [path for path, _ in results]
+    if not errors and readback_tool:
+        print(f"🔄 Reading {len(paths)} images back through {readback_tool}...")
+        errors = readback_fleet(readback_tool, devices, paths, namespace)
+    
+    if errors:
+        print(f"❌ {len(errors)} of {len(devices)} devices failed:")
+        for error in errors[:20]:
+            print(f"  - {error}")
+        if len(errors) > 20:
+            print(f"  ... and {len(errors) - 20} more")
+        return False
+    
+    print(f"✅ Generated {len(devices)} NVS images in {out_dir}/ ({elapsed:.2f}s)")
+    if not readback_tool:
+        print("💡 Build tools/nvs_readback.c and pass --readback to check them with the firmware's credential code")
+    print(f"   Flash each with: esptool.py --port /dev/ttyUSB0 write_flash 0x9000 {out_dir}/credentials-<device>.bin")
+    return True
+
 def main():
     parser = argparse.ArgumentParser(description="Setup ESP32-CAM credentials with NVS support")
     parser.add_argument("--wifi-ssid", help="WiFi SSID")
@@ -445,9 +667,34 @@ def main():
     parser.add_argument("--no-flash", action="store_true", help="Don't flash to ESP32, just generate files")
     parser.add_argument("--baud", type=int, default=115200, help="Serial baud rate (default: 115200)")
     parser.add_argument("--namespace", "-n", default="credentials", help="NVS namespace (default: credentials)")
+    parser.add_argument("--capture-schedule", help="Cron-style capture windows, e.g. \"* 8-17 * * 1-5\" (default: always)")
+    parser.add_argument("--privacy-mask", help="Polygons to blank on the 1600x1200 array, e.g. \"0,900 1600,800 1600,1200 0,1200\"; separate polygons with ';'")
+    parser.add_argument("--roi", help="Sensor window x,y,width,height on the 1600x1200 array, e.g. 400,300,640,480 (default: full frame)")
+    parser.add_argument("--fleet", metavar="MANIFEST", help="Generate an NVS image per device from a CSV/JSON fleet manifest; other options become defaults")
+    parser.add_argument("--fleet-out", default="fleet_nvs", help="Output directory for --fleet images (default: fleet_nvs)")
+    parser.add_argument("--jobs", "-j", type=int, help="Parallel workers for --fleet (default: CPU count)")
+    parser.add_argument("--readback", metavar="TOOL", help="Verify --fleet images with a built tools/nvs_readback.c")
     
     args = parser.parse_args()
     
+    if args.fleet:
+        defaults = {
+            "wifi_ssid": args.wifi_ssid, "wifi_password": args.wifi_password,
+            "firebase_project_id": args.firebase_project_id, "firebase_db_url": args.firebase_db_url,
+            "firebase_api_key": args.firebase_api_key, "capture_schedule": args.capture_schedule,
+            "camera_roi": args.roi, "privacy_mask": args.privacy_mask,
+        }
+        defaults = {k: v for k, v in defaults.items() if v}
+        if args.from_json:
+            loaded = load_credentials_from_json(args.from_json)
+            if not all(loaded):
+                return False
+            names = ["wifi_ssid", "wifi_password", "firebase_project_id", "firebase_db_url", "firebase_api_key"]
+            defaults = {**dict(zip(names, loaded)), **defaults}
+        create_gitignore()
+        return provision_fleet(args.fleet, defaults, args.fleet_out,
+                               args.namespace, jobs=args.jobs, readback_tool=args.readback)
+    
     # Load from JSON file if specified
     if args.from_json:
         wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key = load_credentials_from_json(args.from_json)
@@ -482,7 +729,12 @@ def main():
     # Determine port
     port = args.port if not args.no_flash else False
     
-    return process_credentials(wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key, port, args.namespace)
+    runtime_errors = validate_runtime_settings(args.capture_schedule, args.roi, args.privacy_mask)
+    if runtime_errors:
+        print(f"❌ {runtime_errors[0]}")
+        return False
+    
+    return process_credentials(wifi_ssid, wifi_password, firebase_project_id, firebase_db_url, firebase_api_key, port, args.namespace, args.capture_schedule, args.roi, args.privacy_mask)
 
 if __name__ == "__main__":
     try:
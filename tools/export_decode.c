@@ -0,0 +1,696 @@
+// Bulk decoder for Realtime Database exports of the images node.
+//
+// Turns an export of /images (or of the whole database, whose "images" member
+// is then used) into one JPEG file per record plus a CSV index, for exports
+// far larger than the Python tools can load. The export is memory-mapped and
+// scanned once by the main thread, which hands each record's base64 string to
+// a pool of worker threads without copying it. Workers decode with AVX2 where
+// the CPU has it (scalar otherwise), check the JPEG SOI and EOI markers and
+// write <out>/<key>.jpg. At most a few records per worker are queued, so
+// memory stays flat whatever the export size, and the kernel can drop pages of
+// the mapping once they have been read.
+//
+// Build from the repository root:
+//   gcc -O2 -pthread -o export_decode tools/export_decode.c
+//   ./export_decode [-o frames] [-j threads] [-i index.csv] [--keep-invalid] export.json
+//
+// index.csv has one row per record: key, timestamp, file, bytes, status,
+// metadata. Rows are written as records finish, so sort by key for capture
+// order. Status is "ok", or why the record was not written: "bad_base64",
+// "no_soi" or "no_eoi" (a truncated upload). --keep-invalid writes those
+// files anyway.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_PATH 1
+#endif
+
+#define QUEUE_PER_WORKER 4
+#define MAX_WORKERS 256
+#define MAX_KEY_LEN 256
+#define PROGRESS_EVERY_S 2
+
+typedef struct {
+    const char *b64;                // Into the mapping, JSON escapes included
+    size_t b64_len;
+    char key[MAX_KEY_LEN];
+    char timestamp[64];
+    char *metadata;                 // Unescaped, or NULL
+} job_t;
+
+typedef struct {
+    uint64_t records, written, invalid, skipped;
+    uint64_t bytes_out;
+} totals_t;
+
+static struct {
+    job_t *ring;
+    size_t cap, head, count;
+    bool done;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} queue = {.lock = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER,
+           .not_full = PTHREAD_COND_INITIALIZER};
+
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *index_file;
+static const char *out_dir = "frames";
+static bool keep_invalid;
+static bool use_avx2;
+static totals_t totals;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---------------------------------------------------------------------------
+// Base64
+
+static uint8_t decode_table[256];
+
+static void decode_table_init(void) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    memset(decode_table, 0xFF, sizeof(decode_table));
+    for (int i = 0; i < 64; i++) {
+        decode_table[(uint8_t)alphabet[i]] = (uint8_t)i;
+    }
+}
+
+#ifdef HAVE_AVX2_PATH
+// Muła and Lemire's AVX2 decoder: classify 32 characters with two nibble
+// lookups, map them to 6-bit values, then pack 32 sextets into 24 bytes with
+// multiply-adds and shuffles. Stops at the first block holding anything other
+// than the 64 alphabet characters (padding, escapes), which the scalar loop
+// takes from there. Writes 32 bytes per 24 decoded, so out needs 8 spare.
+__attribute__((target("avx2"))) static size_t decode_avx2(const char *in, size_t len, uint8_t *out, size_t *consumed) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+                                              -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    const __m256i pack_pairs = _mm256_set1_epi32(0x01400140);
+    const __m256i pack_quads = _mm256_set1_epi32(0x00011000);
+    const __m256i gather = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+                                            10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    size_t i = 0, o = 0;
+    for (; i + 32 <= len; i += 32, o += 24) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(v, mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+        __m256i eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        v = _mm256_add_epi8(v, roll);
+        v = _mm256_maddubs_epi16(v, pack_pairs);
+        v = _mm256_madd_epi16(v, pack_quads);
+        v = _mm256_shuffle_epi8(v, gather);
+        v = _mm256_permutevar8x32_epi32(v, lanes);
+        _mm256_storeu_si256((__m256i *)(out + o), v);
+    }
+    *consumed = i;
+    return o;
+}
+#endif
+
+// Decode a JSON string body holding base64. Accepts the "\/" and "\n" escapes
+// some exporters add and a data: URL prefix. Returns false on anything else
+// that is not base64, including data after padding.
+static bool base64_decode(const char *in, size_t len, uint8_t *out, size_t *out_len) {
+    if (len > 5 && memcmp(in, "data:", 5) == 0) {
+        const char *comma = memchr(in, ',', len);
+        if (comma == NULL) {
+            return false;
+        }
+        len -= (size_t)(comma + 1 - in);
+        in = comma + 1;
+    }
+
+    size_t i = 0, o = 0;
+#ifdef HAVE_AVX2_PATH
+    if (use_avx2) {
+        o = decode_avx2(in, len, out, &i);
+    }
+#endif
+
+    uint32_t acc = 0;
+    int have = 0, padding = 0;
+    for (; i < len; i++) {
+        uint8_t c = (uint8_t)in[i];
+        if (c == '\\' && i + 1 < len) {
+            c = (uint8_t)in[++i];
+            if (c == 'n' || c == 'r') {
+                continue;
+            }
+            if (c != '/') {
+                return false;
+            }
+        }
+        if (c == '=') {
+            padding++;
+            continue;
+        }
+        uint8_t v = decode_table[c];
+        if (v == 0xFF || padding > 0) {
+            return false;
+        }
+        acc = (acc << 6) | v;
+        if (++have == 4) {
+            out[o++] = (uint8_t)(acc >> 16);
+            out[o++] = (uint8_t)(acc >> 8);
+            out[o++] = (uint8_t)acc;
+            acc = 0;
+            have = 0;
+        }
+    }
+    if (have == 1 || (padding > 0 && (have + padding) != 4)) {
+        return false;
+    }
+    if (have == 2) {
+        out[o++] = (uint8_t)(acc >> 4);
+    } else if (have == 3) {
+        out[o++] = (uint8_t)(acc >> 10);
+        out[o++] = (uint8_t)(acc >> 2);
+    }
+    *out_len = o;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Workers
+
+static const char *jpeg_status(const uint8_t *jpeg, size_t len) {
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 || jpeg[2] != 0xFF) {
+        return "no_soi";
+    }
+    // The sensor driver can pad the frame after EOI
+    size_t end = len;
+    while (end > 2 && (jpeg[end - 1] == 0x00 || jpeg[end - 1] == 0xFF) && len - end < 4096) {
+        end--;
+    }
+    bool eoi = end >= 4 && jpeg[end - 2] == 0xFF && jpeg[end - 1] == 0xD9;
+    return eoi ? "ok" : "no_eoi";
+}
+
+static void csv_field(FILE *f, const char *s) {
+    if (s == NULL || strpbrk(s, ",\"\r\n") == NULL) {
+        fputs(s ? s : "", f);
+        return;
+    }
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"') {
+            fputc('"', f);
+        }
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return close(fd) == 0;
+}
+
+static void process_job(job_t *job, uint8_t **buf, size_t *buf_cap) {
+    size_t need = job->b64_len / 4 * 3 + 64;
+    if (need > *buf_cap) {
+        free(*buf);
+        *buf = malloc(need);
+        *buf_cap = *buf ? need : 0;
+        if (*buf == NULL) {
+            fprintf(stderr, "out of memory decoding %s\n", job->key);
+            exit(1);
+        }
+    }
+
+    size_t len = 0;
+    const char *status = base64_decode(job->b64, job->b64_len, *buf, &len) ? jpeg_status(*buf, len) : "bad_base64";
+    bool ok = strcmp(status, "ok") == 0;
+
+    // Keys are RTDB keys, which may still hold characters a filesystem dislikes
+    char name[MAX_KEY_LEN];
+    size_t n = 0;
+    for (const char *p = job->key; *p && n < sizeof(name) - 1; p++) {
+        name[n++] = (strchr("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-", *p) != NULL) ? *p : '_';
+    }
+    name[n] = '\0';
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.jpg", out_dir, name);
+
+    bool written = false;
+    if ((ok || (keep_invalid && strcmp(status, "bad_base64") != 0)) && !(written = write_file(path, *buf, len))) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        status = "write_failed";
+    }
+
+    pthread_mutex_lock(&index_lock);
+    csv_field(index_file, job->key);
+    fputc(',', index_file);
+    csv_field(index_file, job->timestamp);
+    fputc(',', index_file);
+    csv_field(index_file, written ? path : "");
+    fprintf(index_file, ",%zu,%s,", len, status);
+    csv_field(index_file, job->metadata);
+    fputc('\n', index_file);
+    totals.records++;
+    totals.written += written;
+    totals.invalid += !ok;
+    totals.bytes_out += written ? len : 0;
+    pthread_mutex_unlock(&index_lock);
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    uint8_t *buf = NULL;
+    size_t buf_cap = 0;
+    while (true) {
+        pthread_mutex_lock(&queue.lock);
+        while (queue.count == 0 && !queue.done) {
+            pthread_cond_wait(&queue.not_empty, &queue.lock);
+        }
+        if (queue.count == 0) {
+            pthread_mutex_unlock(&queue.lock);
+            break;
+        }
+        job_t job = queue.ring[queue.head];
+        queue.head = (queue.head + 1) % queue.cap;
+        queue.count--;
+        pthread_cond_signal(&queue.not_full);
+        pthread_mutex_unlock(&queue.lock);
+
+        process_job(&job, &buf, &buf_cap);
+        free(job.metadata);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void submit(const job_t *job) {
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == queue.cap) {
+        pthread_cond_wait(&queue.not_full, &queue.lock);
+    }
+    queue.ring[(queue.head + queue.count) % queue.cap] = *job;
+    queue.count++;
+    pthread_cond_signal(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+// ---------------------------------------------------------------------------
+// Export scanner. Only the structure is parsed; image strings are located with
+// memchr and passed on untouched.
+
+typedef struct {
+    const char *p, *end;
+    const char *error;
+    const char *error_at;
+} scanner_t;
+
+static void fail(scanner_t *s, const char *what) {
+    if (s->error == NULL) {
+        s->error = what;
+        s->error_at = s->p;
+    }
+    s->p = s->end;
+}
+
+static void skip_ws(scanner_t *s) {
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t')) {
+        s->p++;
+    }
+}
+
+static bool expect(scanner_t *s, char c) {
+    skip_ws(s);
+    if (s->p < s->end && *s->p == c) {
+        s->p++;
+        return true;
+    }
+    return false;
+}
+
+// Returns the raw body of the string at s->p and moves past its closing quote
+static bool scan_string(scanner_t *s, const char **body, size_t *len) {
+    skip_ws(s);
+    if (s->p >= s->end || *s->p != '"') {
+        fail(s, "expected a string");
+        return false;
+    }
+    const char *start = ++s->p;
+    while (true) {
+        const char *q = memchr(s->p, '"', (size_t)(s->end - s->p));
+        if (q == NULL) {
+            fail(s, "unterminated string");
+            return false;
+        }
+        size_t backslashes = 0;
+        while (q - backslashes > start && q[-1 - (ptrdiff_t)backslashes] == '\\') {
+            backslashes++;
+        }
+        s->p = q + 1;
+        if (backslashes % 2 == 0) {
+            *body = start;
+            *len = (size_t)(q - start);
+            return true;
+        }
+    }
+}
+
+static void put_utf8(char **o, char *limit, uint32_t cp) {
+    char tmp[4];
+    int n;
+    if (cp < 0x80) {
+        tmp[0] = (char)cp, n = 1;
+    } else if (cp < 0x800) {
+        tmp[0] = (char)(0xC0 | cp >> 6), tmp[1] = (char)(0x80 | (cp & 0x3F)), n = 2;
+    } else if (cp < 0x10000) {
+        tmp[0] = (char)(0xE0 | cp >> 12), tmp[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        tmp[2] = (char)(0x80 | (cp & 0x3F)), n = 3;
+    } else {
+        tmp[0] = (char)(0xF0 | cp >> 18), tmp[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        tmp[2] = (char)(0x80 | ((cp >> 6) & 0x3F)), tmp[3] = (char)(0x80 | (cp & 0x3F)), n = 4;
+    }
+    if (*o + n < limit) {
+        memcpy(*o, tmp, (size_t)n);
+        *o += n;
+    }
+}
+
+// Unescape a JSON string body into out (size > 0), truncating to fit
+static void unescape(const char *in, size_t len, char *out, size_t size) {
+    char *o = out, *limit = out + size - 1;
+    for (size_t i = 0; i < len && o < limit; i++) {
+        if (in[i] != '\\' || i + 1 >= len) {
+            *o++ = in[i];
+            continue;
+        }
+        char c = in[++i];
+        switch (c) {
+        case 'b': *o++ = '\b'; break;
+        case 'f': *o++ = '\f'; break;
+        case 'n': *o++ = '\n'; break;
+        case 'r': *o++ = '\r'; break;
+        case 't': *o++ = '\t'; break;
+        case 'u': {
+            uint32_t cp = 0;
+            if (i + 4 >= len || sscanf(in + i + 1, "%4x", &cp) != 1) {
+                break;
+            }
+            i += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 6 < len && in[i + 1] == '\\' && in[i + 2] == 'u') {
+                uint32_t low = 0;
+                if (sscanf(in + i + 3, "%4x", &low) == 1 && low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+            }
+            put_utf8(&o, limit, cp);
+            break;
+        }
+        default: *o++ = c; break;
+        }
+    }
+    *o = '\0';
+}
+
+static void skip_value(scanner_t *s) {
+    skip_ws(s);
+    if (s->p >= s->end) {
+        fail(s, "unexpected end of export");
+        return;
+    }
+    const char *body;
+    size_t len;
+    switch (*s->p) {
+    case '"':
+        scan_string(s, &body, &len);
+        return;
+    case '{':
+    case '[': {
+        char close = *s->p == '{' ? '}' : ']';
+        s->p++;
+        if (expect(s, close)) {
+            return;
+        }
+        do {
+            if (close == '}') {
+                scan_string(s, &body, &len);
+                if (!expect(s, ':')) {
+                    fail(s, "expected ':'");
+                    return;
+                }
+            }
+            skip_value(s);
+        } while (expect(s, ','));
+        if (!expect(s, close)) {
+            fail(s, "expected ',' or the end of a container");
+        }
+        return;
+    }
+    default:
+        while (s->p < s->end && strchr(",}] \t\r\n", *s->p) == NULL) {
+            s->p++;
+        }
+        return;
+    }
+}
+
+// One {"image": ..., "timestamp": ..., "metadata": ...} record
+static void scan_record(scanner_t *s, job_t *job) {
+    s->p++;                         // '{'
+    if (expect(s, '}')) {
+        return;
+    }
+    do {
+        const char *name, *value;
+        size_t name_len, value_len;
+        if (!scan_string(s, &name, &name_len) || !expect(s, ':')) {
+            fail(s, "expected a member name");
+            return;
+        }
+        skip_ws(s);
+        bool is_string = s->p < s->end && *s->p == '"';
+        if (!is_string) {
+            skip_value(s);
+            continue;
+        }
+        scan_string(s, &value, &value_len);
+        if (name_len == 5 && memcmp(name, "image", 5) == 0) {
+            job->b64 = value;
+            job->b64_len = value_len;
+        } else if (name_len == 9 && memcmp(name, "timestamp", 9) == 0) {
+            unescape(value, value_len, job->timestamp, sizeof(job->timestamp));
+        } else if (name_len == 8 && memcmp(name, "metadata", 8) == 0 && value_len > 0) {
+            free(job->metadata);
+            job->metadata = malloc(value_len + 1);
+            if (job->metadata != NULL) {
+                unescape(value, value_len, job->metadata, value_len + 1);
+            }
+        }
+    } while (expect(s, ','));
+    if (!expect(s, '}')) {
+        fail(s, "expected ',' or '}' in a record");
+    }
+}
+
+static void scan_records(scanner_t *s, bool top_level, double started, size_t total) {
+    if (!expect(s, '{')) {
+        fail(s, "expected an object of image records");
+        return;
+    }
+    if (expect(s, '}')) {
+        return;
+    }
+    double next_progress = started + PROGRESS_EVERY_S;
+    const char *base = s->end - total;
+    do {
+        const char *key;
+        size_t key_len;
+        if (!scan_string(s, &key, &key_len) || !expect(s, ':')) {
+            fail(s, "expected a record key");
+            return;
+        }
+        skip_ws(s);
+        if (s->p >= s->end || *s->p != '{') {
+            skip_value(s);
+            totals.skipped++;
+            continue;
+        }
+        // A whole-database export: descend into "images" and skip the other nodes
+        if (top_level && key_len == 6 && memcmp(key, "images", 6) == 0) {
+            scan_records(s, false, started, total);
+            continue;
+        }
+
+        job_t job = {0};
+        unescape(key, key_len, job.key, sizeof(job.key));
+        scan_record(s, &job);
+        if (job.b64 == NULL) {
+            free(job.metadata);
+            totals.skipped++;
+            continue;
+        }
+        submit(&job);
+
+        double now = now_s();
+        if (now >= next_progress) {
+            double done = (double)(s->p - base);
+            fprintf(stderr, "\r%.0f%% of %.1f GB, %.0f MB/s   ", 100.0 * done / (double)total, total / 1e9,
+                    done / 1e6 / (now - started));
+            next_progress = now + PROGRESS_EVERY_S;
+        }
+    } while (expect(s, ','));
+    if (!expect(s, '}')) {
+        fail(s, "expected ',' or '}' between records");
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-o out_dir] [-j threads] [-i index.csv] [--keep-invalid] export.json\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *export_path = NULL, *index_path = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            index_path = argv[++i];
+        } else if (strcmp(argv[i], "--keep-invalid") == 0) {
+            keep_invalid = true;
+        } else if (argv[i][0] == '-' || export_path != NULL) {
+            usage(argv[0]);
+        } else {
+            export_path = argv[i];
+        }
+    }
+    if (export_path == NULL || threads < 1) {
+        usage(argv[0]);
+    }
+    threads = threads > MAX_WORKERS ? MAX_WORKERS : threads;
+
+    int fd = open(export_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: %s\n", export_path, strerror(errno));
+        return 1;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "%s: empty export\n", export_path);
+        return 1;
+    }
+    const char *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", export_path, strerror(errno));
+        return 1;
+    }
+    madvise((void *)data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", out_dir, strerror(errno));
+        return 1;
+    }
+    char default_index[4096];
+    if (index_path == NULL) {
+        snprintf(default_index, sizeof(default_index), "%s/index.csv", out_dir);
+        index_path = default_index;
+    }
+    index_file = fopen(index_path, "w");
+    if (index_file == NULL) {
+        fprintf(stderr, "%s: %s\n", index_path, strerror(errno));
+        return 1;
+    }
+    fputs("key,timestamp,file,bytes,status,metadata\n", index_file);
+
+    decode_table_init();
+#ifdef HAVE_AVX2_PATH
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    queue.cap = (size_t)threads * QUEUE_PER_WORKER;
+    queue.ring = calloc(queue.cap, sizeof(job_t));
+    pthread_t pool[MAX_WORKERS];
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&pool[i], NULL, worker, NULL);
+    }
+
+    double started = now_s();
+    scanner_t s = {.p = data, .end = data + st.st_size};
+    scan_records(&s, true, started, (size_t)st.st_size);
+    if (s.error == NULL) {
+        skip_ws(&s);
+        if (s.p != s.end) {
+            fail(&s, "trailing data after the export");
+        }
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.done = true;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+    for (long i = 0; i < threads; i++) {
+        pthread_join(pool[i], NULL);
+    }
+    double elapsed = now_s() - started;
+    bool index_ok = fclose(index_file) == 0;
+
+    fprintf(stderr, "\r%llu records: %llu written, %llu invalid, %llu other entries skipped\n",
+            (unsigned long long)totals.records, (unsigned long long)totals.written,
+            (unsigned long long)totals.invalid, (unsigned long long)totals.skipped);
+    fprintf(stderr, "%.1f GB in %.1f s (%.0f MB/s in, %.0f MB/s of JPEG out) on %ld threads%s, index in %s\n",
+            st.st_size / 1e9, elapsed, st.st_size / 1e6 / elapsed, totals.bytes_out / 1e6 / elapsed, threads,
+            use_avx2 ? " with AVX2" : "", index_path);
+    if (s.error != NULL) {
+        fprintf(stderr, "%s: %s at byte %zu; records before it were decoded\n", export_path, s.error,
+                (size_t)(s.error_at - data));
+        return 1;
+    }
+    return index_ok ? 0 : 1;
+}
@@ -0,0 +1,313 @@
+// Firmware side of tools/fleet_sim.py: builds each virtual camera's requests with the
+// device code instead of a copy of it.
+//
+// Reads one command per line on stdin and answers each with a header line and the
+// raw HTTP request the firmware sent, which fleet_sim.py replays over its simulated
+// uplinks:
+//
+//   frame <device id> <device clock ms> <jpeg bytes> <seed>
+//       A synthetic JPEG of that size goes through the default RTDB_JSON path:
+//       capture_scheduler_frame_key() names it with the device tag, psram_stage
+//       encodes it to base64 and hashes it, and uploader_firebase_backend /
+//       firebase_manager.c PUT it.
+//   get <path>
+//       firebase_get_json(), as the OTA manifest check sends it.
+//
+// The answer is "<key> <length>\n" followed by <length> bytes of request, or
+// "- 0\n" if the firmware code failed. The requests go to a stand-in on a
+// loopback port of this process that records them and answers 200.
+//
+// The device clock reaches capture_scheduler.c through time(), which this tool
+// answers with the clock of the device being served. Devices are treated as
+// SNTP-synced, so keys always have the dated form.
+//
+// Build from the repository root:
+//   gcc -O2 -pthread -Itools/host -Imain/include -o fleet_frames tools/fleet_frames.c
+//       main/src/capture_scheduler.c main/src/capture_window.c main/src/runtime_config.c
+//       main/src/psram_stage.c main/src/jpeg_utils.c main/src/jpeg_codec.c
+//       main/src/uploader.c main/src/uploader_firebase.c main/src/firebase_manager.c
+//       tools/host/http_client_host.c tools/host/cJSON_host.c tools/host/nvs_host.c
+//   ./fleet_frames [-k api_key]
+
+#include "capture_scheduler.h"
+#include "image_analysis.h"
+#include "time_sync.h"
+#include "power_manager.h"
+#include "psram_stage.h"
+#include "jpeg_utils.h"
+#include "uploader.h"
+#include "firebase_manager.h"
+#include "config.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINE_MAX_LEN 512
+#define OTA_MANIFEST_SIZE 1024
+
+static int listen_fd;
+
+// The request the stand-in saw last, handed from its thread to the command loop
+static struct {
+    pthread_mutex_t lock;
+    char *data;
+    size_t len;
+    size_t cap;
+} captured = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static time_t device_clock;
+
+// capture_scheduler.c names frames after time(NULL); answer with the served device's clock
+time_t time(time_t *out) {
+    if (out != NULL) {
+        *out = device_clock;
+    }
+    return device_clock;
+}
+
+// Stand-ins for the modules capture_scheduler.c links against but frame naming never reaches
+bool time_sync_is_synced(void) {
+    return true;
+}
+
+int64_t time_sync_now_ms(void) {
+    return (int64_t)device_clock * 1000;
+}
+
+esp_err_t power_manager_idle_until(time_t wake_at) {
+    (void)wake_at;
+    return ESP_OK;
+}
+
+esp_err_t image_analysis_gray_from_jpeg(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height,
+                                        uint16_t min_width, gray_image_t *out) {
+    (void)jpeg, (void)len, (void)width, (void)height, (void)min_width, (void)out;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void image_analysis_free(gray_image_t *image) {
+    (void)image;
+}
+
+float image_analysis_change_ratio(const gray_image_t *previous, const gray_image_t *current, uint8_t pixel_threshold) {
+    (void)previous, (void)current, (void)pixel_threshold;
+    return 0.0f;
+}
+
+static void capture_append(const char *data, size_t len) {
+    if (captured.len + len > captured.cap) {
+        captured.cap = (captured.len + len) * 2;
+        captured.data = realloc(captured.data, captured.cap);
+    }
+    memcpy(captured.data + captured.len, data, len);
+    captured.len += len;
+}
+
+// Records one request, headers and body, and answers it the way the database would
+static void standin_handle(int fd) {
+    char buf[16384];
+    size_t header_end = 0;
+    long content_length = 0;
+    bool is_get = false;
+
+    pthread_mutex_lock(&captured.lock);
+    captured.len = 0;
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            pthread_mutex_unlock(&captured.lock);
+            return;
+        }
+        capture_append(buf, (size_t)n);
+        if (header_end == 0) {
+            capture_append("", 1);
+            captured.len--;
+            char *end = strstr(captured.data, "\r\n\r\n");
+            if (end == NULL) {
+                continue;
+            }
+            header_end = (size_t)(end - captured.data) + 4;
+            is_get = strncmp(captured.data, "GET ", 4) == 0;
+            for (char *line = strstr(captured.data, "\r\n"); line != NULL && line < end;
+                 line = strstr(line + 2, "\r\n")) {
+                if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+                    content_length = strtol(line + 17, NULL, 10);
+                }
+            }
+        }
+        if (captured.len >= header_end + (size_t)content_length) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&captured.lock);
+
+    const char *response = is_get ? "HTTP/1.1 200 OK\r\nContent-Length: 4\r\nConnection: close\r\n\r\nnull"
+                                  : "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\n{}";
+    send(fd, response, strlen(response), MSG_NOSIGNAL);
+}
+
+static void *standin_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            standin_handle(fd);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static int standin_listen(void) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 4) != 0 || getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("stand-in");
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+// Writes the answer for one command: the key and the request the firmware sent for it
+static void answer(const char *key, bool ok) {
+    pthread_mutex_lock(&captured.lock);
+    if (ok && captured.len > 0) {
+        printf("%s %zu\n", key, captured.len);
+        fwrite(captured.data, 1, captured.len, stdout);
+    } else {
+        printf("- 0\n");
+    }
+    captured.len = 0;
+    pthread_mutex_unlock(&captured.lock);
+    fflush(stdout);
+}
+
+// A baseline JPEG skeleton: SOI, an empty SOS header, entropy data without markers, EOI
+static uint8_t *synthetic_jpeg(size_t len, uint64_t seed) {
+    uint8_t *jpeg = malloc(len);
+    uint64_t state = seed ? seed : 0x9E3779B97F4A7C15ull;
+    static const uint8_t head[] = {0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02};
+    memcpy(jpeg, head, sizeof(head));
+    for (size_t i = sizeof(head); i < len - 2; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        jpeg[i] = (uint8_t)(state % 0xFF);
+    }
+    jpeg[len - 2] = 0xFF;
+    jpeg[len - 1] = 0xD9;
+    return jpeg;
+}
+
+// The default RTDB_JSON path of upload_frame() in main.c for one frame
+static void serve_frame(const char *device_id, long long clock_ms, size_t jpeg_len, uint64_t seed) {
+    if (jpeg_len < 8) {
+        jpeg_len = 8;
+    }
+    device_clock = (time_t)(clock_ms / 1000);
+    capture_scheduler_set_device_id(device_id);
+    char timestamp[64];
+    capture_scheduler_frame_key(timestamp, sizeof(timestamp));
+
+    uint8_t *jpeg = synthetic_jpeg(jpeg_len, seed);
+    jpeg_ranges_t ranges;
+#if JPEG_SANITIZE_ENABLED
+    jpeg_sanitize(jpeg, jpeg_len, &ranges);
+#else
+    jpeg_ranges_whole(jpeg_len, &ranges);
+#endif
+    size_t base64_size = jpeg_ranges_base64_len(&ranges) + 1;
+    char *base64 = malloc(base64_size);
+    size_t base64_len = 0;
+    uint8_t digest[32];
+    esp_err_t err = psram_stage_base64(jpeg, &ranges, base64, base64_size, &base64_len,
+                                       CONTENT_HASH_ENABLED ? digest : NULL);
+
+    uploader_frame_t frame = {
+        .jpeg = jpeg,
+        .jpeg_len = jpeg_len,
+        .base64 = base64,
+        .base64_len = base64_len,
+        .timestamp = timestamp,
+    };
+#if CONTENT_HASH_ENABLED
+    // Key suffix and metadata as upload_frame() forms them
+    char key[96];
+    char digest_hex[65];
+    char metadata[96];
+    for (int i = 0; i < 32; i++) {
+        snprintf(digest_hex + i * 2, 3, "%02x", digest[i]);
+    }
+    if (CONTENT_HASH_KEY_CHARS > 0) {
+        snprintf(key, sizeof(key), "%s_%.*s", timestamp, CONTENT_HASH_KEY_CHARS, digest_hex);
+        frame.timestamp = key;
+    }
+    snprintf(metadata, sizeof(metadata), "{\"sha256\":\"%s\"}", digest_hex);
+    frame.metadata = metadata;
+#endif
+
+    if (err == ESP_OK) {
+        err = uploader_firebase_backend.submit(&frame);
+    }
+    answer(frame.timestamp, err == ESP_OK);
+    free(base64);
+    free(jpeg);
+}
+
+static void serve_get(const char *path) {
+    static char response[OTA_MANIFEST_SIZE];
+    esp_err_t err = firebase_get_json(path, NULL, response, sizeof(response));
+    answer(path, err == ESP_OK);
+}
+
+int main(int argc, char **argv) {
+    const char *api_key = "sim-key";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            api_key = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-k api_key]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int port = standin_listen();
+    pthread_t thread;
+    if (port < 0 || pthread_create(&thread, NULL, standin_thread, NULL) != 0) {
+        return 1;
+    }
+
+    firebase_config_t firebase = {.project_id = "sim"};
+    snprintf(firebase.database_url, sizeof(firebase.database_url), "http://127.0.0.1:%d", port);
+    snprintf(firebase.api_key, sizeof(firebase.api_key), "%s", api_key);
+    if (uploader_firebase_backend.init(&firebase) != ESP_OK) {
+        fprintf(stderr, "firebase backend init failed\n");
+        return 1;
+    }
+
+    char line[LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        char device_id[128];
+        char path[256];
+        long long clock_ms;
+        size_t jpeg_len;
+        unsigned long long seed;
+        if (sscanf(line, "frame %127s %lld %zu %llu", device_id, &clock_ms, &jpeg_len, &seed) == 4) {
+            serve_frame(device_id, clock_ms, jpeg_len, seed);
+        } else if (sscanf(line, "get %255s", path) == 1) {
+            serve_get(path);
+        } else {
+            answer("", false);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,582 @@
+#!/usr/bin/env python3
+"""
+Simulate a fleet of cameras against a local Realtime Database stand-in.
+
+Runs hundreds of virtual devices in one asyncio process. Each device follows
+the firmware's default upload path (UPLOAD_MODE_RTDB_JSON) with the constants
+read from main/include/config.h:
+
+  - capture cadence from the adaptive scheduler: activity snaps the interval to
+    CAPTURE_MIN_INTERVAL_MS, quiet frames double it up to CAPTURE_MAX_INTERVAL_MS,
+    the CAPTURE_BYTES_PER_HOUR budget stretches it, and with
+    CAPTURE_ALIGN_TO_WALL_CLOCK every device fires on the same wall-clock slots
+  - one PUT per frame on a new connection, as esp_http_client_init/cleanup
+    does
+  - a GET of OTA_MANIFEST_PATH on the first cycle after boot and every
+    OTA_CHECK_EVERY cycles
+
+The requests themselves come from the firmware: tools/fleet_frames.c links
+capture_scheduler.c, psram_stage.c, uploader_firebase.c and
+firebase_manager.c against the tools/host shims, and hands back the exact
+request each frame produces (key with device tag and content hash, cJSON
+body, auth query, headers). The simulator only adds the Host and
+X-Sim-Device headers and replays it. Build the helper with the line in its
+header comment and pass it with --firmware if it is not ./fleet_frames;
+it is compiled against config.h, so rebuild it after changing the upload
+constants.
+
+Every device draws its own clock offset, cadence jitter, frame-size
+distribution (log-normal around --frame-kb), scene activity and failure
+profile (WiFi drops and reboots) from a seeded RNG. Devices are spread over
+--sites, each behind an uplink of --uplink-mbps that their request bodies
+share.
+
+The stand-in speaks enough HTTP/1.1 for the firmware's requests and can add
+latency and errors. It also counts PUTs that overwrote a key another device
+wrote, which aligned cameras would run into without the device tag. Use
+--backend http://host:port to drive another backend instead, and --serve PORT
+to run only the stand-in, e.g. as the upstream of tools/lan_gateway.c, which
+sends it PATCH batches.
+
+    fleet_sim.py --devices 500 --sites 25 --duration 120
+    fleet_sim.py --devices 2000 --time-scale 10 --backend-latency-ms 80 --json report.json
+
+--time-scale N runs the fleet's clock N times faster and scales the uplinks
+with it, so cadence and link utilisation stay true while rates are reported
+per fleet second. Latencies are only realistic at scale 1.
+
+Standard library only.
+"""
+
+import argparse
+import asyncio
+import json
+import math
+import random
+import re
+import resource
+import sys
+import time
+from pathlib import Path
+
+CONFIG_H = Path(__file__).resolve().parent.parent / "main" / "include" / "config.h"
+FIRMWARE_HELPER = "./fleet_frames"
+
+
+def read_config(path=CONFIG_H):
+    """Numeric, boolean and string #defines of config.h."""
+    values = {}
+    for line in path.read_text().splitlines():
+        m = re.match(r"#define\s+(\w+)\s+(.+?)\s*(//.*)?$", line)
+        if not m:
+            continue
+        name, expr = m.group(1), m.group(2)
+        if expr in ("true", "false"):
+            values[name] = expr == "true"
+        elif re.fullmatch(r'"[^"]*"', expr):
+            values[name] = expr[1:-1]
+        elif re.fullmatch(r"[\d\s()*+/.-]+f?", expr):
+            values[name] = eval(expr.rstrip("f"), {"__builtins__": {}})
+    return values
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    k = min(len(sorted_values) - 1, max(0, math.ceil(p / 100 * len(sorted_values)) - 1))
+    return sorted_values[k]
+
+
+class Stats:
+    def __init__(self):
+        self.requests = {}
+        self.failures = {}
+        self.latencies = []
+        self.bytes_up = 0
+        self.bytes_down = 0
+        self.frames = 0
+        self.skipped = 0        # Cycles a WiFi drop or reboot kept off the network
+        self.reboots = 0
+        self.in_flight = 0
+        self.peak_in_flight = 0
+
+    def record(self, kind, ok, latency, up, down):
+        self.requests[kind] = self.requests.get(kind, 0) + 1
+        if not ok:
+            self.failures[kind] = self.failures.get(kind, 0) + 1
+        self.latencies.append(latency)
+        self.bytes_up += up
+        self.bytes_down += down
+
+
+class Uplink:
+    """A site's shared uplink: bodies are sent in slices that queue for the link."""
+
+    SLICE = 16 * 1024
+
+    def __init__(self, name, bits_per_s):
+        self.name = name
+        self.bytes_per_s = bits_per_s / 8
+        self.free_at = 0.0
+        self.busy = 0.0
+        self.bytes = 0
+
+    async def send(self, writer, data):
+        loop = asyncio.get_running_loop()
+        for start in range(0, len(data), self.SLICE):
+            chunk = data[start:start + self.SLICE]
+            duration = len(chunk) / self.bytes_per_s
+            begin = max(loop.time(), self.free_at)
+            self.free_at = begin + duration
+            self.busy += duration
+            self.bytes += len(chunk)
+            delay = self.free_at - loop.time()
+            if delay > 0:
+                await asyncio.sleep(delay)
+            writer.write(chunk)
+            await writer.drain()
+
+
+class StandIn:
+    """In-memory Realtime Database answering the firmware's PUT, GET and DELETE, and PATCH from a gateway."""
+
+    def __init__(self, latency_ms, error_rate, rng, ota_path):
+        self.ota_path = ota_path
+        self.latency = latency_ms / 1000
+        self.error_rate = error_rate
+        self.rng = rng
+        self.store = {}         # path -> (device, bytes)
+        self.overwrites = 0
+        self.requests = 0
+        self.connections = 0
+        self.peak_connections = 0
+        self.open = 0
+
+    async def handle(self, reader, writer):
+        self.connections += 1
+        self.open += 1
+        self.peak_connections = max(self.peak_connections, self.open)
+        try:
+            # Keep-alive, so a gateway can reuse its upstream connections
+            while request := await reader.readline():
+                headers = {}
+                while True:
+                    line = await reader.readline()
+                    if line in (b"\r\n", b"\n", b""):
+                        break
+                    name, _, value = line.decode("latin-1").partition(":")
+                    headers[name.strip().lower()] = value.strip()
+                method, target, _ = request.decode("latin-1").split(" ", 2)
+                body = await reader.readexactly(int(headers.get("content-length", 0)))
+                self.requests += 1
+                status, payload = self.respond(method, target, headers, body)
+                if self.latency:
+                    await asyncio.sleep(self.rng.expovariate(1 / self.latency))
+                reason = {200: "OK", 400: "Bad Request", 404: "Not Found", 503: "Service Unavailable"}[status]
+                writer.write(f"HTTP/1.1 {status} {reason}\r\nContent-Type: application/json\r\n"
+                             f"Content-Length: {len(payload)}\r\n\r\n".encode() + payload)
+                await writer.drain()
+        except (ValueError, asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            self.open -= 1
+            writer.close()
+
+    def respond(self, method, target, headers, body):
+        if self.error_rate and self.rng.random() < self.error_rate:
+            return 503, b'{"error":"injected"}'
+        path = target.split("?", 1)[0].strip("/")
+        if not path.endswith(".json"):
+            return 400, b'{"error":"path must end in .json"}'
+        path = path[:-5]
+        if method == "PUT":
+            try:
+                json.loads(body)
+            except ValueError:
+                return 400, b'{"error":"Invalid data; couldn\'t parse JSON object"}'
+            device = headers.get("x-sim-device", "")
+            previous = self.store.get(path)
+            if previous is not None and previous[0] != device:
+                self.overwrites += 1
+            self.store[path] = (device, len(body))
+            return 200, body    # The database answers a PUT with the data written
+        if method == "PATCH":
+            try:
+                children = json.loads(body)
+            except ValueError:
+                return 400, b'{"error":"Invalid data; couldn\'t parse JSON object"}'
+            if not isinstance(children, dict):
+                return 400, b'{"error":"PATCH needs an object"}'
+            # A gateway writes for many devices, so any existing child counts as an overwrite
+            for key, value in children.items():
+                child = f"{path}/{key}"
+                if child in self.store:
+                    self.overwrites += 1
+                self.store[child] = ("", len(json.dumps(value)))
+            return 200, body
+        if method == "GET":
+            if path == self.ota_path:
+                return 200, json.dumps({"version": "sim", "size": 0, "sha256": "", "url": ""}).encode()
+            return 200, b"null"
+        if method == "DELETE":
+            self.store.pop(path, None)
+            return 200, b"null"
+        return 400, b'{"error":"unsupported method"}'
+
+
+class Firmware:
+    """tools/fleet_frames.c: the firmware's key and request for each frame."""
+
+    def __init__(self, path, api_key):
+        self.path = path
+        self.api_key = api_key
+        self.proc = None
+        self.lock = asyncio.Lock()
+
+    async def start(self):
+        try:
+            self.proc = await asyncio.create_subprocess_exec(self.path, "-k", self.api_key,
+                                                             stdin=asyncio.subprocess.PIPE,
+                                                             stdout=asyncio.subprocess.PIPE)
+        except OSError as e:
+            raise SystemExit(f"{self.path}: {e.strerror}; build it with the line in tools/fleet_frames.c")
+
+    async def stop(self):
+        if self.proc is not None:
+            self.proc.stdin.close()
+            await self.proc.wait()
+
+    async def command(self, line):
+        """(key, raw HTTP request) the firmware code produced, or (None, b"") if it failed."""
+        async with self.lock:
+            self.proc.stdin.write(line.encode() + b"\n")
+            await self.proc.stdin.drain()
+            key, length = (await self.proc.stdout.readline()).decode().split()
+            request = await self.proc.stdout.readexactly(int(length))
+        return (key, request) if key != "-" else (None, b"")
+
+    async def frame(self, device, clock_s, jpeg_bytes):
+        return await self.command(f"frame {device.name} {int(clock_s * 1000)} {jpeg_bytes} "
+                                  f"{device.rng.getrandbits(63) + 1}")
+
+    async def get(self, path):
+        return await self.command(f"get {path}")
+
+
+class Device:
+    def __init__(self, index, args, cfg, rng, uplink):
+        self.name = f"sim-{index:04d}"
+        self.rng = rng
+        self.args = args
+        self.cfg = cfg
+        self.uplink = uplink
+        self.clock_offset = rng.gauss(0, args.clock_error_ms / 1000)
+        self.jitter = args.jitter_ms / 1000 * rng.uniform(0.5, 1.5)
+        self.frame_median = args.frame_kb * 1024 * rng.lognormvariate(0, 0.25)
+        self.frame_sigma = args.frame_sigma
+        self.activity = min(1.0, args.activity * rng.lognormvariate(0, 0.5))
+        self.fail_rate = args.fail_rate * rng.uniform(0, 2)
+        self.reboot_rate = args.reboot_rate * rng.uniform(0, 2)
+        self.interval = max(cfg["CAPTURE_MIN_INTERVAL_MS"],
+                            min(cfg["CAPTURE_MAX_INTERVAL_MS"], cfg["NUMBER_OF_SECONDS"] * 1000)) / 1000
+        self.budget = cfg.get("CAPTURE_BYTES_PER_HOUR", 0)
+        self.tokens = self.budget
+        self.average_frame = 0
+
+    def frame_bytes(self):
+        size = int(self.frame_median * self.rng.lognormvariate(0, self.frame_sigma))
+        return max(2048, min(size, 400 * 1024))
+
+    def observe(self):
+        # capture_scheduler_observe_frame(): activity snaps to the minimum, quiet doubles
+        if self.rng.random() < self.activity:
+            self.interval = self.cfg["CAPTURE_MIN_INTERVAL_MS"] / 1000
+        else:
+            self.interval = min(self.interval * 2, self.cfg["CAPTURE_MAX_INTERVAL_MS"] / 1000)
+
+    def next_delay(self, fleet_now, elapsed):
+        # capture_scheduler_wait_next(): the byte budget may stretch the interval
+        interval = self.interval
+        if self.budget:
+            self.tokens = min(self.budget, self.tokens + elapsed * self.budget / 3600)
+            if self.tokens < self.average_frame:
+                interval = max(interval, (self.average_frame - self.tokens) * 3600 / self.budget)
+        if self.cfg.get("CAPTURE_ALIGN_TO_WALL_CLOCK"):
+            local = fleet_now + self.clock_offset
+            delay = (math.floor(local / interval) + 1) * interval - local
+        else:
+            delay = interval
+        return delay + self.rng.uniform(0, self.jitter)
+
+    def record_bytes(self, sent):
+        self.tokens -= sent
+        self.average_frame = (self.average_frame * 7 + sent) // 8 if self.average_frame else sent
+
+
+class Fleet:
+    def __init__(self, args, cfg):
+        self.args = args
+        self.cfg = cfg
+        self.rng = random.Random(args.seed)
+        self.stats = Stats()
+        self.scale = args.time_scale
+        self.timeout = cfg.get("HTTP_TIMEOUT_MS", 10000) / 1000
+        self.ota_every = cfg.get("OTA_CHECK_EVERY", 60) if cfg.get("OTA_ENABLED", False) else 0
+        self.ota_path = cfg.get("OTA_MANIFEST_PATH", "firmware")
+        self.host, self.port = None, None
+        self.uplinks = [Uplink(f"site-{i:02d}", args.uplink_mbps * 1e6 * self.scale) for i in range(args.sites)]
+        self.devices = [Device(i, args, cfg, random.Random(self.rng.random()), self.uplinks[i % args.sites])
+                        for i in range(args.devices)]
+        self.firmware = Firmware(args.firmware, args.api_key)
+        self.manifest_request = b""
+        self.t0 = 0.0
+        self.wall0 = time.time()
+
+    def fleet_now(self):
+        return self.wall0 + (asyncio.get_running_loop().time() - self.t0) * self.scale
+
+    def for_backend(self, device, request):
+        """Header block and body of a firmware request, addressed to the backend."""
+        head, _, body = request.partition(b"\r\n\r\n")
+        lines = [line for line in head.split(b"\r\n") if not line.lower().startswith(b"host:")]
+        lines[1:1] = [f"Host: {self.host}:{self.port}".encode(), f"X-Sim-Device: {device.name}".encode()]
+        return b"\r\n".join(lines) + b"\r\n\r\n", body
+
+    async def request(self, device, kind, request):
+        head, body = self.for_backend(device, request)
+        loop = asyncio.get_running_loop()
+        start = loop.time()
+        self.stats.in_flight += 1
+        self.stats.peak_in_flight = max(self.stats.peak_in_flight, self.stats.in_flight)
+        ok, down, writer = False, 0, None
+        try:
+            async with asyncio.timeout(self.timeout):
+                reader, writer = await asyncio.open_connection(self.host, self.port)
+                writer.write(head)
+                await device.uplink.send(writer, body)
+                # esp_http_client reads Content-Length bytes, then closes the connection
+                status = await reader.readline()
+                down, length = len(status), 0
+                while (line := await reader.readline()) not in (b"\r\n", b""):
+                    down += len(line)
+                    name, _, value = line.partition(b":")
+                    if name.strip().lower() == b"content-length":
+                        length = int(value)
+                down += len(await reader.readexactly(length)) + 2
+                ok = status.split(b" ")[1:2] == [b"200"]
+        except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError, IndexError, ValueError):
+            pass
+        finally:
+            self.stats.in_flight -= 1
+            if writer is not None:
+                writer.close()
+        self.stats.record(kind, ok, loop.time() - start, len(head) + len(body), down)
+        return ok, len(body)
+
+    async def sleep_fleet(self, fleet_seconds, stop_at):
+        """Sleep in fleet time; False once the run is over."""
+        loop = asyncio.get_running_loop()
+        wake = loop.time() + fleet_seconds / self.scale
+        await asyncio.sleep(max(0.0, min(wake, stop_at) - loop.time()))
+        return wake < stop_at
+
+    async def run_device(self, device, stop_at):
+        # Boot somewhere in the first interval
+        if not await self.sleep_fleet(device.rng.uniform(0, device.interval), stop_at):
+            return
+        last = self.fleet_now()
+        boot_cycles = 0         # Cycles since boot; OTA is checked on the first one
+        while True:
+            now = self.fleet_now()
+            if device.rng.random() < device.reboot_rate:
+                # Offline for a reboot and WiFi reconnect
+                self.stats.reboots += 1
+                self.stats.skipped += 1
+                boot_cycles = 0
+                if not await self.sleep_fleet(device.rng.uniform(15, 45), stop_at):
+                    return
+                last = self.fleet_now()
+                continue
+
+            if device.rng.random() < device.fail_rate:
+                self.stats.skipped += 1
+            else:
+                key, request = await self.firmware.frame(device, now + device.clock_offset, device.frame_bytes())
+                device.observe()
+                if key is None:
+                    raise SystemExit("fleet_frames could not build a frame; run it by hand to see why")
+                ok, sent = await self.request(device, "image", request)
+                self.stats.frames += 1
+                device.record_bytes(sent if ok else 0)
+                if self.ota_every and boot_cycles % self.ota_every == 0:
+                    await self.request(device, "ota_manifest", self.manifest_request)
+            boot_cycles += 1
+
+            now = self.fleet_now()
+            if not await self.sleep_fleet(device.next_delay(now, now - last), stop_at):
+                return
+            last = now
+
+    async def run(self):
+        server = None
+        standin = None
+        if self.args.backend:
+            m = re.fullmatch(r"http://([^:/]+)(?::(\d+))?/?", self.args.backend)
+            if not m:
+                raise SystemExit("--backend must be http://host[:port]")
+            self.host, self.port = m.group(1), int(m.group(2) or 80)
+        else:
+            standin = StandIn(self.args.backend_latency_ms, self.args.backend_error_rate, random.Random(self.args.seed + 1),
+                              self.ota_path)
+            server = await asyncio.start_server(standin.handle, "127.0.0.1", 0, backlog=4096)
+            self.host, self.port = server.sockets[0].getsockname()[:2]
+
+        await self.firmware.start()
+        if self.ota_every:
+            _, self.manifest_request = await self.firmware.get(self.ota_path)
+
+        loop = asyncio.get_running_loop()
+        self.t0 = loop.time()
+        cpu0 = time.process_time()
+        stop_at = self.t0 + self.args.duration
+        try:
+            await asyncio.gather(*(self.run_device(d, stop_at) for d in self.devices))
+        finally:
+            await self.firmware.stop()
+        elapsed = loop.time() - self.t0
+        self.cpu_share = (time.process_time() - cpu0) / elapsed
+        if server is not None:
+            server.close()
+            await server.wait_closed()
+        return self.report(elapsed, standin)
+
+    def report(self, elapsed, standin):
+        s = self.stats
+        fleet_s = elapsed * self.scale
+        lat = sorted(s.latencies)
+        requests = sum(s.requests.values())
+        failures = sum(s.failures.values())
+        report = {
+            "devices": len(self.devices),
+            "sites": len(self.uplinks),
+            "fleet_seconds": round(fleet_s, 1),
+            "requests": s.requests,
+            "failures": s.failures,
+            "requests_per_s": round(requests / fleet_s, 2),
+            "upload_bytes_per_s": round(s.bytes_up / fleet_s),
+            "download_bytes_per_s": round(s.bytes_down / fleet_s),
+            "frames": s.frames,
+            "skipped_cycles": s.skipped,
+            "reboots": s.reboots,
+            "peak_in_flight": s.peak_in_flight,
+            "simulator_cpu_share": round(self.cpu_share, 3),
+            "latency_ms": {p: round(percentile(lat, float(p[1:])) * 1000, 1)
+                           for p in ("p50", "p90", "p99", "p99.9")},
+            "latency_max_ms": round(lat[-1] * 1000, 1) if lat else 0.0,
+            "uplinks": {
+                "mbps": self.args.uplink_mbps,
+                "mean_utilisation": round(sum(u.busy for u in self.uplinks) / len(self.uplinks) / elapsed, 3),
+                "max_utilisation": round(max(u.busy for u in self.uplinks) / elapsed, 3),
+                "busiest": max(self.uplinks, key=lambda u: u.busy).name,
+            },
+        }
+        if standin is not None:
+            report["standin"] = {
+                "connections": standin.connections,
+                "peak_connections": standin.peak_connections,
+                "keys": len(standin.store),
+                "overwrites": standin.overwrites,
+            }
+
+        print(f"{len(self.devices)} devices on {len(self.uplinks)} sites, {fleet_s:.0f} fleet seconds"
+              + (f" ({elapsed:.0f} s at x{self.scale:g})" if self.scale != 1 else ""))
+        print(f"  requests     {requests} ({failures} failed), {report['requests_per_s']}/s")
+        for kind in sorted(s.requests):
+            print(f"    {kind:<12} {s.requests[kind]} ({s.failures.get(kind, 0)} failed)")
+        print(f"  upload       {report['upload_bytes_per_s'] / 1e6:.3f} MB/s, download {report['download_bytes_per_s'] / 1e3:.1f} kB/s")
+        print(f"  latency      p50 {report['latency_ms']['p50']} ms, p90 {report['latency_ms']['p90']} ms, "
+              f"p99 {report['latency_ms']['p99']} ms, p99.9 {report['latency_ms']['p99.9']} ms, max {report['latency_max_ms']} ms")
+        print(f"  in flight    peak {s.peak_in_flight}")
+        print(f"  simulator    {self.cpu_share:.0%} of a CPU")
+        if self.cpu_share > 0.7:
+            print("  ⚠ The simulator is close to saturating its CPU; latencies include its own queueing."
+                  " Lower --devices or --time-scale, or run the stand-in elsewhere with --backend")
+        print(f"  cycles       {s.frames} frames, {s.skipped} skipped, {s.reboots} reboots")
+        up = report["uplinks"]
+        print(f"  uplinks      {up['mbps']} Mbit/s each, mean {up['mean_utilisation']:.1%} busy, "
+              f"max {up['max_utilisation']:.1%} ({up['busiest']})")
+        if standin is not None:
+            print(f"  stand-in     {standin.connections} connections (peak {standin.peak_connections} open), "
+                  f"{len(standin.store)} keys")
+            if standin.overwrites:
+                print(f"  ⚠ {standin.overwrites} PUTs overwrote another device's key")
+        return report
+
+
+async def serve(args, cfg):
+    """Run only the stand-in, e.g. as the upstream of tools/lan_gateway.c."""
+    standin = StandIn(args.backend_latency_ms, args.backend_error_rate, random.Random(args.seed + 1),
+                      cfg.get("OTA_MANIFEST_PATH", "firmware"))
+    server = await asyncio.start_server(standin.handle, "127.0.0.1", args.serve, backlog=4096)
+    print(f"Stand-in listening on http://127.0.0.1:{args.serve}", flush=True)
+    last, last_requests = time.monotonic(), 0
+    async with server:
+        while True:
+            await asyncio.sleep(10)
+            now = time.monotonic()
+            print(f"  {(standin.requests - last_requests) / (now - last):.1f} requests/s, {len(standin.store)} keys, "
+                  f"{standin.overwrites} overwrites, {standin.open} connections open", flush=True)
+            last, last_requests = now, standin.requests
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Virtual camera fleet against a local RTDB stand-in")
+    parser.add_argument("--devices", type=int, default=200)
+    parser.add_argument("--sites", type=int, default=10, help="Uplinks the devices are spread over")
+    parser.add_argument("--uplink-mbps", type=float, default=10.0, help="Upstream bandwidth per site")
+    parser.add_argument("--duration", type=float, default=60.0, help="Wall-clock seconds to run")
+    parser.add_argument("--time-scale", type=float, default=1.0, help="Fleet seconds per wall-clock second")
+    parser.add_argument("--frame-kb", type=float, default=40.0, help="Median JPEG size")
+    parser.add_argument("--frame-sigma", type=float, default=0.35, help="Log-normal spread of frame sizes")
+    parser.add_argument("--activity", type=float, default=0.2, help="Mean share of frames with scene activity")
+    parser.add_argument("--jitter-ms", type=float, default=300.0, help="Mean extra delay per cycle")
+    parser.add_argument("--clock-error-ms", type=float, default=50.0, help="SNTP offset spread between devices")
+    parser.add_argument("--fail-rate", type=float, default=0.01, help="Mean share of cycles lost to WiFi drops")
+    parser.add_argument("--reboot-rate", type=float, default=0.001, help="Mean share of cycles that end in a reboot")
+    parser.add_argument("--backend", help="Drive http://host:port instead of the built-in stand-in")
+    parser.add_argument("--backend-latency-ms", type=float, default=0.0, help="Mean stand-in service time")
+    parser.add_argument("--backend-error-rate", type=float, default=0.0, help="Share of stand-in 503 responses")
+    parser.add_argument("--api-key", default="sim-key")
+    parser.add_argument("--firmware", default=FIRMWARE_HELPER,
+                        help=f"fleet_frames helper building the requests (default: {FIRMWARE_HELPER})")
+    parser.add_argument("--config", type=Path, default=CONFIG_H, help="config.h to take cadence constants from")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", help="Also write the report to this file")
+    parser.add_argument("--serve", type=int, metavar="PORT", help="Only run the stand-in on this port until interrupted")
+    args = parser.parse_args()
+
+    if args.devices < 1 or args.sites < 1 or args.time_scale <= 0 or args.uplink_mbps <= 0:
+        parser.error("devices, sites, time scale and uplink bandwidth must be positive")
+    if sys.version_info < (3, 11):
+        parser.error("Python 3.11 or newer is required")
+
+    # Every request holds a socket on each side of the stand-in
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    cfg = read_config(args.config)
+    if args.serve:
+        asyncio.run(serve(args, cfg))
+        return 0
+    report = asyncio.run(Fleet(args, cfg).run())
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        sys.exit(1)
@@ -0,0 +1,34 @@
+// Host stand-in for the cJSON subset the upload paths use to build records:
+// objects of strings and numbers, printed the way cJSON_Print() formats them.
+// Parsing is not provided.
+#ifndef HOST_CJSON_H
+#define HOST_CJSON_H
+
+#define cJSON_Invalid 0
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON *cJSON_CreateObject(void);
+cJSON *cJSON_CreateString(const char *string);
+cJSON *cJSON_CreateNumber(double number);
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *name, cJSON *item);
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *name);
+char *cJSON_Print(const cJSON *item);
+char *cJSON_PrintUnformatted(const cJSON *item);
+void cJSON_Delete(cJSON *item);
+
+#endif // HOST_CJSON_H
@@ -0,0 +1,192 @@
+// Host stand-in for cJSON record building, see cJSON.h
+
+#include "cJSON.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} out_t;
+
+static void out_reserve(out_t *out, size_t extra) {
+    if (out->failed || out->len + extra + 1 <= out->cap) {
+        return;
+    }
+    size_t cap = out->cap ? out->cap : 256;
+    while (cap < out->len + extra + 1) {
+        cap *= 2;
+    }
+    char *data = realloc(out->data, cap);
+    if (data == NULL) {
+        out->failed = true;
+        return;
+    }
+    out->data = data;
+    out->cap = cap;
+}
+
+static void out_append(out_t *out, const char *s, size_t len) {
+    out_reserve(out, len);
+    if (!out->failed) {
+        memcpy(out->data + out->len, s, len);
+        out->len += len;
+        out->data[out->len] = '\0';
+    }
+}
+
+static void out_string(out_t *out, const char *s) {
+    out_append(out, "\"", 1);
+    for (const unsigned char *p = (const unsigned char *)s; *p != '\0'; p++) {
+        char escaped[8];
+        size_t n = 0;
+        switch (*p) {
+        case '"': n = (size_t)snprintf(escaped, sizeof(escaped), "\\\""); break;
+        case '\\': n = (size_t)snprintf(escaped, sizeof(escaped), "\\\\"); break;
+        case '\n': n = (size_t)snprintf(escaped, sizeof(escaped), "\\n"); break;
+        case '\r': n = (size_t)snprintf(escaped, sizeof(escaped), "\\r"); break;
+        case '\t': n = (size_t)snprintf(escaped, sizeof(escaped), "\\t"); break;
+        default:
+            if (*p < 0x20) {
+                n = (size_t)snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+            } else {
+                escaped[0] = (char)*p;
+                n = 1;
+            }
+        }
+        out_append(out, escaped, n);
+    }
+    out_append(out, "\"", 1);
+}
+
+static void out_item(out_t *out, const cJSON *item, int depth, bool format) {
+    if (item->type == cJSON_String) {
+        out_string(out, item->valuestring);
+    } else if (item->type == cJSON_Number) {
+        char number[32];
+        int n = (item->valuedouble == (double)item->valueint)
+                    ? snprintf(number, sizeof(number), "%d", item->valueint)
+                    : snprintf(number, sizeof(number), "%.17g", item->valuedouble);
+        out_append(out, number, (size_t)n);
+    } else if (item->type == cJSON_Object) {
+        out_append(out, format ? "{\n" : "{", format ? 2 : 1);
+        for (const cJSON *child = item->child; child != NULL; child = child->next) {
+            for (int i = 0; format && i <= depth; i++) {
+                out_append(out, "\t", 1);
+            }
+            out_string(out, child->string);
+            out_append(out, format ? ":\t" : ":", format ? 2 : 1);
+            out_item(out, child, depth + 1, format);
+            if (child->next != NULL) {
+                out_append(out, ",", 1);
+            }
+            if (format) {
+                out_append(out, "\n", 1);
+            }
+        }
+        for (int i = 0; format && i < depth; i++) {
+            out_append(out, "\t", 1);
+        }
+        out_append(out, "}", 1);
+    } else {
+        out_append(out, "null", 4);
+    }
+}
+
+static char *print(const cJSON *item, bool format) {
+    if (item == NULL) {
+        return NULL;
+    }
+    out_t out = {0};
+    out_item(&out, item, 0, format);
+    if (out.failed) {
+        free(out.data);
+        return NULL;
+    }
+    return out.data;
+}
+
+cJSON *cJSON_CreateObject(void) {
+    cJSON *item = calloc(1, sizeof(*item));
+    if (item != NULL) {
+        item->type = cJSON_Object;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string) {
+    cJSON *item = calloc(1, sizeof(*item));
+    if (item == NULL) {
+        return NULL;
+    }
+    item->type = cJSON_String;
+    item->valuestring = strdup(string);
+    if (item->valuestring == NULL) {
+        free(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateNumber(double number) {
+    cJSON *item = calloc(1, sizeof(*item));
+    if (item != NULL) {
+        item->type = cJSON_Number;
+        item->valuedouble = number;
+        item->valueint = (int)number;
+    }
+    return item;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *name, cJSON *item) {
+    if (object == NULL || name == NULL || item == NULL) {
+        return 0;
+    }
+    item->string = strdup(name);
+    if (item->string == NULL) {
+        return 0;
+    }
+    if (object->child == NULL) {
+        object->child = item;
+    } else {
+        cJSON *last = object->child;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        last->next = item;
+        item->prev = last;
+    }
+    return 1;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *name) {
+    for (cJSON *child = object ? object->child : NULL; child != NULL; child = child->next) {
+        if (child->string != NULL && strcmp(child->string, name) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+char *cJSON_Print(const cJSON *item) {
+    return print(item, true);
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item) {
+    return print(item, false);
+}
+
+void cJSON_Delete(cJSON *item) {
+    while (item != NULL) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
@@ -0,0 +1,9 @@
+// Host stand-in: placement attributes have no meaning off the chip
+#ifndef HOST_ESP_ATTR_H
+#define HOST_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+
+#endif // HOST_ESP_ATTR_H
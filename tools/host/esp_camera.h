@@ -0,0 +1,25 @@
+// Host stand-in: the frame buffer type the capture code is written against
+#ifndef HOST_ESP_CAMERA_H
+#define HOST_ESP_CAMERA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef enum {
+    PIXFORMAT_RGB565,
+    PIXFORMAT_YUV422,
+    PIXFORMAT_GRAYSCALE,
+    PIXFORMAT_JPEG,
+} pixformat_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;
+} camera_fb_t;
+
+#endif // HOST_ESP_CAMERA_H
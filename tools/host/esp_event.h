@@ -0,0 +1,11 @@
+// Host stand-in: event bases are plain strings, handlers are called directly
+#ifndef HOST_ESP_EVENT_H
+#define HOST_ESP_EVENT_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data);
+
+#endif // HOST_ESP_EVENT_H
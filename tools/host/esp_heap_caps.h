@@ -0,0 +1,27 @@
+// Host stand-in: capability-aware allocation maps onto malloc
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void *heap_caps_malloc(size_t size, unsigned caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void *heap_caps_aligned_alloc(size_t alignment, size_t size, unsigned caps) {
+    (void)caps;
+    void *ptr = NULL;
+    return posix_memalign(&ptr, alignment < sizeof(void *) ? sizeof(void *) : alignment, size) == 0 ? ptr : NULL;
+}
+
+static inline void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+#endif // HOST_ESP_HEAP_CAPS_H
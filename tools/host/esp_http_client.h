@@ -0,0 +1,82 @@
+// Host stand-in for the ESP-IDF HTTP client over plain POSIX sockets, see
+// http_client_host.c. One request per connection, HTTP only; https URLs have to
+// be routed to a local stand-in with esp_http_client_host_route().
+#ifndef HOST_ESP_HTTP_CLIENT_H
+#define HOST_ESP_HTTP_CLIENT_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+typedef enum {
+    HTTP_EVENT_ERROR,
+    HTTP_EVENT_ON_CONNECTED,
+    HTTP_EVENT_HEADERS_SENT,
+    HTTP_EVENT_HEADER_SENT = HTTP_EVENT_HEADERS_SENT,
+    HTTP_EVENT_ON_HEADER,
+    HTTP_EVENT_ON_DATA,
+    HTTP_EVENT_ON_FINISH,
+    HTTP_EVENT_DISCONNECTED,
+    HTTP_EVENT_REDIRECT,
+    HTTP_EVENT_ON_HEADERS_COMPLETE,
+} esp_http_client_event_id_t;
+
+typedef struct {
+    esp_http_client_event_id_t event_id;
+    esp_http_client_handle_t client;
+    void *data;
+    int data_len;
+    void *user_data;
+    char *header_key;
+    char *header_value;
+} esp_http_client_event_t;
+
+typedef esp_err_t (*http_event_handle_cb)(esp_http_client_event_t *evt);
+
+typedef enum {
+    HTTP_METHOD_GET,
+    HTTP_METHOD_POST,
+    HTTP_METHOD_PUT,
+    HTTP_METHOD_PATCH,
+    HTTP_METHOD_DELETE,
+    HTTP_METHOD_HEAD,
+} esp_http_client_method_t;
+
+typedef struct {
+    const char *url;
+    esp_http_client_method_t method;
+    int timeout_ms;
+    http_event_handle_cb event_handler;
+    void *user_data;
+    int buffer_size;
+    int buffer_size_tx;
+    bool keep_alive_enable;
+    bool disable_auto_redirect;
+    esp_err_t (*crt_bundle_attach)(void *conf);
+} esp_http_client_config_t;
+
+// Host only: requests to URLs starting with prefix go to replacement instead,
+// e.g. "https://firebasestorage.googleapis.com" -> "http://127.0.0.1:8081"
+void esp_http_client_host_route(const char *prefix, const char *replacement);
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client);
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url);
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key);
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len);
+esp_err_t esp_http_client_flush_response(esp_http_client_handle_t client, int *len);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client);
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#endif // HOST_ESP_HTTP_CLIENT_H
@@ -0,0 +1,14 @@
+// Host stand-in: errors and warnings go to stderr, everything else is dropped
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include "esp_err.h"
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+// Never printed, but the arguments are still evaluated and format-checked
+#define ESP_LOGI(tag, fmt, ...) do { (void)(tag); if (0) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); if (0) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+
+#endif // HOST_ESP_LOG_H
@@ -0,0 +1,12 @@
+// Host stand-in: every buffer is internal RAM, so staging takes its direct path
+#ifndef HOST_ESP_MEMORY_UTILS_H
+#define HOST_ESP_MEMORY_UTILS_H
+
+#include <stdbool.h>
+
+static inline bool esp_ptr_external_ram(const void *ptr) {
+    (void)ptr;
+    return false;
+}
+
+#endif // HOST_ESP_MEMORY_UTILS_H
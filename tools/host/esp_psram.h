@@ -0,0 +1,11 @@
+// Host stand-in: no PSRAM
+#ifndef HOST_ESP_PSRAM_H
+#define HOST_ESP_PSRAM_H
+
+#include <stdbool.h>
+
+static inline bool esp_psram_is_initialized(void) {
+    return false;
+}
+
+#endif // HOST_ESP_PSRAM_H
@@ -0,0 +1,57 @@
+// Host stand-in: the SPIFFS partition is a directory; its size is fixed at
+// HOST_SPIFFS_BYTES (the spiffs partition in partitions.csv by default) and the
+// used bytes are the sizes of the files in it
+#ifndef HOST_ESP_SPIFFS_H
+#define HOST_ESP_SPIFFS_H
+
+#include "esp_err.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#ifndef HOST_SPIFFS_BYTES
+#define HOST_SPIFFS_BYTES 0x70000
+#endif
+
+typedef struct {
+    const char *base_path;
+    const char *partition_label;
+    size_t max_files;
+    bool format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+static const char *host_spiffs_path;
+
+static inline esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf) {
+    if (mkdir(conf->base_path, 0755) != 0 && errno != EEXIST) {
+        return ESP_FAIL;
+    }
+    host_spiffs_path = conf->base_path;
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes) {
+    (void)partition_label;
+    DIR *dir = host_spiffs_path ? opendir(host_spiffs_path) : NULL;
+    if (dir == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t used = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", host_spiffs_path, entry->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            used += (size_t)st.st_size;
+        }
+    }
+    closedir(dir);
+    *total_bytes = HOST_SPIFFS_BYTES;
+    *used_bytes = used;
+    return ESP_OK;
+}
+
+#endif // HOST_ESP_SPIFFS_H
@@ -0,0 +1,27 @@
+// Host stand-in for the FreeRTOS types and tick macros; one tick is one millisecond
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(ticks))
+
+// Critical sections are a process-wide lock per spinlock
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+
+#endif // HOST_FREERTOS_H
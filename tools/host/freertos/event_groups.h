@@ -0,0 +1,98 @@
+// Host stand-in: an event group is a bit mask behind a mutex and condition variable
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H
+#define HOST_FREERTOS_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef BIT0
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+#endif
+
+typedef uint32_t EventBits_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+} host_event_group_t;
+
+typedef host_event_group_t *EventGroupHandle_t;
+
+static inline EventGroupHandle_t xEventGroupCreate(void) {
+    EventGroupHandle_t group = calloc(1, sizeof(*group));
+    if (group != NULL) {
+        pthread_mutex_init(&group->lock, NULL);
+        pthread_cond_init(&group->changed, NULL);
+    }
+    return group;
+}
+
+static inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+static inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+static inline EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t now = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+static inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                              BaseType_t wait_for_all, TickType_t ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&group->lock);
+    while (1) {
+        EventBits_t set = group->bits & bits;
+        if (wait_for_all ? set == bits : set != 0) {
+            break;
+        }
+        int rc = (ticks == portMAX_DELAY) ? pthread_cond_wait(&group->changed, &group->lock)
+                                          : pthread_cond_timedwait(&group->changed, &group->lock, &deadline);
+        if (rc != 0) {
+            break;
+        }
+    }
+    EventBits_t now = group->bits;
+    EventBits_t set = now & bits;
+    if (clear_on_exit && (wait_for_all ? set == bits : set != 0)) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+static inline void vEventGroupDelete(EventGroupHandle_t group) {
+    pthread_cond_destroy(&group->changed);
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+}
+
+#endif // HOST_FREERTOS_EVENT_GROUPS_H
@@ -0,0 +1,44 @@
+// Host stand-in: mutexes are pthread mutexes, waits are timed locks
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = malloc(sizeof(*mutex));
+    if (mutex != NULL) {
+        pthread_mutex_init(mutex, NULL);
+    }
+    return mutex;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return pthread_mutex_lock(mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return pthread_mutex_timedlock(mutex, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    return pthread_mutex_unlock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+    pthread_mutex_destroy(mutex);
+    free(mutex);
+}
+
+#endif // HOST_FREERTOS_SEMPHR_H
@@ -0,0 +1,35 @@
+// Host stand-in: task delays sleep the calling thread. Tools that model time
+// themselves build with -DHOST_SKIP_DELAYS so retry backoffs return at once.
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+#include <time.h>
+
+static inline TickType_t xTaskGetTickCount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static inline void vTaskDelay(TickType_t ticks) {
+#ifdef HOST_SKIP_DELAYS
+    (void)ticks;
+#else
+    struct timespec ts = {.tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// Sleeps to *previous + increment and advances *previous, as on the device
+static inline BaseType_t xTaskDelayUntil(TickType_t *previous, TickType_t increment) {
+    TickType_t now = xTaskGetTickCount();
+    *previous += increment;
+    if ((int32_t)(*previous - now) <= 0) {
+        return pdFALSE;
+    }
+    vTaskDelay(*previous - now);
+    return pdTRUE;
+}
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,437 @@
+// Host stand-in for esp_http_client: enough HTTP/1.1 over blocking sockets to
+// run the firmware's upload paths against local stand-in servers. Each request
+// opens its own connection and sends "Connection: close". Response headers are
+// delivered to the event handler as HTTP_EVENT_ON_HEADER the way the device
+// client does, bodies may be Content-Length, chunked or read until close.
+
+#include "esp_http_client.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_HEADERS 32
+#define MAX_ROUTES 8
+#define URL_MAX 2048
+
+typedef struct {
+    char *key;
+    char *value;
+} header_t;
+
+struct esp_http_client {
+    char url[URL_MAX];
+    esp_http_client_method_t method;
+    int timeout_ms;
+    http_event_handle_cb handler;
+    void *user_data;
+    header_t headers[MAX_HEADERS];
+    int header_count;
+    const char *post_data;
+    int post_len;
+
+    int fd;
+    int status;
+    int64_t content_length;     // -1 when the body runs until close
+    bool chunked;
+    int64_t chunk_left;         // Bytes left in the current chunk, 0 before its size line
+    int64_t body_read;
+    bool body_done;
+    char buf[4096];
+    size_t buf_pos;
+    size_t buf_len;
+};
+
+static struct {
+    char prefix[256];
+    char replacement[256];
+} routes[MAX_ROUTES];
+static int route_count;
+
+void esp_http_client_host_route(const char *prefix, const char *replacement) {
+    if (route_count < MAX_ROUTES) {
+        snprintf(routes[route_count].prefix, sizeof(routes[0].prefix), "%s", prefix);
+        snprintf(routes[route_count].replacement, sizeof(routes[0].replacement), "%s", replacement);
+        route_count++;
+    }
+}
+
+static void emit(esp_http_client_handle_t client, esp_http_client_event_id_t id, void *data, int len,
+                 char *key, char *value) {
+    if (client->handler == NULL) {
+        return;
+    }
+    esp_http_client_event_t evt = {
+        .event_id = id,
+        .client = client,
+        .data = data,
+        .data_len = len,
+        .user_data = client->user_data,
+        .header_key = key,
+        .header_value = value,
+    };
+    client->handler(&evt);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    if (config == NULL || config->url == NULL) {
+        return NULL;
+    }
+    esp_http_client_handle_t client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+    snprintf(client->url, sizeof(client->url), "%s", config->url);
+    client->method = config->method;
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : 5000;
+    client->handler = config->event_handler;
+    client->user_data = config->user_data;
+    client->fd = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url) {
+    snprintf(client->url, sizeof(client->url), "%s", url);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key) {
+    for (int i = 0; i < client->header_count; i++) {
+        if (strcasecmp(client->headers[i].key, key) == 0) {
+            free(client->headers[i].key);
+            free(client->headers[i].value);
+            client->headers[i] = client->headers[--client->header_count];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    esp_http_client_delete_header(client, key);
+    if (client->header_count == MAX_HEADERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    client->headers[client->header_count].key = strdup(key);
+    client->headers[client->header_count].value = strdup(value);
+    client->header_count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len) {
+    client->post_data = data;
+    client->post_len = len;
+    return ESP_OK;
+}
+
+static const char *method_name(esp_http_client_method_t method) {
+    static const char *const names[] = {"GET", "POST", "PUT", "PATCH", "DELETE", "HEAD"};
+    return names[method];
+}
+
+static bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Split http://host[:port]/path after routing; https is only reachable through a route
+static bool resolve(const char *url, char *host, size_t host_len, char *port, size_t port_len, const char **path) {
+    static char routed[URL_MAX];
+    for (int i = 0; i < route_count; i++) {
+        size_t n = strlen(routes[i].prefix);
+        if (strncmp(url, routes[i].prefix, n) == 0) {
+            snprintf(routed, sizeof(routed), "%s%s", routes[i].replacement, url + n);
+            url = routed;
+            break;
+        }
+    }
+    if (strncmp(url, "http://", 7) != 0) {
+        fprintf(stderr, "http_client_host: no route for %.60s\n", url);
+        return false;
+    }
+
+    const char *authority = url + 7;
+    const char *slash = strchr(authority, '/');
+    *path = slash ? slash : "/";
+    size_t authority_len = slash ? (size_t)(slash - authority) : strlen(authority);
+    const char *colon = memchr(authority, ':', authority_len);
+    size_t name_len = colon ? (size_t)(colon - authority) : authority_len;
+    if (name_len >= host_len) {
+        return false;
+    }
+    memcpy(host, authority, name_len);
+    host[name_len] = '\0';
+    snprintf(port, port_len, "%.*s", colon ? (int)(authority_len - name_len - 1) : 2,
+             colon ? colon + 1 : "80");
+    return true;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+    char host[256];
+    char port[8];
+    const char *path;
+    if (!resolve(client->url, host, sizeof(host), port, sizeof(port), &path)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addrs = NULL;
+    if (getaddrinfo(host, port, &hints, &addrs) != 0) {
+        return ESP_FAIL;
+    }
+    int fd = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+    struct timeval tv = {.tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000};
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    if (fd < 0 || connect(fd, addrs->ai_addr, addrs->ai_addrlen) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        freeaddrinfo(addrs);
+        emit(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+        return ESP_FAIL;
+    }
+    freeaddrinfo(addrs);
+    client->fd = fd;
+    emit(client, HTTP_EVENT_ON_CONNECTED, NULL, 0, NULL, NULL);
+
+    char head[URL_MAX + 4096];
+    int len = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n"
+                       "Connection: close\r\n", method_name(client->method), path, host, port);
+    if (write_len >= 0 && (write_len > 0 || client->method != HTTP_METHOD_GET)) {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Length: %d\r\n", write_len);
+    }
+    for (int i = 0; i < client->header_count && len < (int)sizeof(head); i++) {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", client->headers[i].key,
+                        client->headers[i].value);
+    }
+    if (len + 2 >= (int)sizeof(head)) {
+        esp_http_client_close(client);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    if (!send_all(fd, head, (size_t)len)) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    emit(client, HTTP_EVENT_HEADER_SENT, NULL, 0, NULL, NULL);
+
+    client->status = 0;
+    client->content_length = -1;
+    client->chunked = false;
+    client->chunk_left = 0;
+    client->body_read = 0;
+    client->body_done = false;
+    client->buf_pos = client->buf_len = 0;
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len) {
+    if (client->fd < 0) {
+        return -1;
+    }
+    ssize_t n = send(client->fd, buffer, (size_t)len, MSG_NOSIGNAL);
+    return n < 0 ? -1 : (int)n;
+}
+
+// Buffered reads from the socket; 0 at end of stream, -1 on error or timeout
+static int fill(esp_http_client_handle_t client) {
+    if (client->buf_pos < client->buf_len) {
+        return (int)(client->buf_len - client->buf_pos);
+    }
+    ssize_t n = recv(client->fd, client->buf, sizeof(client->buf), 0);
+    if (n <= 0) {
+        return n == 0 ? 0 : -1;
+    }
+    client->buf_pos = 0;
+    client->buf_len = (size_t)n;
+    return (int)n;
+}
+
+static bool read_line(esp_http_client_handle_t client, char *line, size_t max_len) {
+    size_t len = 0;
+    for (;;) {
+        if (fill(client) <= 0) {
+            return false;
+        }
+        char c = client->buf[client->buf_pos++];
+        if (c == '\n') {
+            break;
+        }
+        if (len + 1 < max_len) {
+            line[len++] = c;
+        }
+    }
+    if (len > 0 && line[len - 1] == '\r') {
+        len--;
+    }
+    line[len] = '\0';
+    return true;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    char line[2048];
+    if (client->fd < 0 || !read_line(client, line, sizeof(line)) || sscanf(line, "HTTP/%*s %d", &client->status) != 1) {
+        return ESP_FAIL;
+    }
+
+    while (read_line(client, line, sizeof(line))) {
+        if (line[0] == '\0') {
+            emit(client, HTTP_EVENT_ON_HEADERS_COMPLETE, NULL, 0, NULL, NULL);
+            if (client->status == 204 || client->status == 304 || client->method == HTTP_METHOD_HEAD ||
+                client->content_length == 0) {
+                client->body_done = true;
+            }
+            return client->content_length < 0 ? 0 : client->content_length;
+        }
+        char *colon = strchr(line, ':');
+        if (colon == NULL) {
+            continue;
+        }
+        *colon = '\0';
+        char *value = colon + 1;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+        if (strcasecmp(line, "Content-Length") == 0) {
+            client->content_length = strtoll(value, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "chunked") == 0) {
+            client->chunked = true;
+        }
+        emit(client, HTTP_EVENT_ON_HEADER, NULL, 0, line, value);
+    }
+    return ESP_FAIL;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+    int total = 0;
+    while (total < len && !client->body_done && client->fd >= 0) {
+        if (client->chunked && client->chunk_left == 0) {
+            char line[64];
+            if (client->body_read > 0 && !read_line(client, line, sizeof(line))) {
+                break;      // CRLF after the previous chunk
+            }
+            if (!read_line(client, line, sizeof(line))) {
+                break;
+            }
+            client->chunk_left = strtoll(line, NULL, 16);
+            if (client->chunk_left == 0) {
+                read_line(client, line, sizeof(line));
+                client->body_done = true;
+                break;
+            }
+        }
+
+        int available = fill(client);
+        if (available <= 0) {
+            client->body_done = (available == 0 && client->content_length < 0 && !client->chunked);
+            break;
+        }
+        int64_t want = len - total;
+        if (client->chunked && want > client->chunk_left) {
+            want = client->chunk_left;
+        } else if (!client->chunked && client->content_length >= 0 && want > client->content_length - client->body_read) {
+            want = client->content_length - client->body_read;
+        }
+        if (want > available) {
+            want = available;
+        }
+        memcpy(buffer + total, client->buf + client->buf_pos, (size_t)want);
+        emit(client, HTTP_EVENT_ON_DATA, buffer + total, (int)want, NULL, NULL);
+        client->buf_pos += (size_t)want;
+        client->body_read += want;
+        total += (int)want;
+        if (client->chunked) {
+            client->chunk_left -= want;
+        } else if (client->content_length >= 0 && client->body_read == client->content_length) {
+            client->body_done = true;
+        }
+    }
+    return total;
+}
+
+esp_err_t esp_http_client_flush_response(esp_http_client_handle_t client, int *len) {
+    char scratch[1024];
+    int total = 0;
+    int n;
+    while ((n = esp_http_client_read(client, scratch, sizeof(scratch))) > 0) {
+        total += n;
+    }
+    if (len != NULL) {
+        *len = total;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+    esp_err_t err = esp_http_client_open(client, client->post_data ? client->post_len : 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (client->post_len > 0 && !send_all(client->fd, client->post_data, (size_t)client->post_len)) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    if (esp_http_client_fetch_headers(client) < 0) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    esp_http_client_flush_response(client, NULL);
+    emit(client, HTTP_EVENT_ON_FINISH, NULL, 0, NULL, NULL);
+    esp_http_client_close(client);
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client) {
+    return client->content_length;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client) {
+    return client->body_done;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+        emit(client, HTTP_EVENT_DISCONNECTED, NULL, 0, NULL, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_http_client_close(client);
+    for (int i = 0; i < client->header_count; i++) {
+        free(client->headers[i].key);
+        free(client->headers[i].value);
+    }
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,111 @@
+// Host stand-in: the mbedtls SHA-256 calls the firmware makes, on a minimal
+// portable implementation (is224 must be 0)
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t block_len;
+    uint64_t total;
+} mbedtls_sha256_context;
+
+#define HOST_SHA_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline void host_sha256_compress(uint32_t h[8], const uint8_t block[64]) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 |
+               block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = HOST_SHA_ROR(w[i - 15], 7) ^ HOST_SHA_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = HOST_SHA_ROR(w[i - 2], 17) ^ HOST_SHA_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], x = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = x + (HOST_SHA_ROR(e, 6) ^ HOST_SHA_ROR(e, 11) ^ HOST_SHA_ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+                      k[i] + w[i];
+        uint32_t t2 = (HOST_SHA_ROR(a, 2) ^ HOST_SHA_ROR(a, 13) ^ HOST_SHA_ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        x = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += x;
+}
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) {
+    static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    (void)is224;
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->block_len = 0;
+    ctx->total = 0;
+    return 0;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t len) {
+    ctx->total += len;
+    while (len > 0) {
+        size_t n = 64 - ctx->block_len < len ? 64 - ctx->block_len : len;
+        memcpy(ctx->block + ctx->block_len, input, n);
+        ctx->block_len += n;
+        input += n;
+        len -= n;
+        if (ctx->block_len == 64) {
+            host_sha256_compress(ctx->state, ctx->block);
+            ctx->block_len = 0;
+        }
+    }
+    return 0;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32]) {
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (ctx->block_len < 56 ? 56 : 120) - ctx->block_len;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    mbedtls_sha256_update(ctx, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        output[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+        output[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        output[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        output[4 * i + 3] = (uint8_t)ctx->state[i];
+    }
+    return 0;
+}
+
+static inline int mbedtls_sha256(const unsigned char *input, size_t len, unsigned char output[32], int is224) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, is224);
+    mbedtls_sha256_update(&ctx, input, len);
+    mbedtls_sha256_finish(&ctx, output);
+    mbedtls_sha256_free(&ctx);
+    return 0;
+}
+
+#endif // HOST_MBEDTLS_SHA256_H
@@ -0,0 +1,72 @@
+// Host stand-in for the ESP-IDF MQTT client, see mqtt_client_host.c. MQTT 3.1.1
+// over plain TCP (mqtt:// only), QoS 0 and 1 publishes. There is no outbox:
+// publishing while disconnected fails, and nothing is resent on reconnect.
+#ifndef HOST_MQTT_CLIENT_H
+#define HOST_MQTT_CLIENT_H
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef struct {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    int msg_id;
+    int session_present;
+    char *topic;
+    int topic_len;
+    char *data;
+    int data_len;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    struct {
+        struct {
+            const char *uri;
+        } address;
+    } broker;
+    struct {
+        const char *username;
+        const char *client_id;
+        struct {
+            const char *password;
+        } authentication;
+    } credentials;
+    struct {
+        bool disable_clean_session;
+        int keepalive;
+    } session;
+    struct {
+        int size;
+        int out_size;
+    } buffer;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+
+#endif // HOST_MQTT_CLIENT_H
@@ -0,0 +1,295 @@
+// Host stand-in for the ESP-IDF MQTT client: one TCP connection, a reader thread
+// that plays the MQTT task and dispatches CONNECTED, PUBLISHED and DISCONNECTED
+// events to the registered handler, and publishes written from the caller's
+// thread as the device client does while connected. PUBACKs can therefore
+// arrive before esp_mqtt_client_publish() has returned.
+
+#include "mqtt_client.h"
+#include <netdb.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+struct esp_mqtt_client {
+    char host[128];
+    char port[8];
+    char client_id[64];
+    bool clean_session;
+    int keepalive;
+
+    esp_event_handler_t handler;
+    void *handler_args;
+
+    int fd;
+    atomic_bool connected;
+    atomic_bool stopping;
+    uint16_t next_msg_id;
+    pthread_mutex_t write_lock;
+    pthread_t reader;
+    bool reader_running;
+};
+
+static esp_event_base_t MQTT_EVENTS = "MQTT_EVENTS";
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id, int session_present) {
+    if (client->handler == NULL) {
+        return;
+    }
+    esp_mqtt_event_t event = {
+        .event_id = id,
+        .client = client,
+        .msg_id = msg_id,
+        .session_present = session_present,
+    };
+    client->handler(client->handler_args, MQTT_EVENTS, id, &event);
+}
+
+static bool send_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Fixed header: type byte and variable-length remaining length; returns the header size
+static size_t put_fixed_header(uint8_t *out, uint8_t type, size_t remaining) {
+    size_t n = 0;
+    out[n++] = type;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        out[n++] = digit | (remaining > 0 ? 0x80 : 0);
+    } while (remaining > 0);
+    return n;
+}
+
+static size_t put_string(uint8_t *out, const char *s, size_t len) {
+    out[0] = (uint8_t)(len >> 8);
+    out[1] = (uint8_t)len;
+    memcpy(out + 2, s, len);
+    return len + 2;
+}
+
+static bool send_connect(esp_mqtt_client_handle_t client) {
+    size_t id_len = strlen(client->client_id);
+    uint8_t packet[160];
+    uint8_t body[150];
+    size_t n = put_string(body, "MQTT", 4);
+    body[n++] = 4;                                  // Protocol level 3.1.1
+    body[n++] = client->clean_session ? 0x02 : 0x00;
+    body[n++] = (uint8_t)(client->keepalive >> 8);
+    body[n++] = (uint8_t)client->keepalive;
+    n += put_string(body + n, client->client_id, id_len);
+
+    size_t head = put_fixed_header(packet, MQTT_CONNECT, n);
+    memcpy(packet + head, body, n);
+    return send_all(client->fd, packet, head + n);
+}
+
+static void *reader_task(void *arg) {
+    esp_mqtt_client_handle_t client = arg;
+    uint8_t payload[256];
+
+    while (!client->stopping) {
+        uint8_t type;
+        if (!recv_all(client->fd, &type, 1)) {
+            break;
+        }
+        size_t remaining = 0;
+        int shift = 0;
+        uint8_t digit;
+        do {
+            if (!recv_all(client->fd, &digit, 1)) {
+                goto closed;
+            }
+            remaining |= (size_t)(digit & 0x7F) << shift;
+            shift += 7;
+        } while ((digit & 0x80) && shift < 28);
+
+        // The broker only sends us acknowledgements; anything larger is skipped
+        size_t keep = remaining < sizeof(payload) ? remaining : sizeof(payload);
+        if (!recv_all(client->fd, payload, keep)) {
+            break;
+        }
+        for (size_t skipped = keep; skipped < remaining; skipped++) {
+            if (!recv_all(client->fd, &digit, 1)) {
+                goto closed;
+            }
+        }
+
+        switch (type & 0xF0) {
+        case MQTT_CONNACK:
+            if (keep >= 2 && payload[1] == 0) {
+                client->connected = true;
+                dispatch(client, MQTT_EVENT_CONNECTED, 0, payload[0] & 0x01);
+            } else {
+                dispatch(client, MQTT_EVENT_ERROR, 0, 0);
+                goto closed;
+            }
+            break;
+        case MQTT_PUBACK:
+            if (keep >= 2) {
+                dispatch(client, MQTT_EVENT_PUBLISHED, (payload[0] << 8) | payload[1], 0);
+            }
+            break;
+        case MQTT_PINGRESP:
+        default:
+            break;
+        }
+    }
+
+closed:
+    if (client->connected) {
+        client->connected = false;
+        dispatch(client, MQTT_EVENT_DISCONNECTED, 0, 0);
+    }
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    const char *uri = config->broker.address.uri;
+    if (uri == NULL || strncmp(uri, "mqtt://", 7) != 0) {
+        fprintf(stderr, "E mqtt_client_host: only mqtt:// URIs are supported\n");
+        return NULL;
+    }
+
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+
+    const char *host = uri + 7;
+    const char *colon = strchr(host, ':');
+    size_t host_len = colon ? (size_t)(colon - host) : strcspn(host, "/");
+    snprintf(client->host, sizeof(client->host), "%.*s", (int)host_len, host);
+    snprintf(client->port, sizeof(client->port), "%.*s", colon ? (int)strcspn(colon + 1, "/") : 4,
+             colon ? colon + 1 : "1883");
+    snprintf(client->client_id, sizeof(client->client_id), "%s",
+             config->credentials.client_id ? config->credentials.client_id : "host");
+    client->clean_session = !config->session.disable_clean_session;
+    client->keepalive = config->session.keepalive > 0 ? config->session.keepalive : 120;
+    client->fd = -1;
+    client->next_msg_id = 1;
+    pthread_mutex_init(&client->write_lock, NULL);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args) {
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addr = NULL;
+    if (getaddrinfo(client->host, client->port, &hints, &addr) != 0) {
+        return ESP_FAIL;
+    }
+    client->fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    bool ok = client->fd >= 0 && connect(client->fd, addr->ai_addr, addr->ai_addrlen) == 0;
+    freeaddrinfo(addr);
+    if (!ok || !send_connect(client)) {
+        if (client->fd >= 0) {
+            close(client->fd);
+            client->fd = -1;
+        }
+        return ESP_FAIL;
+    }
+
+    client->stopping = false;
+    client->reader_running = pthread_create(&client->reader, NULL, reader_task, client) == 0;
+    return client->reader_running ? ESP_OK : ESP_FAIL;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain) {
+    if (!client->connected) {
+        return -1;
+    }
+    if (len <= 0) {
+        len = data ? (int)strlen(data) : 0;
+    }
+
+    size_t topic_len = strlen(topic);
+    size_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + (size_t)len;
+    uint8_t head[300];
+    if (topic_len > sizeof(head) - 16) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&client->write_lock);
+    int msg_id = 0;
+    if (qos > 0) {
+        msg_id = client->next_msg_id++;
+        if (client->next_msg_id == 0) {
+            client->next_msg_id = 1;
+        }
+    }
+    size_t n = put_fixed_header(head, MQTT_PUBLISH | (uint8_t)((qos & 0x03) << 1) | (retain ? 1 : 0), remaining);
+    n += put_string(head + n, topic, topic_len);
+    if (qos > 0) {
+        head[n++] = (uint8_t)(msg_id >> 8);
+        head[n++] = (uint8_t)msg_id;
+    }
+    bool ok = send_all(client->fd, head, n) && send_all(client->fd, (const uint8_t *)data, (size_t)len);
+    pthread_mutex_unlock(&client->write_lock);
+    return ok ? msg_id : -1;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+    if (client->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    client->stopping = true;
+    uint8_t disconnect[2] = {MQTT_DISCONNECT, 0};
+    pthread_mutex_lock(&client->write_lock);
+    send_all(client->fd, disconnect, sizeof(disconnect));
+    pthread_mutex_unlock(&client->write_lock);
+    shutdown(client->fd, SHUT_RDWR);
+    if (client->reader_running) {
+        pthread_join(client->reader, NULL);
+        client->reader_running = false;
+    }
+    close(client->fd);
+    client->fd = -1;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client) {
+    if (client->fd >= 0) {
+        esp_mqtt_client_stop(client);
+    }
+    pthread_mutex_destroy(&client->write_lock);
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,9 @@
+// Host stand-in: the partition comes from nvs_host_load()
+#ifndef HOST_NVS_FLASH_H
+#define HOST_NVS_FLASH_H
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+
+#endif // HOST_NVS_FLASH_H
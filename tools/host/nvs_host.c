@@ -0,0 +1,279 @@
+// Host stand-in for the NVS library: reads a partition image in the NVS page
+// format (version 2) so firmware modules can be run against the images that
+// setup_credentials.py and nvs_partition_gen.py produce. Page headers, entries
+// and string data are CRC-checked the way the device does; a corrupt entry
+// fails the load instead of being skipped, since a provisioning image should
+// have none.
+
+#include "nvs_flash.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_SIZE 4096
+#define ENTRY_SIZE 32
+#define ENTRIES_PER_PAGE 126
+#define PAGE_ACTIVE 0xFFFFFFFEu
+#define PAGE_FULL 0xFFFFFFFCu
+#define PAGE_UNINITIALIZED 0xFFFFFFFFu
+#define FORMAT_VERSION 0xFE
+#define MAX_ITEMS 1024
+
+#define TYPE_U8 0x01
+#define TYPE_U32 0x04
+#define TYPE_STR 0x21
+
+typedef struct {
+    uint8_t ns;
+    uint8_t type;
+    char key[16];
+    const uint8_t *data;        // Value bytes in the entry, or the string after it
+    size_t size;
+} nvs_item_t;
+
+static uint8_t *image;
+static nvs_item_t items[MAX_ITEMS];
+static size_t item_count;
+static uint8_t next_ns = 1;
+static bool loaded;
+
+// esp_rom_crc32_le(0xFFFFFFFF, ...) as NVS calls it: the seed is inverted, so the register starts at 0
+static uint32_t crc32_le(const uint8_t *data, size_t len) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t entry_crc(const uint8_t *entry) {
+    uint8_t buf[28];
+    memcpy(buf, entry, 4);
+    memcpy(buf + 4, entry + 8, 24);
+    return crc32_le(buf, sizeof(buf));
+}
+
+static int entry_state(const uint8_t *page, int index) {
+    return (page[32 + index / 4] >> (index % 4 * 2)) & 3;
+}
+
+static esp_err_t load_page(const uint8_t *page, uint32_t seq) {
+    for (int index = 0; index < ENTRIES_PER_PAGE;) {
+        if (entry_state(page, index) != 2) {
+            index++;
+            continue;
+        }
+        const uint8_t *entry = page + 64 + index * ENTRY_SIZE;
+        uint8_t span = entry[2];
+        if (read_u32(entry + 4) != entry_crc(entry) || span == 0 || index + span > ENTRIES_PER_PAGE) {
+            fprintf(stderr, "nvs_host: entry %d of page %u is corrupt\n", index, (unsigned)seq);
+            return ESP_ERR_INVALID_CRC;
+        }
+        if (item_count == MAX_ITEMS) {
+            return ESP_ERR_NO_MEM;
+        }
+
+        nvs_item_t *item = &items[item_count];
+        item->ns = entry[0];
+        item->type = entry[1];
+        memcpy(item->key, entry + 8, 16);
+        item->key[15] = '\0';
+        item->data = entry + 24;
+        item->size = 8;
+        if (item->type == TYPE_STR) {
+            item->size = entry[24] | (entry[25] << 8);
+            item->data = entry + ENTRY_SIZE;
+            if (item->size == 0 || item->size > (size_t)(span - 1) * ENTRY_SIZE ||
+                crc32_le(item->data, item->size) != read_u32(entry + 28) || item->data[item->size - 1] != '\0') {
+                fprintf(stderr, "nvs_host: string '%s' in page %u is corrupt\n", item->key, (unsigned)seq);
+                return ESP_ERR_INVALID_CRC;
+            }
+        }
+        if (item->ns == 0 && item->data[0] >= next_ns) {
+            next_ns = item->data[0] + 1;
+        }
+        item_count++;
+        index += span;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_host_load(const char *path) {
+    nvs_host_unload();
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0 || size % PAGE_SIZE != 0) {
+        fclose(f);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    image = malloc((size_t)size);
+    if (image == NULL || fread(image, 1, (size_t)size, f) != (size_t)size) {
+        fclose(f);
+        nvs_host_unload();
+        return ESP_FAIL;
+    }
+    fclose(f);
+
+    size_t page_count = (size_t)size / PAGE_SIZE;
+    for (size_t p = 0; p < page_count; p++) {
+        const uint8_t *page = image + p * PAGE_SIZE;
+        uint32_t state = read_u32(page);
+        if (state != PAGE_UNINITIALIZED && ((state != PAGE_ACTIVE && state != PAGE_FULL) ||
+                                            page[8] != FORMAT_VERSION || read_u32(page + 28) != crc32_le(page + 4, 24))) {
+            fprintf(stderr, "nvs_host: page %zu has a bad header\n", p);
+            nvs_host_unload();
+            return ESP_ERR_NVS_NEW_VERSION_FOUND;
+        }
+    }
+
+    // Pages are read in sequence order, as the device builds its page list
+    for (size_t n = 0, last_seq = 0; n < page_count; n++) {
+        const uint8_t *best = NULL;
+        uint32_t best_seq = 0;
+        for (size_t p = 0; p < page_count; p++) {
+            const uint8_t *page = image + p * PAGE_SIZE;
+            uint32_t seq = read_u32(page + 4);
+            if (read_u32(page) == PAGE_UNINITIALIZED || (n > 0 && seq <= last_seq) ||
+                (best != NULL && seq >= best_seq)) {
+                continue;
+            }
+            best = page;
+            best_seq = seq;
+        }
+        if (best == NULL) {
+            break;
+        }
+        esp_err_t err = load_page(best, best_seq);
+        if (err != ESP_OK) {
+            nvs_host_unload();
+            return err;
+        }
+        last_seq = best_seq;
+    }
+    loaded = true;
+    return ESP_OK;
+}
+
+void nvs_host_unload(void) {
+    free(image);
+    image = NULL;
+    item_count = 0;
+    next_ns = 1;
+    loaded = false;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return loaded ? ESP_OK : ESP_ERR_NVS_NO_FREE_PAGES;
+}
+
+static const nvs_item_t *find(uint8_t ns, uint8_t type, const char *key) {
+    // Later entries win, which is what the device sees after an overwrite
+    for (size_t i = item_count; i-- > 0;) {
+        if (items[i].ns == ns && strcmp(items[i].key, key) == 0) {
+            return items[i].type == type ? &items[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (!loaded) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (name == NULL || out_handle == NULL || strlen(name) > 15) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const nvs_item_t *item = find(0, TYPE_U8, name);
+    if (item != NULL) {
+        *out_handle = item->data[0];
+        return ESP_OK;
+    }
+    if (open_mode == NVS_READONLY || next_ns == 255) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    // The device creates the namespace on a read-write open; here it just stays empty
+    *out_handle = next_ns++;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+static esp_err_t get_item(nvs_handle_t handle, const char *key, uint8_t type, const nvs_item_t **item) {
+    if (handle == 0 || handle > 254) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *item = find((uint8_t)handle, type, key);
+    return *item != NULL ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    const nvs_item_t *item;
+    esp_err_t err = get_item(handle, key, TYPE_U8, &item);
+    if (err == ESP_OK) {
+        *out_value = item->data[0];
+    }
+    return err;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    const nvs_item_t *item;
+    esp_err_t err = get_item(handle, key, TYPE_U32, &item);
+    if (err == ESP_OK) {
+        *out_value = read_u32(item->data);
+    }
+    return err;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    const nvs_item_t *item;
+    esp_err_t err = get_item(handle, key, TYPE_STR, &item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (out_value != NULL) {
+        if (*length < item->size) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(out_value, item->data, item->size);
+    }
+    *length = item->size;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    (void)handle, (void)key, (void)value;
+    return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    (void)handle, (void)key, (void)value;
+    return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    (void)handle;
+    return ESP_ERR_NVS_READ_ONLY;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    return ESP_OK;
+}
@@ -0,0 +1,346 @@
+// Host benchmark and check for main/src/jpeg_mask.c.
+//
+// Encodes a synthetic scene at each OV2640 frame size (4:2:2, Annex K tables),
+// masks two polygons with jpeg_mask_apply_into() and compares it against the
+// decode-mask-encode path it replaces:
+//   - every MCU with a pixel centre inside a polygon must come out flat gray,
+//   - every other changed MCU is counted as conservative edge coverage,
+//   - all untouched MCUs must decode to exactly the original pixels,
+//   - the reference masks the same MCUs on decoded RGB and re-encodes with
+//     libjpeg at the same quality; its PSNR outside the mask shows any
+//     generation loss (the DCT-domain path has none by construction).
+// Times are reported next to a bare Huffman decode of the scan, the floor for
+// any approach that has to touch every coefficient.
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o jpeg_mask_bench
+//       tools/jpeg_mask_bench.c main/src/jpeg_mask.c main/src/jpeg_codec.c -ljpeg -lm
+//   ./jpeg_mask_bench [-q quality] [-n iterations]
+
+#include "jpeg_mask.h"
+#include "jpeg_codec.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+#define FILL_LUMA 128
+#define FLAT_TOLERANCE 3
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+} frame_size_t;
+
+static const frame_size_t frame_sizes[] = {
+    {"QQVGA", 160, 120}, {"QVGA", 320, 240}, {"CIF", 400, 296}, {"VGA", 640, 480},
+    {"SVGA", 800, 600}, {"XGA", 1024, 768}, {"SXGA", 1280, 1024}, {"UXGA", 1600, 1200},
+};
+
+// A slanted window on the left and a sidewalk strip along the bottom, in frame fractions
+static const float window_shape[][2] = {{0.05f, 0.10f}, {0.28f, 0.14f}, {0.26f, 0.42f}, {0.07f, 0.38f}};
+static const float sidewalk_shape[][2] = {{0.0f, 0.82f}, {1.0f, 0.70f}, {1.0f, 1.0f}, {0.0f, 1.0f}, {0.4f, 0.9f}};
+
+static jpeg_mask_polygon_t polygons[2];
+
+static void scale_polygon(jpeg_mask_polygon_t *poly, const float (*shape)[2], int count, int width, int height) {
+    poly->count = count;
+    for (int i = 0; i < count; i++) {
+        poly->points[i].x = (uint16_t)lroundf(shape[i][0] * width);
+        poly->points[i].y = (uint16_t)lroundf(shape[i][1] * height);
+    }
+}
+
+static bool inside(const jpeg_mask_polygon_t *poly, float x, float y) {
+    bool in = false;
+    for (int i = 0, j = poly->count - 1; i < poly->count; j = i++) {
+        float xi = poly->points[i].x, yi = poly->points[i].y;
+        float xj = poly->points[j].x, yj = poly->points[j].y;
+        if ((yi > y) != (yj > y) && x < (xj - xi) * (y - yi) / (yj - yi) + xi) {
+            in = !in;
+        }
+    }
+    return in;
+}
+
+// Same scene as jpeg_opt_bench: gradient sky, hard-edged shapes, sensor-like noise
+static uint8_t *synthesize_scene(int width, int height) {
+    uint8_t *rgb = malloc((size_t)width * height * 3);
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float fx = (float)x / width;
+            float fy = (float)y / height;
+            float r = 90 + 120 * fy;
+            float g = 120 + 80 * fx;
+            float b = 200 - 100 * fy;
+            if (fy > 0.6f) {
+                float grass = 30 * sinf(x * 0.35f) * sinf(y * 0.5f);
+                r = 60 + grass;
+                g = 130 + grass;
+                b = 50;
+            }
+            if (fabsf(fx - 0.3f) < 0.12f && fy > 0.25f && fy < 0.7f) {
+                r = 180;
+                g = 60 + 40 * ((x / 8 + y / 8) & 1);
+                b = 40;
+            }
+            seed = seed * 1103515245 + 12345;
+            float noise = (float)((seed >> 16) & 0x0F) - 7.5f;
+            uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+            p[0] = (uint8_t)fminf(255, fmaxf(0, r + noise));
+            p[1] = (uint8_t)fminf(255, fmaxf(0, g + noise));
+            p[2] = (uint8_t)fminf(255, fmaxf(0, b + noise));
+        }
+    }
+    return rgb;
+}
+
+static uint8_t *encode_standard(const uint8_t *rgb, int width, int height, int quality, size_t *len) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *out = NULL;
+    unsigned long out_len = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.optimize_coding = FALSE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * width * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    *len = out_len;
+    return out;
+}
+
+// Plain upsampling keeps each MCU's pixels a function of its own coefficients only
+static uint8_t *decode(const uint8_t *jpeg, size_t len) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    uint8_t *pixels = malloc(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels + stride * cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return pixels;
+}
+
+// Bare Huffman decode of every MCU
+static esp_err_t huffman_pass(const uint8_t *jpeg, size_t len, jpeg_frame_t *frame) {
+    jpeg_block_t blocks[JPEG_MAX_BLOCKS_IN_MCU];
+    esp_err_t err = jpeg_frame_parse(jpeg, len, frame);
+    if (err != ESP_OK) {
+        return err;
+    }
+    jpeg_reader_t reader;
+    jpeg_reader_init(&reader, frame, jpeg, len);
+    for (uint32_t m = 0; m < frame->mcus_x * frame->mcus_y && err == ESP_OK; m++) {
+        err = jpeg_reader_mcu(&reader, frame, blocks);
+    }
+    return err;
+}
+
+typedef struct {
+    bool failed;
+    int masked;             // MCUs the output changed
+    int required;           // MCUs with a pixel centre inside a polygon
+    int extra;              // Changed MCUs without one: conservative edge coverage
+} check_t;
+
+static void check_mcus(const uint8_t *orig, const uint8_t *out, int width, int height, int mcu_w, int mcu_h,
+                       uint8_t *changed, check_t *c) {
+    memset(c, 0, sizeof(*c));
+    int mcus_x = (width + mcu_w - 1) / mcu_w;
+    int mcus_y = (height + mcu_h - 1) / mcu_h;
+
+    for (int my = 0; my < mcus_y; my++) {
+        for (int mx = 0; mx < mcus_x; mx++) {
+            bool differs = false, flat = true, required = false;
+            for (int y = my * mcu_h; y < (my + 1) * mcu_h && y < height; y++) {
+                for (int x = mx * mcu_w; x < (mx + 1) * mcu_w && x < width; x++) {
+                    size_t i = ((size_t)y * width + x) * 3;
+                    for (int k = 0; k < 3; k++) {
+                        differs |= out[i + k] != orig[i + k];
+                        flat &= abs(out[i + k] - FILL_LUMA) <= FLAT_TOLERANCE;
+                    }
+                    for (int p = 0; p < 2; p++) {
+                        required |= inside(&polygons[p], x + 0.5f, y + 0.5f);
+                    }
+                }
+            }
+            changed[my * mcus_x + mx] = differs;
+            if (differs) {
+                c->masked++;
+                c->failed |= !flat;
+                c->extra += !required;
+            }
+            if (required) {
+                c->required++;
+                c->failed |= !differs || !flat;
+            }
+        }
+    }
+}
+
+// The path the DCT-domain masking replaces: fill the same MCUs on RGB and re-encode
+static uint8_t *reference_mask(const uint8_t *orig, int width, int height, int mcu_w, int mcu_h,
+                               const uint8_t *changed, int quality, size_t *len) {
+    uint8_t *rgb = malloc((size_t)width * height * 3);
+    memcpy(rgb, orig, (size_t)width * height * 3);
+    int mcus_x = (width + mcu_w - 1) / mcu_w;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (changed[(y / mcu_h) * mcus_x + x / mcu_w]) {
+                memset(rgb + ((size_t)y * width + x) * 3, FILL_LUMA, 3);
+            }
+        }
+    }
+    uint8_t *jpeg = encode_standard(rgb, width, height, quality, len);
+    free(rgb);
+    return jpeg;
+}
+
+static double psnr_outside(const uint8_t *a, const uint8_t *b, int width, int height, int mcu_w, int mcu_h,
+                           const uint8_t *changed) {
+    int mcus_x = (width + mcu_w - 1) / mcu_w;
+    double sum = 0.0;
+    size_t n = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (changed[(y / mcu_h) * mcus_x + x / mcu_w]) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                double d = (double)a[((size_t)y * width + x) * 3 + k] - b[((size_t)y * width + x) * 3 + k];
+                sum += d * d;
+                n++;
+            }
+        }
+    }
+    return sum == 0.0 ? INFINITY : 10.0 * log10(255.0 * 255.0 * n / sum);
+}
+
+static int bench(const frame_size_t *fs, int quality, int iterations) {
+    uint8_t *rgb = synthesize_scene(fs->width, fs->height);
+    size_t len = 0;
+    uint8_t *jpeg = encode_standard(rgb, fs->width, fs->height, quality, &len);
+    free(rgb);
+
+    scale_polygon(&polygons[0], window_shape, 4, fs->width, fs->height);
+    scale_polygon(&polygons[1], sidewalk_shape, 5, fs->width, fs->height);
+    jpeg_mask_set_polygons(polygons, 2, FILL_LUMA);
+    jpeg_mask_view_t view = {0, 0, (uint16_t)fs->width, (uint16_t)fs->height};
+
+    size_t out_size = len + len / 4 + 1024;
+    uint8_t *out = malloc(out_size);
+    size_t out_len = 0;
+    esp_err_t err = jpeg_mask_apply_into(jpeg, len, &view, out, out_size, &out_len);
+    if (err != ESP_OK) {
+        printf("%-6s %9zu  %s\n", fs->name, len, esp_err_to_name(err));
+        free(out);
+        free(jpeg);
+        return 1;
+    }
+
+    jpeg_frame_t frame;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        jpeg_mask_apply_into(jpeg, len, &view, out, out_size, &out_len);
+    }
+    double mask_ms = (double)(esp_timer_get_time() - start) / 1000.0 / iterations;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        huffman_pass(jpeg, len, &frame);
+    }
+    double huff_ms = (double)(esp_timer_get_time() - start) / 1000.0 / iterations;
+
+    uint8_t *orig = decode(jpeg, len);
+    uint8_t *masked = decode(out, out_len);
+    uint8_t *changed = malloc(frame.mcus_x * frame.mcus_y);
+    check_t c;
+    check_mcus(orig, masked, fs->width, fs->height, frame.mcu_width, frame.mcu_height, changed, &c);
+
+    size_t ref_len = 0;
+    uint8_t *ref = NULL;
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        uint8_t *pixels = decode(jpeg, len);
+        free(ref);
+        ref = reference_mask(pixels, fs->width, fs->height, frame.mcu_width, frame.mcu_height, changed,
+                             quality, &ref_len);
+        free(pixels);
+    }
+    double ref_ms = (double)(esp_timer_get_time() - start) / 1000.0 / iterations;
+    uint8_t *ref_pixels = decode(ref, ref_len);
+    double ref_psnr = psnr_outside(orig, ref_pixels, fs->width, fs->height, frame.mcu_width, frame.mcu_height,
+                                   changed);
+
+    printf("%-6s %9zu %9zu %5d/%-5u %5d %8.3f %8.3f %5.2fx %8.3f %7.1f  %s\n", fs->name, len, out_len,
+           c.masked, (unsigned)(frame.mcus_x * frame.mcus_y), c.extra, mask_ms, huff_ms, mask_ms / huff_ms,
+           ref_ms, ref_psnr, c.failed ? "FAIL" : "ok");
+
+    free(ref_pixels);
+    free(ref);
+    free(changed);
+    free(masked);
+    free(orig);
+    free(out);
+    free(jpeg);
+    return c.failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    int quality = 80;
+    int iterations = 20;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "usage: %s [-q quality] [-n iterations]\n", argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[i], "-q") == 0) {
+            quality = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            iterations = atoi(argv[i + 1]);
+        }
+    }
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    printf("%-6s %9s %9s %11s %5s %8s %8s %6s %8s %7s\n", "frame", "in", "out", "masked", "edge",
+           "mask ms", "huff ms", "ratio", "ref ms", "ref dB");
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++) {
+        failures += bench(&frame_sizes[i], quality, iterations);
+    }
+    return failures ? 1 : 0;
+}
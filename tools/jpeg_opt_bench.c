@@ -0,0 +1,226 @@
+// Host benchmark for main/src/jpeg_optimize.c.
+//
+// Encodes a synthetic scene at each OV2640 frame size with libjpeg's standard
+// Annex K tables and 4:2:2 sampling (what the sensor emits), re-codes it with
+// jpeg_optimize_into(), checks the decoded pixels are identical and reports the
+// saving and the time per frame. JPEG files given on the command line are
+// measured instead of the synthetic frames.
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o jpeg_opt_bench
+//       tools/jpeg_opt_bench.c main/src/jpeg_optimize.c main/src/jpeg_codec.c -ljpeg -lm
+//   ./jpeg_opt_bench [-q quality] [-n iterations] [file.jpg ...]
+//
+// Host timings are not device timings; scale by the ns/byte the firmware logs
+// in jpeg_optimize_get_stats() to estimate the cost on the ESP32.
+
+#include "jpeg_optimize.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+} frame_size_t;
+
+static const frame_size_t frame_sizes[] = {
+    {"QQVGA", 160, 120}, {"QVGA", 320, 240}, {"CIF", 400, 296}, {"VGA", 640, 480},
+    {"SVGA", 800, 600}, {"XGA", 1024, 768}, {"SXGA", 1280, 1024}, {"UXGA", 1600, 1200},
+};
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data != NULL && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+// Gradient sky, a few hard-edged shapes and sensor-like noise
+static uint8_t *synthesize_scene(int width, int height) {
+    uint8_t *rgb = malloc((size_t)width * height * 3);
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float fx = (float)x / width;
+            float fy = (float)y / height;
+            float r = 90 + 120 * fy;
+            float g = 120 + 80 * fx;
+            float b = 200 - 100 * fy;
+            if (fy > 0.6f) {
+                float grass = 30 * sinf(x * 0.35f) * sinf(y * 0.5f);
+                r = 60 + grass;
+                g = 130 + grass;
+                b = 50;
+            }
+            if (fabsf(fx - 0.3f) < 0.12f && fy > 0.25f && fy < 0.7f) {
+                r = 180;
+                g = 60 + 40 * ((x / 8 + y / 8) & 1);
+                b = 40;
+            }
+            seed = seed * 1103515245 + 12345;
+            float noise = (float)((seed >> 16) & 0x0F) - 7.5f;
+            uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+            p[0] = (uint8_t)fminf(255, fmaxf(0, r + noise));
+            p[1] = (uint8_t)fminf(255, fmaxf(0, g + noise));
+            p[2] = (uint8_t)fminf(255, fmaxf(0, b + noise));
+        }
+    }
+    return rgb;
+}
+
+static uint8_t *encode_standard(const uint8_t *rgb, int width, int height, int quality, size_t *len) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *out = NULL;
+    unsigned long out_len = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.optimize_coding = FALSE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * width * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    *len = out_len;
+    return out;
+}
+
+static uint8_t *decode(const uint8_t *jpeg, size_t len, int *width, int *height, int *comps) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    jpeg_read_header(&cinfo, TRUE);
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    *comps = cinfo.output_components;
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    uint8_t *pixels = malloc(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels + stride * cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return pixels;
+}
+
+static bool pixels_identical(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len) {
+    int aw, ah, ac, bw, bh, bc;
+    uint8_t *pa = decode(a, a_len, &aw, &ah, &ac);
+    uint8_t *pb = decode(b, b_len, &bw, &bh, &bc);
+    bool same = aw == bw && ah == bh && ac == bc && memcmp(pa, pb, (size_t)aw * ah * ac) == 0;
+    free(pa);
+    free(pb);
+    return same;
+}
+
+static int bench(const char *label, const uint8_t *jpeg, size_t len, int iterations) {
+    size_t out_size = len + len / 4 + 1024;
+    uint8_t *out = malloc(out_size);
+    size_t out_len = 0;
+
+    esp_err_t err = jpeg_optimize_into(jpeg, len, out, out_size, &out_len);
+    if (err != ESP_OK) {
+        printf("%-14s %9zu  %-s\n", label, len, esp_err_to_name(err));
+        free(out);
+        return 0;
+    }
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        jpeg_optimize_into(jpeg, len, out, out_size, &out_len);
+    }
+    double ms = (double)(esp_timer_get_time() - start) / 1000.0 / iterations;
+
+    bool same = pixels_identical(jpeg, len, out, out_len);
+    printf("%-14s %9zu %9zu %7.2f%% %8.3f %7.1f  %s\n", label, len, out_len,
+           100.0 * (double)(len - out_len) / (double)len, ms, ms * 1e6 / (double)len,
+           same ? "identical" : "MISMATCH");
+    free(out);
+    return same ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    int quality = 80;
+    int iterations = 20;
+    int first_file = 1;
+
+    for (; first_file < argc && argv[first_file][0] == '-'; first_file += 2) {
+        if (first_file + 1 >= argc) {
+            fprintf(stderr, "usage: %s [-q quality] [-n iterations] [file.jpg ...]\n", argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[first_file], "-q") == 0) {
+            quality = atoi(argv[first_file + 1]);
+        } else if (strcmp(argv[first_file], "-n") == 0) {
+            iterations = atoi(argv[first_file + 1]);
+        }
+    }
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    printf("%-14s %9s %9s %8s %8s %7s\n", "frame", "in", "out", "saved", "ms/frame", "ns/B");
+    int failures = 0;
+
+    if (first_file < argc) {
+        for (int i = first_file; i < argc; i++) {
+            size_t len = 0;
+            uint8_t *jpeg = read_file(argv[i], &len);
+            if (jpeg == NULL) {
+                fprintf(stderr, "cannot read %s\n", argv[i]);
+                failures++;
+                continue;
+            }
+            const char *name = strrchr(argv[i], '/');
+            failures += bench(name ? name + 1 : argv[i], jpeg, len, iterations);
+            free(jpeg);
+        }
+        return failures ? 1 : 0;
+    }
+
+    for (size_t i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++) {
+        const frame_size_t *fs = &frame_sizes[i];
+        uint8_t *rgb = synthesize_scene(fs->width, fs->height);
+        size_t len = 0;
+        uint8_t *jpeg = encode_standard(rgb, fs->width, fs->height, quality, &len);
+        failures += bench(fs->name, jpeg, len, iterations);
+        free(jpeg);
+        free(rgb);
+    }
+    return failures ? 1 : 0;
+}
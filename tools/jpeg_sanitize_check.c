@@ -0,0 +1,451 @@
+// Host check for jpeg_sanitize() and jpeg_ranges_base64() in main/src/jpeg_utils.c.
+//
+// Encodes synthetic frames with libjpeg as baseline, restart-interval and
+// progressive files, then decorates each one the way camera drivers and
+// editors do: APP1/COM segments and fill bytes in the header, junk before SOI
+// and padding after EOI. For every file the sanitized byte ranges must decode
+// to the same pixels as the original, the base64 of the ranges must decode
+// back to exactly the gathered bytes, and every decoration of one frame must
+// sanitize to the same bytes. Truncated and randomly corrupted copies must
+// fall back to the whole buffer without reading outside it (run under ASan).
+// JPEG files given on the command line are checked as well.
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o jpeg_sanitize_check
+//       tools/jpeg_sanitize_check.c main/src/jpeg_utils.c -ljpeg -lm
+//   ./jpeg_sanitize_check [-f corruptions] [file.jpg ...]
+
+#include "jpeg_utils.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <jpeglib.h>
+
+typedef enum {
+    CODING_BASELINE,
+    CODING_RESTART,
+    CODING_PROGRESSIVE,
+    CODING_COUNT,
+} coding_t;
+
+static const char *coding_names[CODING_COUNT] = {"baseline", "restart", "progressive"};
+
+typedef enum {
+    DECOR_NONE,
+    DECOR_SEGMENTS,  // APP1 after SOI, fill bytes and a COM after APP0
+    DECOR_TRAILER,   // Padding after EOI
+    DECOR_ALL,       // Junk before SOI plus both of the above
+    DECOR_COUNT,
+} decoration_t;
+
+static const char *decoration_names[DECOR_COUNT] = {"plain", "app1+com", "trailer", "all"};
+
+typedef struct {
+    int width;
+    int height;
+} frame_size_t;
+
+static const frame_size_t frame_sizes[] = {{320, 240}, {800, 600}};
+
+static int failures;
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data != NULL && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+// Gradient with hard-edged blocks and noise, so every coding has real entropy data
+static uint8_t *synthesize_scene(int width, int height) {
+    uint8_t *rgb = malloc((size_t)width * height * 3);
+    uint32_t seed = 4242;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float fx = (float)x / width;
+            float fy = (float)y / height;
+            float r = 80 + 140 * fy;
+            float g = 110 + 90 * fx;
+            float b = 210 - 120 * fy;
+            if (((x / 24) + (y / 24)) % 5 == 0) {
+                r = 230;
+                g = 40;
+                b = 60;
+            }
+            seed = seed * 1103515245 + 12345;
+            float noise = (float)((seed >> 16) & 0x1F) - 15.5f;
+            uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+            p[0] = (uint8_t)fminf(255, fmaxf(0, r + noise));
+            p[1] = (uint8_t)fminf(255, fmaxf(0, g + noise));
+            p[2] = (uint8_t)fminf(255, fmaxf(0, b + noise));
+        }
+    }
+    return rgb;
+}
+
+static uint8_t *encode(const uint8_t *rgb, int width, int height, coding_t coding, size_t *len) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *out = NULL;
+    unsigned long out_len = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 80, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    if (coding == CODING_RESTART) {
+        cinfo.restart_interval = 4;
+    } else if (coding == CODING_PROGRESSIVE) {
+        jpeg_simple_progression(&cinfo);
+    }
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * width * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    *len = out_len;
+    return out;
+}
+
+static uint8_t *decode(const uint8_t *jpeg, size_t len, int *width, int *height, int *comps) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    jpeg_read_header(&cinfo, TRUE);
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    *comps = cinfo.output_components;
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    uint8_t *pixels = malloc(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels + stride * cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return pixels;
+}
+
+static bool pixels_identical(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len) {
+    int aw, ah, ac, bw, bh, bc;
+    uint8_t *pa = decode(a, a_len, &aw, &ah, &ac);
+    uint8_t *pb = decode(b, b_len, &bw, &bh, &bc);
+    bool same = aw == bw && ah == bh && ac == bc && memcmp(pa, pb, (size_t)aw * ah * ac) == 0;
+    free(pa);
+    free(pb);
+    return same;
+}
+
+static size_t put_segment(uint8_t *out, uint8_t marker, const char *payload) {
+    size_t payload_len = strlen(payload);
+    size_t seg_len = payload_len + 2;
+    out[0] = 0xFF;
+    out[1] = marker;
+    out[2] = (uint8_t)(seg_len >> 8);
+    out[3] = (uint8_t)seg_len;
+    memcpy(out + 4, payload, payload_len);
+    return 4 + payload_len;
+}
+
+// Returns a new buffer holding the frame with the requested extras spliced in
+static uint8_t *decorate(const uint8_t *jpeg, size_t len, decoration_t decoration, size_t *out_len) {
+    uint8_t *out = malloc(len + 1024);
+    size_t pos = 0;
+    bool segments = decoration == DECOR_SEGMENTS || decoration == DECOR_ALL;
+    bool trailer = decoration == DECOR_TRAILER || decoration == DECOR_ALL;
+
+    if (decoration == DECOR_ALL) {
+        static const uint8_t junk[] = {0x00, 0xFF, 0x00, 0xD8, 0x12, 0xFF};
+        memcpy(out, junk, sizeof(junk));
+        pos += sizeof(junk);
+    }
+
+    // SOI, then an EXIF-style APP1 whose payload contains marker-like bytes
+    memcpy(out + pos, jpeg, 2);
+    pos += 2;
+    size_t in = 2;
+    if (segments) {
+        pos += put_segment(out + pos, 0xE1, "Exif\x01\x01 \xFF\xD9 \xFF\xDA camera serial 0042");
+    }
+
+    // libjpeg writes JFIF APP0 first; keep it and follow it with fill bytes and a COM
+    size_t app0_len = 2 + (((size_t)jpeg[in + 2] << 8) | jpeg[in + 3]);
+    memcpy(out + pos, jpeg + in, app0_len);
+    pos += app0_len;
+    in += app0_len;
+    if (segments) {
+        out[pos++] = 0xFF;
+        out[pos++] = 0xFF;
+        pos += put_segment(out + pos, 0xFE, "lens=2.8mm firmware=dev build");
+    }
+
+    memcpy(out + pos, jpeg + in, len - in);
+    pos += len - in;
+
+    if (trailer) {
+        memset(out + pos, 0x00, 200);
+        pos += 200;
+        memset(out + pos, 0xFF, 16);
+        pos += 16;
+    }
+
+    *out_len = pos;
+    return out;
+}
+
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+// Plain reference decoder; returns the decoded length or -1 on a bad character
+static long base64_decode(const char *in, size_t in_len, uint8_t *out) {
+    if (in_len % 4 != 0) {
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < in_len; i += 4) {
+        int v[4];
+        int pad = 0;
+        for (int k = 0; k < 4; k++) {
+            if (in[i + k] == '=' && i + 4 == in_len && k >= 2) {
+                v[k] = 0;
+                pad++;
+            } else if (pad > 0 || (v[k] = base64_value(in[i + k])) < 0) {
+                return -1;
+            }
+        }
+        uint32_t group = ((uint32_t)v[0] << 18) | ((uint32_t)v[1] << 12) | ((uint32_t)v[2] << 6) | (uint32_t)v[3];
+        out[n++] = (uint8_t)(group >> 16);
+        if (pad < 2) {
+            out[n++] = (uint8_t)(group >> 8);
+        }
+        if (pad < 1) {
+            out[n++] = (uint8_t)group;
+        }
+    }
+    return (long)n;
+}
+
+static bool ranges_in_bounds(const jpeg_ranges_t *ranges, size_t len) {
+    size_t total = 0;
+    if (ranges->count > JPEG_MAX_RANGES || ranges->original_len != len) {
+        return false;
+    }
+    for (size_t i = 0; i < ranges->count; i++) {
+        if (ranges->ranges[i].offset > len || ranges->ranges[i].len > len - ranges->ranges[i].offset) {
+            return false;
+        }
+        total += ranges->ranges[i].len;
+    }
+    return total == ranges->total_len;
+}
+
+// Base64 of the ranges must decode to exactly the gathered bytes, and a buffer one
+// byte short of the documented size must be refused
+static bool base64_round_trips(const uint8_t *jpeg, const jpeg_ranges_t *ranges, const uint8_t *gathered) {
+    size_t encoded_size = jpeg_ranges_base64_len(ranges) + 1;
+    char *encoded = malloc(encoded_size);
+    uint8_t *decoded = malloc(ranges->total_len + 3);
+    size_t encoded_len = 0;
+    bool ok = false;
+
+    if (jpeg_ranges_base64(jpeg, ranges, encoded, encoded_size - 1, &encoded_len) == ESP_ERR_INVALID_SIZE &&
+        jpeg_ranges_base64(jpeg, ranges, encoded, encoded_size, &encoded_len) == ESP_OK &&
+        encoded_len == encoded_size - 1 && strlen(encoded) == encoded_len) {
+        long decoded_len = base64_decode(encoded, encoded_len, decoded);
+        ok = decoded_len == (long)ranges->total_len && memcmp(decoded, gathered, ranges->total_len) == 0;
+    }
+
+    free(encoded);
+    free(decoded);
+    return ok;
+}
+
+// Sanitizes one well-formed file and runs every check on it. The gathered bytes are
+// returned so callers can compare decorations of the same frame.
+static uint8_t *check_file(const char *label, const uint8_t *jpeg, size_t len, size_t *sanitized_len) {
+    jpeg_ranges_t ranges;
+    esp_err_t err = jpeg_sanitize(jpeg, len, &ranges);
+
+    uint8_t *gathered = malloc(ranges.total_len > 0 ? ranges.total_len : 1);
+    jpeg_ranges_copy(jpeg, &ranges, gathered);
+    *sanitized_len = ranges.total_len;
+
+    // libjpeg itself rejects junk before SOI, so the reference decode starts there
+    size_t soi = 0;
+    while (soi + 1 < len && !(jpeg[soi] == 0xFF && jpeg[soi + 1] == 0xD8)) {
+        soi++;
+    }
+
+    bool bounds = ranges_in_bounds(&ranges, len);
+    bool pixels = bounds && pixels_identical(jpeg + soi, len - soi, gathered, ranges.total_len);
+    bool base64 = bounds && base64_round_trips(jpeg, &ranges, gathered);
+    bool ok = err == ESP_OK && bounds && pixels && base64;
+
+    printf("%-28s %8zu -> %8zu bytes  %2zu range(s)  %s%s%s%s\n", label, len, ranges.total_len, ranges.count,
+           ok ? "ok" : "FAIL", err != ESP_OK ? " (not sanitized)" : "", !pixels ? " (pixels differ)" : "",
+           !base64 ? " (base64 mismatch)" : "");
+    if (!ok) {
+        failures++;
+    }
+    return gathered;
+}
+
+// Anything that is not a complete JPEG must come back as the whole buffer
+static void check_malformed(const char *label, const uint8_t *jpeg, size_t len, unsigned corruptions) {
+    jpeg_ranges_t ranges;
+    int bad = 0;
+    int cases = 0;
+
+    // Cut inside the header, inside the scan and just before EOI
+    size_t cuts[] = {1, 3, 20, len / 3, len / 2, len - 2, len - 1};
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+        esp_err_t err = jpeg_sanitize(jpeg, cuts[i], &ranges);
+        cases++;
+        if (err == ESP_OK || ranges.count != 1 || ranges.ranges[0].offset != 0 || ranges.total_len != cuts[i]) {
+            bad++;
+        }
+    }
+
+    // Random byte damage: whatever the verdict, the ranges must stay inside the buffer
+    uint8_t *copy = malloc(len);
+    uint32_t seed = (uint32_t)len;
+    for (unsigned i = 0; i < corruptions; i++) {
+        memcpy(copy, jpeg, len);
+        for (int k = 0; k < 4; k++) {
+            seed = seed * 1664525 + 1013904223;
+            size_t at = (seed >> 8) % (len < 600 ? len : 600);
+            seed = seed * 1664525 + 1013904223;
+            copy[at] = (uint8_t)(seed >> 24);
+        }
+        jpeg_sanitize(copy, len, &ranges);
+        cases++;
+        if (!ranges_in_bounds(&ranges, len)) {
+            bad++;
+        }
+    }
+    free(copy);
+
+    printf("%-28s %d malformed case(s)  %s\n", label, cases, bad == 0 ? "ok" : "FAIL");
+    if (bad != 0) {
+        failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned corruptions = 200;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt == 'f') {
+            corruptions = (unsigned)strtoul(optarg, NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [-f corruptions] [file.jpg ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t s = 0; s < sizeof(frame_sizes) / sizeof(frame_sizes[0]); s++) {
+        int width = frame_sizes[s].width;
+        int height = frame_sizes[s].height;
+        uint8_t *rgb = synthesize_scene(width, height);
+
+        for (int c = 0; c < CODING_COUNT; c++) {
+            size_t len;
+            uint8_t *jpeg = encode(rgb, width, height, (coding_t)c, &len);
+            uint8_t *reference = NULL;
+            size_t reference_len = 0;
+
+            for (int d = 0; d < DECOR_COUNT; d++) {
+                size_t decorated_len;
+                uint8_t *decorated = decorate(jpeg, len, (decoration_t)d, &decorated_len);
+                char label[64];
+                snprintf(label, sizeof(label), "%dx%d %s %s", width, height, coding_names[c], decoration_names[d]);
+
+                size_t sanitized_len;
+                uint8_t *sanitized = check_file(label, decorated, decorated_len, &sanitized_len);
+                if (reference == NULL) {
+                    reference = sanitized;
+                    reference_len = sanitized_len;
+                } else {
+                    if (sanitized_len != reference_len || memcmp(sanitized, reference, reference_len) != 0) {
+                        printf("%-28s sanitized bytes differ from the plain file  FAIL\n", label);
+                        failures++;
+                    }
+                    free(sanitized);
+                }
+                free(decorated);
+            }
+
+            char label[64];
+            snprintf(label, sizeof(label), "%dx%d %s", width, height, coding_names[c]);
+            check_malformed(label, jpeg, len, corruptions);
+            free(reference);
+            free(jpeg);
+        }
+        free(rgb);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        size_t len;
+        uint8_t *jpeg = read_file(argv[i], &len);
+        if (jpeg == NULL || len == 0) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            failures++;
+            free(jpeg);
+            continue;
+        }
+        size_t sanitized_len;
+        free(check_file(argv[i], jpeg, len, &sanitized_len));
+        free(jpeg);
+    }
+
+    jpeg_sanitize_stats_t stats;
+    jpeg_sanitize_get_stats(&stats);
+    printf("\n%u frame(s), %u malformed, %llu -> %llu bytes\n", (unsigned)stats.frames, (unsigned)stats.malformed,
+           (unsigned long long)stats.bytes_in, (unsigned long long)stats.bytes_out);
+    printf("%s\n", failures == 0 ? "all checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
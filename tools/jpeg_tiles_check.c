@@ -0,0 +1,338 @@
+// Host check for main/src/jpeg_tiles.c.
+//
+// Encodes a sequence of synthetic frames with libjpeg at several sizes and
+// samplings, including a restart-interval stream and a size that is not a
+// whole number of MCUs. Each frame has a static textured background and
+// high-contrast objects that move, pause and appear. The objects are MCU-row
+// aligned so every change clears the DC/AC thresholds. Every frame goes through
+// jpeg_tiles_process(), and:
+//   - tiles must be MCU aligned, inside the frame, non-overlapping and at most
+//     TILE_MAX_PER_FRAME;
+//   - every tile must decode to exactly the pixels of the same crop of the
+//     decoded full frame;
+//   - a receiver canvas built from the last keyframe plus every tile since
+//     must equal the decoded frame, after every frame;
+//   - a global brightness jump, jpeg_tiles_invalidate() and the keyframe
+//     interval must each produce a keyframe, and paused objects an unchanged
+//     frame.
+// Decoding uses plain upsampling so each MCU's pixels depend on its own
+// coefficients only, as in jpeg_mask_bench.
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o jpeg_tiles_check
+//       tools/jpeg_tiles_check.c main/src/jpeg_tiles.c main/src/jpeg_codec.c -ljpeg -lm
+//   ./jpeg_tiles_check [-q quality] [-f frames]
+
+#include "jpeg_tiles.h"
+#include "psram_stage.h"
+#include "config.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+#define BRIGHTNESS_FRAME 45     // Whole background steps up: a keyframe
+#define INVALIDATE_FRAME 55     // jpeg_tiles_invalidate() before this frame
+#define PAUSE_FIRST 10          // Objects hold still for these frames
+#define PAUSE_LAST 13
+#define APPEAR_FIRST 20         // Third object present for these frames
+#define APPEAR_LAST 24
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    int v_samp;                 // Luma vertical sampling: 1 is 4:2:2, 2 is 4:2:0
+    int restart_interval;       // MCUs, 0 for none
+} tile_case_t;
+
+static const tile_case_t cases[] = {
+    {"QVGA 4:2:2", 320, 240, 1, 0},
+    {"VGA 4:2:2 DRI", 640, 480, 1, 7},
+    {"CIF 4:2:0", 400, 296, 2, 0},
+    {"250x190 4:2:2", 250, 190, 1, 0},
+};
+
+// Stand-ins for psram_stage.c; the host has no PSRAM to stage from
+const uint8_t *psram_stage_acquire(const uint8_t *src, size_t len) {
+    (void)len;
+    return src;
+}
+
+void psram_stage_release(const uint8_t *staged) {
+    (void)staged;
+}
+
+static void fill_rect(uint8_t *rgb, int width, int height, int x0, int y0, int w, int h, const uint8_t color[3]) {
+    for (int y = y0 < 0 ? 0 : y0; y < y0 + h && y < height; y++) {
+        for (int x = x0 < 0 ? 0 : x0; x < x0 + w && x < width; x++) {
+            memcpy(rgb + ((size_t)y * width + x) * 3, color, 3);
+        }
+    }
+}
+
+// Static texture that is identical in every frame, with objects drawn on top
+static uint8_t *render(const tile_case_t *tc, int frame) {
+    int width = tc->width;
+    int height = tc->height;
+    int mcu_h = 8 * tc->v_samp;
+    uint8_t *rgb = malloc((size_t)width * height * 3);
+    int lift = frame >= BRIGHTNESS_FRAME ? 40 : 0;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t h = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u);
+            h = (h ^ (h >> 13)) * 0x5bd1e995;
+            int noise = (int)((h >> 24) & 0x0F) - 8;
+            int base = 120 + 30 * (((x / 20) + (y / 12)) & 1) + noise + lift;
+            uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+            p[0] = (uint8_t)(base > 255 ? 255 : base);
+            p[1] = (uint8_t)(base - 10 + lift / 2 > 255 ? 255 : base - 10 + lift / 2);
+            p[2] = (uint8_t)(base - 20);
+        }
+    }
+
+    // Motion stops during the pause and picks up where it left off
+    int t = frame < PAUSE_FIRST ? frame : frame <= PAUSE_LAST ? PAUSE_FIRST : frame - (PAUSE_LAST - PAUSE_FIRST + 1);
+    int rows = height / mcu_h;
+
+    // Luma far from the background before and after the brightness step
+    static const uint8_t dark[3] = {10, 10, 30};
+    static const uint8_t bright[3] = {255, 255, 255};
+    static const uint8_t red[3] = {200, 0, 0};
+
+    int a_w = 40;
+    int a_x = 8 + (5 * t) % (width - a_w - 16);
+    fill_rect(rgb, width, height, a_x, 2 * mcu_h, a_w, 2 * mcu_h, dark);
+
+    int b_x = (width * 2 / 3) / 16 * 16;
+    int b_y = mcu_h * (1 + (t / 2) % (rows - 4));
+    fill_rect(rgb, width, height, b_x, b_y, 32, 2 * mcu_h, bright);
+
+    if (frame >= APPEAR_FIRST && frame <= APPEAR_LAST) {
+        fill_rect(rgb, width, height, width / 4, (rows - 2) * mcu_h, 24, mcu_h, red);
+    }
+    return rgb;
+}
+
+static uint8_t *encode(const uint8_t *rgb, const tile_case_t *tc, int quality, size_t *len) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *out = NULL;
+    unsigned long out_len = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = tc->width;
+    cinfo.image_height = tc->height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.optimize_coding = FALSE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = tc->v_samp;
+    cinfo.restart_interval = tc->restart_interval;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * tc->width * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    *len = out_len;
+    return out;
+}
+
+// Plain upsampling keeps each MCU's pixels a function of its own coefficients only
+static uint8_t *decode(const uint8_t *jpeg, size_t len, int *width, int *height) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    uint8_t *pixels = malloc(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels + stride * cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return pixels;
+}
+
+static bool tiles_overlap(const jpeg_tile_t *a, const jpeg_tile_t *b) {
+    return a->x < b->x + b->width && b->x < a->x + a->width && a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+// Checks one tile against the decoded frame and pastes it onto the canvas
+static bool check_tile(const jpeg_tile_t *tile, const uint8_t *full, uint8_t *canvas, int width, int height,
+                       int mcu_w, int mcu_h) {
+    if (tile->x % mcu_w != 0 || tile->y % mcu_h != 0 || tile->width == 0 || tile->height == 0 ||
+        tile->x + tile->width > width || tile->y + tile->height > height) {
+        printf("  tile %ux%u at %u,%u is not MCU aligned inside the frame\n", tile->width, tile->height, tile->x,
+               tile->y);
+        return false;
+    }
+
+    int tw, th;
+    uint8_t *pixels = decode(tile->jpeg, tile->len, &tw, &th);
+    bool ok = tw == tile->width && th == tile->height;
+    for (int y = 0; ok && y < th; y++) {
+        size_t offset = ((size_t)(tile->y + y) * width + tile->x) * 3;
+        ok = memcmp(pixels + (size_t)y * tw * 3, full + offset, (size_t)tw * 3) == 0;
+        memcpy(canvas + offset, pixels + (size_t)y * tw * 3, (size_t)tw * 3);
+    }
+    if (!ok) {
+        printf("  tile %ux%u at %u,%u does not match the crop of the frame\n", tile->width, tile->height, tile->x,
+               tile->y);
+    }
+    free(pixels);
+    return ok;
+}
+
+static int run_case(const tile_case_t *tc, int quality, int frames) {
+    int mcu_w = 16;
+    int mcu_h = 8 * tc->v_samp;
+    size_t frame_bytes = (size_t)tc->width * tc->height * 3;
+    uint8_t *canvas = malloc(frame_bytes);
+    int failures = 0;
+    int keyframes = 0, tiled = 0, unchanged = 0, tiles = 0;
+    uint64_t bytes_in = 0, bytes_out = 0;
+    int64_t process_us = 0;
+    bool have_canvas = false;
+
+    jpeg_tiles_invalidate();
+    for (int f = 0; f < frames; f++) {
+        uint8_t *rgb = render(tc, f);
+        size_t len;
+        uint8_t *jpeg = encode(rgb, tc, quality, &len);
+        free(rgb);
+        int width, height;
+        uint8_t *full = decode(jpeg, len, &width, &height);
+
+        if (f == INVALIDATE_FRAME) {
+            jpeg_tiles_invalidate();
+        }
+
+        jpeg_tile_set_t set;
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = jpeg_tiles_process(jpeg, len, &set);
+        process_us += esp_timer_get_time() - start;
+
+        bool ok = err == ESP_OK;
+        bool must_key = f == 0 || f == BRIGHTNESS_FRAME || f == INVALIDATE_FRAME;
+        if (ok && must_key && !set.keyframe) {
+            printf("  frame %d: expected a keyframe\n", f);
+            ok = false;
+        }
+
+        if (ok && set.keyframe) {
+            memcpy(canvas, full, frame_bytes);
+            have_canvas = true;
+            keyframes++;
+        } else if (ok) {
+            if (set.count > TILE_MAX_PER_FRAME || !have_canvas) {
+                printf("  frame %d: %d tile(s) without a keyframe or over the limit\n", f, set.count);
+                ok = false;
+            }
+            for (int i = 0; ok && i < set.count; i++) {
+                for (int j = i + 1; j < set.count; j++) {
+                    if (tiles_overlap(&set.tiles[i], &set.tiles[j])) {
+                        printf("  frame %d: tiles %d and %d overlap\n", f, i, j);
+                        ok = false;
+                    }
+                }
+                ok = ok && check_tile(&set.tiles[i], full, canvas, width, height, mcu_w, mcu_h);
+                bytes_out += set.tiles[i].len;
+            }
+            if (set.count > 0) {
+                tiled++;
+                tiles += set.count;
+                bytes_in += len;
+            } else {
+                unchanged++;
+            }
+        }
+
+        // The receiver's picture after this frame must be the frame itself
+        if (ok && memcmp(canvas, full, frame_bytes) != 0) {
+            size_t differ = 0;
+            for (size_t i = 0; i < frame_bytes; i++) {
+                differ += canvas[i] != full[i];
+            }
+            printf("  frame %d: reconstruction differs in %zu byte(s)\n", f, differ);
+            ok = false;
+        }
+        if (!ok) {
+            printf("  frame %d failed (%s)\n", f, esp_err_to_name(err));
+            failures++;
+        }
+
+        free(full);
+        free(jpeg);
+    }
+
+    // The sequence has to exercise every outcome, or the checks above proved little
+    if (tiled == 0 || unchanged == 0 || keyframes < 3) {
+        printf("  sequence produced %d keyframe(s), %d tiled, %d unchanged\n", keyframes, tiled, unchanged);
+        failures++;
+    }
+
+    printf("%-16s %6d %5d %6d %9d %6d %7.1f%% %8.3f  %s\n", tc->name, frames, keyframes, tiled, unchanged, tiles,
+           bytes_in ? 100.0 * bytes_out / bytes_in : 0.0, (double)process_us / 1000.0 / frames,
+           failures ? "FAIL" : "ok");
+    free(canvas);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    int quality = 80;
+    int frames = 2 * TILE_KEYFRAME_INTERVAL + 10;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "usage: %s [-q quality] [-f frames]\n", argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[i], "-q") == 0) {
+            quality = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            frames = atoi(argv[i + 1]);
+        }
+    }
+    if (frames <= INVALIDATE_FRAME) {
+        frames = INVALIDATE_FRAME + 1;
+    }
+
+    if (jpeg_tiles_init(TILE_POOL_SIZE) != ESP_OK) {
+        fprintf(stderr, "jpeg_tiles_init failed\n");
+        return 1;
+    }
+
+    printf("%-16s %6s %5s %6s %9s %6s %8s %8s\n", "case", "frames", "keys", "tiled", "unchanged", "tiles",
+           "of input", "ms/frame");
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        failures += run_case(&cases[i], quality, frames);
+    }
+
+    jpeg_tiles_stats_t stats;
+    jpeg_tiles_get_stats(&stats);
+    printf("\n%u frame(s): %u keyframe(s), %u tiled, %u unchanged, %u fallback(s)\n", (unsigned)stats.frames,
+           (unsigned)stats.keyframes, (unsigned)stats.tiled_frames, (unsigned)stats.unchanged_frames,
+           (unsigned)stats.fallbacks);
+    printf("%s\n", failures == 0 ? "all checks passed" : "FAILED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,1343 @@
+// LAN gateway between a site's cameras and the Realtime Database.
+//
+// Cameras upload to the gateway over plain LAN HTTP or MQTT instead of each
+// holding a TLS session to Firebase, and only the gateway knows the API key:
+//
+//   HTTP  Point the camera's database URL (fb_db_url in NVS) at
+//         http://<gateway>:8080 and its API key at the gateway's LAN token.
+//         firebase_upload_image_with_metadata() then PUTs images/<ts>.json
+//         here unchanged. PUTs are queued and answered right away; GET,
+//         DELETE, PATCH and POST are proxied upstream and answered when
+//         Firebase answers.
+//   MQTT  Point MQTT_BROKER_URI at mqtt://<gateway>:1883. The meta and jpeg
+//         messages uploader_mqtt.c publishes for a frame are joined into the
+//         record firebase_upload_image_with_metadata() would have written.
+//
+// Queued records are deduplicated and batched. A retried upload with the same
+// path and body is answered but not forwarded again. Records for the same
+// parent path go upstream as one PATCH, e.g. PATCH images.json with
+// {"<ts1>": {...}, "<ts2>": {...}}. A batch is sent once it reaches -b bytes
+// or -n records, or -w ms after its first record.
+//
+// Upstream transfers run on libcurl's multi interface in the same epoll loop
+// as the LAN sockets. At most -c of them are in flight, over connections
+// libcurl keeps alive (and multiplexes on HTTP/2). Failed batches are retried
+// with backoff; 4xx answers other than 429 are dropped.
+//
+// Memory is bounded. Queued and in-flight batches may hold at most -q MB;
+// beyond that, PUTs get 503 and cameras retry or spool. A request body may be
+// at most -f bytes and at most -M LAN connections are served, so the worst
+// case is about q + M * f.
+//
+// Build from the repository root:
+//   gcc -O2 -Wall -o lan_gateway tools/lan_gateway.c -lcurl
+//   ./lan_gateway -u https://<project>-default-rtdb.firebaseio.com -k <api key> -t <lan token>
+//       [-p 8080] [-m 1883] [-c 4] [-b bytes] [-n records] [-w ms] [-q MB] [-f bytes] [-M conns] [-s stats_s]
+//
+// Load test with the fleet simulator and its stand-in as the upstream:
+//   python3 tools/fleet_sim.py --serve 9000 &
+//   ./lan_gateway -u http://127.0.0.1:9000 -k sim-key -t sim-key &
+//   python3 tools/fleet_sim.py --devices 1000 --backend http://127.0.0.1:8080
+
+#define _GNU_SOURCE
+#include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 256
+#define READ_CHUNK (64 * 1024)
+#define MAX_HEADER_BYTES (16 * 1024)
+#define MAX_PATH_LEN 256
+#define MAX_OPEN_BATCHES 32
+#define DEDUP_SETS 16384            // Four recent uploads remembered per set, power of two
+#define MQTT_PENDING 256            // Frames waiting for their other half
+#define MAX_ATTEMPTS 5
+#define RETRY_BASE_MS 500
+#define RESPONSE_CAP (64 * 1024)    // Upstream answer bytes kept for proxying
+#define UPSTREAM_TIMEOUT_MS 30000
+
+enum { W_LISTEN_HTTP, W_LISTEN_MQTT, W_CONN, W_CURL };
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+} buf_t;
+
+typedef struct {
+    char upstream[256];
+    char api_key[160];
+    char lan_token[160];
+    int http_port;
+    int mqtt_port;
+    int max_inflight;
+    size_t batch_bytes;
+    int batch_records;
+    int batch_wait_ms;
+    size_t queue_limit;
+    size_t max_frame;
+    int max_conns;
+    int stats_s;
+} options_t;
+
+typedef struct batch {
+    struct batch *next;
+    char parent[MAX_PATH_LEN];
+    buf_t body;                     // "{" "child":record ... "}"
+    int records;
+    uint64_t keys[64];              // Child hashes, to keep a key from appearing twice
+    int64_t opened_ms;
+    int64_t retry_at_ms;
+    int attempts;
+} batch_t;
+
+typedef struct conn {
+    int kind;                       // W_CONN, first so epoll data can be told apart
+    int fd;
+    bool mqtt;
+    bool closing;                   // Close once out is written
+    bool waiting;                   // A proxied request is upstream
+    uint32_t gen;
+    buf_t in, out;
+    struct conn *next_free;
+} conn_t;
+
+typedef struct {
+    int kind;                       // W_CURL
+    curl_socket_t fd;
+    bool added;
+} curl_watch_t;
+
+typedef struct {
+    CURL *easy;
+    struct curl_slist *headers;
+    batch_t *batch;                 // Batched PATCH, or NULL when proxying
+    conn_t *conn;                   // Proxy: answer goes here if conn->gen still matches
+    uint32_t gen;
+    buf_t request;                  // Proxy body
+    buf_t response;
+} transfer_t;
+
+typedef struct {
+    char key[MAX_PATH_LEN];         // <client>/<timestamp>
+    char *meta;
+    size_t meta_len;
+    char *jpeg;
+    size_t jpeg_len;
+    int64_t created_ms;
+} mqtt_pending_t;
+
+typedef struct {
+    uint64_t frames_in, duplicates, rejected_full, bad_requests, proxied;
+    uint64_t batches_sent, records_sent, bytes_sent, batch_failures, batches_dropped, records_dropped;
+    uint64_t mqtt_frames;
+} stats_t;
+
+static options_t opt = {
+    .http_port = 8080,
+    .mqtt_port = 1883,
+    .max_inflight = 4,
+    .batch_bytes = 4 * 1024 * 1024,
+    .batch_records = 64,
+    .batch_wait_ms = 200,
+    .queue_limit = 64 * 1024 * 1024,
+    .max_frame = 1024 * 1024,
+    .max_conns = 1024,
+    .stats_s = 10,
+};
+
+static int ep;
+static CURLM *multi;
+static int64_t curl_deadline_ms = -1;
+static volatile sig_atomic_t stopping;
+static stats_t stats, last_stats;
+static size_t queued_bytes;         // Bodies of open, queued, retrying and in-flight batches
+static int inflight;
+static int conn_count;
+static uint32_t next_gen = 1;
+static conn_t *free_conns;
+
+static batch_t *open_batches[MAX_OPEN_BATCHES];
+static int open_count;
+static batch_t *send_head, *send_tail;
+
+static uint64_t dedup[DEDUP_SETS][4];
+
+static mqtt_pending_t mqtt_pending[MQTT_PENDING];
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void log_msg(const char *fmt, ...) {
+    char when[32];
+    time_t t = time(NULL);
+    strftime(when, sizeof(when), "%H:%M:%S", localtime(&t));
+    fprintf(stderr, "%s ", when);
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+static bool buf_reserve(buf_t *b, size_t extra) {
+    if (b->len + extra <= b->cap) {
+        return true;
+    }
+    size_t cap = b->cap ? b->cap : 1024;
+    while (cap < b->len + extra) {
+        cap *= 2;
+    }
+    char *data = realloc(b->data, cap);
+    if (data == NULL) {
+        return false;
+    }
+    b->data = data;
+    b->cap = cap;
+    return true;
+}
+
+static bool buf_append(buf_t *b, const void *data, size_t len) {
+    if (!buf_reserve(b, len)) {
+        return false;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return true;
+}
+
+static void buf_consume(buf_t *b, size_t n) {
+    memmove(b->data, b->data + n, b->len - n);
+    b->len -= n;
+}
+
+static void buf_free(buf_t *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// ---------------------------------------------------------------------------
+// Deduplication: a 4-way set-associative table of recent upload hashes, where
+// each set forgets its oldest entry
+
+static bool dedup_seen(uint64_t h) {
+    h |= 1;                         // 0 marks an empty way
+    uint64_t *set = dedup[(h >> 32) & (DEDUP_SETS - 1)];
+    for (int i = 0; i < 4; i++) {
+        if (set[i] == h) {
+            return true;
+        }
+    }
+    memmove(set + 1, set, 3 * sizeof(*set));
+    set[0] = h;
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// JSON helpers. A malformed record would make Firebase reject the whole batch,
+// so every record is validated before it joins one.
+
+static const char *json_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static const char *json_value(const char *p, const char *end, int depth);
+
+static const char *json_string(const char *p, const char *end) {
+    if (p >= end || *p != '"') {
+        return NULL;
+    }
+    for (p++; p < end; p++) {
+        if (*p == '"') {
+            return p + 1;
+        }
+        if (*p == '\\') {
+            if (++p >= end) {
+                return NULL;
+            }
+        } else if ((unsigned char)*p < 0x20) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static const char *json_container(const char *p, const char *end, int depth, char close, bool object) {
+    p = json_ws(p + 1, end);
+    if (p < end && *p == close) {
+        return p + 1;
+    }
+    while (p < end) {
+        if (object) {
+            p = json_string(p, end);
+            if (p == NULL || (p = json_ws(p, end)) >= end || *p != ':') {
+                return NULL;
+            }
+            p = json_ws(p + 1, end);
+        }
+        p = json_value(p, end, depth + 1);
+        if (p == NULL || (p = json_ws(p, end)) >= end) {
+            return NULL;
+        }
+        if (*p == close) {
+            return p + 1;
+        }
+        if (*p != ',') {
+            return NULL;
+        }
+        p = json_ws(p + 1, end);
+    }
+    return NULL;
+}
+
+static const char *json_value(const char *p, const char *end, int depth) {
+    if (p >= end || depth > 32) {
+        return NULL;
+    }
+    switch (*p) {
+    case '{':
+        return json_container(p, end, depth, '}', true);
+    case '[':
+        return json_container(p, end, depth, ']', false);
+    case '"':
+        return json_string(p, end);
+    default:
+        break;
+    }
+    static const char *const words[] = {"true", "false", "null"};
+    for (size_t i = 0; i < 3; i++) {
+        size_t n = strlen(words[i]);
+        if ((size_t)(end - p) >= n && memcmp(p, words[i], n) == 0) {
+            return p + n;
+        }
+    }
+    const char *start = p;
+    while (p < end && strchr("+-0123456789.eE", *p) != NULL) {
+        p++;
+    }
+    return p > start ? p : NULL;
+}
+
+static bool json_valid(const char *data, size_t len) {
+    const char *end = data + len;
+    const char *p = json_value(json_ws(data, end), end, 0);
+    return p != NULL && json_ws(p, end) == end;
+}
+
+// Find member name of the top-level object in a valid document; sets *value to its
+// raw JSON text, quotes included for strings
+static bool json_member(const char *data, size_t len, const char *name, const char **value, size_t *value_len) {
+    const char *end = data + len;
+    const char *p = json_ws(data, end);
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    size_t name_len = strlen(name);
+    for (p = json_ws(p + 1, end); p < end && *p == '"'; p = json_ws(p + 1, end)) {
+        const char *key = p + 1;
+        p = json_string(p, end);
+        bool match = (size_t)(p - 1 - key) == name_len && memcmp(key, name, name_len) == 0;
+        p = json_ws(json_ws(p, end) + 1, end);      // Past the ':'
+        const char *v = p;
+        p = json_value(p, end, 1);
+        if (match) {
+            *value = v;
+            *value_len = (size_t)(p - v);
+            return true;
+        }
+        p = json_ws(p, end);
+        if (*p != ',') {
+            break;
+        }
+    }
+    return false;
+}
+
+static bool json_append_escaped(buf_t *b, const char *s, size_t len) {
+    if (!buf_reserve(b, len * 6 + 2)) {
+        return false;
+    }
+    b->data[b->len++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            b->data[b->len++] = '\\';
+            b->data[b->len++] = (char)c;
+        } else if (c < 0x20) {
+            b->len += (size_t)sprintf(b->data + b->len, "\\u%04x", c);
+        } else {
+            b->data[b->len++] = (char)c;
+        }
+    }
+    b->data[b->len++] = '"';
+    return true;
+}
+
+// Realtime Database keys may not contain . $ # [ ] / or control characters
+static bool rtdb_key_ok(const char *key) {
+    if (*key == '\0') {
+        return false;
+    }
+    for (const char *p = key; *p; p++) {
+        if ((unsigned char)*p < 0x20 || strchr(".$#[]/\"\\%", *p) != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Batches
+
+static void send_queue_push(batch_t *b) {
+    b->next = NULL;
+    if (send_tail != NULL) {
+        send_tail->next = b;
+    } else {
+        send_head = b;
+    }
+    send_tail = b;
+}
+
+static void batch_free(batch_t *b) {
+    queued_bytes -= b->body.cap;
+    buf_free(&b->body);
+    free(b);
+}
+
+static void batch_close(int index) {
+    batch_t *b = open_batches[index];
+    open_batches[index] = open_batches[--open_count];
+    b->body.data[b->body.len - 1] = '}';    // Replaces the trailing comma
+    send_queue_push(b);
+}
+
+// Queue one record under parent/child; false when the memory budget is spent
+static bool batch_add(const char *parent, const char *child, const char *record, size_t record_len) {
+    size_t need = strlen(child) + record_len + 8;
+    if (queued_bytes + need > opt.queue_limit) {
+        return false;
+    }
+
+    uint64_t key = fnv1a(0xcbf29ce484222325ULL, child, strlen(child));
+    batch_t *b = NULL;
+    for (int i = 0; i < open_count; i++) {
+        if (strcmp(open_batches[i]->parent, parent) != 0) {
+            continue;
+        }
+        b = open_batches[i];
+        bool repeated = false;
+        for (int k = 0; k < b->records; k++) {
+            repeated |= b->keys[k] == key;
+        }
+        // A key already in the batch ends it, so the later write still wins upstream
+        if (repeated || b->body.len + need > opt.batch_bytes || b->records == opt.batch_records) {
+            batch_close(i);
+            b = NULL;
+        }
+        break;
+    }
+
+    if (b == NULL) {
+        if (open_count == MAX_OPEN_BATCHES) {
+            int oldest = 0;
+            for (int i = 1; i < open_count; i++) {
+                if (open_batches[i]->opened_ms < open_batches[oldest]->opened_ms) {
+                    oldest = i;
+                }
+            }
+            batch_close(oldest);
+        }
+        b = calloc(1, sizeof(*b));
+        if (b == NULL) {
+            return false;
+        }
+        snprintf(b->parent, sizeof(b->parent), "%s", parent);
+        b->opened_ms = now_ms();
+        buf_append(&b->body, "{", 1);
+        queued_bytes += b->body.cap;
+        open_batches[open_count++] = b;
+    }
+
+    size_t before = b->body.cap;
+    bool ok = json_append_escaped(&b->body, child, strlen(child)) && buf_append(&b->body, ":", 1) &&
+              buf_append(&b->body, record, record_len) && buf_append(&b->body, ",", 1);
+    queued_bytes += b->body.cap - before;
+    if (!ok) {
+        return false;
+    }
+    b->keys[b->records++] = key;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Upstream transfers
+
+static size_t on_upstream_data(char *data, size_t size, size_t nmemb, void *arg) {
+    transfer_t *t = arg;
+    size_t n = size * nmemb;
+    if (t->response.len < RESPONSE_CAP) {
+        size_t keep = n < RESPONSE_CAP - t->response.len ? n : RESPONSE_CAP - t->response.len;
+        buf_append(&t->response, data, keep);
+    }
+    return n;
+}
+
+static transfer_t *transfer_start(const char *method, const char *path, const char *query, const char *body,
+                                  size_t body_len) {
+    transfer_t *t = calloc(1, sizeof(*t));
+    if (t == NULL || (t->easy = curl_easy_init()) == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    char url[1024];
+    snprintf(url, sizeof(url), "%s/%s.json?auth=%s%s%s", opt.upstream, path, opt.api_key,
+             query && *query ? "&" : "", query ? query : "");
+    t->headers = curl_slist_append(NULL, "Content-Type: application/json");
+    t->headers = curl_slist_append(t->headers, "Expect:");
+    curl_easy_setopt(t->easy, CURLOPT_URL, url);
+    curl_easy_setopt(t->easy, CURLOPT_CUSTOMREQUEST, method);
+    curl_easy_setopt(t->easy, CURLOPT_HTTPHEADER, t->headers);
+    if (body != NULL) {
+        curl_easy_setopt(t->easy, CURLOPT_POSTFIELDS, body);
+        curl_easy_setopt(t->easy, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body_len);
+    } else if (strcmp(method, "GET") == 0) {
+        curl_easy_setopt(t->easy, CURLOPT_HTTPGET, 1L);
+    }
+    curl_easy_setopt(t->easy, CURLOPT_WRITEFUNCTION, on_upstream_data);
+    curl_easy_setopt(t->easy, CURLOPT_WRITEDATA, t);
+    curl_easy_setopt(t->easy, CURLOPT_PRIVATE, t);
+    curl_easy_setopt(t->easy, CURLOPT_TIMEOUT_MS, (long)UPSTREAM_TIMEOUT_MS);
+    curl_easy_setopt(t->easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(t->easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(t->easy, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(t->easy, CURLOPT_NOSIGNAL, 1L);
+    curl_multi_add_handle(multi, t->easy);
+    inflight++;
+    return t;
+}
+
+static void dispatch_batches(void) {
+    int64_t now = now_ms();
+    batch_t **link = &send_head;
+    batch_t *prev = NULL;
+    while (*link != NULL && inflight < opt.max_inflight) {
+        batch_t *b = *link;
+        if (b->retry_at_ms > now) {
+            prev = b;
+            link = &b->next;
+            continue;
+        }
+        *link = b->next;
+        if (send_tail == b) {
+            send_tail = prev;
+        }
+        transfer_t *t = transfer_start("PATCH", b->parent, NULL, b->body.data, b->body.len);
+        if (t == NULL) {
+            b->retry_at_ms = now + RETRY_BASE_MS;
+            send_queue_push(b);
+            return;
+        }
+        t->batch = b;
+        b->attempts++;
+    }
+}
+
+static void conn_send(conn_t *c, const char *data, size_t len);
+static void on_conn_event(conn_t *c, uint32_t events);
+
+static void http_respond(conn_t *c, int status, const char *body, size_t body_len) {
+    const char *reason = status == 200   ? "OK"
+                         : status == 400 ? "Bad Request"
+                         : status == 401 ? "Unauthorized"
+                         : status == 411 ? "Length Required"
+                         : status == 404 ? "Not Found"
+                         : status == 413 ? "Payload Too Large"
+                         : status == 429 ? "Too Many Requests"
+                         : status == 502 ? "Bad Gateway"
+                         : status == 503 ? "Service Unavailable"
+                                         : "Error";
+    char head[256];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\nContent-Type: application/json; charset=utf-8\r\n"
+                     "Content-Length: %zu\r\n%s\r\n",
+                     status, reason, body_len, c->closing ? "Connection: close\r\n" : "");
+    conn_send(c, head, (size_t)n);
+    conn_send(c, body, body_len);
+}
+
+static void transfer_done(CURL *easy, CURLcode result) {
+    transfer_t *t = NULL;
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&t);
+    long status = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+    curl_multi_remove_handle(multi, easy);
+    curl_easy_cleanup(easy);
+    curl_slist_free_all(t->headers);
+    inflight--;
+
+    batch_t *b = t->batch;
+    if (b != NULL) {
+        bool ok = result == CURLE_OK && status >= 200 && status < 300;
+        bool permanent = result == CURLE_OK && status >= 400 && status < 500 && status != 429;
+        if (ok) {
+            stats.batches_sent++;
+            stats.records_sent += (uint64_t)b->records;
+            stats.bytes_sent += b->body.len;
+            batch_free(b);
+        } else if (permanent || b->attempts >= MAX_ATTEMPTS) {
+            log_msg("PATCH %s with %d records dropped: %s, status %ld: %.*s", b->parent, b->records,
+                    curl_easy_strerror(result), status, (int)(t->response.len < 200 ? t->response.len : 200),
+                    t->response.data ? t->response.data : "");
+            stats.batches_dropped++;
+            stats.records_dropped += (uint64_t)b->records;
+            batch_free(b);
+        } else {
+            stats.batch_failures++;
+            b->retry_at_ms = now_ms() + ((int64_t)RETRY_BASE_MS << (b->attempts - 1));
+            send_queue_push(b);
+        }
+    } else if (t->conn->gen == t->gen) {
+        conn_t *c = t->conn;
+        c->waiting = false;
+        if (result != CURLE_OK) {
+            static const char msg[] = "{\"error\":\"upstream unreachable\"}";
+            http_respond(c, 502, msg, sizeof(msg) - 1);
+        } else {
+            http_respond(c, (int)status, t->response.data ? t->response.data : "", t->response.len);
+        }
+        on_conn_event(c, 0);
+    }
+    buf_free(&t->request);
+    buf_free(&t->response);
+    free(t);
+}
+
+static int on_curl_socket(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp) {
+    (void)easy, (void)userp;
+    curl_watch_t *w = socketp;
+    if (what == CURL_POLL_REMOVE) {
+        if (w != NULL) {
+            epoll_ctl(ep, EPOLL_CTL_DEL, fd, NULL);
+            curl_multi_assign(multi, fd, NULL);
+            free(w);
+        }
+        return 0;
+    }
+    if (w == NULL) {
+        w = calloc(1, sizeof(*w));
+        if (w == NULL) {
+            return -1;
+        }
+        w->kind = W_CURL;
+        w->fd = fd;
+        curl_multi_assign(multi, fd, w);
+    }
+    struct epoll_event ev = {
+        .events = (what & CURL_POLL_IN ? EPOLLIN : 0) | (what & CURL_POLL_OUT ? EPOLLOUT : 0),
+        .data.ptr = w,
+    };
+    epoll_ctl(ep, w->added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    w->added = true;
+    return 0;
+}
+
+static int on_curl_timer(CURLM *m, long timeout_ms, void *userp) {
+    (void)m, (void)userp;
+    curl_deadline_ms = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+    return 0;
+}
+
+static void curl_drive(curl_socket_t fd, int events) {
+    int running;
+    curl_multi_socket_action(multi, fd, events, &running);
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+        if (msg->msg == CURLMSG_DONE) {
+            transfer_done(msg->easy_handle, msg->data.result);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// LAN connections
+
+static void conn_update_events(conn_t *c) {
+    struct epoll_event ev = {
+        .events = (c->waiting ? 0 : EPOLLIN | EPOLLRDHUP) | (c->out.len ? EPOLLOUT : 0),
+        .data.ptr = c,
+    };
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void conn_close(conn_t *c) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->gen = 0;                     // Orphans a proxied request still upstream
+    buf_free(&c->in);
+    buf_free(&c->out);
+    c->next_free = free_conns;
+    free_conns = c;
+    conn_count--;
+}
+
+static void conn_send(conn_t *c, const char *data, size_t len) {
+    if (c->out.len == 0) {
+        ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL);
+        if (n > 0) {
+            data += n;
+            len -= (size_t)n;
+        }
+    }
+    if (len > 0) {
+        buf_append(&c->out, data, len);
+    }
+}
+
+static void http_error(conn_t *c, int status, const char *message) {
+    char body[160];
+    int n = snprintf(body, sizeof(body), "{\"error\":\"%s\"}", message);
+    c->closing = c->closing || status == 400 || status == 411 || status == 413;
+    http_respond(c, status, body, (size_t)n);
+}
+
+static const char *header_value(const char *headers, const char *name, char *out, size_t max) {
+    size_t name_len = strlen(name);
+    for (const char *line = strstr(headers, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        const char *p = line + 2;
+        if (strncasecmp(p, name, name_len) == 0 && p[name_len] == ':') {
+            p += name_len + 1;
+            while (*p == ' ' || *p == '\t') {
+                p++;
+            }
+            size_t n = strcspn(p, "\r\n");
+            n = n < max - 1 ? n : max - 1;
+            memcpy(out, p, n);
+            out[n] = '\0';
+            return out;
+        }
+    }
+    return NULL;
+}
+
+static void handle_http_request(conn_t *c, const char *method, char *target, const char *body, size_t body_len) {
+    char *query = strchr(target, '?');
+    if (query != NULL) {
+        *query++ = '\0';
+    }
+
+    // ?auth=<LAN token>, any other query parameters are passed upstream
+    char rest[512] = "";
+    bool authorized = opt.lan_token[0] == '\0';
+    for (char *param = query ? strtok(query, "&") : NULL; param != NULL; param = strtok(NULL, "&")) {
+        if (strncmp(param, "auth=", 5) == 0) {
+            authorized = strcmp(param + 5, opt.lan_token) == 0 || authorized;
+        } else if (strlen(rest) + strlen(param) + 2 < sizeof(rest)) {
+            if (rest[0]) {
+                strcat(rest, "&");
+            }
+            strcat(rest, param);
+        }
+    }
+    if (!authorized) {
+        http_error(c, 401, "Permission denied");
+        return;
+    }
+
+    size_t path_len = strlen(target);
+    if (target[0] != '/' || path_len < 6 || path_len > MAX_PATH_LEN || strcmp(target + path_len - 5, ".json") != 0) {
+        http_error(c, 400, "path must end in .json");
+        return;
+    }
+    target[path_len - 5] = '\0';
+    char *path = target + 1;
+
+    char *slash = strrchr(path, '/');
+    if (strcmp(method, "PUT") == 0 && slash != NULL && rtdb_key_ok(slash + 1) && rest[0] == '\0') {
+        stats.frames_in++;
+        if (!json_valid(body, body_len)) {
+            stats.bad_requests++;
+            http_error(c, 400, "Invalid data; couldn't parse JSON object");
+            return;
+        }
+        uint64_t h = fnv1a(fnv1a(0xcbf29ce484222325ULL, path, strlen(path)), body, body_len);
+        if (dedup_seen(h)) {
+            stats.duplicates++;
+            http_respond(c, 200, "null", 4);
+            return;
+        }
+        *slash = '\0';
+        if (!batch_add(path, slash + 1, body, body_len)) {
+            stats.rejected_full++;
+            http_error(c, 503, "gateway queue full");
+            return;
+        }
+        http_respond(c, 200, "null", 4);
+        return;
+    }
+
+    // Everything else goes upstream as is and is answered when Firebase answers
+    // libcurl reads the body in place, so it must outlive the input buffer
+    buf_t copy = {0};
+    if (body_len > 0 && !buf_append(&copy, body, body_len)) {
+        http_error(c, 503, "gateway busy");
+        return;
+    }
+    transfer_t *t = transfer_start(method, path, rest, copy.data, copy.len);
+    if (t == NULL) {
+        buf_free(&copy);
+        http_error(c, 503, "gateway busy");
+        return;
+    }
+    t->request = copy;
+    stats.proxied++;
+    t->conn = c;
+    t->gen = c->gen;
+    c->waiting = true;
+}
+
+// Parse complete requests from c->in; returns false when the connection should close
+static bool process_http(conn_t *c) {
+    while (!c->waiting && c->in.len > 0) {
+        buf_reserve(&c->in, 1);
+        c->in.data[c->in.len] = '\0';
+        char *end = strstr(c->in.data, "\r\n\r\n");
+        if (end == NULL) {
+            if (c->in.len > MAX_HEADER_BYTES) {
+                http_error(c, 400, "headers too large");
+            }
+            return c->in.len <= MAX_HEADER_BYTES;
+        }
+        size_t head_len = (size_t)(end - c->in.data) + 4;
+        end[2] = '\0';
+
+        char method[16], target[1024], version[16];
+        if (sscanf(c->in.data, "%15s %1023s %15s", method, target, version) != 3 || strncmp(version, "HTTP/1.", 7) != 0) {
+            http_error(c, 400, "malformed request line");
+            return true;
+        }
+        char value[64];
+        if (header_value(c->in.data, "Transfer-Encoding", value, sizeof(value)) != NULL) {
+            http_error(c, 411, "chunked bodies are not supported");
+            return true;
+        }
+        size_t body_len = 0;
+        if (header_value(c->in.data, "Content-Length", value, sizeof(value)) != NULL) {
+            body_len = strtoull(value, NULL, 10);
+        }
+        if (body_len > opt.max_frame) {
+            http_error(c, 413, "request body too large");
+            return true;
+        }
+        if ((header_value(c->in.data, "Connection", value, sizeof(value)) != NULL && strcasecmp(value, "close") == 0) ||
+            strcmp(version, "HTTP/1.0") == 0) {
+            c->closing = true;
+        }
+        if (c->in.len < head_len + body_len) {
+            if (header_value(c->in.data, "Expect", value, sizeof(value)) != NULL && c->in.len == head_len) {
+                conn_send(c, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+            }
+            end[2] = '\r';
+            return true;
+        }
+
+        handle_http_request(c, method, target, c->in.data + head_len, body_len);
+        buf_consume(&c->in, head_len + body_len);
+        if (c->closing) {
+            break;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// MQTT: enough of 3.1.1 for esp-mqtt publishing at QoS 0 and 1
+
+static void mqtt_pending_clear(mqtt_pending_t *p) {
+    queued_bytes -= p->meta_len + p->jpeg_len;
+    free(p->meta);
+    free(p->jpeg);
+    memset(p, 0, sizeof(*p));
+}
+
+static void base64_append(buf_t *b, const uint8_t *data, size_t len) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (!buf_reserve(b, (len + 2) / 3 * 4)) {
+        return;
+    }
+    char *out = b->data + b->len;
+    size_t i = 0;
+    for (; i + 2 < len; i += 3) {
+        uint32_t v = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+        *out++ = alphabet[v >> 18];
+        *out++ = alphabet[(v >> 12) & 63];
+        *out++ = alphabet[(v >> 6) & 63];
+        *out++ = alphabet[v & 63];
+    }
+    if (i < len) {
+        uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < len ? (uint32_t)data[i + 1] << 8 : 0);
+        *out++ = alphabet[v >> 18];
+        *out++ = alphabet[(v >> 12) & 63];
+        *out++ = i + 1 < len ? alphabet[(v >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+    b->len = (size_t)(out - b->data);
+}
+
+// Build {"image","timestamp","metadata"} the way firebase_upload_image_with_metadata() does
+static bool mqtt_complete(mqtt_pending_t *p, const char *timestamp) {
+    // The meta message is {"timestamp":"...","size":N,"metadata":"..."}. Its metadata is
+    // already an escaped JSON string, so it goes into the record as it is.
+    const char *meta = NULL, *size = NULL;
+    size_t meta_len = 0, size_len = 0;
+    if (!json_valid(p->meta, p->meta_len)) {
+        log_msg("mqtt: meta for %s is not valid JSON, forwarding the image without it", timestamp);
+        stats.bad_requests++;
+    } else {
+        if (json_member(p->meta, p->meta_len, "size", &size, &size_len) &&
+            strtoull(size, NULL, 10) != (unsigned long long)p->jpeg_len) {
+            // The halves come from different publishes of this key; drop both rather than mix them
+            log_msg("mqtt: meta for %s announces %.*s bytes, jpeg has %zu", timestamp, (int)size_len, size, p->jpeg_len);
+            stats.bad_requests++;
+            mqtt_pending_clear(p);
+            return true;
+        }
+        if (!json_member(p->meta, p->meta_len, "metadata", &meta, &meta_len) || *meta != '"' || meta_len <= 2) {
+            meta = NULL;            // Absent, empty or not a string: the RTDB record leaves it out too
+        }
+    }
+
+    buf_t record = {0};
+    bool ok = buf_append(&record, "{\"image\":\"", 10);
+    base64_append(&record, (const uint8_t *)p->jpeg, p->jpeg_len);
+    ok = ok && buf_append(&record, "\",\"timestamp\":", 14) && json_append_escaped(&record, timestamp, strlen(timestamp));
+    if (ok && meta != NULL) {
+        ok = buf_append(&record, ",\"metadata\":", 12) && buf_append(&record, meta, meta_len);
+    }
+    ok = ok && buf_append(&record, "}", 1);
+
+    if (ok) {
+        char path[MAX_PATH_LEN + 8];
+        snprintf(path, sizeof(path), "images/%s", timestamp);
+        uint64_t h = fnv1a(fnv1a(0xcbf29ce484222325ULL, path, strlen(path)), record.data, record.len);
+        stats.mqtt_frames++;
+        stats.frames_in++;
+        if (dedup_seen(h)) {
+            stats.duplicates++;
+        } else if (!batch_add("images", timestamp, record.data, record.len)) {
+            stats.rejected_full++;
+            ok = false;
+        }
+    }
+    buf_free(&record);
+    mqtt_pending_clear(p);
+    return ok;
+}
+
+// <prefix>/<client>/<timestamp>/{meta,jpeg}
+static bool mqtt_publish(const char *topic, const char *payload, size_t len) {
+    const char *kind = strrchr(topic, '/');
+    if (kind == NULL || (strcmp(kind, "/meta") != 0 && strcmp(kind, "/jpeg") != 0)) {
+        return true;                // Not a camera frame; accepted and ignored
+    }
+    const char *ts_start = kind;
+    while (ts_start > topic && ts_start[-1] != '/') {
+        ts_start--;
+    }
+    char timestamp[64];
+    size_t ts_len = (size_t)(kind - ts_start);
+    if (ts_len == 0 || ts_len >= sizeof(timestamp)) {
+        return true;
+    }
+    memcpy(timestamp, ts_start, ts_len);
+    timestamp[ts_len] = '\0';
+    if (!rtdb_key_ok(timestamp)) {
+        return true;
+    }
+    char key[MAX_PATH_LEN];
+    snprintf(key, sizeof(key), "%.*s", (int)(kind - topic), topic);
+
+    // Leave room for the base64 record the pair turns into
+    bool is_meta = strcmp(kind, "/meta") == 0;
+    if (queued_bytes + len * 2 > opt.queue_limit) {
+        stats.rejected_full++;
+        return false;
+    }
+    mqtt_pending_t *slot = NULL, *oldest = &mqtt_pending[0];
+    for (int i = 0; i < MQTT_PENDING && slot == NULL; i++) {
+        mqtt_pending_t *p = &mqtt_pending[i];
+        if (p->key[0] != '\0' && strcmp(p->key, key) == 0) {
+            slot = p;
+        } else if (p->created_ms < oldest->created_ms) {
+            oldest = p;
+        }
+    }
+    if (slot == NULL) {
+        for (int i = 0; i < MQTT_PENDING && slot == NULL; i++) {
+            slot = mqtt_pending[i].key[0] == '\0' ? &mqtt_pending[i] : NULL;
+        }
+        if (slot == NULL) {
+            mqtt_pending_clear(oldest);     // The other half never came
+            slot = oldest;
+        }
+        snprintf(slot->key, sizeof(slot->key), "%s", key);
+        slot->created_ms = now_ms();
+    }
+
+    char **dst = is_meta ? &slot->meta : &slot->jpeg;
+    size_t *dst_len = is_meta ? &slot->meta_len : &slot->jpeg_len;
+    queued_bytes -= *dst_len;
+    free(*dst);
+    *dst = malloc(len ? len : 1);
+    *dst_len = *dst ? len : 0;
+    if (*dst != NULL) {
+        memcpy(*dst, payload, len);
+    }
+    queued_bytes += *dst_len;
+    return slot->meta == NULL || slot->jpeg == NULL || mqtt_complete(slot, timestamp);
+}
+
+static bool process_mqtt(conn_t *c) {
+    while (c->in.len >= 2) {
+        const uint8_t *p = (const uint8_t *)c->in.data;
+        size_t remaining = 0, header = 1;
+        int shift = 0;
+        do {
+            if (header >= c->in.len) {
+                return true;
+            }
+            remaining |= (size_t)(p[header] & 0x7F) << shift;
+            shift += 7;
+        } while ((p[header++] & 0x80) && shift < 28);
+        if (remaining > opt.max_frame + 1024) {
+            return false;
+        }
+        if (c->in.len < header + remaining) {
+            return true;
+        }
+
+        const uint8_t *body = p + header;
+        switch (p[0] >> 4) {
+        case 1:                     // CONNECT
+            conn_send(c, "\x20\x02\x00\x00", 4);
+            break;
+        case 3: {                   // PUBLISH
+            int qos = (p[0] >> 1) & 3;
+            if (qos == 2 || remaining < 2) {
+                return false;
+            }
+            size_t topic_len = ((size_t)body[0] << 8) | body[1];
+            size_t offset = 2 + topic_len + (qos ? 2 : 0);
+            if (offset > remaining || topic_len >= MAX_PATH_LEN) {
+                return false;
+            }
+            char topic[MAX_PATH_LEN];
+            memcpy(topic, body + 2, topic_len);
+            topic[topic_len] = '\0';
+            bool accepted = mqtt_publish(topic, (const char *)body + offset, remaining - offset);
+            // Without a PUBACK esp-mqtt keeps the message in its outbox and resends it
+            if (qos == 1 && accepted) {
+                char ack[4] = {0x40, 0x02, (char)body[2 + topic_len], (char)body[3 + topic_len]};
+                conn_send(c, ack, 4);
+            }
+            break;
+        }
+        case 8: {                   // SUBSCRIBE: refuse every filter
+            char ack[64] = {(char)0x90, 0, (char)body[0], (char)body[1]};
+            size_t n = 4;
+            for (size_t i = 2; i + 2 < remaining && n < sizeof(ack); ) {
+                i += 2 + (((size_t)body[i] << 8) | body[i + 1]) + 1;
+                ack[n++] = (char)0x80;
+            }
+            ack[1] = (char)(n - 2);
+            conn_send(c, ack, n);
+            break;
+        }
+        case 12:                    // PINGREQ
+            conn_send(c, "\xD0\x00", 2);
+            break;
+        case 14:                    // DISCONNECT
+            return false;
+        default:
+            break;
+        }
+        buf_consume(&c->in, header + remaining);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Event loop
+
+static int listen_on(int port, int kind, void *tag) {
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1, zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    struct sockaddr_in6 addr = {.sin6_family = AF_INET6, .sin6_port = htons((uint16_t)port), .sin6_addr = in6addr_any};
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4096) != 0) {
+        log_msg("Cannot listen on port %d: %s", port, strerror(errno));
+        exit(1);
+    }
+    *(int *)tag = kind;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = tag};
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    return fd;
+}
+
+static void accept_all(int lfd, bool mqtt) {
+    while (true) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (conn_count >= opt.max_conns || stopping) {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        conn_t *c = free_conns;
+        if (c != NULL) {
+            free_conns = c->next_free;
+            memset(c, 0, sizeof(*c));
+        } else if ((c = calloc(1, sizeof(*c))) == NULL) {
+            close(fd);
+            continue;
+        }
+        c->kind = W_CONN;
+        c->fd = fd;
+        c->mqtt = mqtt;
+        c->gen = next_gen++;
+        next_gen += next_gen == 0;  // 0 is the closed connection's generation
+        conn_count++;
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void on_conn_event(conn_t *c, uint32_t events) {
+    if (events & EPOLLOUT && c->out.len > 0) {
+        ssize_t n = send(c->fd, c->out.data, c->out.len, MSG_NOSIGNAL);
+        if (n > 0) {
+            buf_consume(&c->out, (size_t)n);
+        } else if (n < 0 && errno != EAGAIN) {
+            conn_close(c);
+            return;
+        }
+    }
+    bool keep = !(events & (EPOLLHUP | EPOLLERR));
+    if (keep && events & (EPOLLIN | EPOLLRDHUP) && !c->waiting) {
+        bool eof = false;
+        while (c->in.len < opt.max_frame + MAX_HEADER_BYTES) {
+            if (!buf_reserve(&c->in, READ_CHUNK + 1)) {
+                break;
+            }
+            ssize_t n = recv(c->fd, c->in.data + c->in.len, READ_CHUNK, 0);
+            if (n > 0) {
+                c->in.len += (size_t)n;
+                continue;
+            }
+            eof = n == 0 || errno != EAGAIN;
+            break;
+        }
+        keep = c->mqtt ? process_mqtt(c) : process_http(c);
+        keep = keep && !eof;
+    } else if (keep && events == 0) {
+        keep = process_http(c);     // Requests that arrived behind a proxied one
+    }
+    if (!keep || (c->closing && c->out.len == 0 && !c->waiting)) {
+        conn_close(c);
+        return;
+    }
+    conn_update_events(c);
+}
+
+static void flush_aged_batches(bool all) {
+    int64_t now = now_ms();
+    for (int i = open_count - 1; i >= 0; i--) {
+        if (all || now - open_batches[i]->opened_ms >= opt.batch_wait_ms) {
+            batch_close(i);
+        }
+    }
+}
+
+static int next_timeout(void) {
+    int64_t now = now_ms();
+    int64_t deadline = now + 1000;
+    if (curl_deadline_ms >= 0 && curl_deadline_ms < deadline) {
+        deadline = curl_deadline_ms;
+    }
+    for (int i = 0; i < open_count; i++) {
+        int64_t due = open_batches[i]->opened_ms + opt.batch_wait_ms;
+        deadline = due < deadline ? due : deadline;
+    }
+    for (batch_t *b = send_head; b != NULL && inflight < opt.max_inflight; b = b->next) {
+        deadline = b->retry_at_ms < deadline ? b->retry_at_ms : deadline;
+    }
+    return deadline > now ? (int)(deadline - now) : 0;
+}
+
+static void print_stats(double seconds) {
+    stats_t d = stats;
+#define RATE(f) ((double)(d.f - last_stats.f) / seconds)
+    log_msg("in %.0f/s (mqtt %.0f/s) dup %.0f/s full %.0f/s | out %.1f batches/s %.0f records/s %.2f MB/s | "
+            "retry %.1f/s dropped %llu | queue %.1f MB, %d in flight, %d conns",
+            RATE(frames_in), RATE(mqtt_frames), RATE(duplicates), RATE(rejected_full), RATE(batches_sent),
+            RATE(records_sent), RATE(bytes_sent) / 1e6, RATE(batch_failures), (unsigned long long)d.records_dropped,
+            queued_bytes / 1e6, inflight, conn_count);
+#undef RATE
+    last_stats = d;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s -u upstream_url -k api_key [-t lan_token] [-p http_port] [-m mqtt_port|0]\n"
+            "          [-c inflight] [-b batch_bytes] [-n batch_records] [-w batch_wait_ms]\n"
+            "          [-q queue_mb] [-f max_frame_bytes] [-M max_conns] [-s stats_s]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int ch;
+    while ((ch = getopt(argc, argv, "u:k:t:p:m:c:b:n:w:q:f:M:s:h")) != -1) {
+        switch (ch) {
+        case 'u': snprintf(opt.upstream, sizeof(opt.upstream), "%s", optarg); break;
+        case 'k': snprintf(opt.api_key, sizeof(opt.api_key), "%s", optarg); break;
+        case 't': snprintf(opt.lan_token, sizeof(opt.lan_token), "%s", optarg); break;
+        case 'p': opt.http_port = atoi(optarg); break;
+        case 'm': opt.mqtt_port = atoi(optarg); break;
+        case 'c': opt.max_inflight = atoi(optarg); break;
+        case 'b': opt.batch_bytes = strtoull(optarg, NULL, 10); break;
+        case 'n': opt.batch_records = atoi(optarg); break;
+        case 'w': opt.batch_wait_ms = atoi(optarg); break;
+        case 'q': opt.queue_limit = strtoull(optarg, NULL, 10) * 1024 * 1024; break;
+        case 'f': opt.max_frame = strtoull(optarg, NULL, 10); break;
+        case 'M': opt.max_conns = atoi(optarg); break;
+        case 's': opt.stats_s = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    size_t url_len = strlen(opt.upstream);
+    while (url_len > 0 && opt.upstream[url_len - 1] == '/') {
+        opt.upstream[--url_len] = '\0';
+    }
+    if (url_len == 0 || opt.api_key[0] == '\0' || opt.max_inflight < 1 || opt.batch_records < 1 ||
+        opt.batch_records > 64 || opt.http_port <= 0) {
+        usage(argv[0]);
+    }
+    if (opt.lan_token[0] == '\0') {
+        log_msg("No LAN token (-t): any device on the network can write through the gateway");
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, on_curl_socket);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, on_curl_timer);
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)opt.max_inflight);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)opt.max_inflight);
+
+    static int http_tag, mqtt_tag;
+    int http_fd = listen_on(opt.http_port, W_LISTEN_HTTP, &http_tag);
+    int mqtt_fd = opt.mqtt_port > 0 ? listen_on(opt.mqtt_port, W_LISTEN_MQTT, &mqtt_tag) : -1;
+    log_msg("Forwarding to %s: HTTP on %d, MQTT on %d, %d upstream transfers, batches of %d records / %zu bytes / %d ms",
+            opt.upstream, opt.http_port, opt.mqtt_port, opt.max_inflight, opt.batch_records, opt.batch_bytes,
+            opt.batch_wait_ms);
+
+    struct epoll_event events[MAX_EVENTS];
+    int64_t stats_at = now_ms() + opt.stats_s * 1000;
+    int64_t stop_deadline = 0;
+    while (true) {
+        int n = epoll_wait(ep, events, MAX_EVENTS, next_timeout());
+        for (int i = 0; i < n; i++) {
+            int kind = *(int *)events[i].data.ptr;
+            if (kind == W_LISTEN_HTTP) {
+                accept_all(http_fd, false);
+            } else if (kind == W_LISTEN_MQTT) {
+                accept_all(mqtt_fd, true);
+            } else if (kind == W_CURL) {
+                curl_watch_t *w = events[i].data.ptr;
+                uint32_t e = events[i].events;
+                curl_drive(w->fd, (e & EPOLLIN ? CURL_CSELECT_IN : 0) | (e & EPOLLOUT ? CURL_CSELECT_OUT : 0) |
+                                      (e & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0));
+            } else {
+                on_conn_event(events[i].data.ptr, events[i].events);
+            }
+        }
+        if (curl_deadline_ms >= 0 && now_ms() >= curl_deadline_ms) {
+            curl_deadline_ms = -1;
+            curl_drive(CURL_SOCKET_TIMEOUT, 0);
+        }
+
+        flush_aged_batches(stopping);
+        dispatch_batches();
+
+        int64_t now = now_ms();
+        if (opt.stats_s > 0 && now >= stats_at) {
+            print_stats(opt.stats_s + (now - stats_at) / 1000.0);
+            stats_at = now + opt.stats_s * 1000;
+        }
+        if (stopping) {
+            // Stop taking frames, then give queued batches a while to go out
+            if (stop_deadline == 0) {
+                log_msg("Shutting down, flushing %.1f MB", queued_bytes / 1e6);
+                epoll_ctl(ep, EPOLL_CTL_DEL, http_fd, NULL);
+                if (mqtt_fd >= 0) {
+                    epoll_ctl(ep, EPOLL_CTL_DEL, mqtt_fd, NULL);
+                }
+                stop_deadline = now + 15000;
+            }
+            if ((send_head == NULL && inflight == 0) || now >= stop_deadline) {
+                break;
+            }
+        }
+    }
+
+    print_stats((opt.stats_s > 0 ? opt.stats_s : 1));
+    log_msg("Sent %llu records in %llu batches, %llu duplicates, %llu dropped",
+            (unsigned long long)stats.records_sent, (unsigned long long)stats.batches_sent,
+            (unsigned long long)stats.duplicates, (unsigned long long)stats.records_dropped);
+    curl_multi_cleanup(multi);
+    curl_global_cleanup();
+    return send_head == NULL && inflight == 0 ? 0 : 1;
+}
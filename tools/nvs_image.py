@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""
+Write and read NVS partition images without ESP-IDF.
+
+Produces the same page format as nvs_partition_gen.py (format version 2) for
+the entry types the firmware reads: namespaces, u8/u32 values and strings.
+Each 4 KB page holds a 32-byte header, a 32-byte entry state bitmap and 126
+entries of 32 bytes:
+
+    header   state u32 | sequence u32 | version u8 | 0xFF x 19 | crc32 u32
+    entry    namespace u8 | type u8 | span u8 | chunk u8 | crc32 u32 | key[16] | data[8]
+
+A string takes one entry with its size and CRC followed by its bytes in the
+next span - 1 entries, and never crosses a page. The last page stays erased so
+the device has a free page for garbage collection, as with nvs_partition_gen.
+
+    nvs_image.py dump credentials.bin
+
+Used by setup_credentials.py --fleet; tools/nvs_readback.c reads the images
+back through the firmware's own credential code.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+PAGE_SIZE = 4096
+ENTRY_SIZE = 32
+ENTRIES_PER_PAGE = 126
+PAGE_ACTIVE = 0xFFFFFFFE
+PAGE_FULL = 0xFFFFFFFC
+FORMAT_VERSION = 0xFE
+KEY_MAX_LEN = 15
+STRING_MAX_LEN = 4000       # nvs_set_str limit, terminator included
+
+TYPE_U8 = 0x01
+TYPE_U32 = 0x04
+TYPE_STR = 0x21
+
+
+def crc32(data):
+    return zlib.crc32(data, 0xFFFFFFFF) & 0xFFFFFFFF
+
+
+def entry_crc(entry):
+    return crc32(bytes(entry[0:4]) + bytes(entry[8:32]))
+
+
+class NvsImage:
+    """Lays out entries page by page in the order they are added."""
+
+    def __init__(self, size=0x5000):
+        if size % PAGE_SIZE or size < 3 * PAGE_SIZE:
+            raise ValueError(f"NVS partition size must be a multiple of {PAGE_SIZE} and at least 3 pages")
+        self.size = size
+        self.pages = []
+        self.namespaces = {}
+        self.current = None
+
+    def _new_page(self):
+        if len(self.pages) + 1 >= self.size // PAGE_SIZE:
+            raise ValueError(f"Entries do not fit a {self.size:#x} byte partition")
+        if self.pages:
+            struct.pack_into("<I", self.pages[-1], 0, PAGE_FULL)
+        page = bytearray(b"\xff" * PAGE_SIZE)
+        struct.pack_into("<II", page, 0, PAGE_ACTIVE, len(self.pages))
+        page[8] = FORMAT_VERSION
+        struct.pack_into("<I", page, 28, crc32(bytes(page[4:28])))
+        self.pages.append(page)
+        self.current = 0
+
+    def _write(self, entries):
+        if self.current is None or self.current + len(entries) > ENTRIES_PER_PAGE:
+            self._new_page()
+        page = self.pages[-1]
+        for entry in entries:
+            index = self.current
+            page[64 + index * ENTRY_SIZE:64 + (index + 1) * ENTRY_SIZE] = entry
+            page[32 + index // 4] &= ~(1 << (index % 4 * 2)) & 0xFF    # 0b11 empty -> 0b10 written
+            self.current += 1
+
+    def _entry(self, ns, kind, key, span=1):
+        if not key or len(key.encode()) > KEY_MAX_LEN:
+            raise ValueError(f"NVS key '{key}' must be 1 to {KEY_MAX_LEN} bytes")
+        entry = bytearray(b"\xff" * ENTRY_SIZE)
+        entry[0:3] = bytes((ns, kind, span))
+        entry[8:24] = key.encode().ljust(16, b"\x00")
+        return entry
+
+    def _seal(self, entry):
+        struct.pack_into("<I", entry, 4, entry_crc(entry))
+        return entry
+
+    def namespace(self, name):
+        if name not in self.namespaces:
+            if len(self.namespaces) >= 254:
+                raise ValueError("Too many NVS namespaces")
+            index = len(self.namespaces) + 1
+            entry = self._entry(0, TYPE_U8, name)
+            entry[24] = index
+            self._write([self._seal(entry)])
+            self.namespaces[name] = index
+        return self.namespaces[name]
+
+    def set_u8(self, namespace, key, value):
+        entry = self._entry(self.namespace(namespace), TYPE_U8, key)
+        entry[24] = value
+        self._write([self._seal(entry)])
+
+    def set_u32(self, namespace, key, value):
+        entry = self._entry(self.namespace(namespace), TYPE_U32, key)
+        struct.pack_into("<I", entry, 24, value)
+        self._write([self._seal(entry)])
+
+    def set_str(self, namespace, key, value):
+        data = value.encode() + b"\x00"
+        if len(data) > STRING_MAX_LEN:
+            raise ValueError(f"NVS string '{key}' is longer than {STRING_MAX_LEN - 1} bytes")
+        chunks = (len(data) + ENTRY_SIZE - 1) // ENTRY_SIZE
+        entry = self._entry(self.namespace(namespace), TYPE_STR, key, 1 + chunks)
+        struct.pack_into("<H", entry, 24, len(data))
+        struct.pack_into("<I", entry, 28, crc32(data))
+        padded = data.ljust(chunks * ENTRY_SIZE, b"\xff")
+        body = [padded[i:i + ENTRY_SIZE] for i in range(0, len(padded), ENTRY_SIZE)]
+        self._write([self._seal(entry)] + body)
+
+    def to_bytes(self):
+        image = b"".join(bytes(p) for p in self.pages)
+        return image.ljust(self.size, b"\xff")
+
+
+def read_image(image):
+    """Return {namespace: {key: value}} after checking page, entry and data CRCs."""
+    if len(image) % PAGE_SIZE:
+        raise ValueError("Image size is not a multiple of the page size")
+    names = {}
+    items = []
+    pages = []
+    for offset in range(0, len(image), PAGE_SIZE):
+        page = image[offset:offset + PAGE_SIZE]
+        state, seq = struct.unpack_from("<II", page, 0)
+        if state == 0xFFFFFFFF:
+            continue
+        if state not in (PAGE_ACTIVE, PAGE_FULL):
+            raise ValueError(f"Page at {offset:#x} has state {state:#x}")
+        if page[8] != FORMAT_VERSION or struct.unpack_from("<I", page, 28)[0] != crc32(page[4:28]):
+            raise ValueError(f"Page at {offset:#x} has a bad header")
+        pages.append((seq, offset, page))
+
+    for seq, offset, page in sorted(pages):
+        index = 0
+        while index < ENTRIES_PER_PAGE:
+            if (page[32 + index // 4] >> (index % 4 * 2)) & 3 != 0b10:
+                index += 1
+                continue
+            entry = page[64 + index * ENTRY_SIZE:64 + (index + 1) * ENTRY_SIZE]
+            ns, kind, span = entry[0], entry[1], entry[2]
+            if struct.unpack_from("<I", entry, 4)[0] != entry_crc(entry) or span == 0 or index + span > ENTRIES_PER_PAGE:
+                raise ValueError(f"Entry {index} of page {seq} is corrupt")
+            key = entry[8:24].split(b"\x00", 1)[0].decode()
+            if kind == TYPE_U8:
+                value = entry[24]
+            elif kind == TYPE_U32:
+                value = struct.unpack_from("<I", entry, 24)[0]
+            elif kind == TYPE_STR:
+                size, data_crc = struct.unpack_from("<H2xI", entry, 24)
+                start = 64 + (index + 1) * ENTRY_SIZE
+                data = page[start:start + size]
+                if size == 0 or size > (span - 1) * ENTRY_SIZE or crc32(data) != data_crc or data[-1] != 0:
+                    raise ValueError(f"String '{key}' in page {seq} is corrupt")
+                value = data[:-1].decode()
+            else:
+                raise ValueError(f"Entry '{key}' has unsupported type {kind:#x}")
+            if ns == 0:
+                names[value] = key
+            else:
+                items.append((ns, key, value))
+            index += span
+
+    result = {}
+    for ns, key, value in items:
+        if ns not in names:
+            raise ValueError(f"Entry '{key}' belongs to unknown namespace {ns}")
+        result.setdefault(names[ns], {})[key] = value
+    for name in names.values():
+        result.setdefault(name, {})
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Inspect an NVS partition image")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("dump", help="Print the namespaces and keys of an image")
+    p.add_argument("image")
+    p.add_argument("--show-secrets", action="store_true", help="Print passwords and API keys in full")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        contents = read_image(f.read())
+    for namespace, values in contents.items():
+        print(f"[{namespace}]")
+        for key, value in values.items():
+            if isinstance(value, str) and not args.show_secrets and ("pass" in key or "key" in key):
+                value = value[:4] + "***"
+            print(f"  {key} = {value}")
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except (OSError, ValueError) as e:
+        sys.exit(f"error: {e}")
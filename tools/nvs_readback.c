@@ -0,0 +1,96 @@
+// Host readback for provisioning images.
+//
+// Loads each NVS partition image through the host NVS shim and reads it with
+// the firmware's own credentials_load() plus the runtime namespace keys, then
+// prints one JSON object per image. setup_credentials.py --fleet compares the
+// output with the fleet manifest, so an image only passes when the code that
+// runs on the camera finds every value it was given.
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o nvs_readback
+//       tools/nvs_readback.c tools/host/nvs_host.c main/src/credentials_manager.c
+//   ./nvs_readback credentials-cam-001.bin [more.bin ...]
+//
+// Exits non-zero if any image fails to load or lacks a credential.
+
+#include "credentials_manager.h"
+#include "config.h"
+#include "nvs_flash.h"
+#include <stdio.h>
+
+static void print_json_string(const char *sep, const char *name, const char *value) {
+    printf("%s\"%s\": \"", sep, name);
+    for (const unsigned char *p = (const unsigned char *)value; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+static esp_err_t readback(const char *path) {
+    esp_err_t err = nvs_host_load(path);
+    if (err == ESP_OK) {
+        err = nvs_flash_init();
+    }
+    if (err == ESP_OK) {
+        err = credentials_init();
+    }
+    credentials_t creds;
+    if (err == ESP_OK) {
+        err = credentials_load(&creds);
+    }
+    if (err != ESP_OK) {
+        print_json_string("{", "image", path);
+        print_json_string(", ", "error", esp_err_to_name(err));
+        printf("}\n");
+        return err;
+    }
+
+    print_json_string("{", "image", path);
+    print_json_string(", ", NVS_WIFI_SSID_KEY, creds.wifi_ssid);
+    print_json_string(", ", NVS_WIFI_PASS_KEY, creds.wifi_password);
+    print_json_string(", ", NVS_FIREBASE_PROJECT_ID_KEY, creds.firebase_project_id);
+    print_json_string(", ", NVS_FIREBASE_DB_URL_KEY, creds.firebase_db_url);
+    print_json_string(", ", NVS_FIREBASE_API_KEY_KEY, creds.firebase_api_key);
+
+    // Optional settings, read the way runtime_config_get_str() does
+    static const char *runtime_keys[] = {
+        RUNTIME_DEVICE_ID_KEY, RUNTIME_CAPTURE_SCHEDULE_KEY, RUNTIME_CAMERA_ROI_KEY, RUNTIME_PRIVACY_MASK_KEY,
+    };
+    nvs_handle_t handle;
+    if (nvs_open(RUNTIME_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        for (size_t i = 0; i < sizeof(runtime_keys) / sizeof(runtime_keys[0]); i++) {
+            char value[256];
+            size_t len = sizeof(value);
+            if (nvs_get_str(handle, runtime_keys[i], value, &len) == ESP_OK) {
+                print_json_string(", ", runtime_keys[i], value);
+            }
+        }
+        nvs_close(handle);
+    }
+    printf("}\n");
+    return ESP_OK;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s image.bin [image.bin ...]\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (readback(argv[i]) != ESP_OK) {
+            failed++;
+        }
+    }
+    nvs_host_unload();
+    if (failed > 0) {
+        fprintf(stderr, "%d of %d images failed\n", failed, argc - 1);
+    }
+    return failed > 0 ? 1 : 0;
+}
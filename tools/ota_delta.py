@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+"""
+Build and check delta firmware patches for the OTA updater (main/src/ota_delta.c).
+
+A patch turns the image running on a device into a new one without sending the
+whole new image. It is a bsdiff-style list of records, each taking bytes from
+the old image with a small difference added and then bytes that only exist in
+the new one:
+
+    header   "SGDP", version, compression, old/new size, old/new SHA-256 (80 bytes)
+    body     records of  diff_len u32 | extra_len u32 | seek i32
+                         diff_len bytes added to the old image at the read position
+                         extra_len bytes copied as they are
+             the read position moves by diff_len, then by seek
+
+The body is LZSS-compressed with a 4 KB window, so the device inflates it with
+a few kilobytes of RAM while the download streams in. Code that only moved
+between builds diffs to runs of zeros, which is what makes patches small.
+
+    ota_delta.py diff old.bin new.bin update.patch
+    ota_delta.py apply old.bin update.patch out.bin
+    ota_delta.py manifest new.bin --url https://.../new.bin --patch 1.1.0=https://.../update.patch
+
+"manifest" prints the JSON to store at OTA_MANIFEST_PATH in the Realtime
+Database. tools/ota_patch_check.c applies patches with the firmware's own code
+against file-backed partitions.
+
+Requires NumPy (pip install numpy).
+"""
+
+import argparse
+import hashlib
+import json
+import struct
+import sys
+
+try:
+    import numpy as np
+except ImportError:
+    sys.exit("NumPy is required: pip install numpy")
+
+MAGIC = b"SGDP"
+VERSION = 1
+COMPRESSION_NONE = 0
+COMPRESSION_LZSS = 1
+HEADER = struct.Struct("<4sBBHII32s32s")
+RECORD = struct.Struct("<IIi")
+
+LZ_WINDOW = 4096
+LZ_MIN = 3
+LZ_MAX = 18 + 255
+LZ_CHAIN = 24
+
+MATCH_BLOCK = 16        # Bytes that must match exactly to start a region
+INDEX_STEP = 4          # Old image positions indexed; scanning every new position covers the rest
+EXTEND_SLACK = 256      # Stop extending a region this far past its best score
+
+APP_DESC_OFFSET = 24 + 8    # Image header and first segment header
+APP_DESC_MAGIC = 0xABCD5432
+
+
+def lzss_compress(data):
+    """Greedy LZSS: flag bytes (1 = literal) ahead of groups of 8 literals or matches."""
+    n = len(data)
+    table = {}
+    items = []
+    i = 0
+    while i < n:
+        best_len, best_off = 0, 0
+        if i + LZ_MIN <= n:
+            limit = min(LZ_MAX, n - i)
+            for p in reversed(table.get(data[i:i + LZ_MIN], ())):
+                off = i - p
+                if off > LZ_WINDOW:
+                    break
+                length = LZ_MIN
+                while length + 32 <= limit and data[p + length:p + length + 32] == data[i + length:i + length + 32]:
+                    length += 32
+                while length < limit and data[p + length] == data[i + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_off = length, off
+                    if length == limit:
+                        break
+        step = best_len if best_len >= LZ_MIN else 1
+        items.append((best_off, best_len) if best_len >= LZ_MIN else data[i])
+        for j in range(i, min(i + step, n - LZ_MIN + 1)):
+            chain = table.setdefault(data[j:j + LZ_MIN], [])
+            chain.append(j)
+            if len(chain) > 2 * LZ_CHAIN:
+                del chain[:LZ_CHAIN]
+        i += step
+
+    out = bytearray()
+    for g in range(0, len(items), 8):
+        group = items[g:g + 8]
+        flags = 0
+        body = bytearray()
+        for bit, item in enumerate(group):
+            if isinstance(item, int):
+                flags |= 1 << bit
+                body.append(item)
+            else:
+                off, length = item
+                nibble = min(length - LZ_MIN, 15)
+                body += bytes([(off - 1) >> 4, ((off - 1) & 0x0F) << 4 | nibble])
+                if nibble == 15:
+                    body.append(length - 18)
+        out.append(flags)
+        out += body
+    return bytes(out)
+
+
+def lzss_decompress(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        flags = data[i]
+        i += 1
+        for bit in range(8):
+            if i >= len(data):
+                break
+            if flags & (1 << bit):
+                out.append(data[i])
+                i += 1
+                continue
+            off = ((data[i] << 4) | (data[i + 1] >> 4)) + 1
+            nibble = data[i + 1] & 0x0F
+            i += 2
+            length = nibble + LZ_MIN
+            if nibble == 15:
+                length = 18 + data[i]
+                i += 1
+            if off > len(out):
+                raise ValueError("match before the start of the output")
+            for _ in range(length):
+                out.append(out[-off])
+    return bytes(out)
+
+
+def extend(old, o, new, i, limit, step):
+    """Length of the aligned run at (o, i) that maximizes matches minus mismatches."""
+    best_score, best_len, score, length = 0, 0, 0, 0
+    while length < limit:
+        n = min(4096, limit - length)
+        if step > 0:
+            a = old[o + length:o + length + n]
+            b = new[i + length:i + length + n]
+        else:
+            a = old[o - length - n:o - length][::-1]
+            b = new[i - length - n:i - length][::-1]
+        scores = score + np.cumsum(np.where(a == b, 1, -1))
+        k = int(np.argmax(scores))
+        if scores[k] > best_score:
+            best_score, best_len = int(scores[k]), length + k + 1
+        score = int(scores[-1])
+        length += n
+        if length - best_len > EXTEND_SLACK:
+            break
+    return best_len
+
+
+def find_regions(old, new):
+    """Aligned (new_start, old_start, length) regions in new order, bsdiff style."""
+    old_np = np.frombuffer(old, dtype=np.uint8)
+    new_np = np.frombuffer(new, dtype=np.uint8)
+    index = {}
+    for p in range(0, len(old) - MATCH_BLOCK + 1, INDEX_STEP):
+        index.setdefault(old[p:p + MATCH_BLOCK], p)
+
+    regions = []
+    new_end, old_end = 0, 0
+    i = 0
+    while i <= len(new) - MATCH_BLOCK:
+        block = new[i:i + MATCH_BLOCK]
+        # Code that moved keeps the previous offset; try that before the index
+        o = i - new_end + old_end
+        if not regions or o + MATCH_BLOCK > len(old) or old[o:o + MATCH_BLOCK] != block:
+            o = index.get(block)
+            if o is None:
+                i += 1
+                continue
+        forward = extend(old_np, o, new_np, i, min(len(old) - o, len(new) - i), 1)
+        backward = extend(old_np, o, new_np, i, min(o, i - new_end), -1)
+        regions.append((i - backward, o - backward, backward + forward))
+        new_end, old_end = i + forward, o + forward
+        i = new_end
+    return regions
+
+
+def make_body(old, new):
+    regions = find_regions(old, new)
+    old_np = np.frombuffer(old, dtype=np.uint8)
+    new_np = np.frombuffer(new, dtype=np.uint8)
+    body = bytearray()
+    # Leading record for new bytes before the first region and the seek to its old offset
+    first = regions[0] if regions else (len(new), 0, 0)
+    if new and first[:2] != (0, 0):
+        body += RECORD.pack(0, first[0], first[1])
+        body += new[:first[0]]
+    for k, (ns, os, length) in enumerate(regions):
+        following = regions[k + 1] if k + 1 < len(regions) else (len(new), os + length, 0)
+        extra = new[ns + length:following[0]]
+        body += RECORD.pack(length, len(extra), following[1] - (os + length))
+        body += (new_np[ns:ns + length] - old_np[os:os + length]).tobytes()
+        body += extra
+    return bytes(body), len(regions)
+
+
+def apply_body(old, body, new_size):
+    out = bytearray()
+    old_pos = 0
+    i = 0
+    while len(out) < new_size:
+        diff_len, extra_len, seek = RECORD.unpack_from(body, i)
+        i += RECORD.size
+        if old_pos + diff_len > len(old):
+            raise ValueError("diff reads past the old image")
+        diff = np.frombuffer(body, dtype=np.uint8, count=diff_len, offset=i)
+        out += (np.frombuffer(old, dtype=np.uint8, count=diff_len, offset=old_pos) + diff).tobytes()
+        i += diff_len
+        out += body[i:i + extra_len]
+        i += extra_len
+        old_pos += diff_len + seek
+        if not 0 <= old_pos <= len(old):
+            raise ValueError("seek outside the old image")
+    if len(out) != new_size or i != len(body):
+        raise ValueError("patch body does not end with the new image")
+    return bytes(out)
+
+
+def parse_header(patch):
+    if len(patch) < HEADER.size:
+        raise ValueError("patch shorter than its header")
+    magic, version, compression, _, old_size, new_size, old_sha, new_sha = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version %d patch" % VERSION)
+    return compression, old_size, new_size, old_sha, new_sha
+
+
+def apply_patch(old, patch):
+    compression, old_size, new_size, old_sha, new_sha = parse_header(patch)
+    if len(old) < old_size or hashlib.sha256(old[:old_size]).digest() != old_sha:
+        raise ValueError("patch was made for a different old image")
+    body = patch[HEADER.size:]
+    if compression == COMPRESSION_LZSS:
+        body = lzss_decompress(body)
+    elif compression != COMPRESSION_NONE:
+        raise ValueError("unknown compression %d" % compression)
+    new = apply_body(old[:old_size], body, new_size)
+    if hashlib.sha256(new).digest() != new_sha:
+        raise ValueError("patched image does not match the expected SHA-256")
+    return new
+
+
+def app_version(image):
+    """Version string from the esp_app_desc_t at the start of an application image."""
+    if len(image) < APP_DESC_OFFSET + 48 or image[0] != 0xE9:
+        raise ValueError("not an ESP application image")
+    magic = struct.unpack_from("<I", image, APP_DESC_OFFSET)[0]
+    if magic != APP_DESC_MAGIC:
+        raise ValueError("application description not found")
+    return image[APP_DESC_OFFSET + 16:APP_DESC_OFFSET + 48].split(b"\0")[0].decode()
+
+
+def cmd_diff(args):
+    old = open(args.old, "rb").read()
+    new = open(args.new, "rb").read()
+    body, regions = make_body(old, new)
+    compression = COMPRESSION_NONE if args.no_compress else COMPRESSION_LZSS
+    packed = body if compression == COMPRESSION_NONE else lzss_compress(body)
+    header = HEADER.pack(MAGIC, VERSION, compression, 0, len(old), len(new),
+                         hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    patch = header + packed
+    # Never ship a patch the reference applier cannot turn back into new.bin
+    if apply_patch(old, patch) != new:
+        sys.exit("internal error: patch does not reproduce the new image")
+    with open(args.patch, "wb") as f:
+        f.write(patch)
+    print("%s: %d bytes for a %d byte image (%.1f%%), %d regions" %
+          (args.patch, len(patch), len(new), 100.0 * len(patch) / max(len(new), 1), regions))
+
+
+def cmd_apply(args):
+    old = open(args.old, "rb").read()
+    patch = open(args.patch, "rb").read()
+    try:
+        new = apply_patch(old, patch)
+    except ValueError as e:
+        sys.exit("%s: %s" % (args.patch, e))
+    with open(args.out, "wb") as f:
+        f.write(new)
+    print("%s: %d bytes, SHA-256 %s" % (args.out, len(new), hashlib.sha256(new).hexdigest()))
+
+
+def cmd_manifest(args):
+    image = open(args.image, "rb").read()
+    manifest = {
+        "version": args.version or app_version(image),
+        "size": len(image),
+        "sha256": hashlib.sha256(image).hexdigest(),
+        "url": args.url,
+        "patches": [],
+    }
+    for spec in args.patch or []:
+        source, sep, url = spec.partition("=")
+        if not sep:
+            sys.exit("--patch takes FROM_VERSION=URL")
+        manifest["patches"].append({"from": source, "url": url})
+    print(json.dumps(manifest, indent=2))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Delta firmware patches for the OTA updater")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("diff", help="Make a patch from old.bin to new.bin")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p.add_argument("--no-compress", action="store_true", help="Store the body uncompressed")
+    p.set_defaults(func=cmd_diff)
+
+    p = sub.add_parser("apply", help="Apply a patch the way the device does")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("out")
+    p.set_defaults(func=cmd_apply)
+
+    p = sub.add_parser("manifest", help="Print the update manifest for a new image")
+    p.add_argument("image")
+    p.add_argument("--url", required=True, help="Download URL of the full image")
+    p.add_argument("--patch", action="append", metavar="FROM_VERSION=URL",
+                   help="Patch for devices running FROM_VERSION; repeat for more")
+    p.add_argument("--version", help="Override the version read from the image")
+    p.set_defaults(func=cmd_manifest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,352 @@
+// Host check for main/src/ota_delta.c against file-backed partitions.
+//
+// The old image is written into a partition file padded with 0xFF like erased
+// flash and read back through the same callback shape the updater uses; the
+// new image is streamed into a second partition file. The patch is fed in
+// chunks of random size, as it arrives over HTTP, and the result is accepted
+// only if its SHA-256 matches the patch header, which is what the device checks
+// before switching slots. With -m, that many copies of the patch are corrupted
+// at random; each must be rejected by the applier or by the hash, unless the
+// change was in bits the decoder never reads, such as unused LZSS flag bits.
+//
+//   python3 tools/ota_delta.py diff old.bin new.bin update.patch
+//   ./ota_patch_check -e new.bin old.bin update.patch
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o ota_patch_check tools/ota_patch_check.c main/src/ota_delta.c
+//   ./ota_patch_check [-s slot_bytes] [-c max_chunk] [-m mutations] [-e expected.bin] old.bin update.patch
+
+#include "ota_delta.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    FILE *running;              // Partition holding the old image
+    FILE *slot;                 // Partition receiving the new image
+    size_t slot_size;
+    size_t written;
+    uint32_t sha[8];            // Running hash of what was written
+    uint8_t sha_block[64];
+    size_t sha_len;
+    uint64_t sha_total;
+} partitions_t;
+
+// Minimal SHA-256; the firmware uses mbedtls for the same checks
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha_compress(uint32_t h[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 |
+               block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+static void sha_start(partitions_t *p) {
+    static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(p->sha, init, sizeof(init));
+    p->sha_len = 0;
+    p->sha_total = 0;
+}
+
+static void sha_update(partitions_t *p, const uint8_t *data, size_t len) {
+    p->sha_total += len;
+    while (len > 0) {
+        size_t n = 64 - p->sha_len < len ? 64 - p->sha_len : len;
+        memcpy(p->sha_block + p->sha_len, data, n);
+        p->sha_len += n;
+        data += n;
+        len -= n;
+        if (p->sha_len == 64) {
+            sha_compress(p->sha, p->sha_block);
+            p->sha_len = 0;
+        }
+    }
+}
+
+static void sha_finish(partitions_t *p, uint8_t digest[32]) {
+    uint64_t bits = p->sha_total * 8;
+    uint8_t pad = 0x80;
+    sha_update(p, &pad, 1);
+    pad = 0;
+    while (p->sha_len != 56) {
+        sha_update(p, &pad, 1);
+    }
+    for (int i = 7; i >= 0; i--) {
+        uint8_t b = (uint8_t)(bits >> (8 * i));
+        sha_update(p, &b, 1);
+    }
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(p->sha[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(p->sha[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(p->sha[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)p->sha[i];
+    }
+}
+
+static esp_err_t read_running(void *ctx, size_t offset, uint8_t *buf, size_t len) {
+    partitions_t *p = ctx;
+    if (fseek(p->running, (long)offset, SEEK_SET) != 0 || fread(buf, 1, len, p->running) != len) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t write_slot(void *ctx, const uint8_t *data, size_t len) {
+    partitions_t *p = ctx;
+    if (p->written + len > p->slot_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (fseek(p->slot, (long)p->written, SEEK_SET) != 0 || fwrite(data, 1, len, p->slot) != len) {
+        return ESP_FAIL;
+    }
+    sha_update(p, data, len);
+    p->written += len;
+    return ESP_OK;
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+// Erased partition file of size bytes with data at its start
+static FILE *make_partition(const uint8_t *data, size_t len, size_t size) {
+    FILE *f = tmpfile();
+    if (f == NULL) {
+        return NULL;
+    }
+    uint8_t erased[4096];
+    memset(erased, 0xFF, sizeof(erased));
+    for (size_t done = 0; done < size; done += sizeof(erased)) {
+        fwrite(erased, 1, size - done < sizeof(erased) ? size - done : sizeof(erased), f);
+    }
+    fseek(f, 0, SEEK_SET);
+    if (len > 0) {
+        fwrite(data, 1, len, f);
+    }
+    fflush(f);
+    return f;
+}
+
+// Apply the way the updater does; ESP_OK only for a verified image
+static esp_err_t apply(partitions_t *p, ota_delta_t *delta, const uint8_t *patch, size_t patch_len,
+                       size_t max_chunk, bool verbose) {
+    ota_delta_header_t header;
+    esp_err_t err = ota_delta_parse_header(patch, patch_len, &header);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (header.new_size > p->slot_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // The patch only applies to the image it was made from
+    uint8_t digest[32];
+    uint8_t *old = malloc(header.old_size ? header.old_size : 1);
+    if (old == NULL || read_running(p, 0, old, header.old_size) != ESP_OK) {
+        free(old);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    sha_start(p);
+    sha_update(p, old, header.old_size);
+    sha_finish(p, digest);
+    free(old);
+    if (memcmp(digest, header.old_sha256, 32) != 0) {
+        if (verbose) {
+            fprintf(stderr, "patch was made for a different running image\n");
+        }
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    p->written = 0;
+    sha_start(p);
+    ota_delta_begin(delta, &header, read_running, write_slot, p);
+    for (size_t pos = OTA_DELTA_HEADER_SIZE; pos < patch_len && err == ESP_OK;) {
+        size_t n = 1 + (size_t)rand() % max_chunk;
+        n = n < patch_len - pos ? n : patch_len - pos;
+        err = ota_delta_feed(delta, patch + pos, n);
+        pos += n;
+    }
+    if (err == ESP_OK) {
+        err = ota_delta_finish(delta);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    sha_finish(p, digest);
+    if (p->written != header.new_size || memcmp(digest, header.new_sha256, 32) != 0) {
+        if (verbose) {
+            fprintf(stderr, "new image does not match the SHA-256 in the patch\n");
+        }
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+int main(int argc, char **argv) {
+    size_t slot_size = 0x180000;
+    size_t max_chunk = 1460;
+    int mutations = 0;
+    const char *expected_path = NULL;
+    const char *paths[2] = {NULL, NULL};
+    int path_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 's': slot_size = (size_t)strtoul(argv[++i], NULL, 0); continue;
+                case 'c': max_chunk = (size_t)atol(argv[++i]); continue;
+                case 'm': mutations = atoi(argv[++i]); continue;
+                case 'e': expected_path = argv[++i]; continue;
+                default: break;
+            }
+        }
+        if (path_count < 2) {
+            paths[path_count++] = argv[i];
+        }
+    }
+    if (path_count != 2 || max_chunk == 0) {
+        fprintf(stderr, "usage: %s [-s slot_bytes] [-c max_chunk] [-m mutations] [-e expected.bin] "
+                        "old.bin update.patch\n", argv[0]);
+        return 2;
+    }
+
+    size_t old_len = 0, patch_len = 0;
+    uint8_t *old = read_file(paths[0], &old_len);
+    uint8_t *patch = read_file(paths[1], &patch_len);
+    ota_delta_t *delta = malloc(sizeof(ota_delta_t));
+    if (old == NULL || patch == NULL || delta == NULL) {
+        return 1;
+    }
+    if (old_len > slot_size) {
+        fprintf(stderr, "%s: %zu bytes do not fit a %zu byte slot\n", paths[0], old_len, slot_size);
+        return 1;
+    }
+
+    partitions_t p = {
+        .running = make_partition(old, old_len, slot_size),
+        .slot = make_partition(NULL, 0, slot_size),
+        .slot_size = slot_size,
+    };
+    if (p.running == NULL || p.slot == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    srand(1);
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = apply(&p, delta, patch, patch_len, max_chunk, true);
+    int64_t elapsed = esp_timer_get_time() - start;
+    int failures = 0;
+    if (err != ESP_OK) {
+        printf("apply      FAIL: %s\n", esp_err_to_name(err));
+        failures++;
+    } else {
+        printf("apply      %zu byte patch -> %zu byte image in %.1f ms, SHA-256 verified\n", patch_len, p.written,
+               elapsed / 1000.0);
+    }
+
+    if (err == ESP_OK && expected_path != NULL) {
+        size_t expected_len = 0;
+        uint8_t *expected = read_file(expected_path, &expected_len);
+        uint8_t *slot = malloc(p.written ? p.written : 1);
+        fseek(p.slot, 0, SEEK_SET);
+        bool same = expected != NULL && slot != NULL && expected_len == p.written &&
+                    fread(slot, 1, p.written, p.slot) == p.written && memcmp(slot, expected, p.written) == 0;
+        printf("expected   %s\n", same ? "identical" : "FAIL: slot differs");
+        failures += !same;
+        free(slot);
+        free(expected);
+    }
+
+    // A corrupted patch must fail before it could be booted, or still give the good image
+    size_t good_len = p.written;
+    uint8_t *good = malloc(good_len ? good_len : 1);
+    uint8_t *slot = malloc(slot_size);
+    fseek(p.slot, 0, SEEK_SET);
+    if (good == NULL || slot == NULL || fread(good, 1, good_len, p.slot) != good_len) {
+        return 1;
+    }
+    int tried = 0, rejected = 0, unchanged = 0;
+    uint8_t *mutated = malloc(patch_len);
+    for (; tried < mutations && err == ESP_OK && mutated != NULL && patch_len > OTA_DELTA_HEADER_SIZE; tried++) {
+        memcpy(mutated, patch, patch_len);
+        int flips = 1 + rand() % 4;
+        for (int f = 0; f < flips; f++) {
+            size_t pos = OTA_DELTA_HEADER_SIZE + (size_t)rand() % (patch_len - OTA_DELTA_HEADER_SIZE);
+            mutated[pos] ^= (uint8_t)(1 + rand() % 255);
+        }
+        size_t len = rand() % 8 == 0 ? OTA_DELTA_HEADER_SIZE + (size_t)rand() % (patch_len - OTA_DELTA_HEADER_SIZE)
+                                     : patch_len;
+        if (apply(&p, delta, mutated, len, max_chunk, false) != ESP_OK) {
+            rejected++;
+            continue;
+        }
+        fseek(p.slot, 0, SEEK_SET);
+        if (p.written == good_len && fread(slot, 1, good_len, p.slot) == good_len &&
+            memcmp(slot, good, good_len) == 0) {
+            unchanged++;
+        }
+    }
+    if (tried > 0) {
+        bool ok = rejected + unchanged == tried;
+        printf("corrupted  %d of %d rejected, %d decoded to the same image%s\n", rejected, tried, unchanged,
+               ok ? "" : " FAIL: a different image was accepted");
+        failures += !ok;
+    }
+
+    free(mutated);
+    free(slot);
+    free(good);
+    fclose(p.running);
+    fclose(p.slot);
+    free(delta);
+    free(patch);
+    free(old);
+    return failures ? 1 : 0;
+}
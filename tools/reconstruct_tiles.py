@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+Rebuild full frames from a changed-tile upload (UPLOAD_MODE_TILES).
+
+Reads a Realtime Database JSON export (the whole database or just the
+"images" node), decodes every keyframe, pastes each frame's tiles onto the
+canvas of the keyframe they name and writes one image per captured frame.
+Keys end in the camera's device tag, so an export holding several cameras
+is handled frame chain by frame chain, a chain being one keyframe and the
+tile frames that name it.
+
+Tiles are MCU-aligned lossless crops of the sensor JPEG, so every pasted
+region matches the full frame's pixels up to chroma upsampling at the tile
+border. Frames whose keyframe is missing from the export are skipped.
+
+Requires Pillow (pip install pillow).
+"""
+
+import argparse
+import base64
+import io
+import json
+import sys
+from pathlib import Path
+
+try:
+    from PIL import Image
+except ImportError:
+    sys.exit("Pillow is required: pip install pillow")
+
+
+def load_records(path):
+    """Return {key: record} for every upload in the export."""
+    with open(path, "r") as f:
+        data = json.load(f)
+    if isinstance(data, dict) and isinstance(data.get("images"), dict):
+        data = data["images"]
+    if not isinstance(data, dict):
+        sys.exit(f"{path}: expected an object of image records")
+
+    records = {}
+    for key, record in data.items():
+        if not isinstance(record, dict) or "image" not in record:
+            continue
+        try:
+            meta = json.loads(record.get("metadata") or "{}")
+        except json.JSONDecodeError:
+            meta = {}
+        records[key] = {"image": record["image"], "meta": meta}
+    return records
+
+
+def capture_order(key):
+    """Sort key placing a camera's frames in capture order.
+
+    Synced frames are keyed <YYYYMMDD_HHMMSS>_<tag>; frames named before the
+    clock synced are b<boot>_<uptime s>_<tag> and would sort after every dated
+    key. A keyframe and its tiles never span a reboot, and within one boot the
+    unsynced frames come before the synced ones, so those sort first, by boot
+    count and uptime.
+    """
+    parts = key.split("_")
+    if parts[0].startswith("b") and parts[0][1:].isdigit() and len(parts) > 1 and parts[1].isdigit():
+        return (0, int(parts[0][1:]), int(parts[1]), key)
+    return (1, 0, 0, key)
+
+
+def decode_image(b64):
+    return Image.open(io.BytesIO(base64.b64decode(b64))).convert("RGB")
+
+
+def reconstruct(records, out_dir, fmt, include_partial):
+    """Walk each keyframe's uploads in capture order and write one image per frame."""
+    # Group tiles by the frame they belong to; keyframes are their own frame
+    frames = {}
+    for key, record in records.items():
+        meta = record["meta"]
+        if meta.get("tile"):
+            frame_id = meta.get("frame") or key.rsplit("_t", 1)[0]
+            frames.setdefault(frame_id, {"tiles": []})["tiles"].append(record)
+        else:
+            frames.setdefault(key, {"tiles": []})["keyframe"] = record
+
+    # Each tile frame builds on the keyframe it names, so chains are independent
+    chains = {}
+    for frame_id, entry in frames.items():
+        if "keyframe" in entry:
+            chain = frame_id
+        else:
+            chain = entry["tiles"][0]["meta"].get("keyframe") or ""
+        chains.setdefault(chain, []).append(frame_id)
+
+    out_dir.mkdir(parents=True, exist_ok=True)
+    written = skipped = 0
+
+    for chain in sorted(chains, key=capture_order):
+        canvas = None
+        for frame_id in sorted(chains[chain], key=capture_order):
+            entry = frames[frame_id]
+            if "keyframe" in entry:
+                canvas = decode_image(entry["keyframe"]["image"])
+            else:
+                tiles = sorted(entry["tiles"], key=lambda t: t["meta"].get("index", 0))
+                expected = tiles[0]["meta"].get("count", len(tiles))
+                if canvas is None:
+                    print(f"{frame_id}: keyframe {chain or '?'} not available, skipped")
+                    skipped += 1
+                    continue
+                if len(tiles) < expected and not include_partial:
+                    print(f"{frame_id}: {len(tiles)} of {expected} tiles, skipped")
+                    skipped += 1
+                    continue
+
+                # The canvas carries every earlier frame's tiles since the keyframe
+                for tile in tiles:
+                    meta = tile["meta"]
+                    image = decode_image(tile["image"])
+                    if image.size != (meta["width"], meta["height"]):
+                        print(f"{frame_id}: tile {meta.get('index')} is {image.size}, "
+                              f"metadata says {meta['width']}x{meta['height']}")
+                    canvas.paste(image, (meta["x"], meta["y"]))
+
+            canvas.save(out_dir / f"{frame_id}.{fmt}")
+            written += 1
+
+    return written, skipped
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Rebuild frames from keyframe plus tile uploads")
+    parser.add_argument("export", help="Realtime Database JSON export")
+    parser.add_argument("--out", "-o", default="frames", help="Output directory (default: frames)")
+    parser.add_argument("--format", "-f", default="png", choices=["png", "jpg", "bmp"],
+                        help="Output image format (default: png)")
+    parser.add_argument("--include-partial", action="store_true",
+                        help="Also write frames with missing tiles")
+    args = parser.parse_args()
+
+    records = load_records(args.export)
+    if not records:
+        sys.exit("No image records found")
+
+    written, skipped = reconstruct(records, Path(args.out), args.format, args.include_partial)
+    print(f"Wrote {written} frame(s) to {args.out}, skipped {skipped}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,466 @@
+// Host goodput measurement for main/src/resumable_upload.c on a lossy link.
+//
+// Runs the firmware's resumable uploader and SPIFFS spool against a stand-in
+// for the Firebase Storage resumable protocol, served by a thread of this
+// process on a loopback port. The stand-in plays a flaky uplink: each request
+// body is cut after a random number of bytes, drawn from an exponential
+// distribution whose mean is -l (the mean bytes between drops), and the server
+// keeps what it received rounded down to the chunk granularity -g, as Storage
+// does. Every finalized object is compared with the frame that was spooled.
+//
+// One frame is spooled and the spool drained per capture cycle, as main.c does
+// in UPLOAD_MODE_RESUMABLE; after the last frame, cycles continue until the
+// spool is empty. The same frames are then sent the way a plain PUT retry loop
+// would, restarting from byte zero after every drop, over the same loss model.
+// Goodput is frame bytes delivered divided by body bytes the server read.
+//
+// With -x, that fraction of frames is refused with 400 at session start; the
+// drain must quarantine them and deliver the rest.
+//
+// Build from the repository root:
+//   gcc -O2 -pthread -DHOST_SKIP_DELAYS -DSPOOL_BASE_PATH='"goodput_spool"' -Itools/host -Imain/include
+//       -o resumable_goodput tools/resumable_goodput.c main/src/resumable_upload.c
+//       main/src/spool_manager.c tools/host/http_client_host.c -lm
+//   ./resumable_goodput [-n frames] [-s frame_bytes] [-l mean_bytes_between_drops] [-g granularity]
+//                       [-x reject_fraction] [-r seed]
+//
+// The spool directory is emptied first. Exits non-zero if a delivered object
+// differs from its frame or a refused frame was not quarantined.
+
+#include "resumable_upload.h"
+#include "spool_manager.h"
+#include "config.h"
+#include "esp_http_client.h"
+#include <dirent.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MAX_FRAMES 1024
+#define MAX_SESSIONS (MAX_FRAMES * 4)
+#define KEY_LEN 32
+
+typedef struct {
+    char name[KEY_LEN];
+    uint8_t *data;
+    size_t total;
+    size_t committed;
+    bool final;
+} session_t;
+
+static struct {
+    int listen_fd;
+    int port;
+    double mean_drop_bytes;
+    size_t granularity;
+    double reject_fraction;
+    uint64_t rng;
+    session_t sessions[MAX_SESSIONS];
+    int session_count;
+    uint64_t resumable_wire;    // Body bytes read for the resumable protocol
+    uint64_t naive_wire;        // Body bytes read for the restart-from-zero PUTs
+    uint32_t drops;
+    uint32_t refused;
+} standin;
+
+static uint8_t *frames[MAX_FRAMES];
+static size_t frame_len;
+static int frame_count;
+static int records_written;
+
+static uint64_t next_random(void) {
+    standin.rng ^= standin.rng << 13;
+    standin.rng ^= standin.rng >> 7;
+    standin.rng ^= standin.rng << 17;
+    return standin.rng;
+}
+
+static double uniform(void) {
+    return (double)(next_random() >> 11) / 9007199254740992.0;
+}
+
+static int frame_index(const char *key) {
+    int index = -1;
+    return sscanf(key, "frame%d", &index) == 1 && index >= 0 && index < frame_count ? index : -1;
+}
+
+// Frames whose index hashes below the reject fraction are refused at session start
+static bool frame_refused(int index) {
+    uint32_t h = (uint32_t)index * 2654435761u;
+    return (double)(h >> 8) / (double)(1u << 24) < standin.reject_fraction;
+}
+
+// The database record is counted, not sent; only the Storage protocol is measured
+esp_err_t firebase_put_json(const char *path, const char *json) {
+    records_written++;
+    return ESP_OK;
+}
+
+static void respond(int fd, int status, const char *headers) {
+    char response[512];
+    int len = snprintf(response, sizeof(response), "HTTP/1.1 %d X\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+                       status, headers);
+    send(fd, response, (size_t)len, MSG_NOSIGNAL);
+}
+
+// Read the head of a request into buf; returns the header length or -1. Body bytes
+// that arrived with it are left at buf + header length, *extra of them.
+static int read_head(int fd, char *buf, size_t max_len, size_t *extra) {
+    size_t len = 0;
+    while (len < max_len - 1) {
+        ssize_t n = recv(fd, buf + len, max_len - 1 - len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        len += (size_t)n;
+        buf[len] = '\0';
+        char *end = strstr(buf, "\r\n\r\n");
+        if (end != NULL) {
+            *extra = len - (size_t)(end + 4 - buf);
+            return (int)(end + 4 - buf);
+        }
+    }
+    return -1;
+}
+
+static const char *header_value(const char *head, const char *name, char *value, size_t max_len) {
+    value[0] = '\0';
+    size_t name_len = strlen(name);
+    for (const char *line = strstr(head, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, name_len) == 0 && line[2 + name_len] == ':') {
+            const char *v = line + 3 + name_len;
+            while (*v == ' ') {
+                v++;
+            }
+            size_t n = strcspn(v, "\r");
+            snprintf(value, max_len, "%.*s", (int)(n < max_len ? n : max_len - 1), v);
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// Receive up to len body bytes into dst (NULL to discard), stopping early at the
+// link's drop point; returns the bytes read
+static size_t read_body(int fd, char *pending, size_t pending_len, uint8_t *dst, size_t len, size_t cut) {
+    size_t limit = len < cut ? len : cut;
+    size_t got = pending_len < limit ? pending_len : limit;
+    if (dst != NULL) {
+        memcpy(dst, pending, got);
+    }
+    char scratch[16384];
+    while (got < limit) {
+        size_t want = limit - got;
+        ssize_t n = recv(fd, dst ? (char *)dst + got : scratch, dst ? want : (want < sizeof(scratch) ? want : sizeof(scratch)), 0);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    return got;
+}
+
+static void drop_connection(int fd) {
+    struct linger hard = {.l_onoff = 1, .l_linger = 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard));
+    standin.drops++;
+}
+
+static void handle(int fd) {
+    char head[8192];
+    size_t extra = 0;
+    int head_len = read_head(fd, head, sizeof(head), &extra);
+    if (head_len < 0) {
+        return;
+    }
+    char method[8], path[1024], value[256];
+    if (sscanf(head, "%7s %1023s", method, path) != 2) {
+        return;
+    }
+    size_t body_len = header_value(head, "Content-Length", value, sizeof(value)) ? strtoull(value, NULL, 10) : 0;
+    header_value(head, "X-Goog-Upload-Command", value, sizeof(value));
+    char command[32];
+    snprintf(command, sizeof(command), "%.31s", value);
+    char *pending = head + head_len;
+    size_t cut = (size_t)(-log(1.0 - uniform()) * standin.mean_drop_bytes);
+
+    if (strncmp(path, "/naive/", 7) == 0) {
+        size_t got = read_body(fd, pending, extra, NULL, body_len, cut);
+        standin.naive_wire += got;
+        if (got < body_len) {
+            drop_connection(fd);
+            return;
+        }
+        respond(fd, 200, "");
+        return;
+    }
+
+    if (strcmp(command, "start") == 0) {
+        size_t got = read_body(fd, pending, extra, NULL, body_len, cut);
+        standin.resumable_wire += got;
+        if (got < body_len) {
+            drop_connection(fd);
+            return;
+        }
+        const char *name = strstr(path, "name=images%2F");
+        char key[KEY_LEN] = "";
+        if (name != NULL) {
+            snprintf(key, sizeof(key), "%.*s", (int)strcspn(name + 14, ".&"), name + 14);
+        }
+        int index = frame_index(key);
+        header_value(head, "X-Goog-Upload-Header-Content-Length", value, sizeof(value));
+        size_t total = strtoull(value, NULL, 10);
+        if (index < 0 || frame_refused(index) || total == 0 || standin.session_count == MAX_SESSIONS) {
+            standin.refused++;
+            respond(fd, 400, "");
+            return;
+        }
+
+        session_t *session = &standin.sessions[standin.session_count];
+        snprintf(session->name, sizeof(session->name), "%s", key);
+        session->data = malloc(total);
+        session->total = total;
+        char headers[256];
+        snprintf(headers, sizeof(headers), "X-Goog-Upload-Status: active\r\nX-Goog-Upload-URL: http://127.0.0.1:%d/upload/%d\r\n"
+                 "X-Goog-Upload-Chunk-Granularity: %zu\r\n", standin.port, standin.session_count, standin.granularity);
+        standin.session_count++;
+        respond(fd, 200, headers);
+        return;
+    }
+
+    int id = -1;
+    if (sscanf(path, "/upload/%d", &id) != 1 || id < 0 || id >= standin.session_count) {
+        respond(fd, 404, "");
+        return;
+    }
+    session_t *session = &standin.sessions[id];
+    char headers[160];
+
+    if (strcmp(command, "query") == 0) {
+        snprintf(headers, sizeof(headers), "X-Goog-Upload-Status: %s\r\nX-Goog-Upload-Size-Received: %zu\r\n",
+                 session->final ? "final" : "active", session->committed);
+        respond(fd, 200, headers);
+        return;
+    }
+
+    header_value(head, "X-Goog-Upload-Offset", value, sizeof(value));
+    size_t offset = strtoull(value, NULL, 10);
+    bool finalize = strstr(command, "finalize") != NULL;
+    if (strncmp(command, "upload", 6) != 0 || session->final || offset != session->committed ||
+        offset + body_len > session->total) {
+        read_body(fd, pending, extra, NULL, body_len, body_len);
+        respond(fd, 400, "");
+        return;
+    }
+
+    size_t got = read_body(fd, pending, extra, session->data + offset, body_len, cut);
+    standin.resumable_wire += got;
+    if (got < body_len) {
+        session->committed += got / standin.granularity * standin.granularity;
+        drop_connection(fd);
+        return;
+    }
+    if (!finalize && body_len % standin.granularity != 0) {
+        respond(fd, 400, "");
+        return;
+    }
+    session->committed += got;
+    session->final = finalize && session->committed == session->total;
+    snprintf(headers, sizeof(headers), "X-Goog-Upload-Status: %s\r\n", session->final ? "final" : "active");
+    respond(fd, 200, headers);
+}
+
+static void *standin_thread(void *arg) {
+    for (;;) {
+        int fd = accept(standin.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        handle(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static bool standin_start(void) {
+    standin.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    if (standin.listen_fd < 0 || bind(standin.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(standin.listen_fd, 16) != 0 || getsockname(standin.listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("stand-in");
+        return false;
+    }
+    standin.port = ntohs(addr.sin_port);
+    pthread_t thread;
+    return pthread_create(&thread, NULL, standin_thread, NULL) == 0;
+}
+
+static void empty_spool(void) {
+    DIR *dir = opendir(SPOOL_BASE_PATH);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", SPOOL_BASE_PATH, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+// Plain PUT of the whole frame, restarted from byte zero until one gets through
+static uint32_t naive_upload(int index, char *url) {
+    uint32_t attempts = 0;
+    for (;;) {
+        attempts++;
+        snprintf(url + strlen("http://127.0.0.1:00000"), 32, "/naive/%d", index);
+        esp_http_client_config_t config = {.url = url, .method = HTTP_METHOD_PUT, .timeout_ms = 5000};
+        esp_http_client_handle_t client = esp_http_client_init(&config);
+        bool ok = false;
+        if (esp_http_client_open(client, (int)frame_len) == ESP_OK) {
+            size_t written = 0;
+            while (written < frame_len) {
+                int n = esp_http_client_write(client, (const char *)frames[index] + written, (int)(frame_len - written));
+                if (n <= 0) {
+                    break;
+                }
+                written += (size_t)n;
+            }
+            ok = written == frame_len && esp_http_client_fetch_headers(client) >= 0 &&
+                 esp_http_client_get_status_code(client) == 200;
+        }
+        esp_http_client_cleanup(client);
+        if (ok) {
+            return attempts;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int frames_wanted = 50;
+    frame_len = 200 * 1024;
+    standin.mean_drop_bytes = 512 * 1024;
+    standin.granularity = 256 * 1024;
+    standin.rng = 0x9E3779B97F4A7C15ull;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:l:g:x:r:")) != -1) {
+        switch (opt) {
+        case 'n': frames_wanted = atoi(optarg); break;
+        case 's': frame_len = strtoul(optarg, NULL, 10); break;
+        case 'l': standin.mean_drop_bytes = atof(optarg); break;
+        case 'g': standin.granularity = strtoul(optarg, NULL, 10); break;
+        case 'x': standin.reject_fraction = atof(optarg); break;
+        case 'r': standin.rng = strtoull(optarg, NULL, 10) | 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-s frame_bytes] [-l mean_bytes_between_drops] [-g granularity] "
+                    "[-x reject_fraction] [-r seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (frames_wanted < 1 || frames_wanted > MAX_FRAMES || frame_len == 0 || standin.granularity == 0 ||
+        standin.mean_drop_bytes <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    frame_count = frames_wanted;
+    for (int i = 0; i < frame_count; i++) {
+        frames[i] = malloc(frame_len);
+        for (size_t j = 0; j < frame_len; j++) {
+            frames[i][j] = (uint8_t)next_random();
+        }
+    }
+
+    if (!standin_start()) {
+        return 1;
+    }
+    char base[64];
+    snprintf(base, sizeof(base), "http://127.0.0.1:%05d", standin.port);
+    esp_http_client_host_route(FIREBASE_STORAGE_HOST, base);
+
+    empty_spool();
+    firebase_config_t config = {.project_id = "goodput"};
+    if (spool_init() != ESP_OK || resumable_upload_init(&config) != ESP_OK) {
+        return 1;
+    }
+
+    int delivered = 0;
+    int cycles = 0;
+    for (int i = 0; i < frame_count || (spool_pending_count() > 0 && cycles < frame_count * 100); cycles++) {
+        if (i < frame_count) {
+            char key[KEY_LEN];
+            snprintf(key, sizeof(key), "frame%04d", i);
+            spool_store_frame(key, frames[i], frame_len);
+            i++;
+        }
+        delivered += resumable_upload_drain();
+    }
+
+    int verified = 0;
+    int corrupt = 0;
+    int refused_delivered = 0;
+    for (int s = 0; s < standin.session_count; s++) {
+        session_t *session = &standin.sessions[s];
+        int index = frame_index(session->name);
+        if (!session->final) {
+            continue;
+        }
+        if (session->total == frame_len && memcmp(session->data, frames[index], frame_len) == 0) {
+            verified++;
+        } else {
+            corrupt++;
+        }
+        refused_delivered += frame_refused(index);
+    }
+    int expected_refused = 0;
+    for (int i = 0; i < frame_count; i++) {
+        expected_refused += frame_refused(i);
+    }
+
+    resumable_upload_stats_t stats;
+    resumable_upload_get_stats(&stats);
+    uint64_t delivered_bytes = (uint64_t)verified * frame_len;
+    printf("frames %d x %zu bytes, mean %.0f bytes between drops, granularity %zu, chunk %d\n", frame_count, frame_len,
+           standin.mean_drop_bytes, standin.granularity, RESUMABLE_CHUNK_SIZE);
+    size_t pending = spool_pending_count();
+    printf("resumable: %d delivered (%d verified, %d corrupt), %u quarantined, %d evicted, %zu left in spool, %d cycles\n",
+           delivered, verified, corrupt, (unsigned)stats.frames_quarantined,
+           frame_count - delivered - (int)stats.frames_quarantined - (int)pending, pending, cycles);
+    printf("resumable: %llu body bytes on the wire, goodput %.1f%%, %u drops, %u sessions resumed\n",
+           (unsigned long long)standin.resumable_wire,
+           standin.resumable_wire ? 100.0 * (double)delivered_bytes / (double)standin.resumable_wire : 0.0,
+           (unsigned)standin.drops, (unsigned)stats.sessions_resumed);
+
+    uint32_t drops_before = standin.drops;
+    uint64_t naive_attempts = 0;
+    int naive_frames = 0;
+    for (int i = 0; i < frame_count; i++) {
+        if (!frame_refused(i)) {
+            naive_attempts += naive_upload(i, base);
+            naive_frames++;
+        }
+    }
+    printf("restart:   %d delivered, %llu attempts, %llu body bytes on the wire, goodput %.1f%%, %u drops\n",
+           naive_frames, (unsigned long long)naive_attempts, (unsigned long long)standin.naive_wire,
+           standin.naive_wire ? 100.0 * (double)naive_frames * (double)frame_len / (double)standin.naive_wire : 0.0,
+           (unsigned)(standin.drops - drops_before));
+
+    bool ok = corrupt == 0 && refused_delivered == 0 && (int)stats.frames_quarantined == expected_refused;
+    if (!ok) {
+        fprintf(stderr, "FAIL: %d corrupt, %d refused frames delivered, %u of %d refused frames quarantined\n",
+                corrupt, refused_delivered, (unsigned)stats.frames_quarantined, expected_refused);
+    }
+    return ok ? 0 : 1;
+}
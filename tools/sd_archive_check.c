@@ -0,0 +1,354 @@
+// Host check for main/src/sd_archive.c.
+//
+// Appends frames of varying size to an archive in a local directory with small
+// segments so it rolls over and retention deletes the oldest ones. It then
+// reopens the archive, appends a few more frames and syncs. Finally the
+// directory is moved away across a rollover, as a pulled or full card would
+// fail it, and later appends must retry and carry on once it is back. After
+// the sync and again after the final close, every segment file is read back
+// independently of the writer:
+//   - the file must be preallocated to its full size;
+//   - the header must be consistent;
+//   - each index entry must point at a packed record whose header matches it;
+//   - each payload must match the frame that was appended.
+// The surviving frames must be exactly the last frames the writer accepted.
+// The first run's stats give the sustained write throughput, with wall-clock
+// throughput including preallocation shown next to it.
+//
+// The directory can be anywhere, including a mounted FAT image, for example
+//   mkfs.vfat -C sd.img 262144 && mount -o loop sd.img /mnt/sd && ./sd_archive_check -d /mnt/sd/ARCHIVE
+// On the host the writer always zero-fills. The IDF f_expand() path is only
+// exercised on the device.
+//
+// Build from the repository root:
+//   gcc -O2 -Wall -DSD_ARCHIVE_SEGMENT_SIZE='(8 * 1024 * 1024)' -DSD_ARCHIVE_MAX_SEGMENTS=4
+//       -Itools/host -Imain/include -o sd_archive_check tools/sd_archive_check.c main/src/sd_archive.c
+//   ./sd_archive_check [-n frames] [-s mean_frame_bytes] [-d dir]
+//
+// Segment files already in the directory are deleted first. Exits non-zero if
+// anything read back differs from what was written.
+
+#include "sd_archive.h"
+#include "config.h"
+#include "esp_timer.h"
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TIMESTAMP_BASE 1700000000u
+#define REOPEN_FRAMES 6
+
+static const char *archive_dir = "archive_check";
+static int failures;
+
+static void fail(const char *what, unsigned segment, unsigned frame) {
+    printf("FAIL: segment %u frame %u: %s\n", segment, frame, what);
+    failures++;
+}
+
+// Frame contents are derived from the timestamp so the reader can regenerate them
+static void fill_frame(uint8_t *buf, size_t len, uint32_t timestamp) {
+    uint32_t seed = timestamp * 2654435761u;
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1664525 + 1013904223;
+        buf[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+static size_t frame_len(uint32_t timestamp, size_t mean) {
+    uint32_t h = timestamp * 2246822519u;
+    h ^= h >> 15;
+    return mean / 2 + h % (mean + 1);
+}
+
+static int compare_unsigned(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a;
+    unsigned y = *(const unsigned *)b;
+    return (x > y) - (x < y);
+}
+
+// Segment numbers present in the directory, ascending
+static size_t list_segments(unsigned *numbers, size_t max) {
+    DIR *dir = opendir(archive_dir);
+    if (dir == NULL) {
+        return 0;
+    }
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < max) {
+        unsigned number;
+        if (sscanf(entry->d_name, "SEG%5u.BIN", &number) == 1) {
+            numbers[count++] = number;
+        }
+    }
+    closedir(dir);
+    qsort(numbers, count, sizeof(numbers[0]), compare_unsigned);
+    return count;
+}
+
+static void remove_segments(void) {
+    unsigned numbers[1024];
+    size_t count = list_segments(numbers, 1024);
+    for (size_t i = 0; i < count; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/SEG%05u.BIN", archive_dir, numbers[i]);
+        unlink(path);
+    }
+}
+
+// Reads one segment back and appends the timestamps it holds to found[]
+static void verify_segment(unsigned number, size_t mean, uint32_t *found, size_t *found_count, size_t max_found) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/SEG%05u.BIN", archive_dir, number);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fail("cannot open", number, 0);
+        return;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size != SD_ARCHIVE_SEGMENT_SIZE) {
+        fail("file is not preallocated to the segment size", number, 0);
+    }
+
+    sd_archive_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1) {
+        fail("short header", number, 0);
+        fclose(f);
+        return;
+    }
+    uint32_t index_bytes = SD_ARCHIVE_INDEX_ENTRIES * sizeof(sd_archive_index_entry_t);
+    uint32_t index_offset = SD_ARCHIVE_SEGMENT_SIZE -
+                            (index_bytes + SD_ARCHIVE_SECTOR_SIZE - 1) / SD_ARCHIVE_SECTOR_SIZE * SD_ARCHIVE_SECTOR_SIZE;
+    if (header.magic != SD_ARCHIVE_MAGIC || header.version != SD_ARCHIVE_VERSION ||
+        header.segment_size != SD_ARCHIVE_SEGMENT_SIZE || header.sector_size != SD_ARCHIVE_SECTOR_SIZE ||
+        header.index_capacity != SD_ARCHIVE_INDEX_ENTRIES || header.index_offset != index_offset ||
+        header.frame_count > header.index_capacity || header.data_end > header.index_offset) {
+        fail("bad header", number, 0);
+        fclose(f);
+        return;
+    }
+
+    sd_archive_index_entry_t *index = malloc(index_bytes);
+    uint8_t *expected = malloc(2 * mean + 1);
+    uint8_t *payload = malloc(2 * mean + 1);
+    fseek(f, (long)header.index_offset, SEEK_SET);
+    if (fread(index, sizeof(index[0]), header.frame_count, f) != header.frame_count) {
+        fail("short index", number, 0);
+        header.frame_count = 0;
+    }
+
+    // Records are packed back to back after the header sector
+    uint32_t next_offset = SD_ARCHIVE_SECTOR_SIZE;
+    for (uint32_t i = 0; i < header.frame_count; i++) {
+        const sd_archive_index_entry_t *entry = &index[i];
+        if (entry->offset != next_offset || entry->length > 2 * mean ||
+            entry->offset + sizeof(sd_archive_record_t) + entry->length > header.data_end) {
+            fail("index entry out of place", number, i);
+            break;
+        }
+
+        sd_archive_record_t record;
+        fseek(f, (long)entry->offset, SEEK_SET);
+        if (fread(&record, sizeof(record), 1, f) != 1 || record.magic != SD_ARCHIVE_RECORD_MAGIC ||
+            record.length != entry->length || record.timestamp != entry->timestamp ||
+            record.sequence != entry->sequence) {
+            fail("record header does not match the index", number, i);
+            break;
+        }
+
+        size_t len = frame_len(entry->timestamp, mean);
+        fill_frame(expected, len, entry->timestamp);
+        if (entry->length != len || fread(payload, 1, len, f) != len || memcmp(payload, expected, len) != 0) {
+            fail("payload differs from the frame written", number, i);
+        }
+
+        if (*found_count < max_found) {
+            found[(*found_count)++] = entry->timestamp;
+        }
+        next_offset = entry->offset + (uint32_t)(sizeof(sd_archive_record_t) + entry->length);
+    }
+    if (next_offset != header.data_end) {
+        fail("data_end does not follow the last record", number, header.frame_count);
+    }
+
+    printf("segment %05u  %5u frame(s)  %8u data bytes\n", number, (unsigned)header.frame_count,
+           (unsigned)(header.data_end - SD_ARCHIVE_SECTOR_SIZE));
+    free(index);
+    free(expected);
+    free(payload);
+    fclose(f);
+}
+
+// Timestamps of every frame the writer accepted, in order
+static uint32_t *accepted;
+static size_t accepted_count;
+
+static esp_err_t append_frame(uint32_t timestamp, size_t mean, uint8_t *buf) {
+    size_t len = frame_len(timestamp, mean);
+    fill_frame(buf, len, timestamp);
+    esp_err_t err = sd_archive_append(buf, len, timestamp);
+    if (err == ESP_OK) {
+        accepted[accepted_count++] = timestamp;
+    }
+    return err;
+}
+
+static esp_err_t append_frames(uint32_t first, unsigned count, size_t mean, uint8_t *buf) {
+    for (unsigned i = 0; i < count; i++) {
+        esp_err_t err = append_frame(first + i, mean, buf);
+        if (err != ESP_OK) {
+            printf("FAIL: append of frame %u returned %s\n", first + i - TIMESTAMP_BASE, esp_err_to_name(err));
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+// Reads back every segment. Retention only drops whole segments from the front, so
+// what is left must be exactly the tail of the accepted frames.
+static size_t verify_archive(size_t mean) {
+    unsigned numbers[1024];
+    size_t segment_count = list_segments(numbers, 1024);
+    uint32_t *found = malloc((accepted_count + 1) * sizeof(uint32_t));
+    size_t found_count = 0;
+    for (size_t i = 0; i < segment_count; i++) {
+        verify_segment(numbers[i], mean, found, &found_count, accepted_count + 1);
+    }
+
+    if (segment_count > SD_ARCHIVE_MAX_SEGMENTS) {
+        printf("FAIL: %zu segments kept, retention allows %d\n", segment_count, SD_ARCHIVE_MAX_SEGMENTS);
+        failures++;
+    }
+    if (found_count == 0 || found_count > accepted_count ||
+        memcmp(found, accepted + accepted_count - found_count, found_count * sizeof(uint32_t)) != 0) {
+        printf("FAIL: the %zu frame(s) read back are not the last frames accepted\n", found_count);
+        failures++;
+    }
+
+    printf("%zu segment(s) kept, %zu frame(s) read back\n\n", segment_count, found_count);
+    free(found);
+    return found_count;
+}
+
+int main(int argc, char **argv) {
+    unsigned frames = 1000;
+    size_t mean = 40000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:d:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            mean = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            archive_dir = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-s mean_frame_bytes] [-d dir]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (mean < 2) {
+        mean = 2;
+    }
+
+    mkdir(archive_dir, 0755);
+    remove_segments();
+    uint8_t *buf = malloc(2 * mean + 1);
+    // Three runs of at most frames + REOPEN_FRAMES each
+    accepted = malloc(3 * ((size_t)frames + REOPEN_FRAMES) * sizeof(uint32_t));
+
+    // First run: roll over several segments
+    uint64_t payload_bytes = 0;
+    for (unsigned i = 0; i < frames; i++) {
+        payload_bytes += frame_len(TIMESTAMP_BASE + i, mean);
+    }
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = sd_archive_open(archive_dir);
+    if (err == ESP_OK) {
+        err = append_frames(TIMESTAMP_BASE, frames, mean, buf);
+    }
+    esp_err_t close_err = sd_archive_close();
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    if (err != ESP_OK || close_err != ESP_OK) {
+        failures++;
+    }
+
+    sd_archive_stats_t stats;
+    sd_archive_get_stats(&stats);
+
+    // Second run: reopening starts a fresh segment; check it on disk after a sync, while still open
+    uint32_t next = TIMESTAMP_BASE + frames;
+    err = sd_archive_open(archive_dir);
+    if (err == ESP_OK) {
+        err = append_frames(next, REOPEN_FRAMES, mean, buf);
+        next += REOPEN_FRAMES;
+    }
+    if (err == ESP_OK) {
+        err = sd_archive_sync();
+    }
+    if (err != ESP_OK) {
+        failures++;
+    }
+    printf("after reopen and sync:\n");
+    verify_archive(mean);
+    sd_archive_close();
+
+    // Third run: the directory disappears (card pulled, full card) across a rollover. The
+    // failed rollover must be retried by later appends once it is back.
+    char away[256];
+    snprintf(away, sizeof(away), "%s.away", archive_dir);
+    err = sd_archive_open(archive_dir);
+    if (err != ESP_OK || rename(archive_dir, away) != 0) {
+        printf("FAIL: cannot set up the rollover failure\n");
+        failures++;
+    }
+    sd_archive_stats_t outage;
+    unsigned lost = 0;
+    for (unsigned i = 0; i < frames + REOPEN_FRAMES; i++) {
+        if (append_frame(next++, mean, buf) != ESP_OK) {
+            lost++;
+        }
+        sd_archive_get_stats(&outage);
+        if (outage.open_errors >= 3) {
+            break;
+        }
+    }
+    rename(away, archive_dir);
+    err = append_frames(next, REOPEN_FRAMES, mean, buf);
+    next += REOPEN_FRAMES;
+    sd_archive_get_stats(&outage);
+    if (err != ESP_OK || outage.open_errors < 3 || lost != outage.open_errors) {
+        printf("FAIL: rollover failure was not retried (%u open error(s), %u frame(s) refused)\n",
+               (unsigned)outage.open_errors, lost);
+        failures++;
+    }
+    close_err = sd_archive_close();
+    if (close_err != ESP_OK) {
+        failures++;
+    }
+    printf("after a failed rollover (%u open error(s), %u frame(s) refused) and close:\n",
+           (unsigned)outage.open_errors, lost);
+    verify_archive(mean);
+
+    printf("%u frame(s), %.1f MB of payload, %u segment(s) opened, %u write error(s)\n",
+           (unsigned)stats.frames_written, payload_bytes / 1e6, (unsigned)stats.segments_opened,
+           (unsigned)stats.write_errors);
+    printf("sustained write: %.1f MB/s (%.1f MB in %.2f s of write/fsync)\n",
+           stats.write_time_us ? stats.bytes_written / (double)stats.write_time_us : 0.0, stats.bytes_written / 1e6,
+           stats.write_time_us / 1e6);
+    printf("wall clock incl. preallocation: %.1f MB/s of payload\n",
+           elapsed_us > 0 ? payload_bytes / (double)elapsed_us : 0.0);
+    printf("%s\n", failures == 0 ? "all checks passed" : "FAILED");
+
+    free(accepted);
+    free(buf);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Host benchmark and check for main/src/tinyml.c.
+//
+// Loads a .tflite model with the firmware's interpreter and reports, per
+// operator type, the share of the inference time and multiply-accumulates,
+// plus the memory the device needs: the planned activation arena, the
+// requantization tables and the interpreter state. The arena is filled with a
+// canary before the run so the bytes actually written can be compared with
+// the plan. With -i and -e the output for a known input is compared with an
+// expected one, e.g. from tools/tinyml_model.py:
+//
+//   python3 tools/tinyml_model.py --out /tmp/tinyml
+//   ./tinyml_bench -i /tmp/tinyml/input.bin -e /tmp/tinyml/expected.bin /tmp/tinyml/model.tflite
+//
+// Build from the repository root:
+//   gcc -O2 -Itools/host -Imain/include -o tinyml_bench
+//       tools/tinyml_bench.c main/src/tinyml.c -lm
+//   ./tinyml_bench [-n iterations] [-a arena_bytes] [-t tolerance] [-i input.bin] [-e expected.bin] model.tflite
+//
+// Host timings are not device timings; compare the MAC count with the
+// avg_us the firmware logs in person_detect_get_stats() to scale them.
+
+#include "tinyml.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CANARY 0xA5
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+static uint64_t op_macs(const tinyml_model_t *m, const tinyml_op_t *op) {
+    const tinyml_tensor_t *in = &m->tensors[op->inputs[0]];
+    const tinyml_tensor_t *out = &m->tensors[op->output];
+    const tinyml_tensor_t *filter = op->inputs[1] >= 0 ? &m->tensors[op->inputs[1]] : NULL;
+    switch (op->type) {
+        case TINYML_OP_CONV_2D:
+            return (uint64_t)out->bytes * filter->dims[1] * filter->dims[2] * in->dims[3];
+        case TINYML_OP_DEPTHWISE_CONV_2D:
+            return (uint64_t)out->bytes * filter->dims[1] * filter->dims[2];
+        case TINYML_OP_AVERAGE_POOL_2D:
+        case TINYML_OP_MAX_POOL_2D:
+            return (uint64_t)out->bytes * op->filter_w * op->filter_h;
+        case TINYML_OP_FULLY_CONNECTED:
+            return (uint64_t)in->bytes * filter->dims[0];
+        default:
+            return 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = 20;
+    size_t arena_size = 256 * 1024;
+    int tolerance = 0;
+    const char *input_path = NULL;
+    const char *expected_path = NULL;
+    const char *model_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'n': iterations = atoi(argv[++i]); continue;
+                case 'a': arena_size = (size_t)atol(argv[++i]); continue;
+                case 't': tolerance = atoi(argv[++i]); continue;
+                case 'i': input_path = argv[++i]; continue;
+                case 'e': expected_path = argv[++i]; continue;
+                default: break;
+            }
+        }
+        model_path = argv[i];
+    }
+    if (model_path == NULL) {
+        fprintf(stderr, "usage: %s [-n iterations] [-a arena_bytes] [-t tolerance] [-i input.bin] "
+                        "[-e expected.bin] model.tflite\n", argv[0]);
+        return 2;
+    }
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    size_t model_len = 0;
+    uint8_t *tflite = read_file(model_path, &model_len);
+    uint8_t *arena = malloc(arena_size);
+    tinyml_model_t *model = malloc(sizeof(tinyml_model_t));
+    if (tflite == NULL || arena == NULL || model == NULL) {
+        return 1;
+    }
+    memset(arena, CANARY, arena_size);
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = tinyml_load(model, tflite, model_len, arena, arena_size);
+    int64_t load_us = esp_timer_get_time() - start;
+    if (err != ESP_OK) {
+        fprintf(stderr, "Load failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+
+    tinyml_tensor_t *input = tinyml_input(model);
+    if (input_path != NULL) {
+        size_t len = 0;
+        uint8_t *data = read_file(input_path, &len);
+        if (data == NULL || len != input->bytes) {
+            fprintf(stderr, "%s: expected %zu bytes\n", input_path, input->bytes);
+            return 1;
+        }
+        memcpy((void *)input->data, data, len);
+        free(data);
+    } else {
+        srand(1);
+        for (size_t i = 0; i < input->bytes; i++) {
+            ((int8_t *)input->data)[i] = (int8_t)(rand() & 0xFF);
+        }
+    }
+
+    // The input is overwritten by the first activations that share its slot, so keep a copy
+    uint8_t *input_copy = malloc(input->bytes);
+    memcpy(input_copy, input->data, input->bytes);
+
+    double op_us[TINYML_OP_COUNT] = {0};
+    uint64_t type_macs[TINYML_OP_COUNT] = {0};
+    int type_count[TINYML_OP_COUNT] = {0};
+    for (int i = 0; i < model->op_count; i++) {
+        type_macs[model->ops[i].type] += op_macs(model, &model->ops[i]);
+        type_count[model->ops[i].type]++;
+    }
+
+    double total_us = 0, best_us = 1e18;
+    for (int it = 0; it < iterations; it++) {
+        memcpy((void *)input->data, input_copy, input->bytes);
+        double run_us = 0;
+        for (int i = 0; i < model->op_count; i++) {
+            int64_t t0 = esp_timer_get_time();
+            err = tinyml_invoke_op(model, i);
+            int64_t dt = esp_timer_get_time() - t0;
+            if (err != ESP_OK) {
+                fprintf(stderr, "Operator %d failed: %s\n", i, esp_err_to_name(err));
+                return 1;
+            }
+            op_us[model->ops[i].type] += (double)dt;
+            run_us += (double)dt;
+        }
+        total_us += run_us;
+        best_us = run_us < best_us ? run_us : best_us;
+    }
+
+    printf("model      %zu bytes, %d ops, %d tensors, parsed and planned in %.2f ms\n", model_len,
+           model->op_count, model->tensor_count, load_us / 1000.0);
+    printf("input      %dx%dx%d int8, scale %.6f, zero point %d\n", (int)input->dims[1], (int)input->dims[2],
+           (int)input->dims[3], input->scale, (int)input->zero_point);
+    printf("\n%-18s %4s %10s %9s %7s\n", "operator", "n", "kMAC", "ms", "share");
+    for (int t = 0; t < TINYML_OP_COUNT; t++) {
+        if (type_count[t] == 0) {
+            continue;
+        }
+        printf("%-18s %4d %10.1f %9.3f %6.1f%%\n", tinyml_op_name((tinyml_op_type_t)t), type_count[t],
+               type_macs[t] / 1000.0, op_us[t] / iterations / 1000.0, 100.0 * op_us[t] / total_us);
+    }
+    printf("%-18s %4d %10.1f %9.3f  (best %.3f ms, %.2f GMAC/s)\n", "total", model->op_count,
+           model->macs / 1000.0, total_us / iterations / 1000.0, best_us / 1000.0,
+           model->macs / (best_us * 1000.0));
+
+    // Highest activation byte touched; the plan must cover it and nothing above it may change
+    size_t touched = 0;
+    for (size_t i = 0; i < model->arena_size - model->persistent_bytes; i++) {
+        if (model->arena[i] != CANARY) {
+            touched = i + 1;
+        }
+    }
+    printf("\nmemory     activations %zu (touched %zu), tables %zu, interpreter %zu bytes\n",
+           model->activation_bytes, touched, model->persistent_bytes, sizeof(tinyml_model_t));
+    printf("           arena to configure: %zu bytes\n",
+           model->activation_bytes + model->persistent_bytes + TINYML_ARENA_ALIGN);
+
+    int failures = touched > model->activation_bytes ? 1 : 0;
+    if (failures) {
+        printf("FAIL: activations written beyond the planned arena\n");
+    }
+
+    const tinyml_tensor_t *output = tinyml_output(model);
+    const int8_t *out = output->data;
+    printf("output    ");
+    for (size_t i = 0; i < output->bytes && i < 16; i++) {
+        printf(" %d (%.3f)", out[i], (out[i] - output->zero_point) * output->scale);
+    }
+    printf("\n");
+
+    if (expected_path != NULL) {
+        size_t len = 0;
+        uint8_t *expected = read_file(expected_path, &len);
+        if (expected == NULL || len != output->bytes) {
+            fprintf(stderr, "%s: expected %zu bytes\n", expected_path, output->bytes);
+            return 1;
+        }
+        int max_diff = 0;
+        for (size_t i = 0; i < len; i++) {
+            int diff = abs((int)out[i] - (int)(int8_t)expected[i]);
+            max_diff = diff > max_diff ? diff : max_diff;
+        }
+        printf("reference  max difference %d (tolerance %d): %s\n", max_diff, tolerance,
+               max_diff <= tolerance ? "ok" : "FAIL");
+        failures += max_diff > tolerance;
+        free(expected);
+    }
+
+    free(input_copy);
+    free(model);
+    free(arena);
+    free(tflite);
+    return failures ? 1 : 0;
+}
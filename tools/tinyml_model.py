@@ -0,0 +1,454 @@
+#!/usr/bin/env python3
+"""
+Test model generator for main/src/tinyml.c.
+
+Writes an int8 MobileNet-v1 (width 0.25, 96x96x1 input, two classes) with the
+layer layout of the TFLite Micro person_detect example as a .tflite flatbuffer,
+with random weights calibrated so no layer saturates. A random input and the
+expected output, computed here with an independent NumPy implementation of the
+TFLite reference kernels, are written next to it for tools/tinyml_bench.c.
+
+The weights are random, so the scores are meaningless; use the trained
+person_detect.tflite for the device. This model only checks that the parser
+and kernels agree with the reference arithmetic and gives the bench a
+representative workload when no trained model is at hand.
+
+Usage:
+    python3 tools/tinyml_model.py [--out DIR] [--seed N] [--head conv|fc] [--no-softmax]
+
+Requires: pip install flatbuffers numpy
+"""
+
+import argparse
+import os
+import sys
+
+try:
+    import flatbuffers
+    import numpy as np
+except ImportError:
+    print("Requires flatbuffers and numpy: pip install flatbuffers numpy")
+    sys.exit(1)
+
+# TFLite schema values
+TYPE_INT32 = 2
+TYPE_INT8 = 9
+OP_AVERAGE_POOL_2D = 1
+OP_CONV_2D = 3
+OP_DEPTHWISE_CONV_2D = 4
+OP_FULLY_CONNECTED = 9
+OP_MAX_POOL_2D = 17
+OP_RESHAPE = 22
+OP_SOFTMAX = 25
+OPTIONS_CONV_2D = 1
+OPTIONS_DEPTHWISE_CONV_2D = 2
+OPTIONS_POOL_2D = 5
+OPTIONS_FULLY_CONNECTED = 8
+OPTIONS_SOFTMAX = 9
+OPTIONS_RESHAPE = 17
+PADDING_SAME = 0
+PADDING_VALID = 1
+ACT_NONE = 0
+ACT_RELU6 = 3
+
+# (stride, output channels) of each depthwise/pointwise pair after the stem
+MOBILENET_BLOCKS = [(1, 16), (2, 32), (1, 32), (2, 64), (1, 64), (2, 128), (1, 128),
+                    (1, 128), (1, 128), (1, 128), (1, 128), (2, 256), (1, 256)]
+
+
+# ---- Reference arithmetic, mirroring the TFLite reference kernels ----
+
+def quantize_multiplier(real):
+    if real == 0.0:
+        return 0, 0
+    q, exponent = np.frexp(real)
+    q_fixed = int(np.floor(q * (1 << 31) + 0.5))     # llround; q is positive here
+    if q_fixed == (1 << 31):
+        q_fixed //= 2
+        exponent += 1
+    if exponent < -31:
+        return 0, 0
+    if exponent > 30:
+        return (1 << 31) - 1, 30
+    return q_fixed, int(exponent)
+
+
+def requantize(acc, multiplier, shift):
+    """MultiplyByQuantizedMultiplier on int64 arrays, per channel on the last axis."""
+    acc = acc.astype(np.int64)
+    multiplier = np.asarray(multiplier, dtype=np.int64)
+    shift = np.asarray(shift, dtype=np.int64)
+    left = np.where(shift > 0, shift, 0)
+    right = np.where(shift > 0, 0, -shift)
+    x = np.clip(acc << left, -(1 << 31), (1 << 31) - 1)
+    ab = x * multiplier
+    nudge = np.where(ab >= 0, 1 << 30, 1 - (1 << 30))
+    total = ab + nudge
+    high = np.sign(total) * (np.abs(total) >> 31)        # Division truncating toward zero
+    mask = (np.int64(1) << right) - 1
+    remainder = high & mask
+    threshold = (mask >> 1) + (high < 0)
+    return (high >> right) + (remainder > threshold)
+
+
+def pad_amount(in_size, out_size, filter_size, stride, padding):
+    if padding == PADDING_VALID:
+        return 0
+    return max(0, ((out_size - 1) * stride + filter_size - in_size) // 2)
+
+
+def out_size(in_size, filter_size, stride, padding):
+    if padding == PADDING_SAME:
+        return (in_size + stride - 1) // stride
+    return (in_size - filter_size + stride) // stride
+
+
+def conv_acc(x, zero_point, weights, stride, padding, depthwise):
+    """Int32 accumulators of a convolution over an NHWC int8 tensor with batch 1."""
+    _, in_h, in_w, in_c = x.shape
+    if depthwise:
+        _, f_h, f_w, out_c = weights.shape
+    else:
+        out_c, f_h, f_w, _ = weights.shape
+    out_h = out_size(in_h, f_h, stride, padding)
+    out_w = out_size(in_w, f_w, stride, padding)
+    pad_h = pad_amount(in_h, out_h, f_h, stride, padding)
+    pad_w = pad_amount(in_w, out_w, f_w, stride, padding)
+
+    # Padding taps contribute nothing, so pad with the zero point and subtract it everywhere
+    xp = np.full((in_h + 2 * f_h, in_w + 2 * f_w, in_c), zero_point, dtype=np.int64)
+    xp[pad_h:pad_h + in_h, pad_w:pad_w + in_w] = x[0]
+    xp -= zero_point
+    acc = np.zeros((out_h, out_w, out_c), dtype=np.int64)
+    for fy in range(f_h):
+        for fx in range(f_w):
+            patch = xp[fy:fy + stride * out_h:stride, fx:fx + stride * out_w:stride]
+            if depthwise:
+                acc += patch * weights[0, fy, fx].astype(np.int64)
+            else:
+                acc += patch @ weights[:, fy, fx, :].astype(np.int64).T
+    return acc[None]
+
+
+def activation_range(activation, scale, zero_point):
+    lo, hi = -128, 127
+    if activation == ACT_RELU6:
+        lo = zero_point
+        hi = zero_point + int(np.floor(np.float32(6.0) / np.float32(scale) + 0.5))   # lroundf
+    return max(lo, -128), min(hi, 127)
+
+
+class Graph:
+    """Collects tensors, buffers and operators while running the reference on the way."""
+
+    def __init__(self, rng):
+        self.rng = rng
+        self.tensors = []
+        self.buffers = [b""]
+        self.ops = []
+        self.opcodes = []
+
+    def tensor(self, shape, dtype, scale, zero_point, data=None, name=""):
+        buffer = 0
+        if data is not None:
+            self.buffers.append(data.tobytes())
+            buffer = len(self.buffers) - 1
+        scales = list(np.atleast_1d(np.asarray(scale, dtype=np.float32)))
+        zero_points = [zero_point] * len(scales)
+        self.tensors.append(dict(shape=list(shape), type=dtype, buffer=buffer, scale=scales,
+                                 zero_point=zero_points, name=name))
+        return len(self.tensors) - 1
+
+    def op(self, code, inputs, outputs, options_type=0, options=None):
+        if code not in self.opcodes:
+            self.opcodes.append(code)
+        self.ops.append(dict(opcode=self.opcodes.index(code), inputs=inputs, outputs=outputs,
+                             options_type=options_type, options=options or {}))
+
+    def conv(self, x, x_index, scale, zero_point, out_c, f, stride, depthwise, activation, padding=PADDING_SAME):
+        in_c = x.shape[3]
+        if depthwise:
+            weights = self.rng.integers(-127, 128, size=(1, f, f, in_c), dtype=np.int8)
+        else:
+            weights = self.rng.integers(-127, 128, size=(out_c, f, f, in_c), dtype=np.int8)
+        channels = in_c if depthwise else out_c
+        w_scale = self.rng.uniform(0.5, 1.5, size=channels).astype(np.float32) / (127.0 * np.sqrt(f * f * (1 if depthwise else in_c)))
+        bias_real = self.rng.normal(0.0, 0.2, size=channels)
+        bias_scale = scale * w_scale.astype(np.float64)
+        bias = np.round(bias_real / bias_scale).astype(np.int32)
+
+        acc = conv_acc(x, zero_point, weights, stride, padding, depthwise) + bias.astype(np.int64)
+
+        # Calibrate the output range on this input, as post-training quantization would
+        real = acc * bias_scale
+        lo, hi = min(float(real.min()), 0.0), max(float(real.max()), 1e-3)
+        if activation == ACT_RELU6:
+            lo, hi = 0.0, min(hi, 6.0)
+        out_scale = np.float32((hi - lo) / 255.0)
+        out_zp = int(np.clip(round(-128 - lo / float(out_scale)), -128, 127))
+
+        multipliers, shifts = zip(*(quantize_multiplier(float(np.float32(scale)) * float(ws) / float(out_scale)) for ws in w_scale))
+        y = requantize(acc, multipliers, shifts) + out_zp
+        a_min, a_max = activation_range(activation, float(out_scale), out_zp)
+        y = np.clip(y, a_min, a_max).astype(np.int8)
+
+        w_index = self.tensor(weights.shape, TYPE_INT8, w_scale, 0, weights)
+        b_index = self.tensor(bias.shape, TYPE_INT32, bias_scale.astype(np.float32), 0, bias)
+        y_index = self.tensor(y.shape, TYPE_INT8, out_scale, out_zp)
+        if depthwise:
+            self.op(OP_DEPTHWISE_CONV_2D, [x_index, w_index, b_index], [y_index], OPTIONS_DEPTHWISE_CONV_2D,
+                    dict(padding=padding, stride=stride, activation=activation, depth_multiplier=1))
+        else:
+            self.op(OP_CONV_2D, [x_index, w_index, b_index], [y_index], OPTIONS_CONV_2D,
+                    dict(padding=padding, stride=stride, activation=activation))
+        return y, y_index, float(out_scale), out_zp
+
+    def pool(self, x, x_index, scale, zero_point, code):
+        _, h, w, c = x.shape
+        if code == OP_AVERAGE_POOL_2D:
+            s = x.astype(np.int64).sum(axis=(1, 2))
+            count = h * w
+            v = np.where(s > 0, (s + count // 2) // count, -((-s + count // 2) // count))
+        else:
+            v = x.astype(np.int64).max(axis=(1, 2))
+        y = np.clip(v, -128, 127).astype(np.int8).reshape(1, 1, 1, c)
+        y_index = self.tensor(y.shape, TYPE_INT8, scale, zero_point)
+        self.op(code, [x_index], [y_index], OPTIONS_POOL_2D,
+                dict(padding=PADDING_VALID, stride=1, filter_w=w, filter_h=h, activation=ACT_NONE))
+        return y, y_index
+
+    def reshape(self, x, x_index, scale, zero_point, shape):
+        y = x.reshape(shape)
+        shape_index = self.tensor([len(shape)], TYPE_INT32, 0.0, 0, np.array(shape, dtype=np.int32))
+        y_index = self.tensor(shape, TYPE_INT8, scale, zero_point)
+        self.op(OP_RESHAPE, [x_index, shape_index], [y_index], OPTIONS_RESHAPE, {})
+        return y, y_index
+
+    def fully_connected(self, x, x_index, scale, zero_point, units):
+        depth = x.shape[-1]
+        weights = self.rng.integers(-127, 128, size=(units, depth), dtype=np.int8)
+        w_scale = np.float32(1.0 / (127.0 * np.sqrt(depth)))
+        bias_scale = np.float32(scale) * w_scale
+        bias = np.round(self.rng.normal(0.0, 0.2, size=units) / bias_scale).astype(np.int32)
+        acc = (x.astype(np.int64) - zero_point) @ weights.astype(np.int64).T + bias
+        real = acc * float(bias_scale)
+        lo, hi = min(float(real.min()), -1e-3), max(float(real.max()), 1e-3)
+        out_scale = np.float32((hi - lo) / 255.0)
+        out_zp = int(np.clip(round(-128 - lo / float(out_scale)), -128, 127))
+        multiplier, shift = quantize_multiplier(float(np.float32(scale)) * float(w_scale) / float(out_scale))
+        y = np.clip(requantize(acc, [multiplier], [shift]) + out_zp, -128, 127).astype(np.int8)
+
+        w_index = self.tensor(weights.shape, TYPE_INT8, w_scale, 0, weights)
+        b_index = self.tensor(bias.shape, TYPE_INT32, bias_scale, 0, bias)
+        y_index = self.tensor(y.shape, TYPE_INT8, out_scale, out_zp)
+        self.op(OP_FULLY_CONNECTED, [x_index, w_index, b_index], [y_index], OPTIONS_FULLY_CONNECTED,
+                dict(activation=ACT_NONE))
+        return y, y_index, float(out_scale), out_zp
+
+    def softmax(self, x, x_index, scale):
+        # Output quantization fixed by TFLite for int8 softmax: scale 1/256, zero point -128
+        logits = (x.astype(np.float32) - x.max(axis=-1, keepdims=True)) * np.float32(scale)
+        p = np.exp(logits.astype(np.float32))
+        p = p / p.sum(axis=-1, keepdims=True)
+        y = np.clip(np.round(p * 256.0) - 128, -128, 127).astype(np.int8)
+        y_index = self.tensor(y.shape, TYPE_INT8, 1.0 / 256.0, -128)
+        self.op(OP_SOFTMAX, [x_index], [y_index], OPTIONS_SOFTMAX, dict(beta=1.0))
+        return y, y_index
+
+
+# ---- Flatbuffer serialization ----
+
+def int_vector(builder, values, width):
+    prepend = {1: builder.PrependUint8, 4: builder.PrependInt32, 8: builder.PrependInt64}[width]
+    builder.StartVector(width, len(values), width)
+    for v in reversed(values):
+        prepend(v)
+    return builder.EndVector()
+
+
+def float_vector(builder, values):
+    builder.StartVector(4, len(values), 4)
+    for v in reversed(values):
+        builder.PrependFloat32(float(v))
+    return builder.EndVector()
+
+
+def table_vector(builder, offsets):
+    builder.StartVector(4, len(offsets), 4)
+    for o in reversed(offsets):
+        builder.PrependUOffsetTRelative(o)
+    return builder.EndVector()
+
+
+def write_options(builder, options_type, o):
+    if options_type in (OPTIONS_CONV_2D, OPTIONS_DEPTHWISE_CONV_2D):
+        depthwise = options_type == OPTIONS_DEPTHWISE_CONV_2D
+        builder.StartObject(7)
+        builder.PrependInt8Slot(0, o["padding"], 0)
+        builder.PrependInt32Slot(1, o["stride"], 0)
+        builder.PrependInt32Slot(2, o["stride"], 0)
+        if depthwise:
+            builder.PrependInt32Slot(3, o["depth_multiplier"], 0)
+        builder.PrependInt8Slot(4 if depthwise else 3, o["activation"], 0)
+        builder.PrependInt32Slot(5 if depthwise else 4, 1, 1)
+        builder.PrependInt32Slot(6 if depthwise else 5, 1, 1)
+        return builder.EndObject()
+    if options_type == OPTIONS_POOL_2D:
+        builder.StartObject(6)
+        builder.PrependInt8Slot(0, o["padding"], 0)
+        builder.PrependInt32Slot(1, o["stride"], 0)
+        builder.PrependInt32Slot(2, o["stride"], 0)
+        builder.PrependInt32Slot(3, o["filter_w"], 0)
+        builder.PrependInt32Slot(4, o["filter_h"], 0)
+        builder.PrependInt8Slot(5, o["activation"], 0)
+        return builder.EndObject()
+    if options_type == OPTIONS_FULLY_CONNECTED:
+        builder.StartObject(1)
+        builder.PrependInt8Slot(0, o["activation"], 0)
+        return builder.EndObject()
+    if options_type == OPTIONS_SOFTMAX:
+        builder.StartObject(1)
+        builder.PrependFloat32Slot(0, o["beta"], 0.0)
+        return builder.EndObject()
+    builder.StartObject(1)
+    return builder.EndObject()
+
+
+def serialize(graph, input_index, output_index):
+    builder = flatbuffers.Builder(1 << 20)
+
+    buffers = []
+    for data in graph.buffers:
+        data_offset = None
+        if data:
+            builder.StartVector(1, len(data), 16)
+            builder.head = builder.head - len(data)
+            builder.Bytes[builder.head:builder.head + len(data)] = data
+            data_offset = builder.EndVector()
+        builder.StartObject(1)
+        if data_offset is not None:
+            builder.PrependUOffsetTRelativeSlot(0, data_offset, 0)
+        buffers.append(builder.EndObject())
+
+    tensors = []
+    for t in graph.tensors:
+        name = builder.CreateString(t["name"])
+        shape = int_vector(builder, t["shape"], 4)
+        scale = float_vector(builder, t["scale"])
+        zero_point = int_vector(builder, t["zero_point"], 8)
+        builder.StartObject(7)
+        builder.PrependUOffsetTRelativeSlot(2, scale, 0)
+        builder.PrependUOffsetTRelativeSlot(3, zero_point, 0)
+        quantization = builder.EndObject()
+        builder.StartObject(6)
+        builder.PrependUOffsetTRelativeSlot(0, shape, 0)
+        builder.PrependInt8Slot(1, t["type"], 0)
+        builder.PrependUint32Slot(2, t["buffer"], 0)
+        builder.PrependUOffsetTRelativeSlot(3, name, 0)
+        builder.PrependUOffsetTRelativeSlot(4, quantization, 0)
+        tensors.append(builder.EndObject())
+
+    ops = []
+    for op in graph.ops:
+        inputs = int_vector(builder, op["inputs"], 4)
+        outputs = int_vector(builder, op["outputs"], 4)
+        options = write_options(builder, op["options_type"], op["options"])
+        builder.StartObject(5)
+        builder.PrependUint32Slot(0, op["opcode"], 0)
+        builder.PrependUOffsetTRelativeSlot(1, inputs, 0)
+        builder.PrependUOffsetTRelativeSlot(2, outputs, 0)
+        builder.PrependUint8Slot(3, op["options_type"], 0)
+        builder.PrependUOffsetTRelativeSlot(4, options, 0)
+        ops.append(builder.EndObject())
+
+    tensor_vec = table_vector(builder, tensors)
+    input_vec = int_vector(builder, [input_index], 4)
+    output_vec = int_vector(builder, [output_index], 4)
+    op_vec = table_vector(builder, ops)
+    name = builder.CreateString("main")
+    builder.StartObject(5)
+    builder.PrependUOffsetTRelativeSlot(0, tensor_vec, 0)
+    builder.PrependUOffsetTRelativeSlot(1, input_vec, 0)
+    builder.PrependUOffsetTRelativeSlot(2, output_vec, 0)
+    builder.PrependUOffsetTRelativeSlot(3, op_vec, 0)
+    builder.PrependUOffsetTRelativeSlot(4, name, 0)
+    subgraph = builder.EndObject()
+
+    codes = []
+    for code in graph.opcodes:
+        builder.StartObject(4)
+        builder.PrependInt8Slot(0, min(code, 127), 0)
+        builder.PrependInt32Slot(2, 1, 1)
+        builder.PrependInt32Slot(3, code, 0)
+        codes.append(builder.EndObject())
+
+    code_vec = table_vector(builder, codes)
+    subgraph_vec = table_vector(builder, [subgraph])
+    buffer_vec = table_vector(builder, buffers)
+    description = builder.CreateString("tinyml test model")
+    builder.StartObject(5)
+    builder.PrependUint32Slot(0, 3, 0)
+    builder.PrependUOffsetTRelativeSlot(1, code_vec, 0)
+    builder.PrependUOffsetTRelativeSlot(2, subgraph_vec, 0)
+    builder.PrependUOffsetTRelativeSlot(3, description, 0)
+    builder.PrependUOffsetTRelativeSlot(4, buffer_vec, 0)
+    model = builder.EndObject()
+    builder.Finish(model, file_identifier=b"TFL3")
+    return bytes(builder.Output())
+
+
+def build(seed, head, softmax):
+    rng = np.random.default_rng(seed)
+    graph = Graph(rng)
+
+    # Input in [0, 1] with the person_detect quantization: scale 1/255, zero point -128
+    pixels = rng.integers(0, 256, size=(1, 96, 96, 1))
+    scale, zp = 1.0 / 255.0, -128
+    x = (pixels - 128).astype(np.int8)
+    x_index = graph.tensor(x.shape, TYPE_INT8, scale, zp, name="input")
+    input_index, input_data = x_index, x.copy()
+
+    x, x_index, scale, zp = graph.conv(x, x_index, scale, zp, 8, 3, 2, False, ACT_RELU6)
+    for stride, channels in MOBILENET_BLOCKS:
+        x, x_index, scale, zp = graph.conv(x, x_index, scale, zp, None, 3, stride, True, ACT_RELU6)
+        x, x_index, scale, zp = graph.conv(x, x_index, scale, zp, channels, 1, 1, False, ACT_RELU6)
+
+    if head == "conv":
+        x, x_index = graph.pool(x, x_index, scale, zp, OP_AVERAGE_POOL_2D)
+        x, x_index, scale, zp = graph.conv(x, x_index, scale, zp, 2, 1, 1, False, ACT_NONE, PADDING_VALID)
+        x, x_index = graph.reshape(x, x_index, scale, zp, [1, 2])
+    else:
+        x, x_index = graph.pool(x, x_index, scale, zp, OP_MAX_POOL_2D)
+        x, x_index = graph.reshape(x, x_index, scale, zp, [1, x.shape[-1]])
+        x, x_index, scale, zp = graph.fully_connected(x, x_index, scale, zp, 2)
+
+    if softmax:
+        x, x_index = graph.softmax(x, x_index, scale)
+    return serialize(graph, input_index, x_index), input_data, x
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a random-weight int8 MobileNet test model")
+    parser.add_argument("--out", default=".", help="Output directory (default: current)")
+    parser.add_argument("--seed", type=int, default=1, help="Random seed (default: 1)")
+    parser.add_argument("--head", choices=["conv", "fc"], default="conv",
+                        help="conv: average pool and 1x1 conv as in person_detect; fc: max pool and fully connected")
+    parser.add_argument("--no-softmax", action="store_true", help="End at the logits, which must match exactly")
+    args = parser.parse_args()
+
+    model, input_data, expected = build(args.seed, args.head, not args.no_softmax)
+    os.makedirs(args.out, exist_ok=True)
+    paths = {
+        "model.tflite": model,
+        "input.bin": input_data.tobytes(),
+        "expected.bin": expected.tobytes(),
+    }
+    for name, data in paths.items():
+        with open(os.path.join(args.out, name), "wb") as f:
+            f.write(data)
+    print(f"Wrote {len(model)} byte model, input and expected output to {args.out}")
+    print(f"Expected output: {expected.flatten().tolist()}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,645 @@
+// Host benchmark of the Firebase and MQTT uploader backends (main/src/uploader_*.c).
+//
+// Both backends run unmodified against stand-ins served by threads of this
+// process on loopback ports: a Realtime Database that accepts PUTs of image
+// records, and an MQTT 3.1.1 broker in place of mosquitto that acknowledges
+// QoS 1 publishes. Each stand-in delays its answers by the round-trip time -t,
+// so the comparison shows what the protocols cost on a real link: the Firebase
+// backend pays -c extra round trips per frame for the TCP and TLS setup of its
+// fresh connection (the stand-in itself speaks plain HTTP), while the MQTT
+// backend keeps one connection and has both of a frame's publishes in flight
+// before flush() waits for their acknowledgements.
+//
+// Every record and message is checked: the RTDB body and the MQTT meta message
+// must be valid JSON whose metadata string equals the frame's, the image must
+// decode to the frame's bytes and the meta size must match the JPEG message.
+// The default metadata has quotes, a backslash and a newline in it.
+//
+// Build from the repository root:
+//   gcc -O2 -pthread -Itools/host -Imain/include -o uploader_bench tools/uploader_bench.c
+//       main/src/uploader.c main/src/uploader_firebase.c main/src/uploader_mqtt.c main/src/firebase_manager.c
+//       tools/host/http_client_host.c tools/host/mqtt_client_host.c tools/host/cJSON_host.c
+//   ./uploader_bench [-n frames] [-s frame_bytes] [-t rtt_ms] [-c setup_round_trips] [-m metadata] [-r seed]
+//
+// Exits non-zero if a backend fails a frame or a stand-in sees a bad record.
+
+#define _GNU_SOURCE
+#include "uploader.h"
+#include "firebase_manager.h"
+#include "esp_http_client.h"
+#include "esp_timer.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FRAMES 4096
+#define MAX_ACKS 1024
+
+typedef struct {
+    int listen_fd;
+    int port;
+    uint64_t wire_bytes;        // Everything the stand-in read, headers and framing included
+    uint32_t accepted;
+    uint32_t bad;
+} standin_t;
+
+static standin_t rtdb;
+static standin_t broker;
+static int rtt_ms = 20;
+static int setup_round_trips = 3;
+
+static uint8_t *frames[MAX_FRAMES];
+static size_t frame_len;
+static int frame_count;
+static const char *frame_metadata = "{\"sha256\":\"9f86d0\",\"note\":\"lens \\\"A\\\"\\\\1\nsecond line\"}";
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+static int frame_index(const char *key) {
+    int index = -1;
+    if (sscanf(key, "bench_%d", &index) != 1 || index < 0 || index >= frame_count) {
+        return -1;
+    }
+    return index;
+}
+
+static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static char *base64_encode(const uint8_t *data, size_t len, size_t *out_len) {
+    char *out = malloc((len + 2) / 3 * 4 + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < len ? data[i + 1] << 8 : 0) | (i + 2 < len ? data[i + 2] : 0);
+        out[n++] = BASE64_CHARS[(v >> 18) & 0x3F];
+        out[n++] = BASE64_CHARS[(v >> 12) & 0x3F];
+        out[n++] = i + 1 < len ? BASE64_CHARS[(v >> 6) & 0x3F] : '=';
+        out[n++] = i + 2 < len ? BASE64_CHARS[v & 0x3F] : '=';
+    }
+    out[n] = '\0';
+    *out_len = n;
+    return out;
+}
+
+static bool base64_matches(const char *text, size_t text_len, const uint8_t *data, size_t len) {
+    if (text_len != (len + 2) / 3 * 4) {
+        return false;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < text_len; i += 4) {
+        uint32_t v = 0;
+        for (int j = 0; j < 4; j++) {
+            const char *c = strchr(BASE64_CHARS, text[i + j]);
+            v = v << 6 | (text[i + j] != '=' && c != NULL ? (uint32_t)(c - BASE64_CHARS) : 0);
+        }
+        for (int j = 0; j < 3 && n < len; j++, n++) {
+            if (data[n] != (uint8_t)(v >> (16 - 8 * j))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Minimal JSON reader: validates a document and pulls string and number members
+// out of its top-level object. Strings are unescaped into a caller buffer.
+typedef struct {
+    const char *p;
+    const char *end;
+} json_t;
+
+static void json_space(json_t *j) {
+    while (j->p < j->end && (*j->p == ' ' || *j->p == '\t' || *j->p == '\n' || *j->p == '\r')) {
+        j->p++;
+    }
+}
+
+// Parse a string at j->p; out may be NULL to only validate. Returns false on bad syntax.
+static bool json_string(json_t *j, char *out, size_t max_len, size_t *out_len) {
+    size_t n = 0;
+    if (j->p >= j->end || *j->p++ != '"') {
+        return false;
+    }
+    while (j->p < j->end && *j->p != '"') {
+        unsigned char c = (unsigned char)*j->p++;
+        if (c < 0x20) {
+            return false;
+        }
+        if (c == '\\') {
+            if (j->p >= j->end) {
+                return false;
+            }
+            char e = *j->p++;
+            switch (e) {
+            case '"': case '\\': case '/': c = (unsigned char)e; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                unsigned code = 0;
+                if (j->end - j->p < 4 || sscanf(j->p, "%4x", &code) != 1 || code > 0x7F) {
+                    return false;   // The firmware only escapes control characters this way
+                }
+                j->p += 4;
+                c = (unsigned char)code;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (out != NULL && n + 1 < max_len) {
+            out[n] = (char)c;
+        }
+        n++;
+    }
+    if (j->p >= j->end) {
+        return false;
+    }
+    j->p++;
+    if (out != NULL) {
+        out[n < max_len ? n : max_len - 1] = '\0';
+    }
+    if (out_len != NULL) {
+        *out_len = n;
+    }
+    return true;
+}
+
+static bool json_value(json_t *j, int depth) {
+    json_space(j);
+    if (j->p >= j->end || depth > 16) {
+        return false;
+    }
+    if (*j->p == '"') {
+        return json_string(j, NULL, 0, NULL);
+    }
+    if (*j->p == '{' || *j->p == '[') {
+        char close = *j->p == '{' ? '}' : ']';
+        bool object = close == '}';
+        j->p++;
+        json_space(j);
+        if (j->p < j->end && *j->p == close) {
+            j->p++;
+            return true;
+        }
+        while (1) {
+            if (object) {
+                json_space(j);
+                if (!json_string(j, NULL, 0, NULL)) {
+                    return false;
+                }
+                json_space(j);
+                if (j->p >= j->end || *j->p++ != ':') {
+                    return false;
+                }
+            }
+            if (!json_value(j, depth + 1)) {
+                return false;
+            }
+            json_space(j);
+            if (j->p < j->end && *j->p == ',') {
+                j->p++;
+                continue;
+            }
+            return j->p < j->end && *j->p++ == close;
+        }
+    }
+    const char *start = j->p;
+    if (strncmp(j->p, "true", 4) == 0 || strncmp(j->p, "null", 4) == 0) {
+        j->p += 4;
+    } else if (strncmp(j->p, "false", 5) == 0) {
+        j->p += 5;
+    } else {
+        strtod(j->p, (char **)&j->p);
+    }
+    return j->p > start && j->p <= j->end;
+}
+
+static bool json_valid(const char *text, size_t len) {
+    json_t j = {text, text + len};
+    if (!json_value(&j, 0)) {
+        return false;
+    }
+    json_space(&j);
+    return j.p == j.end;
+}
+
+// Find a top-level member of a valid object; leaves j->p at its value
+static bool json_member(const char *text, size_t len, const char *name, json_t *j) {
+    j->p = text;
+    j->end = text + len;
+    json_space(j);
+    if (j->p >= j->end || *j->p++ != '{') {
+        return false;
+    }
+    while (1) {
+        char key[64];
+        json_space(j);
+        if (!json_string(j, key, sizeof(key), NULL)) {
+            return false;
+        }
+        json_space(j);
+        j->p++;
+        json_space(j);
+        if (strcmp(key, name) == 0) {
+            return true;
+        }
+        if (!json_value(j, 1)) {
+            return false;
+        }
+        json_space(j);
+        if (j->p >= j->end || *j->p++ != ',') {
+            return false;
+        }
+    }
+}
+
+// Check a record's metadata member against the frame's
+static bool metadata_matches(const char *text, size_t len) {
+    json_t j;
+    char value[512];
+    return json_member(text, len, "metadata", &j) && json_string(&j, value, sizeof(value), NULL) &&
+           strcmp(value, frame_metadata) == 0;
+}
+
+static bool recv_all(int fd, void *data, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t n = recv(fd, (char *)data + got, len - got, 0);
+        if (n <= 0) {
+            return false;
+        }
+        got += (size_t)n;
+    }
+    return true;
+}
+
+static bool standin_listen(standin_t *standin) {
+    standin->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    if (standin->listen_fd < 0 || bind(standin->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(standin->listen_fd, 16) != 0 ||
+        getsockname(standin->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("stand-in");
+        return false;
+    }
+    standin->port = ntohs(addr.sin_port);
+    return true;
+}
+
+// Realtime Database stand-in: one PUT per connection, as firebase_manager.c sends them
+static void rtdb_handle(int fd) {
+    char head[4096];
+    size_t len = 0;
+    char *end = NULL;
+    while (end == NULL && len < sizeof(head) - 1) {
+        ssize_t n = recv(fd, head + len, sizeof(head) - 1 - len, 0);
+        if (n <= 0) {
+            return;
+        }
+        len += (size_t)n;
+        head[len] = '\0';
+        end = strstr(head, "\r\n\r\n");
+    }
+    if (end == NULL) {
+        return;
+    }
+    size_t head_len = (size_t)(end + 4 - head);
+    const char *cl = strcasestr(head, "\r\nContent-Length:");
+    size_t body_len = cl ? strtoull(cl + 17, NULL, 10) : 0;
+    char *body = malloc(body_len + 1);
+    size_t extra = len - head_len;
+    memcpy(body, head + head_len, extra < body_len ? extra : body_len);
+    bool ok = recv_all(fd, body + extra, body_len - extra);
+    body[body_len] = '\0';
+    rtdb.wire_bytes += head_len + body_len;
+
+    char key[64] = "";
+    const char *path = strstr(head, " /images/");
+    if (path != NULL) {
+        snprintf(key, sizeof(key), "%.*s", (int)strcspn(path + 9, ".?"), path + 9);
+    }
+    int index = frame_index(key);
+    json_t j;
+    ok = ok && index >= 0 && strncmp(head, "PUT ", 4) == 0 && json_valid(body, body_len) &&
+         metadata_matches(body, body_len) && json_member(body, body_len, "image", &j);
+    if (ok) {
+        const char *start = j.p + 1;
+        ok = json_string(&j, NULL, 0, NULL) && base64_matches(start, (size_t)(j.p - 1 - start), frames[index], frame_len);
+    }
+    if (ok) {
+        rtdb.accepted++;
+    } else {
+        rtdb.bad++;
+        fprintf(stderr, "rtdb: bad record for %s\n", key[0] ? key : "(no key)");
+    }
+    free(body);
+
+    sleep_ms(rtt_ms * (1 + setup_round_trips));
+    const char *response = ok ? "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\n{}"
+                              : "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    send(fd, response, strlen(response), MSG_NOSIGNAL);
+}
+
+static void *rtdb_thread(void *arg) {
+    for (;;) {
+        int fd = accept(rtdb.listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            rtdb_handle(fd);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+// Broker stand-in: the reader queues each PUBACK and the acker sends it one RTT later
+static struct {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    uint16_t ids[MAX_ACKS];
+    int64_t due_us[MAX_ACKS];
+    int head;
+    int tail;
+    size_t meta_size;           // Size announced by the last meta message
+    int meta_index;
+} mqtt;
+
+static void *acker_thread(void *arg) {
+    pthread_mutex_lock(&mqtt.lock);
+    for (;;) {
+        while (mqtt.head == mqtt.tail) {
+            pthread_cond_wait(&mqtt.queued, &mqtt.lock);
+        }
+        int slot = mqtt.head % MAX_ACKS;
+        int64_t wait_us = mqtt.due_us[slot] - esp_timer_get_time();
+        uint8_t ack[4] = {0x40, 2, (uint8_t)(mqtt.ids[slot] >> 8), (uint8_t)mqtt.ids[slot]};
+        pthread_mutex_unlock(&mqtt.lock);
+        if (wait_us > 0) {
+            struct timespec ts = {.tv_sec = wait_us / 1000000, .tv_nsec = (long)(wait_us % 1000000) * 1000};
+            nanosleep(&ts, NULL);
+        }
+        send(mqtt.fd, ack, sizeof(ack), MSG_NOSIGNAL);
+        pthread_mutex_lock(&mqtt.lock);
+        mqtt.head++;
+    }
+    return NULL;
+}
+
+static void broker_publish(const char *topic, const uint8_t *payload, size_t len) {
+    char key[64] = "";
+    const char *slash = strrchr(topic, '/');
+    if (slash != NULL && slash > topic) {
+        const char *key_start = slash - 1;
+        while (key_start > topic && key_start[-1] != '/') {
+            key_start--;
+        }
+        snprintf(key, sizeof(key), "%.*s", (int)(slash - key_start), key_start);
+    }
+    int index = frame_index(key);
+    bool ok = index >= 0;
+
+    if (ok && strcmp(slash, "/meta") == 0) {
+        json_t j;
+        double size = -1;
+        ok = json_valid((const char *)payload, len) && metadata_matches((const char *)payload, len) &&
+             json_member((const char *)payload, len, "size", &j);
+        if (ok) {
+            size = strtod(j.p, NULL);
+        }
+        mqtt.meta_size = size >= 0 ? (size_t)size : 0;
+        mqtt.meta_index = ok ? index : -1;
+    } else if (ok && strcmp(slash, "/jpeg") == 0) {
+        ok = mqtt.meta_index == index && mqtt.meta_size == len && len == frame_len &&
+             memcmp(payload, frames[index], len) == 0;
+        mqtt.meta_index = -1;
+        if (ok) {
+            broker.accepted++;
+        }
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        broker.bad++;
+        fprintf(stderr, "broker: bad message on %s\n", topic);
+    }
+}
+
+static void *broker_thread(void *arg) {
+    mqtt.fd = accept(broker.listen_fd, NULL, NULL);
+    if (mqtt.fd < 0) {
+        return NULL;
+    }
+    pthread_t acker;
+    pthread_create(&acker, NULL, acker_thread, NULL);
+
+    uint8_t *packet = NULL;
+    size_t packet_cap = 0;
+    for (;;) {
+        uint8_t type, digit;
+        size_t remaining = 0;
+        int shift = 0;
+        if (!recv_all(mqtt.fd, &type, 1)) {
+            break;
+        }
+        do {
+            if (!recv_all(mqtt.fd, &digit, 1)) {
+                goto closed;
+            }
+            remaining |= (size_t)(digit & 0x7F) << shift;
+            shift += 7;
+        } while ((digit & 0x80) && shift < 28);
+        if (remaining + 1 > packet_cap) {
+            packet_cap = remaining + 1;
+            packet = realloc(packet, packet_cap);
+        }
+        if (!recv_all(mqtt.fd, packet, remaining)) {
+            break;
+        }
+        broker.wire_bytes += 1 + (size_t)shift / 7 + remaining;
+
+        switch (type & 0xF0) {
+        case 0x10: {    // CONNECT
+            uint8_t connack[4] = {0x20, 2, 0, 0};
+            send(mqtt.fd, connack, sizeof(connack), MSG_NOSIGNAL);
+            break;
+        }
+        case 0x30: {    // PUBLISH
+            int qos = (type >> 1) & 0x03;
+            size_t topic_len = (size_t)(packet[0] << 8 | packet[1]);
+            char topic[256];
+            snprintf(topic, sizeof(topic), "%.*s", (int)topic_len, (const char *)packet + 2);
+            size_t offset = 2 + topic_len;
+            uint16_t id = 0;
+            if (qos > 0) {
+                id = (uint16_t)(packet[offset] << 8 | packet[offset + 1]);
+                offset += 2;
+            }
+            broker_publish(topic, packet + offset, remaining - offset);
+            if (qos > 0) {
+                pthread_mutex_lock(&mqtt.lock);
+                if (mqtt.tail - mqtt.head < MAX_ACKS) {
+                    mqtt.ids[mqtt.tail % MAX_ACKS] = id;
+                    mqtt.due_us[mqtt.tail % MAX_ACKS] = esp_timer_get_time() + (int64_t)rtt_ms * 1000;
+                    mqtt.tail++;
+                    pthread_cond_signal(&mqtt.queued);
+                }
+                pthread_mutex_unlock(&mqtt.lock);
+            }
+            break;
+        }
+        case 0xC0: {    // PINGREQ
+            uint8_t pingresp[2] = {0xD0, 0};
+            send(mqtt.fd, pingresp, sizeof(pingresp), MSG_NOSIGNAL);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+closed:
+    free(packet);
+    return NULL;
+}
+
+typedef struct {
+    double seconds;
+    uploader_stats_t stats;
+    int failed;
+} run_t;
+
+static run_t run_backend(const uploader_backend_t *backend, const void *config) {
+    run_t run = {0};
+    if (backend->init(config) != ESP_OK) {
+        run.failed = frame_count;
+        return run;
+    }
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < frame_count; i++) {
+        char timestamp[32];
+        snprintf(timestamp, sizeof(timestamp), "bench_%05d", i);
+        uploader_frame_t frame = {
+            .jpeg = frames[i],
+            .jpeg_len = frame_len,
+            .timestamp = timestamp,
+            .metadata = frame_metadata,
+        };
+        char *base64 = NULL;
+        if (backend->encoding == UPLOADER_ENCODING_BASE64) {
+            base64 = base64_encode(frames[i], frame_len, &frame.base64_len);
+            frame.base64 = base64;
+        }
+        if (backend->submit(&frame) != ESP_OK) {
+            run.failed++;
+        }
+        free(base64);
+    }
+    if (backend->flush(10000) != ESP_OK) {
+        fprintf(stderr, "%s: flush timed out\n", backend->name);
+        run.failed++;
+    }
+    run.seconds = (double)(esp_timer_get_time() - start) / 1e6;
+    backend->get_stats(&run.stats);
+    return run;
+}
+
+static void report(const char *name, const run_t *run, const standin_t *standin) {
+    uint32_t ok = run->stats.frames_submitted - run->stats.frames_failed;
+    printf("%-8s %6.1f frames/s  latency avg %5.1f ms max %5u ms  %8.0f wire bytes/frame (%.2fx)  %u ok, %u bad\n",
+           name, run->seconds > 0 ? frame_count / run->seconds : 0.0,
+           ok ? (double)run->stats.total_latency_ms / ok : 0.0, (unsigned)run->stats.max_latency_ms,
+           frame_count ? (double)standin->wire_bytes / frame_count : 0.0,
+           frame_count ? (double)standin->wire_bytes / frame_count / (double)frame_len : 0.0,
+           (unsigned)standin->accepted, (unsigned)standin->bad);
+}
+
+int main(int argc, char **argv) {
+    frame_count = 200;
+    frame_len = 40 * 1024;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:t:c:m:r:")) != -1) {
+        switch (opt) {
+        case 'n': frame_count = atoi(optarg); break;
+        case 's': frame_len = strtoul(optarg, NULL, 10); break;
+        case 't': rtt_ms = atoi(optarg); break;
+        case 'c': setup_round_trips = atoi(optarg); break;
+        case 'm': frame_metadata = optarg; break;
+        case 'r': rng = strtoull(optarg, NULL, 10) | 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-s frame_bytes] [-t rtt_ms] [-c setup_round_trips] "
+                    "[-m metadata] [-r seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (frame_count < 1 || frame_count > MAX_FRAMES || frame_len == 0 || rtt_ms < 0 || setup_round_trips < 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    for (int i = 0; i < frame_count; i++) {
+        frames[i] = malloc(frame_len);
+        for (size_t j = 0; j < frame_len; j++) {
+            frames[i][j] = (uint8_t)next_random();
+        }
+        frames[i][0] = 0xFF;
+        frames[i][1] = 0xD8;
+    }
+
+    pthread_mutex_init(&mqtt.lock, NULL);
+    pthread_cond_init(&mqtt.queued, NULL);
+    mqtt.meta_index = -1;
+    pthread_t thread;
+    if (!standin_listen(&rtdb) || !standin_listen(&broker) ||
+        pthread_create(&thread, NULL, rtdb_thread, NULL) != 0 ||
+        pthread_create(&thread, NULL, broker_thread, NULL) != 0) {
+        return 1;
+    }
+
+    char route[64];
+    snprintf(route, sizeof(route), "http://127.0.0.1:%d", rtdb.port);
+    esp_http_client_host_route("https://bench-rtdb.firebaseio.com", route);
+    firebase_config_t firebase = {
+        .project_id = "bench",
+        .database_url = "https://bench-rtdb.firebaseio.com",
+        .api_key = "bench-key",
+    };
+    uploader_mqtt_config_t mqtt_config = {.client_id = "bench-camera", .topic_prefix = "cameras"};
+    snprintf(mqtt_config.broker_uri, sizeof(mqtt_config.broker_uri), "mqtt://127.0.0.1:%d", broker.port);
+
+    printf("%d frames x %zu bytes, rtt %d ms, %d setup round trips per HTTP request\n", frame_count, frame_len, rtt_ms,
+           setup_round_trips);
+    run_t fb = run_backend(&uploader_firebase_backend, &firebase);
+    run_t mq = run_backend(&uploader_mqtt_backend, &mqtt_config);
+    report("firebase", &fb, &rtdb);
+    report("mqtt", &mq, &broker);
+
+    bool ok = fb.failed == 0 && mq.failed == 0 && rtdb.bad == 0 && broker.bad == 0 &&
+              rtdb.accepted == (uint32_t)frame_count && broker.accepted == (uint32_t)frame_count;
+    if (!ok) {
+        fprintf(stderr, "FAIL: firebase %d failed, mqtt %d failed, %u/%u bad records\n", fb.failed, mq.failed,
+                (unsigned)rtdb.bad, (unsigned)broker.bad);
+    }
+    return ok ? 0 : 1;
+}